@@ -0,0 +1,227 @@
+/*--------------------------------------------------------------------*/
+/* arena.c                                                            */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#include "arena.h"
+#include "ish.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The size of the first chunk of an arena. */
+enum {INITIAL_CHUNK_SIZE = 16384};
+
+/* A union of the types with the strictest alignment requirements. */
+union Align
+{
+   long double ldValue;
+   long long llValue;
+   void *pvValue;
+   void (*pfValue)(void);
+};
+
+/* The alignment of every object returned by Arena_alloc(). */
+enum {ALIGNMENT = sizeof(union Align)};
+
+/*--------------------------------------------------------------------*/
+
+/* A Chunk is one block of memory obtained from malloc().  Its bytes
+   follow the header. */
+
+struct Chunk
+{
+   /* The chunk that was filled before this one, or NULL. */
+   struct Chunk *psPrev;
+
+   /* The number of bytes in the chunk, not counting the header. */
+   size_t uSize;
+
+   /* Forces the bytes that follow to be suitably aligned. */
+   union Align aAlign[];
+};
+
+/*--------------------------------------------------------------------*/
+
+/* An Arena hands out memory from its current chunk.  When that chunk
+   is full it starts a larger one, remembering the full chunks until
+   the next reset. */
+
+struct Arena
+{
+   /* The chunk from which memory is being allocated. */
+   struct Chunk *psChunk;
+
+   /* The next free byte and the end of the current chunk. */
+   char *pcNext;
+   char *pcLimit;
+
+   /* The total size of all chunks in the arena. */
+   size_t uTotalSize;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Return a new chunk that holds uSize bytes and follows psPrev. */
+
+static struct Chunk *Arena_newChunk(struct Chunk *psPrev, size_t uSize)
+{
+   struct Chunk *psChunk;
+
+   psChunk = (struct Chunk*)malloc(sizeof(struct Chunk) + uSize);
+   if (psChunk == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE);}
+
+   psChunk->psPrev = psPrev;
+   psChunk->uSize = uSize;
+   return psChunk;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make psChunk the current chunk of psArena. */
+
+static void Arena_useChunk(struct Arena *psArena, struct Chunk *psChunk)
+{
+   psArena->psChunk = psChunk;
+   psArena->pcNext = (char*)psChunk->aAlign;
+   psArena->pcLimit = psArena->pcNext + psChunk->uSize;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty arena.  The caller owns the arena. */
+
+Arena_T Arena_new(void)
+{
+   return Arena_newSized(INITIAL_CHUNK_SIZE);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty arena whose first chunk holds uSize
+   bytes.  The caller owns the arena. */
+
+Arena_T Arena_newSized(size_t uSize)
+{
+   struct Arena *psArena;
+
+   assert(uSize > 0);
+
+   psArena = (struct Arena*)malloc(sizeof(struct Arena));
+   if (psArena == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE);}
+
+   uSize = (uSize + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+   Arena_useChunk(psArena, Arena_newChunk(NULL, uSize));
+   psArena->uTotalSize = uSize;
+   return psArena;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return a pointer to uSize bytes of memory from oArena, suitably
+   aligned for any object.  oArena owns the memory, which remains
+   valid until the next call of Arena_reset() or Arena_free(). */
+
+void *Arena_alloc(Arena_T oArena, size_t uSize)
+{
+   void *pvObject;
+   size_t uChunkSize;
+
+   assert(oArena != NULL);
+
+   /* Round the request up so the next object stays aligned. */
+   uSize = (uSize + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+
+   if (uSize > (size_t)(oArena->pcLimit - oArena->pcNext))
+   {
+      /* Start a chunk at least as large as the whole arena so far,
+         so that the number of chunks grows logarithmically. */
+      uChunkSize = oArena->uTotalSize;
+      if (uChunkSize < uSize)
+         uChunkSize = uSize;
+      Arena_useChunk(oArena,
+                     Arena_newChunk(oArena->psChunk, uChunkSize));
+      oArena->uTotalSize += uChunkSize;
+   }
+
+   pvObject = oArena->pcNext;
+   oArena->pcNext += uSize;
+   return pvObject;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return a copy, allocated from oArena, of the uLength characters at
+   pcSource followed by a null character.  oArena owns the copy. */
+
+char *Arena_strndup(Arena_T oArena, const char *pcSource,
+                    size_t uLength)
+{
+   char *pcCopy;
+
+   assert(oArena != NULL);
+   assert(pcSource != NULL);
+
+   pcCopy = (char*)Arena_alloc(oArena, uLength + 1);
+   memcpy(pcCopy, pcSource, uLength);
+   pcCopy[uLength] = '\0';
+   return pcCopy;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Free every chunk of psArena. */
+
+static void Arena_freeChunks(struct Arena *psArena)
+{
+   struct Chunk *psChunk;
+   struct Chunk *psPrev;
+
+   for (psChunk = psArena->psChunk; psChunk != NULL; psChunk = psPrev)
+   {
+      psPrev = psChunk->psPrev;
+      free(psChunk);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Release every object allocated from oArena.  The memory is kept
+   for reuse, so that resetting an arena that has not grown since the
+   last reset takes constant time. */
+
+void Arena_reset(Arena_T oArena)
+{
+   assert(oArena != NULL);
+
+   /* If the last use overflowed into more chunks, replace them all
+      with one chunk big enough for it, so that later uses of the
+      same size fit in a single chunk. */
+   if (oArena->psChunk->psPrev != NULL)
+   {
+      Arena_freeChunks(oArena);
+      Arena_useChunk(oArena,
+                     Arena_newChunk(NULL, oArena->uTotalSize));
+      return;
+   }
+
+   oArena->pcNext = (char*)oArena->psChunk->aAlign;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Free oArena and all of the memory that it holds. */
+
+void Arena_free(Arena_T oArena)
+{
+   assert(oArena != NULL);
+
+   Arena_freeChunks(oArena);
+   free(oArena);
+}
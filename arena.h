@@ -0,0 +1,65 @@
+/*--------------------------------------------------------------------*/
+/* arena.h                                                            */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef ARENA_INCLUDED
+#define ARENA_INCLUDED
+
+#include <stddef.h>
+
+/*--------------------------------------------------------------------*/
+
+/* An Arena_T object is a region of memory from which objects are
+   allocated by bumping a pointer.  Objects are never freed one at a
+   time; resetting the arena releases all of them at once. */
+
+typedef struct Arena *Arena_T;
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty arena.  The caller owns the arena. */
+
+Arena_T Arena_new(void);
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty arena whose first chunk holds uSize
+   bytes, for a small set of objects that live and die together.
+   The caller owns the arena. */
+
+Arena_T Arena_newSized(size_t uSize);
+
+/*--------------------------------------------------------------------*/
+
+/* Return a pointer to uSize bytes of memory from oArena, suitably
+   aligned for any object.  oArena owns the memory, which remains
+   valid until the next call of Arena_reset() or Arena_free(). */
+
+void *Arena_alloc(Arena_T oArena, size_t uSize);
+
+/*--------------------------------------------------------------------*/
+
+/* Return a copy, allocated from oArena, of the uLength characters at
+   pcSource followed by a null character.  oArena owns the copy. */
+
+char *Arena_strndup(Arena_T oArena, const char *pcSource,
+                    size_t uLength);
+
+/*--------------------------------------------------------------------*/
+
+/* Release every object allocated from oArena.  The memory is kept
+   for reuse, so that resetting an arena that has not grown since the
+   last reset takes constant time. */
+
+void Arena_reset(Arena_T oArena);
+
+/*--------------------------------------------------------------------*/
+
+/* Free oArena and all of the memory that it holds. */
+
+void Arena_free(Arena_T oArena);
+
+/*--------------------------------------------------------------------*/
+
+#endif
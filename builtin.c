@@ -0,0 +1,1729 @@
+/*--------------------------------------------------------------------*/
+/* builtin.c                                                          */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#include "builtin.h"
+#include "command.h"
+#include "pipeline.h"
+#include "pathcache.h"
+#include "jobs.h"
+#include "usage.h"
+#include "spawner.h"
+#include "vartable.h"
+#include "history.h"
+#include "ish.h"
+#include <stdio.h>
+#include <stdio_ext.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+
+/*--------------------------------------------------------------------*/
+
+/* Denotes that the setenv command exports the variable it sets */
+enum {EXPORT_ON = 1};
+
+/*--------------------------------------------------------------------*/
+
+/* Write the error message pcMessage for the builtin command being
+   run to stderr, and return EXIT_FAILURE. */
+
+static int builtinError(const char *pcMessage)
+{
+   fprintf(stderr, "%s: %s\n", getPgmName(), pcMessage);
+   return EXIT_FAILURE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "exit" command */
+
+static int builtinExit(Command_T oCommand, struct ShellState *psState)
+{
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   /* Error if the exit function has arguments */
+   if (Command_getArgCount(oCommand) != 0)
+      return builtinError("too many arguments");
+   exit(0);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "setenv var [value]" command */
+
+static int builtinSetenv(Command_T oCommand, struct ShellState *psState)
+{
+   int iRet;
+
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   switch (Command_getArgCount(oCommand)) {
+      case 0:
+         /* Error to have 0 command line arguments */
+         return builtinError("missing variable");
+      case 1:
+         /* Value omitted, argument is the var */
+         iRet = VarTable_set(psState->oVars, Command_getArg(oCommand, 0),
+                             "", EXPORT_ON);
+         break;
+      case 2:
+         /* Var and value must have been specified */
+         iRet = VarTable_set(psState->oVars, Command_getArg(oCommand, 0),
+                             Command_getArg(oCommand, 1), EXPORT_ON);
+         break;
+      default:
+         /* Over two command line arguments is an error */
+         return builtinError("too many arguments");
+   }
+   if (iRet == -1) {perror(getPgmName()); exit(EXIT_FAILURE); }
+
+   /* A new PATH makes the cached command locations stale */
+   if (strcmp(Command_getArg(oCommand, 0), "PATH") == 0)
+      PathCache_clear(psState->oPaths);
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "unsetenv var" command */
+
+static int builtinUnsetenv(Command_T oCommand,
+                           struct ShellState *psState)
+{
+   int iRet;
+
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   switch (Command_getArgCount(oCommand)) {
+      case 0:
+         /* Error to have 0 command line arguments */
+         return builtinError("missing variable");
+      case 1:
+         /* Var has been specified, remove it */
+         iRet = VarTable_unset(psState->oVars,
+                               Command_getArg(oCommand, 0));
+         if (iRet == -1) {perror(getPgmName()); exit(EXIT_FAILURE); }
+         if (strcmp(Command_getArg(oCommand, 0), "PATH") == 0)
+            PathCache_clear(psState->oPaths);
+         return 0;
+      default:
+         /* Over one command line arguments is an error */
+         return builtinError("too many arguments");
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "cd [dir]" command */
+
+static int builtinCd(Command_T oCommand, struct ShellState *psState)
+{
+   /* String for a path variable for the cd command */
+   const char *pcPath;
+   int iRet;
+
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   switch (Command_getArgCount(oCommand)) {
+      case 0:
+         /* Stores value of HOME into pcPath */
+         pcPath = VarTable_get(psState->oVars, "HOME");
+         /* Error to have 0 command line arguments if HOME is not
+            set */
+         if (pcPath == NULL)
+            return builtinError("HOME is not set");
+         break;
+      case 1:
+         pcPath = Command_getArg(oCommand, 0);
+         break;
+      default:
+         /* Over one command line arguments is an error */
+         return builtinError("too many arguments");
+   }
+
+   /* Calls chdir to change directory */
+   iRet = chdir(pcPath);
+   if (iRet == -1) {perror(getPgmName()); exit(EXIT_FAILURE); }
+
+   /* Relative PATH directories now name other places */
+   PathCache_changeDir(psState->oPaths);
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "hash [-r | name...]" command */
+
+static int builtinHash(Command_T oCommand, struct ShellState *psState)
+{
+   size_t uLength;
+   size_t u;
+   int iStatus = 0;
+
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   uLength = Command_getArgCount(oCommand);
+
+   /* List the cached command locations and their hits */
+   if (uLength == 0)
+   {
+      PathCache_write(psState->oPaths, stdout);
+      return 0;
+   }
+
+   if (strcmp(Command_getArg(oCommand, 0), "-r") == 0)
+   {
+      if (uLength != 1)
+         return builtinError("too many arguments");
+      PathCache_clear(psState->oPaths);
+      return 0;
+   }
+
+   /* Look up and remember each name */
+   for (u = 0; u < uLength; u++)
+   {
+      if (PathCache_lookup(psState->oPaths,
+                           Command_getArg(oCommand, u)) == NULL)
+      {
+         fprintf(stderr, "%s: %s: not found\n", getPgmName(),
+                 Command_getArg(oCommand, u));
+         iStatus = EXIT_FAILURE;
+      }
+   }
+   return iStatus;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "stats" command */
+
+static int builtinStats(Command_T oCommand, struct ShellState *psState)
+{
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   if (Command_getArgCount(oCommand) != 0)
+      return builtinError("too many arguments");
+
+   ParseCache_write(psState->oParses, stdout);
+   UsageStats_write(psState->oUsage, stdout);
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write the entry number uNumber of a history, which is the uLength
+   characters at pcLine, to stdout as the history command lists it. */
+
+static void builtinWriteEntry(const char *pcLine, size_t uLength,
+                              size_t uNumber, void *pvExtra)
+{
+   (void)pvExtra;
+   printf("%5lu  %.*s\n", (unsigned long)uNumber, (int)uLength, pcLine);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "history [n | -p prefix | -s text]" command.
+   Lists every entry of the history, or the last n, or the newest of
+   each distinct entry that begins with prefix, or every entry that
+   contains text. */
+
+static int builtinHistory(Command_T oCommand, struct ShellState *psState)
+{
+   const char *pcArg;
+   unsigned long ulValue;
+   char *pcEnd;
+   size_t uCount;
+
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   if (psState->oHistory == NULL)
+      return builtinError("no history file");
+
+   switch (Command_getArgCount(oCommand)) {
+      case 0:
+         History_map(psState->oHistory, 1, builtinWriteEntry, NULL);
+         return 0;
+      case 1:
+         pcArg = Command_getArg(oCommand, 0);
+         ulValue = strtoul(pcArg, &pcEnd, 10);
+         if (! isdigit((unsigned char)*pcArg) || *pcEnd != '\0')
+         {
+            fprintf(stderr, "%s: %s: numeric argument required\n",
+                    getPgmName(), pcArg);
+            return EXIT_FAILURE;
+         }
+         uCount = History_getCount(psState->oHistory);
+         if (ulValue == 0)
+            return 0;
+         History_map(psState->oHistory,
+                     (ulValue >= uCount) ? 1 : uCount - ulValue + 1,
+                     builtinWriteEntry, NULL);
+         return 0;
+      case 2:
+         pcArg = Command_getArg(oCommand, 0);
+         if (strcmp(pcArg, "-p") == 0)
+            (void)History_mapPrefix(psState->oHistory,
+                                    Command_getArg(oCommand, 1),
+                                    builtinWriteEntry, NULL);
+         else if (strcmp(pcArg, "-s") == 0)
+            (void)History_mapContaining(psState->oHistory,
+                                        Command_getArg(oCommand, 1),
+                                        builtinWriteEntry, NULL);
+         else
+         {
+            fprintf(stderr, "%s: %s: invalid option\n", getPgmName(),
+                    pcArg);
+            return EXIT_FAILURE;
+         }
+         return 0;
+      default:
+         return builtinError("too many arguments");
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of the job of psState that pcArg names, either
+   "%n" for job n or the process ID of one of its processes.  If there
+   is no such job, write an error message and return 0. */
+
+static int builtinFindJob(const char *pcArg, struct ShellState *psState)
+{
+   const char *pcNumber;
+   pid_t iPgid;
+   char *pcEnd;
+   long lValue;
+   int iJob = 0;
+
+   assert(pcArg != NULL);
+   assert(psState != NULL);
+
+   pcNumber = (*pcArg == '%') ? pcArg + 1 : pcArg;
+   lValue = strtol(pcNumber, &pcEnd, 10);
+   if (*pcNumber != '\0' && *pcEnd == '\0' && lValue > 0
+       && lValue <= INT_MAX)
+   {
+      if (pcNumber != pcArg)
+         iJob = (int)lValue;
+      else
+         iJob = JobTable_findPid(psState->oJobs, (pid_t)lValue);
+   }
+
+   if (iJob == 0
+       || JobTable_getText(psState->oJobs, iJob, &iPgid) == NULL)
+   {
+      fprintf(stderr, "%s: %s: no such job\n", getPgmName(), pcArg);
+      return 0;
+   }
+   return iJob;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "jobs" command */
+
+static int builtinJobs(Command_T oCommand, struct ShellState *psState)
+{
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   if (Command_getArgCount(oCommand) != 0)
+      return builtinError("too many arguments");
+
+   /* Report the jobs that have finished before those that have not */
+   JobTable_reap(psState->oJobs, stdout);
+   JobTable_write(psState->oJobs, stdout);
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "wait [%n | pid]..." command.  Without
+   arguments, waits for every job.  A signal stops the wait. */
+
+static int builtinWait(Command_T oCommand, struct ShellState *psState)
+{
+   size_t uLength;
+   size_t u;
+   int iJob;
+   int iStatus = 0;
+
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   uLength = Command_getArgCount(oCommand);
+   if (uLength == 0)
+   {
+      while ((iJob = JobTable_getLatest(psState->oJobs)) != 0)
+         if (JobTable_wait(psState->oJobs, iJob, NULL, NULL, 1) == -1)
+            return EXIT_FAILURE;
+      return 0;
+   }
+
+   for (u = 0; u < uLength; u++)
+   {
+      iJob = builtinFindJob(Command_getArg(oCommand, u), psState);
+      if (iJob == 0)
+         iStatus = EXIT_FAILURE;
+      else if (JobTable_wait(psState->oJobs, iJob, NULL, NULL, 1)
+               == -1)
+         return EXIT_FAILURE;
+   }
+   return iStatus;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "fg [%n | pid]" command.  If stdin is a
+   terminal, the job is given the terminal until it finishes. */
+
+static int builtinFg(Command_T oCommand, struct ShellState *psState)
+{
+   const char *pcText;
+   pid_t iPgid;
+   sigset_t sSet;
+   int iJob;
+   int iTerminal;
+
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   switch (Command_getArgCount(oCommand)) {
+      case 0:
+         iJob = JobTable_getLatest(psState->oJobs);
+         if (iJob == 0)
+            return builtinError("no current job");
+         break;
+      case 1:
+         iJob = builtinFindJob(Command_getArg(oCommand, 0), psState);
+         if (iJob == 0)
+            return EXIT_FAILURE;
+         break;
+      default:
+         return builtinError("too many arguments");
+   }
+
+   pcText = JobTable_getText(psState->oJobs, iJob, &iPgid);
+   printf("%s\n", pcText);
+   if (fflush(stdout) == EOF) {perror(getPgmName()); exit(EXIT_FAILURE); }
+
+   /* Hand the terminal to the job's group, and wake the job in case
+      it stopped when it tried to use the terminal */
+   iTerminal = iPgid > 0 && isatty(STDIN_FILENO);
+   if (iTerminal && tcsetpgrp(STDIN_FILENO, iPgid) == -1)
+   {
+      perror(getPgmName());
+      iTerminal = 0;
+   }
+   if (iPgid > 0 && kill(-iPgid, SIGCONT) == -1 && errno != ESRCH)
+      perror(getPgmName());
+
+   (void)JobTable_wait(psState->oJobs, iJob, NULL, NULL, 0);
+
+   /* Take the terminal back.  The shell is not in the terminal's
+      group until then, so SIGTTOU must not stop it. */
+   if (iTerminal)
+   {
+      if (sigemptyset(&sSet) == -1 || sigaddset(&sSet, SIGTTOU) == -1
+          || sigprocmask(SIG_BLOCK, &sSet, NULL) == -1)
+      {perror(getPgmName()); exit(EXIT_FAILURE); }
+      if (tcsetpgrp(STDIN_FILENO, getpgrp()) == -1)
+         perror(getPgmName());
+      if (sigprocmask(SIG_UNBLOCK, &sSet, NULL) == -1)
+      {perror(getPgmName()); exit(EXIT_FAILURE); }
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *pcOut the character that the backslash escape whose
+   text after the backslash starts at pc denotes, and return the
+   number of characters of that text, or 0 if it is not an escape.
+   If iZeroOctal, an octal escape is 0 and up to three more octal
+   digits, as for echo and printf's %b; otherwise it is one to three
+   octal digits, as in a printf format.  "\xHH" has one or two hex
+   digits. */
+
+static size_t builtinEscape(const char *pc, int iZeroOctal,
+                            char *pcOut)
+{
+   enum {MAX_OCTAL_DIGITS = 3, MAX_HEX_DIGITS = 2};
+   static const char acFrom[] = "\\abefnrtv";
+   static const char acTo[] = "\\\a\b\033\f\n\r\t\v";
+   const char *pcFound;
+   const char *pcDigits;
+   unsigned int uValue = 0;
+   size_t u;
+
+   assert(pc != NULL);
+   assert(pcOut != NULL);
+
+   if (*pc == '\0')
+      return 0;
+
+   pcFound = strchr(acFrom, *pc);
+   if (pcFound != NULL)
+   {
+      *pcOut = acTo[pcFound - acFrom];
+      return 1;
+   }
+
+   if (*pc == 'x')
+   {
+      for (u = 1; u <= MAX_HEX_DIGITS && isxdigit((unsigned char)pc[u]);
+           u++)
+         uValue = uValue * 16
+                  + (unsigned int)(isdigit((unsigned char)pc[u])
+                                   ? pc[u] - '0'
+                                   : tolower((unsigned char)pc[u])
+                                     - 'a' + 10);
+      if (u == 1)
+         return 0;
+      *pcOut = (char)uValue;
+      return u;
+   }
+
+   if (iZeroOctal)
+   {
+      if (*pc != '0')
+         return 0;
+      pcDigits = pc + 1;
+   }
+   else
+   {
+      if (*pc < '0' || *pc > '7')
+         return 0;
+      pcDigits = pc;
+   }
+   for (u = 0; u < MAX_OCTAL_DIGITS && pcDigits[u] >= '0'
+               && pcDigits[u] <= '7'; u++)
+      uValue = uValue * 8 + (unsigned int)(pcDigits[u] - '0');
+   *pcOut = (char)uValue;
+   return (size_t)(pcDigits - pc) + u;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write pcText to stdout with its backslash escapes replaced, as
+   "echo -e" and printf's %b do, stopping at "\c".  Return 1 iff
+   "\c" was found, which ends all output of the command. */
+
+static int builtinWriteEscaped(const char *pcText)
+{
+   const char *pc;
+   size_t uEscape;
+   char c;
+
+   assert(pcText != NULL);
+
+   for (pc = pcText; *pc != '\0'; pc++)
+   {
+      if (*pc != '\\')
+      {
+         putchar(*pc);
+         continue;
+      }
+      if (pc[1] == 'c')
+         return 1;
+      uEscape = builtinEscape(pc + 1, 1, &c);
+      if (uEscape == 0)
+         putchar('\\');
+      else
+      {
+         putchar(c);
+         pc += uEscape;
+      }
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "echo [-neE] [arg...]" command, which takes
+   options as the GNU utility does: leading arguments made only of
+   the letters n, e and E after a "-" are options; -n omits the final
+   newline, and -e replaces backslash escapes, which -E, the default,
+   leaves as they are. */
+
+static int builtinEcho(Command_T oCommand, struct ShellState *psState)
+{
+   const char *pcArg;
+   const char *pc;
+   size_t uLength;
+   size_t uFirst;
+   size_t u;
+   int iNewline = 1;
+   int iEscapes = 0;
+
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   uLength = Command_getArgCount(oCommand);
+   for (uFirst = 0; uFirst < uLength; uFirst++)
+   {
+      pcArg = Command_getArg(oCommand, uFirst);
+      if (pcArg[0] != '-' || pcArg[1] == '\0'
+          || pcArg[1 + strspn(pcArg + 1, "neE")] != '\0')
+         break;
+      for (pc = pcArg + 1; *pc != '\0'; pc++)
+      {
+         if (*pc == 'n')
+            iNewline = 0;
+         else
+            iEscapes = (*pc == 'e');
+      }
+   }
+
+   for (u = uFirst; u < uLength; u++)
+   {
+      if (u > uFirst)
+         putchar(' ');
+      if (! iEscapes)
+         fputs(Command_getArg(oCommand, u), stdout);
+      else if (builtinWriteEscaped(Command_getArg(oCommand, u)))
+         return 0;
+   }
+   if (iNewline)
+      putchar('\n');
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Check that printf converted all of the numeric argument pcArg,
+   ending at pcEnd, with errno iErrno.  If not, write an error
+   message and set *piStatus to EXIT_FAILURE. */
+
+static void builtinCheckNumber(const char *pcArg, const char *pcEnd,
+                               int iErrno, int *piStatus)
+{
+   const char *pcMessage = NULL;
+
+   if (pcEnd == pcArg)
+      pcMessage = "expected a numeric value";
+   else if (*pcEnd != '\0')
+      pcMessage = "value not completely converted";
+   else if (iErrno == ERANGE)
+      pcMessage = strerror(ERANGE);
+
+   if (pcMessage != NULL)
+   {
+      fprintf(stderr, "%s: %s: %s\n", getPgmName(), pcArg, pcMessage);
+      *piStatus = EXIT_FAILURE;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the value of the numeric argument pcArg of printf, written
+   as a C integer constant, or as a quote and a character, whose code
+   is the value.  If pcArg is NULL, because the arguments ran out,
+   return 0.  An invalid argument is reported as by
+   builtinCheckNumber(). */
+
+static intmax_t builtinToInt(const char *pcArg, int *piStatus)
+{
+   intmax_t iValue;
+   char *pcEnd;
+
+   if (pcArg == NULL)
+      return 0;
+   if (*pcArg == '\'' || *pcArg == '"')
+      return (unsigned char)pcArg[1];
+
+   errno = 0;
+   iValue = strtoimax(pcArg, &pcEnd, 0);
+   builtinCheckNumber(pcArg, pcEnd, errno, piStatus);
+   return iValue;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the value of the numeric argument pcArg of printf for an
+   unsigned conversion, as builtinToInt() does. */
+
+static uintmax_t builtinToUnsigned(const char *pcArg, int *piStatus)
+{
+   uintmax_t uValue;
+   char *pcEnd;
+
+   if (pcArg == NULL)
+      return 0;
+   if (*pcArg == '\'' || *pcArg == '"')
+      return (unsigned char)pcArg[1];
+
+   errno = 0;
+   uValue = strtoumax(pcArg, &pcEnd, 0);
+   builtinCheckNumber(pcArg, pcEnd, errno, piStatus);
+   return uValue;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the value of the numeric argument pcArg of printf for a
+   floating-point conversion, as builtinToInt() does. */
+
+static long double builtinToFloat(const char *pcArg, int *piStatus)
+{
+   long double ldValue;
+   char *pcEnd;
+
+   if (pcArg == NULL)
+      return 0.0L;
+   if (*pcArg == '\'' || *pcArg == '"')
+      return (long double)(unsigned char)pcArg[1];
+
+   errno = 0;
+   ldValue = strtold(pcArg, &pcEnd);
+   builtinCheckNumber(pcArg, pcEnd, errno, piStatus);
+   return ldValue;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the field width or precision of a printf conversion that
+   starts at *ppc, advancing *ppc past it: "*" takes the next argument
+   of oCommand after *puArg, advancing *puArg, and digits are the
+   number.  If there is neither, return iDefault. */
+
+static int builtinToWidth(const char **ppc, Command_T oCommand,
+                          size_t *puArg, int iDefault, int *piStatus)
+{
+   const char *pcArg = NULL;
+   intmax_t iValue;
+   long lValue = 0;
+
+   if (**ppc == '*')
+   {
+      (*ppc)++;
+      if (*puArg < Command_getArgCount(oCommand))
+         pcArg = Command_getArg(oCommand, (*puArg)++);
+      iValue = builtinToInt(pcArg, piStatus);
+      if (iValue > INT_MAX || iValue < -INT_MAX)
+      {
+         fprintf(stderr, "%s: %s: invalid field width\n", getPgmName(),
+                 pcArg);
+         *piStatus = EXIT_FAILURE;
+         return iDefault;
+      }
+      return (int)iValue;
+   }
+
+   if (! isdigit((unsigned char)**ppc))
+      return iDefault;
+   while (isdigit((unsigned char)**ppc))
+   {
+      if (lValue <= INT_MAX)
+         lValue = lValue * 10 + (**ppc - '0');
+      (*ppc)++;
+   }
+   return (lValue > INT_MAX) ? INT_MAX : (int)lValue;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write the "%b" argument pcArg of printf with its escapes replaced,
+   at most iPrecision characters of it unless that is negative, in a
+   field of at least iWidth characters, on the left if iLeft.  Return
+   1 iff "\c" was found, which ends all output of the command. */
+
+static int builtinWriteB(const char *pcArg, int iWidth, int iPrecision,
+                         int iLeft)
+{
+   char *pcText;
+   const char *pc;
+   size_t uLength = 0;
+   size_t uEscape;
+   size_t uPad;
+   size_t u;
+   int iStop = 0;
+   char c;
+
+   /* No escape is longer than the character it denotes */
+   pcText = (char*)malloc(strlen(pcArg) + 1);
+   if (pcText == NULL) {perror(getPgmName()); exit(EXIT_FAILURE); }
+
+   for (pc = pcArg; *pc != '\0'; pc++)
+   {
+      c = *pc;
+      if (c == '\\' && pc[1] == 'c')
+      {
+         iStop = 1;
+         break;
+      }
+      if (c == '\\')
+      {
+         uEscape = builtinEscape(pc + 1, 1, &c);
+         pc += uEscape;
+      }
+      pcText[uLength++] = c;
+   }
+
+   if (iPrecision >= 0 && (size_t)iPrecision < uLength)
+      uLength = (size_t)iPrecision;
+
+   /* A negative width, given with "*", puts the text on the left */
+   if (iWidth < 0)
+   {
+      iLeft = 1;
+      iWidth = -iWidth;
+   }
+   uPad = ((size_t)iWidth > uLength) ? (size_t)iWidth - uLength : 0;
+   for (u = 0; ! iLeft && u < uPad; u++)
+      putchar(' ');
+   (void)fwrite(pcText, 1, uLength, stdout);
+   for (u = 0; iLeft && u < uPad; u++)
+      putchar(' ');
+   free(pcText);
+   return iStop;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write pcFormat once, as printf does, converting the arguments of
+   oCommand from *puArg on and advancing *puArg past those used; an
+   argument that is missing counts as empty or zero.  Set *piStatus
+   to EXIT_FAILURE if an argument is invalid.  Return 1 iff output
+   must stop, because of "\c" or an invalid conversion. */
+
+static int builtinFormat(const char *pcFormat, Command_T oCommand,
+                         size_t *puArg, int *piStatus)
+{
+   /* "%", five flags, "*.*", a length modifier, a letter, and the
+      null character */
+   enum {SPEC_SIZE = 12};
+   char acSpec[SPEC_SIZE];
+   const char *pcStart;
+   const char *pcFlag;
+   const char *pcArg;
+   const char *pc;
+   size_t uFlags;
+   size_t uSpec;
+   size_t uEscape;
+   int iLeft;
+   int iWidth;
+   int iPrecision;
+   char cConversion;
+   char c;
+
+   for (pc = pcFormat; *pc != '\0'; pc++)
+   {
+      if (*pc == '\\')
+      {
+         uEscape = builtinEscape(pc + 1, 0, &c);
+         if (uEscape == 0)
+            putchar('\\');
+         else
+         {
+            putchar(c);
+            pc += uEscape;
+         }
+         continue;
+      }
+      if (*pc != '%')
+      {
+         putchar(*pc);
+         continue;
+      }
+      if (pc[1] == '%')
+      {
+         putchar('%');
+         pc++;
+         continue;
+      }
+
+      /* A conversion: flags, width, precision, and a letter, which is
+         passed on to the C library with the widest length modifier,
+         and with the width and, but for %c, the precision as
+         arguments.  Repeated flags mean no more than one, and a
+         negative precision is as if there were none. */
+      pcStart = pc++;
+      uFlags = strspn(pc, "-+ #0");
+      acSpec[0] = '%';
+      uSpec = 1;
+      for (pcFlag = "-+ #0"; *pcFlag != '\0'; pcFlag++)
+         if (memchr(pc, *pcFlag, uFlags) != NULL)
+            acSpec[uSpec++] = *pcFlag;
+      iLeft = (memchr(pc, '-', uFlags) != NULL);
+      pc += uFlags;
+      iWidth = builtinToWidth(&pc, oCommand, puArg, 0, piStatus);
+      iPrecision = -1;
+      if (*pc == '.')
+      {
+         pc++;
+         iPrecision = builtinToWidth(&pc, oCommand, puArg, 0,
+                                     piStatus);
+      }
+
+      cConversion = *pc;
+      if (cConversion == '\0'
+          || strchr("diouxXcsbeEfFgGaA", cConversion) == NULL)
+      {
+         fprintf(stderr, "%s: %.*s: invalid conversion\n",
+                 getPgmName(),
+                 (int)(pc - pcStart) + (cConversion != '\0'), pcStart);
+         *piStatus = EXIT_FAILURE;
+         return 1;
+      }
+
+      acSpec[uSpec++] = '*';
+      if (cConversion != 'c')
+      {
+         acSpec[uSpec++] = '.';
+         acSpec[uSpec++] = '*';
+      }
+      if (strchr("diouxX", cConversion) != NULL)
+         acSpec[uSpec++] = 'j';
+      else if (strchr("eEfFgGaA", cConversion) != NULL)
+         acSpec[uSpec++] = 'L';
+      acSpec[uSpec++] = cConversion;
+      acSpec[uSpec] = '\0';
+
+      pcArg = NULL;
+      if (*puArg < Command_getArgCount(oCommand))
+         pcArg = Command_getArg(oCommand, (*puArg)++);
+
+      switch (cConversion)
+      {
+         case 'd':
+         case 'i':
+            printf(acSpec, iWidth, iPrecision,
+                   builtinToInt(pcArg, piStatus));
+            break;
+         case 'o':
+         case 'u':
+         case 'x':
+         case 'X':
+            printf(acSpec, iWidth, iPrecision,
+                   builtinToUnsigned(pcArg, piStatus));
+            break;
+         case 'c':
+            /* The first character, which is the null character for
+               an empty argument */
+            printf(acSpec, iWidth, (pcArg == NULL) ? 0 : *pcArg);
+            break;
+         case 's':
+            printf(acSpec, iWidth, iPrecision,
+                   (pcArg == NULL) ? "" : pcArg);
+            break;
+         case 'b':
+            if (builtinWriteB((pcArg == NULL) ? "" : pcArg, iWidth,
+                              iPrecision, iLeft))
+               return 1;
+            break;
+         default:
+            printf(acSpec, iWidth, iPrecision,
+                   builtinToFloat(pcArg, piStatus));
+            break;
+      }
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "printf format [arg...]" command.  The
+   format is used again for as long as arguments remain, unless it
+   uses none. */
+
+static int builtinPrintf(Command_T oCommand, struct ShellState *psState)
+{
+   const char *pcFormat;
+   size_t uLength;
+   size_t uArg = 0;
+   size_t uBefore;
+   int iStatus = 0;
+
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   uLength = Command_getArgCount(oCommand);
+   if (uLength > 0 && strcmp(Command_getArg(oCommand, 0), "--") == 0)
+      uArg++;
+   if (uArg == uLength)
+      return builtinError("missing format");
+   pcFormat = Command_getArg(oCommand, uArg++);
+
+   do
+   {
+      uBefore = uArg;
+      if (builtinFormat(pcFormat, oCommand, &uArg, &iStatus))
+         break;
+   } while (uArg < uLength && uArg > uBefore);
+   return iStatus;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* The exit statuses of test: true, false, and an error. */
+
+enum {TEST_TRUE = 0, TEST_FALSE = 1, TEST_ERROR = 2};
+
+/* A Test is an expression of the test command being evaluated: its
+   arguments, those from uNext to uEnd not yet read, and 1 iff an
+   error has been reported. */
+
+struct Test
+{
+   Command_T oCommand;
+   size_t uNext;
+   size_t uEnd;
+   int iError;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Write the error message pcMessage about the argument pcArg of the
+   test *psTest, unless it already has an error, and record that it
+   has one.  Return 0. */
+
+static int builtinTestError(struct Test *psTest, const char *pcArg,
+                            const char *pcMessage)
+{
+   if (! psTest->iError)
+      fprintf(stderr, "%s: %s: %s\n", getPgmName(), pcArg, pcMessage);
+   psTest->iError = 1;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return argument uIndex of the expression of *psTest, counted from
+   its next one. */
+
+static const char *builtinTestArg(const struct Test *psTest,
+                                  size_t uIndex)
+{
+   return Command_getArg(psTest->oCommand, psTest->uNext + uIndex);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 iff pcArg is a unary primary of test, such as "-f". */
+
+static int builtinIsUnary(const char *pcArg)
+{
+   return pcArg[0] == '-' && pcArg[1] != '\0' && pcArg[2] == '\0'
+          && strchr("bcdefghkLnprSstuwxz", pcArg[1]) != NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 iff pcArg is a binary primary of test, such as "=". */
+
+static int builtinIsBinary(const char *pcArg)
+{
+   static const char *apcBinaries[] =
+      {"=", "==", "!=", "<", ">", "-eq", "-ne", "-gt", "-ge", "-lt",
+       "-le", "-nt", "-ot", "-ef"};
+   size_t u;
+
+   for (u = 0; u < sizeof(apcBinaries) / sizeof(apcBinaries[0]); u++)
+      if (strcmp(pcArg, apcBinaries[u]) == 0)
+         return 1;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the value of the unary primary pcOp of *psTest applied to
+   pcArg. */
+
+static int builtinTestUnary(struct Test *psTest, const char *pcOp,
+                            const char *pcArg)
+{
+   struct stat sStat;
+   char *pcEnd;
+   long lFd;
+   int iMode;
+
+   switch (pcOp[1])
+   {
+      case 'n':
+         return *pcArg != '\0';
+      case 'z':
+         return *pcArg == '\0';
+      case 't':
+         errno = 0;
+         lFd = strtol(pcArg, &pcEnd, 10);
+         if (*pcArg == '\0' || *pcEnd != '\0' || errno != 0)
+            return builtinTestError(psTest, pcArg,
+                                    "integer expression expected");
+         return lFd >= 0 && lFd <= INT_MAX && isatty((int)lFd);
+      case 'r':
+      case 'w':
+      case 'x':
+         iMode = (pcOp[1] == 'r') ? R_OK : (pcOp[1] == 'w') ? W_OK
+                                                             : X_OK;
+         return faccessat(AT_FDCWD, pcArg, iMode, AT_EACCESS) == 0;
+      case 'h':
+      case 'L':
+         return lstat(pcArg, &sStat) == 0 && S_ISLNK(sStat.st_mode);
+      default:
+         break;
+   }
+
+   if (stat(pcArg, &sStat) == -1)
+      return 0;
+   switch (pcOp[1])
+   {
+      case 'b':
+         return S_ISBLK(sStat.st_mode);
+      case 'c':
+         return S_ISCHR(sStat.st_mode);
+      case 'd':
+         return S_ISDIR(sStat.st_mode);
+      case 'f':
+         return S_ISREG(sStat.st_mode);
+      case 'g':
+         return (sStat.st_mode & S_ISGID) != 0;
+      case 'k':
+         return (sStat.st_mode & S_ISVTX) != 0;
+      case 'p':
+         return S_ISFIFO(sStat.st_mode);
+      case 'S':
+         return S_ISSOCK(sStat.st_mode);
+      case 's':
+         return sStat.st_size > 0;
+      case 'u':
+         return (sStat.st_mode & S_ISUID) != 0;
+      default:
+         /* -e */
+         return 1;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *piValue the integer pcArg, an operand of *psTest, which
+   may have blanks around it.  Return 1 iff it is one. */
+
+static int builtinTestInt(struct Test *psTest, const char *pcArg,
+                          intmax_t *piValue)
+{
+   char *pcEnd;
+
+   errno = 0;
+   *piValue = strtoimax(pcArg, &pcEnd, 10);
+   while (isblank((unsigned char)*pcEnd))
+      pcEnd++;
+   if (pcEnd == pcArg || *pcEnd != '\0' || errno != 0)
+      return builtinTestError(psTest, pcArg,
+                              "integer expression expected");
+   return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the value of the binary primary pcOp of *psTest applied to
+   pcLeft and pcRight. */
+
+static int builtinTestBinary(struct Test *psTest, const char *pcLeft,
+                             const char *pcOp, const char *pcRight)
+{
+   struct stat sLeft;
+   struct stat sRight;
+   intmax_t iLeft;
+   intmax_t iRight;
+   int iHaveLeft;
+   int iHaveRight;
+   int iCompare;
+
+   if (pcOp[0] != '-')
+   {
+      iCompare = strcmp(pcLeft, pcRight);
+      switch (pcOp[0])
+      {
+         case '!':
+            return iCompare != 0;
+         case '<':
+            return iCompare < 0;
+         case '>':
+            return iCompare > 0;
+         default:
+            return iCompare == 0;
+      }
+   }
+
+   /* -nt, -ot and -ef compare files, of which -nt and -ot allow one
+      not to exist */
+   if (strcmp(pcOp, "-nt") == 0 || strcmp(pcOp, "-ot") == 0
+       || strcmp(pcOp, "-ef") == 0)
+   {
+      iHaveLeft = (stat(pcLeft, &sLeft) == 0);
+      iHaveRight = (stat(pcRight, &sRight) == 0);
+      if (pcOp[1] == 'e')
+         return iHaveLeft && iHaveRight && sLeft.st_dev == sRight.st_dev
+                && sLeft.st_ino == sRight.st_ino;
+      if (! iHaveLeft || ! iHaveRight)
+         return (pcOp[1] == 'n') ? iHaveLeft : iHaveRight;
+      if (sLeft.st_mtim.tv_sec != sRight.st_mtim.tv_sec)
+         iCompare = (sLeft.st_mtim.tv_sec > sRight.st_mtim.tv_sec)
+                    ? 1 : -1;
+      else
+         iCompare = (sLeft.st_mtim.tv_nsec > sRight.st_mtim.tv_nsec)
+                    - (sLeft.st_mtim.tv_nsec < sRight.st_mtim.tv_nsec);
+      return (pcOp[1] == 'n') ? iCompare > 0 : iCompare < 0;
+   }
+
+   if (! builtinTestInt(psTest, pcLeft, &iLeft)
+       || ! builtinTestInt(psTest, pcRight, &iRight))
+      return 0;
+   if (strcmp(pcOp, "-eq") == 0)
+      return iLeft == iRight;
+   if (strcmp(pcOp, "-ne") == 0)
+      return iLeft != iRight;
+   if (strcmp(pcOp, "-gt") == 0)
+      return iLeft > iRight;
+   if (strcmp(pcOp, "-ge") == 0)
+      return iLeft >= iRight;
+   if (strcmp(pcOp, "-lt") == 0)
+      return iLeft < iRight;
+   return iLeft <= iRight;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* builtinTestPrimary() reads a parenthesized expression with
+   builtinTestOr(), which is defined below. */
+
+static int builtinTestOr(struct Test *psTest);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the value of the primary, or "!" or parenthesized
+   expression, at the next argument of *psTest, reading past it. */
+
+static int builtinTestPrimary(struct Test *psTest)
+{
+   size_t uLeft = psTest->uEnd - psTest->uNext;
+   const char *pcArg;
+   int iValue;
+
+   if (uLeft == 0)
+      return builtinTestError(psTest, "test", "argument expected");
+
+   pcArg = builtinTestArg(psTest, 0);
+   if (uLeft >= 3 && builtinIsBinary(builtinTestArg(psTest, 1)))
+   {
+      iValue = builtinTestBinary(psTest, pcArg,
+                                 builtinTestArg(psTest, 1),
+                                 builtinTestArg(psTest, 2));
+      psTest->uNext += 3;
+      return iValue;
+   }
+   if (strcmp(pcArg, "!") == 0)
+   {
+      psTest->uNext++;
+      return ! builtinTestPrimary(psTest);
+   }
+   if (strcmp(pcArg, "(") == 0)
+   {
+      psTest->uNext++;
+      iValue = builtinTestOr(psTest);
+      if (psTest->uNext == psTest->uEnd
+          || strcmp(builtinTestArg(psTest, 0), ")") != 0)
+         return builtinTestError(psTest, "(", "')' expected");
+      psTest->uNext++;
+      return iValue;
+   }
+   if (uLeft >= 2 && builtinIsUnary(pcArg))
+   {
+      iValue = builtinTestUnary(psTest, pcArg,
+                                builtinTestArg(psTest, 1));
+      psTest->uNext += 2;
+      return iValue;
+   }
+   psTest->uNext++;
+   return *pcArg != '\0';
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the value of the primaries joined by "-a" from the next
+   argument of *psTest, reading past them. */
+
+static int builtinTestAnd(struct Test *psTest)
+{
+   int iValue;
+
+   iValue = builtinTestPrimary(psTest);
+   while (psTest->uNext < psTest->uEnd
+          && strcmp(builtinTestArg(psTest, 0), "-a") == 0)
+   {
+      psTest->uNext++;
+      iValue = builtinTestPrimary(psTest) && iValue;
+   }
+   return iValue;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the value of the expressions joined by "-o" from the next
+   argument of *psTest, reading past them. */
+
+static int builtinTestOr(struct Test *psTest)
+{
+   int iValue;
+
+   iValue = builtinTestAnd(psTest);
+   while (psTest->uNext < psTest->uEnd
+          && strcmp(builtinTestArg(psTest, 0), "-o") == 0)
+   {
+      psTest->uNext++;
+      iValue = builtinTestAnd(psTest) || iValue;
+   }
+   return iValue;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the value of the expression that is the rest of the
+   arguments of *psTest, reading past them. */
+
+static int builtinTestExpression(struct Test *psTest)
+{
+   int iValue;
+
+   iValue = builtinTestOr(psTest);
+   if (psTest->uNext != psTest->uEnd)
+      return builtinTestError(psTest, builtinTestArg(psTest, 0),
+                              "unexpected argument");
+   return iValue;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the value of the uCount arguments of *psTest from its next
+   one, which must be all that are left, by the rules of POSIX for
+   up to four arguments, and otherwise as an expression of primaries,
+   "!", "-a", "-o" and parentheses. */
+
+static int builtinTestArgs(struct Test *psTest, size_t uCount)
+{
+   const char *pcFirst = "";
+   const char *pcLast = "";
+
+   if (uCount > 0)
+   {
+      pcFirst = builtinTestArg(psTest, 0);
+      pcLast = builtinTestArg(psTest, uCount - 1);
+   }
+
+   switch (uCount)
+   {
+      case 0:
+         return 0;
+      case 1:
+         return *pcFirst != '\0';
+      case 2:
+         if (strcmp(pcFirst, "!") == 0)
+         {
+            psTest->uNext++;
+            return ! builtinTestArgs(psTest, 1);
+         }
+         if (builtinIsUnary(pcFirst))
+            return builtinTestUnary(psTest, pcFirst, pcLast);
+         return builtinTestError(psTest, pcFirst,
+                                 "unary operator expected");
+      case 3:
+         if (builtinIsBinary(builtinTestArg(psTest, 1)))
+            return builtinTestBinary(psTest, pcFirst,
+                                     builtinTestArg(psTest, 1),
+                                     pcLast);
+         if (strcmp(builtinTestArg(psTest, 1), "-a") == 0)
+            return *pcFirst != '\0' && *pcLast != '\0';
+         if (strcmp(builtinTestArg(psTest, 1), "-o") == 0)
+            return *pcFirst != '\0' || *pcLast != '\0';
+         break;
+      case 4:
+         break;
+      default:
+         return builtinTestExpression(psTest);
+   }
+
+   /* Three or four arguments that begin with "!" or are in
+      parentheses */
+   if (strcmp(pcFirst, "!") == 0)
+   {
+      psTest->uNext++;
+      return ! builtinTestArgs(psTest, uCount - 1);
+   }
+   if (strcmp(pcFirst, "(") == 0 && strcmp(pcLast, ")") == 0)
+   {
+      psTest->uNext++;
+      psTest->uEnd--;
+      return builtinTestArgs(psTest, uCount - 2);
+   }
+   return builtinTestExpression(psTest);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the exit status of test applied to the arguments of
+   oCommand before argument uEnd. */
+
+static int builtinTestStatus(Command_T oCommand, size_t uEnd)
+{
+   struct Test sTest;
+   int iValue;
+
+   sTest.oCommand = oCommand;
+   sTest.uNext = 0;
+   sTest.uEnd = uEnd;
+   sTest.iError = 0;
+   iValue = builtinTestArgs(&sTest, uEnd);
+   if (sTest.iError)
+      return TEST_ERROR;
+   return iValue ? TEST_TRUE : TEST_FALSE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "test expression" command */
+
+static int builtinTest(Command_T oCommand, struct ShellState *psState)
+{
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   return builtinTestStatus(oCommand, Command_getArgCount(oCommand));
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "[ expression ]" command */
+
+static int builtinBracket(Command_T oCommand,
+                          struct ShellState *psState)
+{
+   size_t uLength;
+
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   uLength = Command_getArgCount(oCommand);
+   if (uLength == 0
+       || strcmp(Command_getArg(oCommand, uLength - 1), "]") != 0)
+   {
+      (void)builtinError("missing ]");
+      return TEST_ERROR;
+   }
+   return builtinTestStatus(oCommand, uLength - 1);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "true" command */
+
+static int builtinTrue(Command_T oCommand, struct ShellState *psState)
+{
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "false" command */
+
+static int builtinFalse(Command_T oCommand, struct ShellState *psState)
+{
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   return EXIT_FAILURE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 iff pcPath is an absolute path of the working directory
+   without "." or ".." components, which "pwd -L" may write. */
+
+static int builtinIsLogicalCwd(const char *pcPath)
+{
+   struct stat sPath;
+   struct stat sCwd;
+   const char *pc;
+
+   if (pcPath == NULL || *pcPath != '/')
+      return 0;
+
+   for (pc = pcPath; *pc != '\0'; pc++)
+   {
+      if (*pc != '/' || pc[1] != '.')
+         continue;
+      if (pc[2] == '\0' || pc[2] == '/'
+          || (pc[2] == '.' && (pc[3] == '\0' || pc[3] == '/')))
+         return 0;
+   }
+
+   return stat(pcPath, &sPath) == 0 && stat(".", &sCwd) == 0
+          && sPath.st_dev == sCwd.st_dev && sPath.st_ino == sCwd.st_ino;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Implementation of the "pwd [-L | -P]" command.  -L, the default,
+   writes PWD if it names the working directory without "." or ".."
+   components, and -P, or -L otherwise, the path without symbolic
+   links. */
+
+static int builtinPwd(Command_T oCommand, struct ShellState *psState)
+{
+   const char *pcArg;
+   const char *pc;
+   const char *pcPwd;
+   char *pcCwd;
+   size_t uLength;
+   size_t u;
+   int iPhysical = 0;
+
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   uLength = Command_getArgCount(oCommand);
+   for (u = 0; u < uLength; u++)
+   {
+      pcArg = Command_getArg(oCommand, u);
+      if (strcmp(pcArg, "--") == 0)
+      {
+         u++;
+         break;
+      }
+      if (pcArg[0] != '-' || pcArg[1] == '\0')
+         break;
+      for (pc = pcArg + 1; *pc != '\0'; pc++)
+      {
+         if (*pc != 'L' && *pc != 'P')
+         {
+            fprintf(stderr, "%s: %s: invalid option\n", getPgmName(),
+                    pcArg);
+            return EXIT_FAILURE;
+         }
+         iPhysical = (*pc == 'P');
+      }
+   }
+   if (u < uLength)
+      return builtinError("too many arguments");
+
+   pcPwd = VarTable_get(psState->oVars, "PWD");
+   if (! iPhysical && builtinIsLogicalCwd(pcPwd))
+   {
+      printf("%s\n", pcPwd);
+      return 0;
+   }
+
+   pcCwd = getcwd(NULL, 0);
+   if (pcCwd == NULL)
+   {
+      perror(getPgmName());
+      return EXIT_FAILURE;
+   }
+   printf("%s\n", pcCwd);
+   free(pcCwd);
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* The builtin commands, each in the slot of the table that
+   Builtin_hash() gives for its name; the other slots are empty.  The
+   multipliers of Builtin_hash() were found by a brute-force search
+   that leaves every name in a slot of its own, with room for more
+   builtins.  When adding one, check its slot, and search again if
+   it is taken. */
+
+enum {TABLE_SIZE = 32};
+
+static const struct Builtin asBuiltins[TABLE_SIZE] =
+{
+   [1] = {"true", builtinTrue, 1},
+   [3] = {"hash", builtinHash, 0},
+   [4] = {"stats", builtinStats, 0},
+   [6] = {"jobs", builtinJobs, 0},
+   [7] = {"history", builtinHistory, 0},
+   [9] = {"false", builtinFalse, 1},
+   [10] = {"echo", builtinEcho, 1},
+   [11] = {"test", builtinTest, 1},
+   [12] = {"cd", builtinCd, 0},
+   [18] = {"[", builtinBracket, 1},
+   [20] = {"printf", builtinPrintf, 1},
+   [21] = {"fg", builtinFg, 0},
+   [22] = {"pwd", builtinPwd, 1},
+   [27] = {"exit", builtinExit, 0},
+   [29] = {"setenv", builtinSetenv, 0},
+   [30] = {"unsetenv", builtinUnsetenv, 0},
+   [31] = {"wait", builtinWait, 0}
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Return the slot of asBuiltins for the name pcName of uLength
+   characters, computed from its length and its first, middle, and
+   last characters. */
+
+static size_t Builtin_hash(const char *pcName, size_t uLength)
+{
+   enum {FIRST_MULTIPLIER = 2, MIDDLE_MULTIPLIER = 21,
+         LAST_MULTIPLIER = 12};
+
+   assert(pcName != NULL);
+   assert(uLength > 0);
+
+   return (uLength
+           + FIRST_MULTIPLIER * (size_t)(unsigned char)pcName[0]
+           + MIDDLE_MULTIPLIER
+             * (size_t)(unsigned char)pcName[uLength / 2]
+           + LAST_MULTIPLIER
+             * (size_t)(unsigned char)pcName[uLength - 1])
+          % TABLE_SIZE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* If pcName is the name of a builtin command that the shell whose
+   state is psState runs within itself, then return its Builtin,
+   which is the same object for every lookup of that name.  Otherwise
+   return NULL, and the command is external; so it is for a utility
+   if psState->iExternalUtilities.  Takes the same time however many
+   builtins there are. */
+
+const struct Builtin *Builtin_lookup(const char *pcName,
+                                     const struct ShellState *psState)
+{
+   const struct Builtin *psBuiltin;
+   size_t uLength;
+
+   assert(pcName != NULL);
+   assert(psState != NULL);
+
+   uLength = strlen(pcName);
+   if (uLength == 0)
+      return NULL;
+
+   /* Only the builtin in the name's slot can match it */
+   psBuiltin = &asBuiltins[Builtin_hash(pcName, uLength)];
+   if (psBuiltin->pcName == NULL
+       || strcmp(psBuiltin->pcName, pcName) != 0)
+      return NULL;
+   if (psBuiltin->iUtility && psState->iExternalUtilities)
+      return NULL;
+   return psBuiltin;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the Builtin that the shell whose state is psState runs
+   within itself for oPipeline, or NULL if its stages are external
+   commands.  Only a pipeline of one command can be a builtin, which
+   ignores "&", but a utility in the background runs as an external
+   command, so that the shell does not wait for it. */
+
+const struct Builtin *Builtin_find(Pipeline_T oPipeline,
+                                   const struct ShellState *psState)
+{
+   const struct Builtin *psBuiltin;
+
+   assert(oPipeline != NULL);
+   assert(psState != NULL);
+
+   if (Pipeline_getLength(oPipeline) != 1)
+      return NULL;
+   psBuiltin = Builtin_lookup(
+      Command_getName(Pipeline_getCommand(oPipeline, 0)), psState);
+   if (psBuiltin != NULL && psBuiltin->iUtility
+       && Pipeline_isBackground(oPipeline))
+      return NULL;
+   return psBuiltin;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Run psBuiltin on oCommand within the shell whose state is psState,
+   adding what it cost to psState->oUsage, and if iTimed, also writing
+   that to stderr with Usage_write().  The redirects of oCommand are
+   applied to the shell's own descriptors while psBuiltin runs, and
+   stdout and stderr are flushed before they are undone.  Return what
+   psBuiltin returns, or EXIT_FAILURE if a redirect or the output
+   fails. */
+
+int Builtin_run(const struct Builtin *psBuiltin, Command_T oCommand,
+                struct ShellState *psState, int iTimed)
+{
+   struct timespec sStart;
+   struct rusage sBefore;
+   struct Usage sUsage;
+   int *aiSaved;
+   int iRet;
+
+   assert(psBuiltin != NULL);
+   assert(oCommand != NULL);
+   assert(psState != NULL);
+
+   if (clock_gettime(CLOCK_MONOTONIC, &sStart) == -1
+       || getrusage(RUSAGE_SELF, &sBefore) == -1)
+   {perror(getPgmName()); exit(EXIT_FAILURE); }
+
+   /* The builtin writes to the shell's own descriptors, so they are
+      redirected while it runs, with nothing of the shell's output
+      buffered; stderr is fully buffered while a script runs */
+   if (fflush(NULL) == EOF) {perror(getPgmName()); exit(EXIT_FAILURE); }
+   if (Spawn_redirectShell(oCommand, &aiSaved) == -1)
+   {
+      perror(getPgmName());
+      iRet = EXIT_FAILURE;
+   }
+   else
+   {
+      iRet = (*psBuiltin->pfRun)(oCommand, psState);
+
+      /* Output and diagnostics that cannot be written, say to a
+         closed descriptor, are dropped rather than written after the
+         redirects are undone.  stderr is flushed last, after any
+         message about stdout. */
+      if (fflush(stdout) == EOF)
+      {
+         perror(getPgmName());
+         __fpurge(stdout);
+         clearerr(stdout);
+         iRet = EXIT_FAILURE;
+      }
+      if (fflush(stderr) == EOF)
+      {
+         __fpurge(stderr);
+         clearerr(stderr);
+         iRet = EXIT_FAILURE;
+      }
+      Spawn_restoreShell(oCommand, aiSaved);
+   }
+
+   Usage_sinceSelf(&sUsage, &sStart, &sBefore);
+   UsageStats_add(psState->oUsage, psBuiltin->pcName, &sUsage);
+   if (iTimed)
+      Usage_write(psBuiltin->pcName, &sUsage, stderr);
+   return iRet;
+}
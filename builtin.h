@@ -0,0 +1,122 @@
+/*--------------------------------------------------------------------*/
+/* builtin.h                                                          */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef BUILTIN_INCLUDED
+#define BUILTIN_INCLUDED
+
+#include "command.h"
+#include "pipeline.h"
+#include "pathcache.h"
+#include "spawner.h"
+#include "jobs.h"
+#include "parsecache.h"
+#include "usage.h"
+#include "vartable.h"
+#include "history.h"
+
+/*--------------------------------------------------------------------*/
+
+/* The state of the shell that builtin commands read and change. */
+
+struct ShellState
+{
+   /* The variables of the shell, whose exported ones are the
+      environment of its commands */
+   VarTable_T oVars;
+
+   /* Where the directories of PATH hold each command name */
+   PathCache_T oPaths;
+
+   /* How child processes are created */
+   enum SpawnMethod eSpawn;
+
+   /* The capacity asked for each pipe of a pipeline, or 0 for the
+      system's default */
+   size_t uPipeSize;
+
+   /* 1 iff the time taken by each stage of a pipeline is written to
+      stderr */
+   int iReportTimes;
+
+   /* The pipelines that have been started and not yet reaped */
+   JobTable_T oJobs;
+
+   /* The Pipelines parsed from recent lines */
+   ParseCache_T oParses;
+
+   /* What the commands run so far have cost, by name */
+   UsageStats_T oUsage;
+
+   /* The history of the lines that users have entered, or NULL if
+      there is no history file */
+   History_T oHistory;
+
+   /* 1 iff the builtins that are also standard utilities, such as
+      echo, run as external commands instead */
+   int iExternalUtilities;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A BuiltinFunc_T function runs the builtin command oCommand within
+   the shell whose state is psState.  It writes its own error
+   messages, and returns 0 iff successful. */
+
+typedef int (*BuiltinFunc_T)(Command_T oCommand,
+                             struct ShellState *psState);
+
+/*--------------------------------------------------------------------*/
+
+/* A Builtin is the shell's single copy of the name of a builtin
+   command, the function that runs it, and 1 iff it is also a
+   standard utility, such as echo or test, that only reads the state
+   of the shell, and so could as well run as an external command. */
+
+struct Builtin
+{
+   const char *pcName;
+   BuiltinFunc_T pfRun;
+   int iUtility;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* If pcName is the name of a builtin command that the shell whose
+   state is psState runs within itself, then return its Builtin,
+   which is the same object for every lookup of that name.  Otherwise
+   return NULL, and the command is external; so it is for a utility
+   if psState->iExternalUtilities.  Takes the same time however many
+   builtins there are. */
+
+const struct Builtin *Builtin_lookup(const char *pcName,
+                                     const struct ShellState *psState);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the Builtin that the shell whose state is psState runs
+   within itself for oPipeline, or NULL if its stages are external
+   commands.  Only a pipeline of one command can be a builtin, which
+   ignores "&", but a utility in the background runs as an external
+   command, so that the shell does not wait for it. */
+
+const struct Builtin *Builtin_find(Pipeline_T oPipeline,
+                                   const struct ShellState *psState);
+
+/*--------------------------------------------------------------------*/
+
+/* Run psBuiltin on oCommand within the shell whose state is psState,
+   adding what it cost to psState->oUsage, and if iTimed, also writing
+   that to stderr with Usage_write().  The redirects of oCommand are
+   applied to the shell's own descriptors while psBuiltin runs, and
+   stdout and stderr are flushed before they are undone.  Return what
+   psBuiltin returns, or EXIT_FAILURE if a redirect or the output
+   fails. */
+
+int Builtin_run(const struct Builtin *psBuiltin, Command_T oCommand,
+                struct ShellState *psState, int iTimed);
+
+/*--------------------------------------------------------------------*/
+
+#endif
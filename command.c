@@ -4,8 +4,7 @@
 /*--------------------------------------------------------------------*/
 
 #include "command.h"
-#include "dynarray.h"
-#include "token.h"
+#include "arena.h"
 #include "ish.h"
 #include <ctype.h>
 #include <stdio.h>
@@ -15,195 +14,469 @@
 
 /*--------------------------------------------------------------------*/
 
+/* The factor by which a block grows when its words do not fit. */
+enum {GROWTH_FACTOR = 2};
+
+/* The number of redirects that the first redirect array of a command
+   has room for. */
+enum {INITIAL_PHYS_REDIRECTS = 2};
+
+/* The most digits of a descriptor in a redirect. */
+enum {MAX_FD_DIGITS = 9};
+
+/*--------------------------------------------------------------------*/
+
 /* A Command includes information on the command name, its arguments, 
-   a stdin redirect location, and a stdout redirect location. */
+   and its redirects.  All of its strings are in one block, which
+   begins with the argv array (room for uPhysArgc pointers plus the
+   NULL) and continues with uPhysText bytes of packed string data. */
 
 struct Command
 {
-   /* The string which is the command's name. */
-   char *pcName;
+   /* The block: argv, whose first element is the command's name, and
+      then the string data. */
+   char **ppcArgv;
+
+   /* The number of elements of argv before its NULL, and the number
+      the block has room for. */
+   size_t uArgc;
+   size_t uPhysArgc;
+
+   /* The string data, the number of bytes used, and the number the
+      block has room for. */
+   char *pcText;
+   size_t uTextLength;
+   size_t uPhysText;
+
+   /* The offset in pcText where the word being built began. */
+   size_t uWordStart;
+
+   /* The redirects, in the order in which they are applied, the
+      number of them, and the number the array has room for.  Their
+      words are in the string data. */
+   struct Redirect *psRedirects;
+   size_t uRedirects;
+   size_t uPhysRedirects;
+
+   /* The arena that holds the command and its block. */
+   Arena_T oArena;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Give psCommand a new, empty block from its arena with room for
+   uPhysArgc arguments and uPhysText bytes of string data. */
+
+static void Command_allocBlock(struct Command *psCommand,
+                               size_t uPhysArgc, size_t uPhysText)
+{
+   psCommand->ppcArgv = (char**)Arena_alloc(psCommand->oArena,
+      (uPhysArgc + 1) * sizeof(char*) + uPhysText);
+   psCommand->pcText = (char*)(psCommand->ppcArgv + uPhysArgc + 1);
+   psCommand->uPhysArgc = uPhysArgc;
+   psCommand->uPhysText = uPhysText;
+}
 
-   /* DynArray of strings that contains the command's arguments. */
-   DynArray_T oArgs;
+/*--------------------------------------------------------------------*/
 
-   /* The string that is the location name of the command's input
-      location. By default, this is the empty string, for stdin. */
-   char *pcInFile;
+/* Move the contents of psCommand to a block with room for at least
+   uArgc arguments and uTextLength bytes of string data, adjusting
+   every pointer into the old block.  The old block stays in the
+   arena until it is reset. */
 
-   /* The string that is the location name of the command's output
-      location. By default, this is the empty string, for stout. */
-   char *pcOutFile;
-};
+static void Command_grow(struct Command *psCommand, size_t uArgc,
+                         size_t uTextLength)
+{
+   char **ppcOldArgv = psCommand->ppcArgv;
+   char *pcOldText = psCommand->pcText;
+   size_t uPhysArgc = psCommand->uPhysArgc;
+   size_t uPhysText = psCommand->uPhysText;
+   size_t u;
+
+   while (uPhysArgc < uArgc)
+      uPhysArgc *= GROWTH_FACTOR;
+   while (uPhysText < uTextLength)
+      uPhysText *= GROWTH_FACTOR;
+   Command_allocBlock(psCommand, uPhysArgc, uPhysText);
+
+   memcpy(psCommand->pcText, pcOldText, psCommand->uTextLength);
+   for (u = 0; u < psCommand->uArgc; u++)
+      psCommand->ppcArgv[u] =
+         psCommand->pcText + (ppcOldArgv[u] - pcOldText);
+   psCommand->ppcArgv[psCommand->uArgc] = NULL;
+
+   for (u = 0; u < psCommand->uRedirects; u++)
+      if (psCommand->psRedirects[u].pcWord != NULL)
+         psCommand->psRedirects[u].pcWord = psCommand->pcText
+            + (psCommand->psRedirects[u].pcWord - pcOldText);
+}
 
 /*--------------------------------------------------------------------*/
 
-/* Create and return a command whose name is pcName with arguments
-   list oTokens, stdin redirected to fd iInFile, and stdout
-   redirected to fd iOutFile.  The caller owns the command. */
+/* Create and return an empty command to be built from the words of a
+   line of uLineLength characters.  Its block is sized so that those
+   words fit without moving it.  The command is allocated from oArena,
+   which owns it. */
 
-struct Command *newCommand(char *pcName, DynArray_T oArgs, 
-                           char *pcInFile, char *pcOutFile)
+Command_T newCommand(size_t uLineLength, Arena_T oArena)
 {
    /* Holds the finished command object */
    struct Command *psCommand;
 
-   /* Indexing variables to construct argument array */ 
-   size_t u;
-   size_t uLen;
-
-   /* Copies args passed as an argument into oArgs of psCommand */
-   char *pcOldArg;
-   char *pcNewArg;
-
-   assert(pcName != NULL);
-   assert(oArgs != NULL);
-
-   uLen = DynArray_getLength(oArgs);
-
-   /* Malloc needed space for new Command */
-   psCommand = (struct Command*)malloc(sizeof(struct Command));
-   if (psCommand == NULL)
-   {perror(getPgmName()); exit(EXIT_FAILURE);}
-
-   /* Create new char pointer to the name of the command */
-   psCommand->pcName = (char*)malloc(strlen(pcName) + 1);
-   if (psCommand->pcName == NULL)
-   {perror(getPgmName()); exit(EXIT_FAILURE);}
-   strcpy(psCommand->pcName, pcName);
-
-   /* Stores arguments of given arg array into oArgs of the Command */
-   psCommand->oArgs = DynArray_new(0);
-    
-   /* Copies each element from oArgs into a string that is
-      placed into the oArgs array of the new Command object. */
-   for (u = 0; u < uLen; u++) {
-      pcOldArg = DynArray_get(oArgs, u);
-
-      /* Malloc enough memory for the new string */
-      pcNewArg = (char*)malloc(strlen(pcOldArg) + 1);
-      if (pcNewArg == NULL)
-      {perror(getPgmName()); exit(EXIT_FAILURE);}
-
-      /* Copy argument into the oArgs array of the Command */
-      strcpy(pcNewArg, pcOldArg);
-      DynArray_add(psCommand->oArgs, pcNewArg);
-   }
+   assert(oArena != NULL);
 
-   /* Create new char pointer to the redirected stdin location */
-   if(pcInFile != NULL) {
-      psCommand->pcInFile = (char*)malloc(strlen(pcInFile) + 1);
-      if (psCommand->pcInFile == NULL)
-      {perror(getPgmName()); exit(EXIT_FAILURE);}
-      /* Store the stdin redirect location into the Command */
-      strcpy(psCommand->pcInFile, pcInFile);
-   }
-   else psCommand->pcInFile = NULL;
-
-   /* Create new char pointer to the redirected stdout location */
-   if(pcOutFile != NULL) {
-      psCommand->pcOutFile = (char*)malloc(strlen(pcOutFile) + 1);
-      if (psCommand->pcOutFile == NULL)
-      {perror(getPgmName()); exit(EXIT_FAILURE);}
-      /* Store the stdout redirect location into the Command */
-      strcpy(psCommand->pcOutFile, pcOutFile);
-   }
-   else psCommand->pcOutFile = NULL;
+   psCommand = (struct Command*)Arena_alloc(oArena,
+                                            sizeof(struct Command));
+   psCommand->oArena = oArena;
+
+   /* Every word but the last is followed by at least one character
+      that is not part of it, so the words and a null character after
+      each take at most uLineLength + 1 bytes, and there are at most
+      half that many words. */
+   Command_allocBlock(psCommand, (uLineLength + 1) / 2 + 1,
+                      uLineLength + 1);
+
+   psCommand->uArgc = 0;
+   psCommand->ppcArgv[0] = NULL;
+   psCommand->uTextLength = 0;
+   psCommand->uWordStart = 0;
+   psCommand->psRedirects = NULL;
+   psCommand->uRedirects = 0;
+   psCommand->uPhysRedirects = 0;
 
    return psCommand;
 }
 
 /*--------------------------------------------------------------------*/
 
-/* Returns the name of the Command object oCommand as a string. */
-char* Command_getName(Command_T oCommand)
+/* Create and return a command whose NULL-terminated argv, of uArgc
+   elements before the NULL, is ppcArgv, and whose redirects are
+   psRedirects[0..uRedirects).  The command refers to these arrays
+   and strings instead of copying them. */
+
+Command_T Command_newView(char **ppcArgv, size_t uArgc,
+                          const struct Redirect *psRedirects,
+                          size_t uRedirects, Arena_T oArena)
 {
-   assert(oCommand != NULL);
-   return oCommand->pcName;
+   struct Command *psCommand;
+
+   assert(ppcArgv != NULL);
+   assert(uArgc > 0);
+   assert(ppcArgv[uArgc] == NULL);
+   assert(psRedirects != NULL || uRedirects == 0);
+   assert(oArena != NULL);
+
+   psCommand = (struct Command*)Arena_alloc(oArena,
+                                            sizeof(struct Command));
+   psCommand->oArena = oArena;
+
+   /* The block is full, and has no string data of its own */
+   psCommand->ppcArgv = ppcArgv;
+   psCommand->uArgc = uArgc;
+   psCommand->uPhysArgc = uArgc;
+   psCommand->pcText = NULL;
+   psCommand->uTextLength = 0;
+   psCommand->uPhysText = 0;
+   psCommand->uWordStart = 0;
+
+   /* A view is never built further, so its redirects are never
+      written through this pointer */
+   psCommand->psRedirects = (struct Redirect*)psRedirects;
+   psCommand->uRedirects = uRedirects;
+   psCommand->uPhysRedirects = uRedirects;
+
+   return psCommand;
 }
 
 /*--------------------------------------------------------------------*/
 
-/* Returns the argument DynArray of the Command object oCommand. */
-DynArray_T Command_getArgs(Command_T oCommand)
+/* If the uLength characters at pc are a redirect operator, optionally
+   preceded by the digits of a descriptor, then store the descriptor
+   in *piFd and the kind of redirect in *peKind, and return 1.
+   Otherwise return 0. */
+
+int Command_parseRedirect(const char *pc, size_t uLength, int *piFd,
+                          enum RedirectKind *peKind)
 {
-   assert(oCommand != NULL);
-   return oCommand->oArgs;
+   size_t uDigits = 0;
+   int iFd = 0;
+   const char *pcOp;
+   size_t uOpLength;
+
+   assert(pc != NULL);
+   assert(piFd != NULL);
+   assert(peKind != NULL);
+
+   while (uDigits < uLength && isdigit((unsigned char)pc[uDigits]))
+   {
+      iFd = iFd * 10 + (pc[uDigits] - '0');
+      uDigits++;
+   }
+   if (uDigits > MAX_FD_DIGITS)
+      return 0;
+   pcOp = pc + uDigits;
+   uOpLength = uLength - uDigits;
+   if (uOpLength == 0 || (pcOp[0] != '<' && pcOp[0] != '>'))
+      return 0;
+
+   if (uOpLength == 1)
+      *peKind = (pcOp[0] == '<') ? REDIRECT_READ : REDIRECT_WRITE;
+   else if (uOpLength == 2 && pcOp[1] == '&')
+      *peKind = (pcOp[0] == '<') ? REDIRECT_DUP_IN : REDIRECT_DUP_OUT;
+   else if (uOpLength == 2 && strncmp(pcOp, ">>", 2) == 0)
+      *peKind = REDIRECT_APPEND;
+   else if (uOpLength == 2 && strncmp(pcOp, "<<", 2) == 0)
+      *peKind = REDIRECT_HEREDOC;
+   else if (uOpLength == 3 && strncmp(pcOp, "<<<", 3) == 0)
+      *peKind = REDIRECT_HERESTRING;
+   else
+      return 0;
+
+   if (uDigits == 0)
+      iFd = (pcOp[0] == '<') ? 0 : 1;
+   *piFd = iFd;
+   return 1;
 }
 
 /*--------------------------------------------------------------------*/
 
-/* Returns the stdin location of oCommand as a string. */
-char* Command_getStdin(Command_T oCommand)
+/* Add to the end of the redirects of oCommand one that redirects
+   descriptor iFd in the way eKind names.  The redirect array is
+   allocated from the arena of oCommand, and doubles when it is
+   full. */
+
+void Command_addRedirect(Command_T oCommand, int iFd,
+                         enum RedirectKind eKind)
 {
+   struct Redirect *psOld;
+   struct Redirect *psRedirect;
+
    assert(oCommand != NULL);
-   return oCommand->pcInFile;
+   assert(iFd >= 0);
+
+   if (oCommand->uRedirects == oCommand->uPhysRedirects)
+   {
+      psOld = oCommand->psRedirects;
+      oCommand->uPhysRedirects = (oCommand->uPhysRedirects == 0)
+         ? INITIAL_PHYS_REDIRECTS
+         : oCommand->uPhysRedirects * GROWTH_FACTOR;
+      oCommand->psRedirects = (struct Redirect*)Arena_alloc(
+         oCommand->oArena,
+         oCommand->uPhysRedirects * sizeof(struct Redirect));
+      if (oCommand->uRedirects > 0)
+         memcpy(oCommand->psRedirects, psOld,
+                oCommand->uRedirects * sizeof(struct Redirect));
+   }
+
+   psRedirect = &oCommand->psRedirects[oCommand->uRedirects++];
+   psRedirect->iFd = iFd;
+   psRedirect->eKind = eKind;
+   psRedirect->pcWord = NULL;
+   psRedirect->iSourceFd = -1;
+   psRedirect->pcBody = NULL;
 }
 
 /*--------------------------------------------------------------------*/
 
-/* Returns the stdout location of oCommand as a string. */
-char* Command_getStdout(Command_T oCommand)
+/* Append the uLength characters at pc to the word being built in
+   oCommand, writing them straight into its string data. */
+
+void Command_addChars(Command_T oCommand, const char *pc,
+                      size_t uLength)
 {
    assert(oCommand != NULL);
-   return oCommand->pcOutFile;
+   assert(pc != NULL);
+
+   /* Leave room for the word's null character. */
+   if (oCommand->uTextLength + uLength + 1 > oCommand->uPhysText)
+      Command_grow(oCommand, oCommand->uArgc,
+                   oCommand->uTextLength + uLength + 1);
+
+   memcpy(oCommand->pcText + oCommand->uTextLength, pc, uLength);
+   oCommand->uTextLength += uLength;
 }
 
 /*--------------------------------------------------------------------*/
 
-/* Outputs the details of a Command object to stdout.  Writes the name
-   of the command, followed by the command's arguments, stdin redirect
-   location, and stdout redirect location, if applicable. */
+/* Null-terminate the word being built in oCommand, and make it the
+   part of oCommand that eRole names.  Return 1, or 0 if the word is
+   the word of a redirect that copies a descriptor but is neither a
+   descriptor nor "-". */
 
-void writeCommand(Command_T oCommand)
+int Command_endWord(Command_T oCommand, enum WordRole eRole)
 {
-   size_t u;
+   char *pcWord;
+   struct Redirect *psRedirect;
    size_t uLength;
-   char *pcArg;
+   int iFd;
 
    assert(oCommand != NULL);
 
-   /* Print out command name */
-   printf("Command name: %s\n", oCommand->pcName);
+   if (oCommand->uTextLength + 1 > oCommand->uPhysText)
+      Command_grow(oCommand, oCommand->uArgc,
+                   oCommand->uTextLength + 1);
+   if (eRole == WORD_ARG && oCommand->uArgc == oCommand->uPhysArgc)
+      Command_grow(oCommand, oCommand->uArgc + 1,
+                   oCommand->uTextLength);
 
-   /* Print out arguments */
-   uLength = DynArray_getLength(oCommand->oArgs);
+   oCommand->pcText[oCommand->uTextLength++] = '\0';
+   pcWord = oCommand->pcText + oCommand->uWordStart;
+   oCommand->uWordStart = oCommand->uTextLength;
 
-   for (u = 0; u < uLength; u++)
+   switch (eRole)
    {
-      pcArg = DynArray_get(oCommand->oArgs, u);
-      printf("Command arg: %s\n", pcArg);
+      case WORD_ARG:
+         oCommand->ppcArgv[oCommand->uArgc++] = pcWord;
+         oCommand->ppcArgv[oCommand->uArgc] = NULL;
+         break;
+      case WORD_REDIRECT:
+         assert(oCommand->uRedirects > 0);
+         psRedirect = &oCommand->psRedirects[oCommand->uRedirects - 1];
+         assert(psRedirect->pcWord == NULL);
+         psRedirect->pcWord = pcWord;
+         if (psRedirect->eKind != REDIRECT_DUP_IN
+             && psRedirect->eKind != REDIRECT_DUP_OUT)
+            break;
+
+         /* The word of a copy is a descriptor, which is parsed like
+            the one before an operator, or "-" */
+         if (strcmp(pcWord, "-") == 0)
+            break;
+         uLength = strlen(pcWord);
+         if (uLength == 0 || uLength > MAX_FD_DIGITS
+             || strspn(pcWord, "0123456789") != uLength)
+            return 0;
+         iFd = 0;
+         for (; *pcWord != '\0'; pcWord++)
+            iFd = iFd * 10 + (*pcWord - '0');
+         psRedirect->iSourceFd = iFd;
+         break;
+      default:
+         assert(0);
    }
+   return 1;
+}
 
-   /* Print out input location if applicable */
-   if(oCommand->pcInFile != NULL)
-      printf("Command stdin: %s\n", oCommand->pcInFile);
+/*--------------------------------------------------------------------*/
+
+/* Discard the characters of the word being built in oCommand. */
 
-   /* Print out output location if applicable */
-   if(oCommand->pcOutFile != NULL)
-      printf("Command stdout: %s\n", oCommand->pcOutFile);
+void Command_discardWord(Command_T oCommand)
+{
+   assert(oCommand != NULL);
+   oCommand->uTextLength = oCommand->uWordStart;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of characters of the word being built in
+   oCommand. */
+
+size_t Command_getWordLength(Command_T oCommand)
+{
+   assert(oCommand != NULL);
+   return oCommand->uTextLength - oCommand->uWordStart;
 }
 
 /*--------------------------------------------------------------------*/
 
-/* Free all of the data associated data with a Command object. */
+/* Returns the name of the Command object oCommand as a string. */
+char* Command_getName(Command_T oCommand)
+{
+   assert(oCommand != NULL);
+   assert(oCommand->uArgc > 0);
+   return oCommand->ppcArgv[0];
+}
+
+/*--------------------------------------------------------------------*/
 
-void freeCommand(Command_T oCommand)
+/* Returns the number of arguments of oCommand, not counting its
+   name. */
+size_t Command_getArgCount(Command_T oCommand)
 {
    assert(oCommand != NULL);
+   assert(oCommand->uArgc > 0);
+   return oCommand->uArgc - 1;
+}
+
+/*--------------------------------------------------------------------*/
 
-   free(oCommand->pcName);
+/* Returns argument uIndex of oCommand as a string. */
+char* Command_getArg(Command_T oCommand, size_t uIndex)
+{
+   assert(oCommand != NULL);
+   assert(uIndex + 1 < oCommand->uArgc);
+   return oCommand->ppcArgv[uIndex + 1];
+}
 
-   freeTokens(oCommand->oArgs);
-   free(oCommand->oArgs);
+/*--------------------------------------------------------------------*/
 
-   if(oCommand->pcInFile != NULL) 
-      free(oCommand->pcInFile);
+/* Returns the NULL-terminated argument vector of oCommand. */
+char** Command_getArgv(Command_T oCommand)
+{
+   assert(oCommand != NULL);
+   return oCommand->ppcArgv;
+}
 
-   if(oCommand->pcOutFile != NULL) 
-      free(oCommand->pcOutFile);
+/*--------------------------------------------------------------------*/
 
-   free(oCommand);
+/* Returns the number of redirects of oCommand. */
+size_t Command_getRedirectCount(Command_T oCommand)
+{
+   assert(oCommand != NULL);
+   return oCommand->uRedirects;
 }
 
 /*--------------------------------------------------------------------*/
 
+/* Returns the array of the redirects of oCommand. */
+const struct Redirect *Command_getRedirects(Command_T oCommand)
+{
+   assert(oCommand != NULL);
+   return oCommand->psRedirects;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* The operator of each kind of redirect, for writeCommand(). */
+
+static const char *const apcRedirectOps[] =
+   {"<", ">", ">>", "<&", ">&", "<<", "<<<"};
+
+/*--------------------------------------------------------------------*/
+
+/* Outputs the details of a Command object to stdout.  Writes the name
+   of the command, followed by the command's arguments and redirects,
+   in order. */
+
+void writeCommand(Command_T oCommand)
+{
+   size_t u;
+   const struct Redirect *psRedirect;
+
+   assert(oCommand != NULL);
+
+   /* Print out command name */
+   printf("Command name: %s\n", oCommand->ppcArgv[0]);
+
+   /* Print out arguments */
+   for (u = 1; u < oCommand->uArgc; u++)
+      printf("Command arg: %s\n", oCommand->ppcArgv[u]);
+
+   /* Print out redirects, with the plain ones of stdin and stdout as
+      their locations */
+   for (u = 0; u < oCommand->uRedirects; u++)
+   {
+      psRedirect = &oCommand->psRedirects[u];
+      if (psRedirect->eKind == REDIRECT_READ && psRedirect->iFd == 0)
+         printf("Command stdin: %s\n", psRedirect->pcWord);
+      else if (psRedirect->eKind == REDIRECT_WRITE
+               && psRedirect->iFd == 1)
+         printf("Command stdout: %s\n", psRedirect->pcWord);
+      else
+         printf("Command redirect: %d%s%s\n", psRedirect->iFd,
+                apcRedirectOps[psRedirect->eKind], psRedirect->pcWord);
+   }
+}
+
+/*--------------------------------------------------------------------*/
@@ -8,24 +8,136 @@
 
 #include <stdio.h>
 #include <stddef.h>
-#include "dynarray.h"
-#include "token.h"
+#include "arena.h"
 
 /*--------------------------------------------------------------------*/
 
 /* A Command_T object is used in Linux shells and contains information
-   on the command name, arguments, stdin, and stdout locations. */
+   on the command name, arguments, and redirects.  Its strings live
+   in one contiguous block: a NULL-terminated argv array that exec
+   functions accept as is, followed by the packed string data. */
 
 typedef struct Command *Command_T;
 
 /*--------------------------------------------------------------------*/
 
-/* Create and return a command whose name is pcName with arguments                                 
-   list oArgs, stdin redirected to fd pcInFile, and stdout
-   redirected to fd pcOutFile.  The caller owns the command. */
+/* The part of a Command that a word becomes when it is ended with
+   Command_endWord(): the next argument (the first is the name), or
+   the word of the redirect most recently added. */
 
-struct Command *newCommand(char *pcName, DynArray_T oArgs, 
-                           char *pcInFile, char *pcOutFile);
+enum WordRole {WORD_ARG, WORD_REDIRECT};
+
+/*--------------------------------------------------------------------*/
+
+/* What a redirect makes a file descriptor of a command refer to: a
+   file opened for reading ("<"), a file truncated or created for
+   writing (">"), a file opened or created for appending (">>"), a
+   copy of another descriptor of the command, or nothing ("<&" or
+   ">&", which differ only in how they are written), a here-document
+   ("<<"), or a here-string ("<<<"). */
+
+enum RedirectKind {REDIRECT_READ, REDIRECT_WRITE, REDIRECT_APPEND,
+                   REDIRECT_DUP_IN, REDIRECT_DUP_OUT, REDIRECT_HEREDOC,
+                   REDIRECT_HERESTRING};
+
+/*--------------------------------------------------------------------*/
+
+/* A Redirect is one redirect of a command.  A command applies its
+   redirects in order, after it has been connected to its pipes. */
+
+struct Redirect
+{
+   /* The descriptor of the command that is redirected, and how */
+   int iFd;
+   enum RedirectKind eKind;
+
+   /* The word after the operator: the name of the file, the
+      descriptor to copy or "-", the delimiter of the here-document,
+      or the here-string, which is given to the command followed by a
+      newline */
+   char *pcWord;
+
+   /* For REDIRECT_DUP_IN and REDIRECT_DUP_OUT, the descriptor to
+      copy, or -1 to close iFd */
+   int iSourceFd;
+
+   /* For REDIRECT_HEREDOC, the lines of the here-document, once they
+      have been read, and otherwise NULL */
+   const char *pcBody;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty command to be built from the words of a
+   line of uLineLength characters.  Its block is sized so that those
+   words fit without moving it.  The command is allocated from oArena,
+   which owns it. */
+
+Command_T newCommand(size_t uLineLength, Arena_T oArena);
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return a command whose NULL-terminated argv, of uArgc
+   elements before the NULL, is ppcArgv, and whose redirects are
+   psRedirects[0..uRedirects).  The command refers to these arrays
+   and their strings instead of copying them, and cannot be built
+   further.  The command is allocated from oArena, which owns it, but
+   not its arrays or strings. */
+
+Command_T Command_newView(char **ppcArgv, size_t uArgc,
+                          const struct Redirect *psRedirects,
+                          size_t uRedirects, Arena_T oArena);
+
+/*--------------------------------------------------------------------*/
+
+/* If the uLength characters at pc are a redirect operator, optionally
+   preceded by the digits of a descriptor, then store the descriptor
+   in *piFd and the kind of redirect in *peKind, and return 1.  The
+   descriptor is 0 for an operator that starts with '<', and 1 for
+   one that starts with '>', unless it is given.  Otherwise return
+   0. */
+
+int Command_parseRedirect(const char *pc, size_t uLength, int *piFd,
+                          enum RedirectKind *peKind);
+
+/*--------------------------------------------------------------------*/
+
+/* Add to the end of the redirects of oCommand one that redirects
+   descriptor iFd in the way eKind names.  The next word ended with
+   role WORD_REDIRECT becomes its word. */
+
+void Command_addRedirect(Command_T oCommand, int iFd,
+                         enum RedirectKind eKind);
+
+/*--------------------------------------------------------------------*/
+
+/* Append the uLength characters at pc to the word being built in
+   oCommand, writing them straight into its string data. */
+
+void Command_addChars(Command_T oCommand, const char *pc,
+                      size_t uLength);
+
+/*--------------------------------------------------------------------*/
+
+/* Null-terminate the word being built in oCommand, and make it the
+   part of oCommand that eRole names.  Return 1, or 0 if the word is
+   the word of a redirect that copies a descriptor but is neither a
+   descriptor nor "-". */
+
+int Command_endWord(Command_T oCommand, enum WordRole eRole);
+
+/*--------------------------------------------------------------------*/
+
+/* Discard the characters of the word being built in oCommand. */
+
+void Command_discardWord(Command_T oCommand);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of characters of the word being built in
+   oCommand. */
+
+size_t Command_getWordLength(Command_T oCommand);
 
 /*--------------------------------------------------------------------*/
 
@@ -35,35 +147,46 @@ char* Command_getName(Command_T oCommand);
 
 /*--------------------------------------------------------------------*/
 
-/* Returns the argument DynArray of the Command object oCommand. */
+/* Returns the number of arguments of oCommand, not counting its
+   name. */
 
-DynArray_T Command_getArgs(Command_T oCommand);
+size_t Command_getArgCount(Command_T oCommand);
 
 /*--------------------------------------------------------------------*/
 
-/* Returns the stdin location of oCommand as a string. */
+/* Returns argument uIndex of oCommand as a string.  uIndex must be
+   less than Command_getArgCount(oCommand). */
 
-char* Command_getStdin(Command_T oCommand);
+char* Command_getArg(Command_T oCommand, size_t uIndex);
 
 /*--------------------------------------------------------------------*/
 
-/* Returns the stdout location of oCommand as a string. */
+/* Returns the NULL-terminated argument vector of oCommand, whose
+   first element is its name, in the form that execv() expects. */
 
-char* Command_getStdout(Command_T oCommand);
+char** Command_getArgv(Command_T oCommand);
 
 /*--------------------------------------------------------------------*/
 
-/* Outputs the details of Command object oCommand to stdout.  Writes 
-   the name of the command, followed by its arguments, stdin redirect
-   location, and stdout redirect location, if applicable. */
+/* Returns the number of redirects of oCommand. */
 
-void writeCommand(Command_T oCommand);
+size_t Command_getRedirectCount(Command_T oCommand);
 
 /*--------------------------------------------------------------------*/
 
-/* Free all of the data associated data with oCommand. */
+/* Returns the array of the redirects of oCommand, in the order in
+   which they are applied. */
 
-void freeCommand(Command_T oCommand);
+const struct Redirect *Command_getRedirects(Command_T oCommand);
+
+/*--------------------------------------------------------------------*/
+
+/* Outputs the details of Command object oCommand to stdout.  Writes 
+   the name of the command, followed by its arguments and its
+   redirects, in order.  A redirect of stdin from a file or of stdout
+   to a file is written as its location. */
+
+void writeCommand(Command_T oCommand);
 
 /*--------------------------------------------------------------------*/
 
@@ -0,0 +1,302 @@
+/*--------------------------------------------------------------------*/
+/* eventloop.c                                                        */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#include "eventloop.h"
+#include "shellfd.h"
+#include "ish.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The number of events taken from each epoll_wait() call, and of
+   signals from each read of the signalfd. */
+enum {MAX_EVENTS = 32};
+enum {MAX_SIGNALS = 8};
+
+/* The seconds for which a SIGINT arms the interrupt. */
+enum {INTERRUPT_SECONDS = 5};
+
+/* The number of watches that a new EventLoop has room for. */
+enum {INITIAL_PHYS_WATCHES = 64};
+
+/*--------------------------------------------------------------------*/
+
+/* A Watch is the handler of the events of one file descriptor. */
+
+struct Watch
+{
+   /* The function to call, or NULL if the descriptor is not
+      watched, and its argument. */
+   EventFunc_T pfHandle;
+   void *pvData;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* An EventLoop is an epoll instance and a signalfd, with the Watches
+   of its descriptors indexed by descriptor. */
+
+struct EventLoop
+{
+   int iEpollFd;
+   int iSignalFd;
+
+   /* The Watches, and the number of elements of the array. */
+   struct Watch *psWatches;
+   size_t uPhysWatches;
+
+   /* 1 iff a SIGINT has armed the interrupt, and the alarm that
+      disarms it has not yet gone off. */
+   int iArmed;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Block SIGINT, SIGALRM and SIGCHLD, and create and return an
+   EventLoop that receives them.  Store the signal mask that was
+   replaced in *psOldSet, for child processes to start with.  The
+   caller owns the EventLoop. */
+
+EventLoop_T EventLoop_new(sigset_t *psOldSet)
+{
+   EventLoop_T oLoop;
+   struct epoll_event sEvent;
+   sigset_t sSet;
+
+   assert(psOldSet != NULL);
+
+   oLoop = (EventLoop_T)malloc(sizeof(struct EventLoop));
+   if (oLoop == NULL) {perror(getPgmName()); exit(EXIT_FAILURE); }
+   oLoop->psWatches = (struct Watch*)calloc(INITIAL_PHYS_WATCHES,
+                                            sizeof(struct Watch));
+   if (oLoop->psWatches == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE); }
+   oLoop->uPhysWatches = INITIAL_PHYS_WATCHES;
+   oLoop->iArmed = 0;
+
+   /* The signals are only ever received through the signalfd */
+   if (sigemptyset(&sSet) == -1 || sigaddset(&sSet, SIGINT) == -1
+       || sigaddset(&sSet, SIGALRM) == -1
+       || sigaddset(&sSet, SIGCHLD) == -1)
+   {perror(getPgmName()); exit(EXIT_FAILURE); }
+   if (sigprocmask(SIG_BLOCK, &sSet, psOldSet) == -1)
+   {perror(getPgmName()); exit(EXIT_FAILURE); }
+   oLoop->iSignalFd = ShellFd_move(
+      signalfd(-1, &sSet, SFD_NONBLOCK | SFD_CLOEXEC));
+   if (oLoop->iSignalFd == -1) {perror(getPgmName()); exit(EXIT_FAILURE); }
+
+   oLoop->iEpollFd = ShellFd_move(epoll_create1(EPOLL_CLOEXEC));
+   if (oLoop->iEpollFd == -1) {perror(getPgmName()); exit(EXIT_FAILURE); }
+   sEvent.events = EPOLLIN;
+   sEvent.data.fd = oLoop->iSignalFd;
+   if (epoll_ctl(oLoop->iEpollFd, EPOLL_CTL_ADD, oLoop->iSignalFd,
+                 &sEvent) == -1)
+   {perror(getPgmName()); exit(EXIT_FAILURE); }
+
+   return oLoop;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Free oLoop.  The signals stay blocked, and the descriptors that it
+   watches are not closed. */
+
+void EventLoop_free(EventLoop_T oLoop)
+{
+   assert(oLoop != NULL);
+
+   (void)close(oLoop->iEpollFd);
+   (void)close(oLoop->iSignalFd);
+   free(oLoop->psWatches);
+   free(oLoop);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make oLoop call (*pfHandle)(pvData) when file descriptor iFd is
+   readable, has reached end-of-file, or has failed.  If iOnce, do so
+   only once, until EventLoop_rearm() is called.  Return 0, or -1
+   with errno set if iFd cannot be watched; EPERM means that iFd is
+   always readable, as a regular file is. */
+
+int EventLoop_add(EventLoop_T oLoop, int iFd, int iOnce,
+                  EventFunc_T pfHandle, void *pvData)
+{
+   struct epoll_event sEvent;
+   struct Watch *psWatches;
+   size_t uPhysWatches;
+
+   assert(oLoop != NULL);
+   assert(iFd >= 0);
+   assert(pfHandle != NULL);
+
+   /* Make room for a Watch at index iFd */
+   if ((size_t)iFd >= oLoop->uPhysWatches)
+   {
+      uPhysWatches = oLoop->uPhysWatches;
+      while ((size_t)iFd >= uPhysWatches)
+         uPhysWatches *= 2;
+      psWatches = (struct Watch*)realloc(oLoop->psWatches,
+                                         uPhysWatches
+                                         * sizeof(struct Watch));
+      if (psWatches == NULL) {perror(getPgmName()); exit(EXIT_FAILURE); }
+      memset(psWatches + oLoop->uPhysWatches, 0,
+             (uPhysWatches - oLoop->uPhysWatches)
+             * sizeof(struct Watch));
+      oLoop->psWatches = psWatches;
+      oLoop->uPhysWatches = uPhysWatches;
+   }
+
+   sEvent.events = EPOLLIN | (iOnce ? EPOLLONESHOT : 0);
+   sEvent.data.fd = iFd;
+   if (epoll_ctl(oLoop->iEpollFd, EPOLL_CTL_ADD, iFd, &sEvent) == -1)
+      return -1;
+
+   oLoop->psWatches[iFd].pfHandle = pfHandle;
+   oLoop->psWatches[iFd].pvData = pvData;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make oLoop handle the next event of iFd, which was added with
+   iOnce set. */
+
+void EventLoop_rearm(EventLoop_T oLoop, int iFd)
+{
+   struct epoll_event sEvent;
+
+   assert(oLoop != NULL);
+   assert(iFd >= 0 && (size_t)iFd < oLoop->uPhysWatches);
+   assert(oLoop->psWatches[iFd].pfHandle != NULL);
+
+   sEvent.events = EPOLLIN | EPOLLONESHOT;
+   sEvent.data.fd = iFd;
+   if (epoll_ctl(oLoop->iEpollFd, EPOLL_CTL_MOD, iFd, &sEvent) == -1)
+   {perror(getPgmName()); exit(EXIT_FAILURE); }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Stop watching iFd.  Must be called before iFd is closed. */
+
+void EventLoop_remove(EventLoop_T oLoop, int iFd)
+{
+   assert(oLoop != NULL);
+   assert(iFd >= 0 && (size_t)iFd < oLoop->uPhysWatches);
+
+   if (epoll_ctl(oLoop->iEpollFd, EPOLL_CTL_DEL, iFd, NULL) == -1)
+   {perror(getPgmName()); exit(EXIT_FAILURE); }
+   oLoop->psWatches[iFd].pfHandle = NULL;
+   oLoop->psWatches[iFd].pvData = NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Read the signals that oLoop has received, handle SIGINT and
+   SIGALRM, and return the flags for EventLoop_wait(). */
+
+static int EventLoop_readSignals(EventLoop_T oLoop)
+{
+   struct signalfd_siginfo asInfo[MAX_SIGNALS];
+   ssize_t iCount;
+   size_t u;
+   int iFlags = 0;
+
+   /* Any signals left over keep the signalfd readable */
+   iCount = read(oLoop->iSignalFd, asInfo, sizeof(asInfo));
+   if (iCount == -1)
+   {
+      if (errno == EAGAIN || errno == EINTR)
+         return 0;
+      perror(getPgmName());
+      exit(EXIT_FAILURE);
+   }
+
+   for (u = 0; u < (size_t)iCount / sizeof(asInfo[0]); u++)
+   {
+      switch (asInfo[u].ssi_signo) {
+         case SIGINT:
+            iFlags |= EVENT_INTERRUPT;
+            if (oLoop->iArmed)
+            {
+               printf("To exit the shell, issue an 'exit' command\n");
+               if (fflush(stdout) == EOF)
+               {perror(getPgmName()); exit(EXIT_FAILURE); }
+            }
+            else
+            {
+               oLoop->iArmed = 1;
+               alarm(INTERRUPT_SECONDS);
+            }
+            break;
+         case SIGALRM:
+            oLoop->iArmed = 0;
+            break;
+         case SIGCHLD:
+            iFlags |= EVENT_CHILD;
+            break;
+         default:
+            break;
+      }
+   }
+   return iFlags;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Wait up to iTimeout milliseconds, or forever if iTimeout is -1,
+   for events of oLoop, and handle all of the events that have
+   arrived.  Return EVENT_INTERRUPT and EVENT_CHILD, combined with
+   "|", for the signals that were received, or 0 if there were none. */
+
+int EventLoop_wait(EventLoop_T oLoop, int iTimeout)
+{
+   struct epoll_event asEvents[MAX_EVENTS];
+   struct Watch *psWatch;
+   int iCount;
+   int i;
+   int iFd;
+   int iFlags = 0;
+
+   assert(oLoop != NULL);
+
+   iCount = epoll_wait(oLoop->iEpollFd, asEvents, MAX_EVENTS, iTimeout);
+   if (iCount == -1)
+   {
+      /* A signal that is not routed to the signalfd, such as
+         SIGTSTP, can interrupt the wait; the caller waits again */
+      if (errno == EINTR)
+         return 0;
+      perror(getPgmName());
+      exit(EXIT_FAILURE);
+   }
+
+   for (i = 0; i < iCount; i++)
+   {
+      iFd = asEvents[i].data.fd;
+      if (iFd == oLoop->iSignalFd)
+      {
+         iFlags |= EventLoop_readSignals(oLoop);
+         continue;
+      }
+
+      /* A handler may have removed a descriptor that was ready */
+      psWatch = &oLoop->psWatches[iFd];
+      if (psWatch->pfHandle != NULL)
+         (*psWatch->pfHandle)(psWatch->pvData);
+   }
+   return iFlags;
+}
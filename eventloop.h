@@ -0,0 +1,90 @@
+/*--------------------------------------------------------------------*/
+/* eventloop.h                                                        */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef EVENTLOOP_INCLUDED
+#define EVENTLOOP_INCLUDED
+
+#include <signal.h>
+
+/*--------------------------------------------------------------------*/
+
+/* An EventLoop_T object is the one place where the shell waits: for
+   input, for child processes to exit, and for signals.  It watches
+   file descriptors with epoll, and receives SIGINT, SIGALRM and
+   SIGCHLD through a signalfd instead of signal handlers, so their
+   dispositions are set once, when it is created.
+
+   A SIGINT arms the interrupt for 5 seconds.  A SIGINT while it is
+   armed writes a reminder to use the "exit" command to stdout. */
+
+typedef struct EventLoop *EventLoop_T;
+
+/*--------------------------------------------------------------------*/
+
+/* Flags that EventLoop_wait() returns: a SIGINT or a SIGCHLD was
+   received. */
+
+enum {EVENT_INTERRUPT = 1, EVENT_CHILD = 2};
+
+/*--------------------------------------------------------------------*/
+
+/* An EventFunc_T function handles an event of a file descriptor that
+   an EventLoop watches.  pvData is the pointer given when the
+   descriptor was added. */
+
+typedef void (*EventFunc_T)(void *pvData);
+
+/*--------------------------------------------------------------------*/
+
+/* Block SIGINT, SIGALRM and SIGCHLD, and create and return an
+   EventLoop that receives them.  Store the signal mask that was
+   replaced in *psOldSet, for child processes to start with.  The
+   caller owns the EventLoop. */
+
+EventLoop_T EventLoop_new(sigset_t *psOldSet);
+
+/*--------------------------------------------------------------------*/
+
+/* Free oLoop.  The signals stay blocked, and the descriptors that it
+   watches are not closed. */
+
+void EventLoop_free(EventLoop_T oLoop);
+
+/*--------------------------------------------------------------------*/
+
+/* Make oLoop call (*pfHandle)(pvData) when file descriptor iFd is
+   readable, has reached end-of-file, or has failed.  If iOnce, do so
+   only once, until EventLoop_rearm() is called.  Return 0, or -1
+   with errno set if iFd cannot be watched; EPERM means that iFd is
+   always readable, as a regular file is. */
+
+int EventLoop_add(EventLoop_T oLoop, int iFd, int iOnce,
+                  EventFunc_T pfHandle, void *pvData);
+
+/*--------------------------------------------------------------------*/
+
+/* Make oLoop handle the next event of iFd, which was added with
+   iOnce set. */
+
+void EventLoop_rearm(EventLoop_T oLoop, int iFd);
+
+/*--------------------------------------------------------------------*/
+
+/* Stop watching iFd.  Must be called before iFd is closed. */
+
+void EventLoop_remove(EventLoop_T oLoop, int iFd);
+
+/*--------------------------------------------------------------------*/
+
+/* Wait up to iTimeout milliseconds, or forever if iTimeout is -1,
+   for events of oLoop, and handle all of the events that have
+   arrived.  Return EVENT_INTERRUPT and EVENT_CHILD, combined with
+   "|", for the signals that were received, or 0 if there were none. */
+
+int EventLoop_wait(EventLoop_T oLoop, int iTimeout);
+
+/*--------------------------------------------------------------------*/
+
+#endif
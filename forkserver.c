@@ -0,0 +1,991 @@
+/*--------------------------------------------------------------------*/
+/* forkserver.c                                                       */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#include "forkserver.h"
+#include "command.h"
+#include "arena.h"
+#include "spawner.h"
+#include "shellfd.h"
+#include "ish.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/signalfd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The environment that posix_spawn() gives the command. */
+extern char **environ;
+
+/* The descriptors that a request passes, in order: the current
+   directory of the shell, and the stdin, stdout and stderr of the
+   command. */
+enum {FD_CWD, FD_IN, FD_OUT, FD_ERR, REQUEST_FD_COUNT};
+
+/* The kinds of message that the server sends: the exit of a process
+   that it started, and the reply to a request. */
+enum {MESSAGE_EXIT, MESSAGE_REPLY};
+
+/* The initial physical lengths of the request buffer, in bytes, and
+   of the array of exits that arrived while waiting for a reply. */
+enum {INITIAL_PHYS_BUFFER = 1024};
+enum {INITIAL_PHYS_EXITS = 16};
+
+/*--------------------------------------------------------------------*/
+
+/* A ServerRequest is the fixed part of a request, which is followed
+   by uLength bytes: a RequestRedirect for each of uRedirects
+   redirects, and then null-terminated strings: the file to execute,
+   the uArgc arguments, the uEnvc strings of the environment, and the
+   word of each redirect, followed by its body if it has one.  If
+   iSameEnv, the environment is not sent, and that of the previous
+   request is used again. */
+
+struct ServerRequest
+{
+   size_t uLength;
+   size_t uArgc;
+   size_t uEnvc;
+   size_t uRedirects;
+   pid_t iPgid;
+   int iSameEnv;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A RequestRedirect is a redirect of a request, without its
+   strings. */
+
+struct RequestRedirect
+{
+   int iFd;
+   int iKind;
+   int iSourceFd;
+   int iHasBody;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A ServerMessage is what the server sends.  For MESSAGE_EXIT, iPid
+   is the process that exited, iValue its wait status, and sRusage the
+   resources it used.  For MESSAGE_REPLY, iPid is the process that was
+   started, or -1, in which case iValue is the errno of the
+   failure. */
+
+struct ServerMessage
+{
+   int iType;
+   pid_t iPid;
+   int iValue;
+   struct rusage sRusage;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A ForkServer is the shell's end of the socket of a server, and the
+   process ID of the server. */
+
+struct ForkServer
+{
+   int iSocket;
+   pid_t iPid;
+
+   /* 1 iff the server has died, after which nothing is sent to it. */
+   int iLost;
+
+   /* The variable part of the request being built, its length, and
+      its physical length. */
+   char *pcBuffer;
+   size_t uLength;
+   size_t uPhysLength;
+
+   /* The exits that arrived while the shell waited for a reply, which
+      are psExits[uFirstExit..uFirstExit+uExits), and the physical
+      length of psExits. */
+   struct ServerMessage *psExits;
+   size_t uFirstExit;
+   size_t uExits;
+   size_t uPhysExits;
+
+   /* The generation of the environment that was last sent, or 0. */
+   unsigned long ulEnvGeneration;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* An Outbox holds the bytes that the server has yet to send: those
+   at pcData[uSent..uLength), in an array of uPhysLength bytes. */
+
+struct Outbox
+{
+   char *pcData;
+   size_t uSent;
+   size_t uLength;
+   size_t uPhysLength;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* An Environment is the environment that the server last received:
+   a copy of its strings, and a NULL-terminated array of them. */
+
+struct Environment
+{
+   char *pcText;
+   char **ppcEnv;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Read uLength bytes from socket iSocket into pv.  If iWait is 0 and
+   no byte has arrived, return 0 at once.  Return 1 when all of them
+   have been read, or -1 with errno set if the socket fails or reaches
+   end-of-file first, which sets errno to ECONNRESET. */
+
+static int ForkServer_receive(int iSocket, void *pv, size_t uLength,
+                              int iWait)
+{
+   char *pc = (char*)pv;
+   ssize_t iRead;
+
+   while (uLength > 0)
+   {
+      iRead = recv(iSocket, pc, uLength, iWait ? 0 : MSG_DONTWAIT);
+      if (iRead == -1)
+      {
+         if (errno == EINTR)
+            continue;
+         if (errno == EAGAIN && ! iWait)
+            return 0;
+         return -1;
+      }
+      if (iRead == 0)
+      {
+         errno = ECONNRESET;
+         return -1;
+      }
+      pc += iRead;
+      uLength -= (size_t)iRead;
+
+      /* Part of a message is there, so the rest is on its way */
+      iWait = 1;
+   }
+   return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write uLength bytes from pv to socket iSocket.  Return 0, or -1
+   with errno set. */
+
+static int ForkServer_sendAll(int iSocket, const void *pv,
+                              size_t uLength)
+{
+   const char *pc = (const char*)pv;
+   ssize_t iSent;
+
+   while (uLength > 0)
+   {
+      iSent = send(iSocket, pc, uLength, MSG_NOSIGNAL);
+      if (iSent == -1)
+      {
+         if (errno == EINTR)
+            continue;
+         return -1;
+      }
+      pc += iSent;
+      uLength -= (size_t)iSent;
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Append the uLength bytes at pv to psOutbox. */
+
+static void ForkServer_post(struct Outbox *psOutbox, const void *pv,
+                            size_t uLength)
+{
+   size_t uPhysLength;
+   char *pcData;
+
+   if (psOutbox->uSent == psOutbox->uLength)
+      psOutbox->uSent = psOutbox->uLength = 0;
+
+   if (psOutbox->uLength + uLength > psOutbox->uPhysLength)
+   {
+      uPhysLength = (psOutbox->uPhysLength == 0)
+         ? INITIAL_PHYS_BUFFER : psOutbox->uPhysLength;
+      while (psOutbox->uLength + uLength > uPhysLength)
+         uPhysLength *= 2;
+      pcData = (char*)realloc(psOutbox->pcData, uPhysLength);
+      if (pcData == NULL)
+         _exit(EXIT_FAILURE);
+      psOutbox->pcData = pcData;
+      psOutbox->uPhysLength = uPhysLength;
+   }
+   memcpy(psOutbox->pcData + psOutbox->uLength, pv, uLength);
+   psOutbox->uLength += uLength;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Send as much of psOutbox to socket iSocket as fits without
+   blocking, so that the server never waits for the shell to read.
+   Exit if the shell has closed the socket. */
+
+static void ForkServer_flush(int iSocket, struct Outbox *psOutbox)
+{
+   ssize_t iSent;
+
+   while (psOutbox->uSent < psOutbox->uLength)
+   {
+      iSent = send(iSocket, psOutbox->pcData + psOutbox->uSent,
+                   psOutbox->uLength - psOutbox->uSent,
+                   MSG_DONTWAIT | MSG_NOSIGNAL);
+      if (iSent == -1)
+      {
+         if (errno == EINTR)
+            continue;
+         if (errno == EAGAIN)
+            return;
+         _exit(EXIT_SUCCESS);
+      }
+      psOutbox->uSent += (size_t)iSent;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Reap each child of the server that has exited, after draining the
+   signalfd iSignalFd, and post an exit message for it to
+   psOutbox. */
+
+static void ForkServer_reapChildren(int iSignalFd,
+                                    struct Outbox *psOutbox)
+{
+   struct signalfd_siginfo sInfo;
+   struct ServerMessage sMessage;
+   int iStatus;
+   pid_t iPid;
+
+   while (read(iSignalFd, &sInfo, sizeof(sInfo)) > 0)
+      ;
+
+   memset(&sMessage, 0, sizeof(sMessage));
+   sMessage.iType = MESSAGE_EXIT;
+   for (;;)
+   {
+      iPid = wait4(-1, &iStatus, WNOHANG, &sMessage.sRusage);
+      if (iPid <= 0)
+         break;
+      sMessage.iPid = iPid;
+      sMessage.iValue = iStatus;
+      ForkServer_post(psOutbox, &sMessage, sizeof(sMessage));
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Replace *psEnv with a copy of the uEnvc strings at pc, which are
+   followed by others. */
+
+static void ForkServer_copyEnv(struct Environment *psEnv,
+                               const char *pc, size_t uEnvc)
+{
+   const char *pcEnd = pc;
+   char *pcText;
+   char *pcString;
+   char **ppcEnv;
+   size_t u;
+
+   for (u = 0; u < uEnvc; u++)
+      pcEnd += strlen(pcEnd) + 1;
+
+   pcText = (char*)malloc((size_t)(pcEnd - pc) + 1);
+   ppcEnv = (char**)malloc((uEnvc + 1) * sizeof(char*));
+   if (pcText == NULL || ppcEnv == NULL)
+      _exit(EXIT_FAILURE);
+   memcpy(pcText, pc, (size_t)(pcEnd - pc));
+   pcString = pcText;
+   for (u = 0; u < uEnvc; u++)
+   {
+      ppcEnv[u] = pcString;
+      pcString += strlen(pcString) + 1;
+   }
+   ppcEnv[uEnvc] = NULL;
+
+   /* The first environment is the server's own, which it does not
+      own */
+   if (psEnv->pcText != NULL)
+   {
+      free(psEnv->pcText);
+      free(psEnv->ppcEnv);
+   }
+   psEnv->pcText = pcText;
+   psEnv->ppcEnv = ppcEnv;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Receive the next request from socket iSocket, with its descriptors,
+   and return the command that it describes, allocated from oArena
+   with its strings.  Store in *psRequest the fixed part of the
+   request, in *ppcFile the file to execute, in *psEnv the
+   environment if the request carries one, and in aiFds the
+   descriptors.  Exit if the shell has closed the socket. */
+
+static Command_T ForkServer_readRequest(int iSocket, Arena_T oArena,
+                                        struct ServerRequest *psRequest,
+                                        const char **ppcFile,
+                                        struct Environment *psEnv,
+                                        int aiFds[])
+{
+   union
+   {
+      char ac[CMSG_SPACE(REQUEST_FD_COUNT * sizeof(int))];
+      struct cmsghdr sAlign;
+   } uControl;
+   struct msghdr sHeader;
+   struct iovec sVector;
+   struct cmsghdr *psControl;
+   const struct RequestRedirect *psRecords;
+   struct Redirect *psRedirects = NULL;
+   char **ppcArgv;
+   char *pcPayload;
+   char *pc;
+   ssize_t iRead;
+   size_t u;
+
+   memset(&sHeader, 0, sizeof(sHeader));
+   sVector.iov_base = psRequest;
+   sVector.iov_len = sizeof(struct ServerRequest);
+   sHeader.msg_iov = &sVector;
+   sHeader.msg_iovlen = 1;
+   sHeader.msg_control = uControl.ac;
+   sHeader.msg_controllen = sizeof(uControl.ac);
+
+   /* The descriptors come with the first byte of the request */
+   do
+      iRead = recvmsg(iSocket, &sHeader, MSG_CMSG_CLOEXEC);
+   while (iRead == -1 && errno == EINTR);
+   if (iRead <= 0)
+      _exit(EXIT_SUCCESS);
+   psControl = CMSG_FIRSTHDR(&sHeader);
+   if (psControl == NULL || psControl->cmsg_level != SOL_SOCKET
+       || psControl->cmsg_type != SCM_RIGHTS
+       || psControl->cmsg_len != CMSG_LEN(REQUEST_FD_COUNT * sizeof(int)))
+      _exit(EXIT_FAILURE);
+   memcpy(aiFds, CMSG_DATA(psControl), REQUEST_FD_COUNT * sizeof(int));
+
+   /* The descriptors arrive at small numbers, which a redirect of the
+      command could name */
+   for (u = 0; u < REQUEST_FD_COUNT; u++)
+      if ((aiFds[u] = ShellFd_move(aiFds[u])) == -1)
+         _exit(EXIT_FAILURE);
+
+   if ((size_t)iRead < sizeof(struct ServerRequest)
+       && ForkServer_receive(iSocket, (char*)psRequest + iRead,
+                             sizeof(struct ServerRequest)
+                             - (size_t)iRead, 1) == -1)
+      _exit(EXIT_SUCCESS);
+   pcPayload = (char*)Arena_alloc(oArena, psRequest->uLength);
+   if (ForkServer_receive(iSocket, pcPayload, psRequest->uLength, 1)
+       == -1)
+      _exit(EXIT_SUCCESS);
+
+   /* The strings stay where they arrived; only arrays of pointers to
+      them are built */
+   psRecords = (const struct RequestRedirect*)pcPayload;
+   pc = pcPayload
+      + psRequest->uRedirects * sizeof(struct RequestRedirect);
+   *ppcFile = pc;
+   pc += strlen(pc) + 1;
+
+   ppcArgv = (char**)Arena_alloc(oArena,
+                                 (psRequest->uArgc + 1) * sizeof(char*));
+   for (u = 0; u < psRequest->uArgc; u++)
+   {
+      ppcArgv[u] = pc;
+      pc += strlen(pc) + 1;
+   }
+   ppcArgv[psRequest->uArgc] = NULL;
+
+   /* The environment outlives the request, until the next one that
+      carries an environment */
+   if (! psRequest->iSameEnv)
+   {
+      ForkServer_copyEnv(psEnv, pc, psRequest->uEnvc);
+      for (u = 0; u < psRequest->uEnvc; u++)
+         pc += strlen(pc) + 1;
+   }
+
+   if (psRequest->uRedirects > 0)
+      psRedirects = (struct Redirect*)Arena_alloc(oArena,
+         psRequest->uRedirects * sizeof(struct Redirect));
+   for (u = 0; u < psRequest->uRedirects; u++)
+   {
+      psRedirects[u].iFd = psRecords[u].iFd;
+      psRedirects[u].eKind = (enum RedirectKind)psRecords[u].iKind;
+      psRedirects[u].iSourceFd = psRecords[u].iSourceFd;
+      psRedirects[u].pcWord = pc;
+      pc += strlen(pc) + 1;
+      psRedirects[u].pcBody = NULL;
+      if (psRecords[u].iHasBody)
+      {
+         psRedirects[u].pcBody = pc;
+         pc += strlen(pc) + 1;
+      }
+   }
+
+   return Command_newView(ppcArgv, psRequest->uArgc, psRedirects,
+                          psRequest->uRedirects, oArena);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Receive the next request from socket iSocket, start the process
+   that it asks for, and post the reply to psOutbox.  oArena holds
+   the request until the process has started, and *psEnv the
+   environment. */
+
+static void ForkServer_handleRequest(int iSocket, Arena_T oArena,
+                                     struct Environment *psEnv,
+                                     struct Outbox *psOutbox)
+{
+   struct ServerRequest sRequest;
+   struct ServerMessage sMessage;
+   int aiFds[REQUEST_FD_COUNT];
+   const char *pcFile;
+   char **ppcOldEnv;
+   Command_T oCommand;
+   int u;
+
+   oCommand = ForkServer_readRequest(iSocket, oArena, &sRequest,
+                                     &pcFile, psEnv, aiFds);
+
+   memset(&sMessage, 0, sizeof(sMessage));
+   sMessage.iType = MESSAGE_REPLY;
+   sMessage.iPid = -1;
+   if (fchdir(aiFds[FD_CWD]) == -1
+       || dup2(aiFds[FD_ERR], STDERR_FILENO) == -1)
+      sMessage.iValue = errno;
+   else
+   {
+      ppcOldEnv = environ;
+      environ = psEnv->ppcEnv;
+      sMessage.iPid = spawnCommand(oCommand, pcFile, aiFds[FD_IN],
+                                   aiFds[FD_OUT], sRequest.iPgid,
+                                   SPAWN_POSIX);
+      sMessage.iValue = errno;
+      environ = ppcOldEnv;
+   }
+
+   for (u = 0; u < REQUEST_FD_COUNT; u++)
+      (void)close(aiFds[u]);
+   Arena_reset(oArena);
+   ForkServer_post(psOutbox, &sMessage, sizeof(sMessage));
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Serve the shell at the other end of socket iSocket until it closes
+   the socket, and then exit.  This is the whole life of the server
+   process. */
+
+static void ForkServer_serve(int iSocket)
+{
+   struct Outbox sOutbox = {NULL, 0, 0, 0};
+   struct Environment sEnv = {NULL, NULL};
+   struct pollfd asPoll[2];
+   sigset_t sSet;
+   sigset_t sOldSet;
+   Arena_T oArena;
+   int iSignalFd;
+
+   /* Leave the shell's process group, so that the keys that signal
+      the foreground job at a terminal never stop or kill the
+      server */
+   (void)setpgid(0, 0);
+
+   if (sigemptyset(&sSet) == -1 || sigaddset(&sSet, SIGCHLD) == -1
+       || sigprocmask(SIG_BLOCK, &sSet, &sOldSet) == -1)
+      _exit(EXIT_FAILURE);
+   if (! sigismember(&sOldSet, SIGCHLD))
+      Spawn_setChildMask(&sOldSet);
+
+   /* The environment comes with the requests, as environ */
+   Spawn_setVars(NULL);
+   sEnv.ppcEnv = environ;
+   iSignalFd = ShellFd_move(
+      signalfd(-1, &sSet, SFD_NONBLOCK | SFD_CLOEXEC));
+   if (iSignalFd == -1)
+      _exit(EXIT_FAILURE);
+   oArena = Arena_new();
+
+   for (;;)
+   {
+      asPoll[0].fd = iSocket;
+      asPoll[0].events = POLLIN;
+      if (sOutbox.uSent < sOutbox.uLength)
+         asPoll[0].events |= POLLOUT;
+      asPoll[1].fd = iSignalFd;
+      asPoll[1].events = POLLIN;
+      if (poll(asPoll, 2, -1) == -1)
+      {
+         if (errno == EINTR)
+            continue;
+         _exit(EXIT_FAILURE);
+      }
+
+      if (asPoll[1].revents & POLLIN)
+         ForkServer_reapChildren(iSignalFd, &sOutbox);
+      if (asPoll[0].revents & (POLLIN | POLLHUP | POLLERR))
+         ForkServer_handleRequest(iSocket, oArena, &sEnv, &sOutbox);
+      ForkServer_flush(iSocket, &sOutbox);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Start a fork server and return it.  The server receives SIGCHLD
+   through a signalfd of its own; if SIGCHLD is not already blocked,
+   the processes it starts get the signal mask from before it was.
+   The caller owns the server. */
+
+ForkServer_T ForkServer_new(void)
+{
+   ForkServer_T oServer;
+   int aiSockets[2];
+
+   oServer = (ForkServer_T)malloc(sizeof(struct ForkServer));
+   if (oServer == NULL) {perror(getPgmName()); exit(EXIT_FAILURE); }
+   oServer->pcBuffer = (char*)malloc(INITIAL_PHYS_BUFFER);
+   oServer->psExits = (struct ServerMessage*)malloc(
+      INITIAL_PHYS_EXITS * sizeof(struct ServerMessage));
+   if (oServer->pcBuffer == NULL || oServer->psExits == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE); }
+   oServer->uLength = 0;
+   oServer->uPhysLength = INITIAL_PHYS_BUFFER;
+   oServer->uFirstExit = 0;
+   oServer->uExits = 0;
+   oServer->uPhysExits = INITIAL_PHYS_EXITS;
+   oServer->ulEnvGeneration = 0;
+   oServer->iLost = 0;
+
+   if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, aiSockets)
+       == -1)
+   {perror(getPgmName()); exit(EXIT_FAILURE); }
+
+   oServer->iPid = fork();
+   if (oServer->iPid == -1) {perror(getPgmName()); exit(EXIT_FAILURE); }
+   if (oServer->iPid == 0)
+   {
+      (void)close(aiSockets[0]);
+      aiSockets[1] = ShellFd_move(aiSockets[1]);
+      if (aiSockets[1] == -1)
+         _exit(EXIT_FAILURE);
+      ForkServer_serve(aiSockets[1]);
+   }
+
+   (void)close(aiSockets[1]);
+   oServer->iSocket = ShellFd_move(aiSockets[0]);
+   if (oServer->iSocket == -1) {perror(getPgmName()); exit(EXIT_FAILURE); }
+   return oServer;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Stop oServer, which exits once it sees that its socket is closed,
+   and wait for it.  The processes that it started keep running. */
+
+void ForkServer_free(ForkServer_T oServer)
+{
+   pid_t iRet;
+
+   if (oServer == NULL)
+      return;
+
+   (void)close(oServer->iSocket);
+   if (! oServer->iLost)
+   {
+      do
+         iRet = waitpid(oServer->iPid, NULL, 0);
+      while (iRet == -1 && errno == EINTR);
+   }
+   free(oServer->pcBuffer);
+   free(oServer->psExits);
+   free(oServer);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the descriptor of the socket of oServer, which is readable
+   when an exit status has arrived. */
+
+int ForkServer_getFd(ForkServer_T oServer)
+{
+   assert(oServer != NULL);
+   return oServer->iSocket;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 if oServer has died, or 0 otherwise. */
+
+int ForkServer_isLost(ForkServer_T oServer)
+{
+   assert(oServer != NULL);
+   return oServer->iLost;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Handle the failure of a send to or a receive from oServer, whose
+   errno is set.  If the server has died, which shows as ECONNRESET
+   or EPIPE, warn once, wait for it, and mark it lost.  Exit on any
+   other failure. */
+
+static void ForkServer_fail(ForkServer_T oServer)
+{
+   pid_t iRet;
+
+   if (errno != ECONNRESET && errno != EPIPE)
+   {perror(getPgmName()); exit(EXIT_FAILURE); }
+   if (oServer->iLost)
+      return;
+
+   fprintf(stderr, "%s: the fork server died; the exit statuses of "
+           "its processes are lost\n", getPgmName());
+   do
+      iRet = waitpid(oServer->iPid, NULL, 0);
+   while (iRet == -1 && errno == EINTR);
+   oServer->iLost = 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Append the uLength bytes at pv to the request being built in
+   oServer. */
+
+static void ForkServer_append(ForkServer_T oServer, const void *pv,
+                              size_t uLength)
+{
+   size_t uPhysLength;
+   char *pcBuffer;
+
+   if (oServer->uLength + uLength > oServer->uPhysLength)
+   {
+      uPhysLength = oServer->uPhysLength;
+      while (oServer->uLength + uLength > uPhysLength)
+         uPhysLength *= 2;
+      pcBuffer = (char*)realloc(oServer->pcBuffer, uPhysLength);
+      if (pcBuffer == NULL) {perror(getPgmName()); exit(EXIT_FAILURE); }
+      oServer->pcBuffer = pcBuffer;
+      oServer->uPhysLength = uPhysLength;
+   }
+   memcpy(oServer->pcBuffer + oServer->uLength, pv, uLength);
+   oServer->uLength += uLength;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Append string pc, with its null character, to the request being
+   built in oServer. */
+
+static void ForkServer_appendString(ForkServer_T oServer,
+                                    const char *pc)
+{
+   ForkServer_append(oServer, pc, strlen(pc) + 1);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Send *psRequest and the request built in oServer to the server,
+   with the descriptors aiFds[0..REQUEST_FD_COUNT).  Return 0, or -1
+   if the server has died. */
+
+static int ForkServer_send(ForkServer_T oServer,
+                            const struct ServerRequest *psRequest,
+                            const int aiFds[])
+{
+   union
+   {
+      char ac[CMSG_SPACE(REQUEST_FD_COUNT * sizeof(int))];
+      struct cmsghdr sAlign;
+   } uControl;
+   struct msghdr sHeader;
+   struct iovec asVectors[2];
+   struct cmsghdr *psControl;
+   ssize_t iSent;
+   size_t uSent;
+   int iRet = 0;
+
+   asVectors[0].iov_base = (void*)psRequest;
+   asVectors[0].iov_len = sizeof(struct ServerRequest);
+   asVectors[1].iov_base = oServer->pcBuffer;
+   asVectors[1].iov_len = oServer->uLength;
+
+   memset(&sHeader, 0, sizeof(sHeader));
+   memset(&uControl, 0, sizeof(uControl));
+   sHeader.msg_iov = asVectors;
+   sHeader.msg_iovlen = 2;
+   sHeader.msg_control = uControl.ac;
+   sHeader.msg_controllen = sizeof(uControl.ac);
+   psControl = CMSG_FIRSTHDR(&sHeader);
+   psControl->cmsg_level = SOL_SOCKET;
+   psControl->cmsg_type = SCM_RIGHTS;
+   psControl->cmsg_len = CMSG_LEN(REQUEST_FD_COUNT * sizeof(int));
+   memcpy(CMSG_DATA(psControl), aiFds, REQUEST_FD_COUNT * sizeof(int));
+
+   do
+      iSent = sendmsg(oServer->iSocket, &sHeader, MSG_NOSIGNAL);
+   while (iSent == -1 && errno == EINTR);
+   if (iSent == -1)
+   {
+      ForkServer_fail(oServer);
+      return -1;
+   }
+
+   /* A large request may go in pieces; the descriptors went with the
+      first */
+   uSent = (size_t)iSent;
+   if (uSent < sizeof(struct ServerRequest))
+   {
+      iRet = ForkServer_sendAll(oServer->iSocket,
+                                (const char*)psRequest + uSent,
+                                sizeof(struct ServerRequest) - uSent);
+      uSent = sizeof(struct ServerRequest);
+   }
+   uSent -= sizeof(struct ServerRequest);
+   if (iRet == 0)
+      iRet = ForkServer_sendAll(oServer->iSocket,
+                                oServer->pcBuffer + uSent,
+                                oServer->uLength - uSent);
+   if (iRet == -1)
+      ForkServer_fail(oServer);
+   return iRet;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Keep the exit message *psMessage in oServer until
+   ForkServer_readExit() returns it. */
+
+static void ForkServer_keepExit(ForkServer_T oServer,
+                                const struct ServerMessage *psMessage)
+{
+   struct ServerMessage *psExits;
+   size_t uPhysExits;
+
+   if (oServer->uFirstExit + oServer->uExits == oServer->uPhysExits)
+   {
+      if (oServer->uFirstExit > 0)
+      {
+         memmove(oServer->psExits,
+                 oServer->psExits + oServer->uFirstExit,
+                 oServer->uExits * sizeof(struct ServerMessage));
+         oServer->uFirstExit = 0;
+      }
+      else
+      {
+         uPhysExits = oServer->uPhysExits * 2;
+         psExits = (struct ServerMessage*)realloc(oServer->psExits,
+            uPhysExits * sizeof(struct ServerMessage));
+         if (psExits == NULL)
+         {perror(getPgmName()); exit(EXIT_FAILURE); }
+         oServer->psExits = psExits;
+         oServer->uPhysExits = uPhysExits;
+      }
+   }
+   oServer->psExits[oServer->uFirstExit + oServer->uExits] = *psMessage;
+   oServer->uExits++;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Read the next message from oServer into *psMessage and return 1.
+   If iWait is 0 and none has arrived, return 0 at once.  Return -1 if
+   the server has died. */
+
+static int ForkServer_readMessage(ForkServer_T oServer,
+                                  struct ServerMessage *psMessage,
+                                  int iWait)
+{
+   int iRet;
+
+   if (oServer->iLost)
+      return -1;
+   iRet = ForkServer_receive(oServer->iSocket, psMessage,
+                             sizeof(struct ServerMessage), iWait);
+   if (iRet == -1)
+      ForkServer_fail(oServer);
+   return iRet;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Ask oServer to start a process that runs oCommand as
+   spawnCommand() does with SPAWN_POSIX, from the current directory
+   of the shell and with the environment ppcEnvp.  The stdin and
+   stdout of the process are iInFd and iOutFd, and its stderr is that
+   of the shell.  If ulEnvGeneration is not 0, it is the generation of
+   ppcEnvp, as VarTable_getGeneration() returns it, and the
+   environment is sent to the server only when that differs from the
+   one of the last request.  Return the process ID of the process,
+   which the caller must wait for with ForkServer_readExit(), or -1
+   with errno set if it could not be started.  If oServer has died,
+   errno is ECONNRESET, and a process whose request reached the server
+   before it died may have been started. */
+
+pid_t ForkServer_spawn(ForkServer_T oServer, Command_T oCommand,
+                       const char *pcFile, int iInFd, int iOutFd,
+                       pid_t iPgid, char **ppcEnvp,
+                       unsigned long ulEnvGeneration)
+{
+   const struct Redirect *psRedirects;
+   struct RequestRedirect sRecord;
+   struct ServerRequest sRequest;
+   struct ServerMessage sMessage;
+   int aiFds[REQUEST_FD_COUNT];
+   char **ppc;
+   size_t u;
+   int iRet;
+
+   assert(oServer != NULL);
+   assert(oCommand != NULL);
+   assert(pcFile != NULL);
+   assert(ppcEnvp != NULL);
+
+   if (oServer->iLost)
+   {
+      errno = ECONNRESET;
+      return -1;
+   }
+
+   oServer->uLength = 0;
+   memset(&sRequest, 0, sizeof(sRequest));
+   psRedirects = Command_getRedirects(oCommand);
+   sRequest.uRedirects = Command_getRedirectCount(oCommand);
+   memset(&sRecord, 0, sizeof(sRecord));
+   for (u = 0; u < sRequest.uRedirects; u++)
+   {
+      sRecord.iFd = psRedirects[u].iFd;
+      sRecord.iKind = (int)psRedirects[u].eKind;
+      sRecord.iSourceFd = psRedirects[u].iSourceFd;
+      sRecord.iHasBody = (psRedirects[u].pcBody != NULL);
+      ForkServer_append(oServer, &sRecord, sizeof(sRecord));
+   }
+
+   ForkServer_appendString(oServer, pcFile);
+   sRequest.uArgc = 0;
+   for (ppc = Command_getArgv(oCommand); *ppc != NULL; ppc++)
+   {
+      ForkServer_appendString(oServer, *ppc);
+      sRequest.uArgc++;
+   }
+   /* The server keeps the environment from one request to the next */
+   sRequest.iSameEnv = (ulEnvGeneration != 0
+                        && ulEnvGeneration == oServer->ulEnvGeneration);
+   sRequest.uEnvc = 0;
+   if (! sRequest.iSameEnv)
+      for (ppc = ppcEnvp; *ppc != NULL; ppc++)
+      {
+         ForkServer_appendString(oServer, *ppc);
+         sRequest.uEnvc++;
+      }
+   for (u = 0; u < sRequest.uRedirects; u++)
+   {
+      ForkServer_appendString(oServer, psRedirects[u].pcWord);
+      if (psRedirects[u].pcBody != NULL)
+         ForkServer_appendString(oServer, psRedirects[u].pcBody);
+   }
+
+   /* The server is in a group of its own, so staying in the shell's
+      group means joining it */
+   sRequest.uLength = oServer->uLength;
+   sRequest.iPgid = (iPgid == -1) ? getpgrp() : iPgid;
+
+   aiFds[FD_CWD] = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+   if (aiFds[FD_CWD] == -1)
+      return -1;
+   aiFds[FD_IN] = iInFd;
+   aiFds[FD_OUT] = iOutFd;
+   aiFds[FD_ERR] = STDERR_FILENO;
+   iRet = ForkServer_send(oServer, &sRequest, aiFds);
+   (void)close(aiFds[FD_CWD]);
+   if (iRet == -1)
+   {
+      errno = ECONNRESET;
+      return -1;
+   }
+   oServer->ulEnvGeneration = ulEnvGeneration;
+
+   /* Keep the exits that arrive before the reply */
+   for (;;)
+   {
+      if (ForkServer_readMessage(oServer, &sMessage, 1) == -1)
+      {
+         errno = ECONNRESET;
+         return -1;
+      }
+      if (sMessage.iType == MESSAGE_REPLY)
+         break;
+      ForkServer_keepExit(oServer, &sMessage);
+   }
+
+   if (sMessage.iPid == -1)
+      errno = sMessage.iValue;
+   return sMessage.iPid;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *piPid, *piStatus and *psRusage the process ID, the wait
+   status, and the resources used of a process that oServer started
+   and that has exited, and return 1.  If none has exited, return 0,
+   or wait for one if iWait.  Return 0 at once if oServer has died,
+   as no exit can arrive from it then. */
+
+int ForkServer_readExit(ForkServer_T oServer, int iWait, pid_t *piPid,
+                        int *piStatus, struct rusage *psRusage)
+{
+   struct ServerMessage sMessage;
+
+   assert(oServer != NULL);
+   assert(piPid != NULL);
+   assert(piStatus != NULL);
+   assert(psRusage != NULL);
+
+   if (oServer->uExits > 0)
+   {
+      sMessage = oServer->psExits[oServer->uFirstExit];
+      oServer->uFirstExit++;
+      oServer->uExits--;
+      if (oServer->uExits == 0)
+         oServer->uFirstExit = 0;
+   }
+   else if (ForkServer_readMessage(oServer, &sMessage, iWait) != 1)
+      return 0;
+
+   /* Only a request is answered with a reply */
+   assert(sMessage.iType == MESSAGE_EXIT);
+   *piPid = sMessage.iPid;
+   *piStatus = sMessage.iValue;
+   *psRusage = sMessage.sRusage;
+   return 1;
+}
@@ -0,0 +1,96 @@
+/*--------------------------------------------------------------------*/
+/* forkserver.h                                                       */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef FORKSERVER_INCLUDED
+#define FORKSERVER_INCLUDED
+
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "command.h"
+
+/*--------------------------------------------------------------------*/
+
+/* A ForkServer_T object is a helper process that starts the
+   processes of commands for the shell.  It is forked when the shell
+   starts, while the shell is still small, and then only waits on a
+   socket for requests, so its address space stays as small as it
+   was; starting a process from it costs the same however large the
+   shell grows.  Each request carries the command, the environment
+   unless it is unchanged, and the descriptors the command needs;
+   the server starts the process, replies with its process ID, and
+   later sends its exit status and the resources it used over the
+   same socket.  The processes are children of the server, not of
+   the shell.
+
+   If the server dies, from a signal or for lack of memory, the shell
+   sees its socket reset: it warns once and marks the server lost.
+   The exit statuses of the processes that the server started can no
+   longer arrive, and no request is sent to it again. */
+
+typedef struct ForkServer *ForkServer_T;
+
+/*--------------------------------------------------------------------*/
+
+/* Start a fork server and return it.  The server receives SIGCHLD
+   through a signalfd of its own; if SIGCHLD is not already blocked,
+   the processes it starts get the signal mask from before it was.
+   The caller owns the server. */
+
+ForkServer_T ForkServer_new(void);
+
+/*--------------------------------------------------------------------*/
+
+/* Stop oServer, which exits once it sees that its socket is closed,
+   and wait for it.  The processes that it started keep running. */
+
+void ForkServer_free(ForkServer_T oServer);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the descriptor of the socket of oServer, which is readable
+   when an exit status has arrived. */
+
+int ForkServer_getFd(ForkServer_T oServer);
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 if oServer has died, or 0 otherwise. */
+
+int ForkServer_isLost(ForkServer_T oServer);
+
+/*--------------------------------------------------------------------*/
+
+/* Ask oServer to start a process that runs oCommand as
+   spawnCommand() does with SPAWN_POSIX, from the current directory
+   of the shell and with the environment ppcEnvp.  The stdin and
+   stdout of the process are iInFd and iOutFd, and its stderr is that
+   of the shell.  If ulEnvGeneration is not 0, it is the generation of
+   ppcEnvp, as VarTable_getGeneration() returns it, and the
+   environment is sent to the server only when that differs from the
+   one of the last request.  Return the process ID of the process,
+   which the caller must wait for with ForkServer_readExit(), or -1
+   with errno set if it could not be started.  If oServer has died,
+   errno is ECONNRESET, and a process whose request reached the server
+   before it died may have been started. */
+
+pid_t ForkServer_spawn(ForkServer_T oServer, Command_T oCommand,
+                       const char *pcFile, int iInFd, int iOutFd,
+                       pid_t iPgid, char **ppcEnvp,
+                       unsigned long ulEnvGeneration);
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *piPid, *piStatus and *psRusage the process ID, the wait
+   status, and the resources used of a process that oServer started
+   and that has exited, and return 1.  If none has exited, return 0,
+   or wait for one if iWait.  Return 0 at once if oServer has died,
+   as no exit can arrive from it then. */
+
+int ForkServer_readExit(ForkServer_T oServer, int iWait, pid_t *piPid,
+                        int *piStatus, struct rusage *psRusage);
+
+/*--------------------------------------------------------------------*/
+
+#endif
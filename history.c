@@ -0,0 +1,813 @@
+/*--------------------------------------------------------------------*/
+/* history.c                                                          */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#include "history.h"
+#include "shellfd.h"
+#include "ish.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The first bytes of every index, and the version of its format,
+   which must change whenever the format does. */
+static const char acIndexMagic[4] = {'I', 'S', 'H', 'H'};
+enum {INDEX_VERSION = 1};
+
+/* The most entries that are left out of the index before it is
+   written again.  They are sorted in memory, and sorted again after
+   each new line, so the limit bounds that cost. */
+enum {TAIL_LIMIT = 4096};
+
+/* The number of entries that the array of entries left out of the
+   index starts with room for, and the factor by which it grows. */
+enum {INITIAL_PHYS_TAIL = 64};
+enum {GROWTH_FACTOR = 2};
+
+/*--------------------------------------------------------------------*/
+
+/* An index begins with an IndexHeader, which is followed by its
+   IndexEntries. */
+
+struct IndexHeader
+{
+   /* acIndexMagic and INDEX_VERSION. */
+   char acMagic[4];
+   uint32_t uiVersion;
+
+   /* The device and inode of the history file, which the index is
+      only of. */
+   uint64_t ulDev;
+   uint64_t ulIno;
+
+   /* The number of bytes at the start of the history file whose
+      entries the index holds, and the number of those entries. */
+   uint64_t ulLength;
+   uint64_t ulCount;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* An IndexEntry is an entry of a history file: the offset of its
+   line in the file, and its number.  The entries of an index are in
+   the order of the texts of their lines, and of their offsets among
+   lines of the same text. */
+
+struct IndexEntry
+{
+   uint64_t ulOffset;
+   uint64_t ulNumber;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A History is a history file, mapped into memory, its index, and
+   its entries that the index does not hold. */
+
+struct History
+{
+   /* The name of the history file, and of its index. */
+   char *pcFile;
+   char *pcIndex;
+
+   /* The history file, opened for appending, and its device and
+      inode. */
+   int iFd;
+   dev_t iDev;
+   ino_t iIno;
+
+   /* The mapping of the history file, of uMapLength bytes, of which
+      the first uLength are whole lines. */
+   char *pcText;
+   size_t uMapLength;
+   size_t uLength;
+
+   /* The index, of uIndexSize bytes, which is mapped if iIndexMapped
+      and allocated otherwise, or NULL; its uIndexed entries, which
+      are of the first uIndexedLength bytes of the history file. */
+   void *pvIndex;
+   size_t uIndexSize;
+   int iIndexMapped;
+   const struct IndexEntry *psIndexed;
+   size_t uIndexed;
+   size_t uIndexedLength;
+
+   /* The uTail entries after those of the index, with room for
+      uPhysTail, and 1 iff they are in the order of an index. */
+   struct IndexEntry *psTail;
+   size_t uTail;
+   size_t uPhysTail;
+   int iTailSorted;
+
+   /* The number of entries. */
+   size_t uCount;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Compare the lines at pc1 and pc2, each ended by a newline, as
+   strcmp() compares strings. */
+
+static int History_compareLines(const char *pc1, const char *pc2)
+{
+   while (*pc1 == *pc2 && *pc1 != '\n')
+   {
+      pc1++;
+      pc2++;
+   }
+   if (*pc1 == *pc2)
+      return 0;
+   if (*pc1 == '\n')
+      return -1;
+   if (*pc2 == '\n')
+      return 1;
+   return (unsigned char)*pc1 < (unsigned char)*pc2 ? -1 : 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Compare the line at pcLine, ended by a newline, with string
+   pcPrefix: return 0 if the line begins with pcPrefix, and otherwise
+   compare them as strcmp() would. */
+
+static int History_comparePrefix(const char *pcLine, const char *pcPrefix)
+{
+   while (*pcPrefix != '\0' && *pcLine == *pcPrefix)
+   {
+      pcLine++;
+      pcPrefix++;
+   }
+   if (*pcPrefix == '\0')
+      return 0;
+   if (*pcLine == '\n')
+      return -1;
+   return (unsigned char)*pcLine < (unsigned char)*pcPrefix ? -1 : 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* The text of the history file whose entries qsort() is sorting.
+   qsort() passes its comparison function nothing else. */
+
+static const char *pcSortText;
+
+/*--------------------------------------------------------------------*/
+
+/* Compare the IndexEntries of pcSortText at pv1 and pv2 in the order
+   of an index, as qsort() requires. */
+
+static int History_compareEntries(const void *pv1, const void *pv2)
+{
+   const struct IndexEntry *psEntry1 = (const struct IndexEntry*)pv1;
+   const struct IndexEntry *psEntry2 = (const struct IndexEntry*)pv2;
+   int iCompare;
+
+   iCompare = History_compareLines(pcSortText + psEntry1->ulOffset,
+                                   pcSortText + psEntry2->ulOffset);
+   if (iCompare != 0)
+      return iCompare;
+   return (psEntry1->ulOffset < psEntry2->ulOffset) ? -1 : 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Forget the index of oHistory. */
+
+static void History_dropIndex(History_T oHistory)
+{
+   if (oHistory->pvIndex != NULL)
+   {
+      if (oHistory->iIndexMapped)
+         munmap(oHistory->pvIndex, oHistory->uIndexSize);
+      else
+         free(oHistory->pvIndex);
+   }
+   oHistory->pvIndex = NULL;
+   oHistory->uIndexSize = 0;
+   oHistory->psIndexed = NULL;
+   oHistory->uIndexed = 0;
+   oHistory->uIndexedLength = 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make the uIndexSize bytes at pvIndex, which hold an index, the
+   index of oHistory, if it is an index of whole lines at the start
+   of the mapping of the history file of oHistory.  Return 0, or -1
+   if it is not. */
+
+static int History_useIndex(History_T oHistory, void *pvIndex,
+                            size_t uIndexSize, int iIndexMapped)
+{
+   const struct IndexHeader *psHeader;
+   const struct IndexEntry *psEntries;
+   size_t u;
+
+   if (uIndexSize < sizeof(struct IndexHeader))
+      return -1;
+   psHeader = (const struct IndexHeader*)pvIndex;
+   if (memcmp(psHeader->acMagic, acIndexMagic, sizeof(acIndexMagic))
+       != 0
+       || psHeader->uiVersion != INDEX_VERSION
+       || psHeader->ulDev != (uint64_t)oHistory->iDev
+       || psHeader->ulIno != (uint64_t)oHistory->iIno
+       || psHeader->ulLength > oHistory->uMapLength
+       || psHeader->ulCount > (uIndexSize - sizeof(struct IndexHeader))
+          / sizeof(struct IndexEntry)
+       || uIndexSize != sizeof(struct IndexHeader)
+          + psHeader->ulCount * sizeof(struct IndexEntry))
+      return -1;
+   if (psHeader->ulLength > 0
+       && oHistory->pcText[psHeader->ulLength - 1] != '\n')
+      return -1;
+
+   /* Every line that the index names must be within the whole lines
+      that it is of */
+   psEntries = (const struct IndexEntry*)(psHeader + 1);
+   for (u = 0; u < psHeader->ulCount; u++)
+      if (psEntries[u].ulOffset >= psHeader->ulLength)
+         return -1;
+
+   History_dropIndex(oHistory);
+   oHistory->pvIndex = pvIndex;
+   oHistory->uIndexSize = uIndexSize;
+   oHistory->iIndexMapped = iIndexMapped;
+   oHistory->psIndexed = psEntries;
+   oHistory->uIndexed = (size_t)psHeader->ulCount;
+   oHistory->uIndexedLength = (size_t)psHeader->ulLength;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Map the index file of oHistory and make it the index of oHistory.
+   Return 0, or -1 if there is none that will do. */
+
+static int History_loadIndex(History_T oHistory)
+{
+   struct stat sStat;
+   void *pvIndex;
+   int iFd;
+
+   iFd = open(oHistory->pcIndex, O_RDONLY | O_CLOEXEC);
+   if (iFd == -1)
+      return -1;
+   if (fstat(iFd, &sStat) == -1 || sStat.st_size == 0)
+   {
+      close(iFd);
+      return -1;
+   }
+   pvIndex = mmap(NULL, (size_t)sStat.st_size, PROT_READ, MAP_SHARED,
+                  iFd, 0);
+   close(iFd);
+   if (pvIndex == MAP_FAILED)
+      return -1;
+   if (History_useIndex(oHistory, pvIndex, (size_t)sStat.st_size, 1)
+       == -1)
+   {
+      munmap(pvIndex, (size_t)sStat.st_size);
+      return -1;
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write the uLength bytes at pcData to file descriptor iFd.  Return
+   0, or -1 with errno set. */
+
+static int History_writeAll(int iFd, const char *pcData, size_t uLength)
+{
+   ssize_t lWritten;
+
+   while (uLength > 0)
+   {
+      lWritten = write(iFd, pcData, uLength);
+      if (lWritten == -1)
+      {
+         if (errno == EINTR)
+            continue;
+         return -1;
+      }
+      pcData += lWritten;
+      uLength -= (size_t)lWritten;
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write the uLength bytes at pcData to a new file that then replaces
+   the index file of oHistory, so that a shell loading the index
+   never sees it half written.  Return 0, or -1 if it cannot. */
+
+static int History_writeFile(History_T oHistory, const char *pcData,
+                             size_t uLength)
+{
+   char *pcTemp;
+   int iFd;
+   int iRet;
+
+   pcTemp = (char*)malloc(strlen(oHistory->pcIndex)
+                          + sizeof(".XXXXXX"));
+   if (pcTemp == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+   strcpy(pcTemp, oHistory->pcIndex);
+   strcat(pcTemp, ".XXXXXX");
+
+   iFd = mkstemp(pcTemp);
+   if (iFd == -1)
+   {
+      free(pcTemp);
+      return -1;
+   }
+   iRet = History_writeAll(iFd, pcData, uLength);
+   if (close(iFd) == -1)
+      iRet = -1;
+   if (iRet == 0)
+      iRet = rename(pcTemp, oHistory->pcIndex);
+   if (iRet == -1)
+      unlink(pcTemp);
+   free(pcTemp);
+   return iRet;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Sort the entries that the index of oHistory leaves out, if they
+   are not sorted. */
+
+static void History_sortTail(History_T oHistory)
+{
+   if (oHistory->iTailSorted)
+      return;
+   pcSortText = oHistory->pcText;
+   qsort(oHistory->psTail, oHistory->uTail, sizeof(struct IndexEntry),
+         History_compareEntries);
+   oHistory->iTailSorted = 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Merge the entries that the index of oHistory leaves out into a new
+   index of all of its entries, write it to its index file, and make
+   it the index of oHistory.  If the index file cannot be written,
+   the new index is kept in memory only, and if even that will not
+   do, the old index and the entries it leaves out are kept. */
+
+static void History_writeIndex(History_T oHistory)
+{
+   struct IndexHeader *psHeader;
+   struct IndexEntry *psEntries;
+   size_t uIndexSize;
+   size_t uIndexed = 0;
+   size_t uTail = 0;
+   size_t u = 0;
+
+   History_sortTail(oHistory);
+   uIndexSize = sizeof(struct IndexHeader)
+      + oHistory->uCount * sizeof(struct IndexEntry);
+   psHeader = (struct IndexHeader*)malloc(uIndexSize);
+   if (psHeader == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+   memcpy(psHeader->acMagic, acIndexMagic, sizeof(acIndexMagic));
+   psHeader->uiVersion = INDEX_VERSION;
+   psHeader->ulDev = (uint64_t)oHistory->iDev;
+   psHeader->ulIno = (uint64_t)oHistory->iIno;
+   psHeader->ulLength = (uint64_t)oHistory->uLength;
+   psHeader->ulCount = (uint64_t)oHistory->uCount;
+
+   /* Both are in the order of an index already */
+   pcSortText = oHistory->pcText;
+   psEntries = (struct IndexEntry*)(psHeader + 1);
+   while (uIndexed < oHistory->uIndexed || uTail < oHistory->uTail)
+   {
+      if (uTail == oHistory->uTail
+          || (uIndexed < oHistory->uIndexed
+              && History_compareEntries(
+                    &oHistory->psIndexed[uIndexed],
+                    &oHistory->psTail[uTail]) < 0))
+         psEntries[u++] = oHistory->psIndexed[uIndexed++];
+      else
+         psEntries[u++] = oHistory->psTail[uTail++];
+   }
+   assert(u == oHistory->uCount);
+
+   if (History_writeFile(oHistory, (const char*)psHeader, uIndexSize)
+       == 0 && History_loadIndex(oHistory) == 0)
+   {
+      free(psHeader);
+      oHistory->uTail = 0;
+      return;
+   }
+   if (History_useIndex(oHistory, psHeader, uIndexSize, 0) == -1)
+   {
+      free(psHeader);
+      return;
+   }
+   oHistory->uTail = 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Add the entries of the lines that have been appended to the
+   history file of oHistory since it was last mapped, mapping it
+   again, and write a new index if too many are left out of it.
+   If the file has shrunk, forget every entry and add them all
+   again.  Return 0, or -1 with errno set if the file cannot be
+   mapped. */
+
+static int History_refresh(History_T oHistory)
+{
+   struct IndexEntry *psTail;
+   struct stat sStat;
+   const char *pcNewline;
+   size_t uOffset;
+
+   if (fstat(oHistory->iFd, &sStat) == -1)
+      return -1;
+   if ((size_t)sStat.st_size < oHistory->uLength)
+   {
+      History_dropIndex(oHistory);
+      oHistory->uLength = 0;
+      oHistory->uTail = 0;
+      oHistory->uCount = 0;
+   }
+
+   if ((size_t)sStat.st_size != oHistory->uMapLength)
+   {
+      if (oHistory->pcText != NULL)
+         munmap(oHistory->pcText, oHistory->uMapLength);
+      oHistory->pcText = NULL;
+      oHistory->uMapLength = 0;
+      if (sStat.st_size > 0)
+      {
+         oHistory->pcText = (char*)mmap(NULL, (size_t)sStat.st_size,
+                                        PROT_READ, MAP_SHARED,
+                                        oHistory->iFd, 0);
+         if (oHistory->pcText == MAP_FAILED)
+         {
+            oHistory->pcText = NULL;
+            oHistory->uLength = 0;
+            oHistory->uTail = 0;
+            oHistory->uCount = 0;
+            History_dropIndex(oHistory);
+            return -1;
+         }
+         oHistory->uMapLength = (size_t)sStat.st_size;
+      }
+   }
+
+   /* Start from the index file, if there is one that will do */
+   if (oHistory->uLength == 0)
+   {
+      if (History_loadIndex(oHistory) == 0)
+      {
+         oHistory->uLength = oHistory->uIndexedLength;
+         oHistory->uCount = oHistory->uIndexed;
+      }
+   }
+
+   /* Add an entry for each whole line after those already known */
+   uOffset = oHistory->uLength;
+   while (uOffset < oHistory->uMapLength)
+   {
+      pcNewline = (const char*)memchr(oHistory->pcText + uOffset, '\n',
+                                      oHistory->uMapLength - uOffset);
+      if (pcNewline == NULL)
+         break;
+      if (oHistory->uTail == oHistory->uPhysTail)
+      {
+         oHistory->uPhysTail *= GROWTH_FACTOR;
+         psTail = (struct IndexEntry*)realloc(oHistory->psTail,
+            oHistory->uPhysTail * sizeof(struct IndexEntry));
+         if (psTail == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+         oHistory->psTail = psTail;
+      }
+      oHistory->psTail[oHistory->uTail].ulOffset = uOffset;
+      oHistory->psTail[oHistory->uTail].ulNumber = ++oHistory->uCount;
+      oHistory->uTail++;
+      oHistory->iTailSorted = 0;
+      uOffset = (size_t)(pcNewline - oHistory->pcText) + 1;
+   }
+   oHistory->uLength = uOffset;
+
+   if (oHistory->uTail > TAIL_LIMIT)
+      History_writeIndex(oHistory);
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Open the history file named pcFile, creating it if need be, and
+   return a History of it.  If the index of the file is missing, is
+   not of that file, or leaves too many lines out, write a new one.
+   If the file cannot be opened or mapped, write a message to stderr
+   and return NULL.  The caller owns the History. */
+
+History_T History_open(const char *pcFile)
+{
+   struct History *psHistory;
+   struct stat sStat;
+   int iFd;
+
+   assert(pcFile != NULL);
+
+   iFd = ShellFd_move(
+      open(pcFile, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600));
+   if (iFd == -1) {perror(pcFile); return NULL;}
+   if (fstat(iFd, &sStat) == -1) {perror(pcFile); close(iFd); return NULL;}
+
+   psHistory = (struct History*)calloc(1, sizeof(struct History));
+   if (psHistory == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+   psHistory->pcFile = (char*)malloc(strlen(pcFile) + 1);
+   psHistory->pcIndex = (char*)malloc(strlen(pcFile) + sizeof(".idx"));
+   psHistory->uPhysTail = INITIAL_PHYS_TAIL;
+   psHistory->psTail = (struct IndexEntry*)malloc(
+      psHistory->uPhysTail * sizeof(struct IndexEntry));
+   if (psHistory->pcFile == NULL || psHistory->pcIndex == NULL
+       || psHistory->psTail == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE);}
+   strcpy(psHistory->pcFile, pcFile);
+   strcpy(psHistory->pcIndex, pcFile);
+   strcat(psHistory->pcIndex, ".idx");
+   psHistory->iFd = iFd;
+   psHistory->iDev = sStat.st_dev;
+   psHistory->iIno = sStat.st_ino;
+   psHistory->iTailSorted = 1;
+
+   if (History_refresh(psHistory) == -1)
+   {
+      perror(pcFile);
+      History_free(psHistory);
+      return NULL;
+   }
+   return psHistory;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Close oHistory. */
+
+void History_free(History_T oHistory)
+{
+   assert(oHistory != NULL);
+
+   History_dropIndex(oHistory);
+   if (oHistory->pcText != NULL)
+      munmap(oHistory->pcText, oHistory->uMapLength);
+   close(oHistory->iFd);
+   free(oHistory->psTail);
+   free(oHistory->pcIndex);
+   free(oHistory->pcFile);
+   free(oHistory);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Append the uLength characters at pcLine, which must contain no
+   newline, to the file of oHistory as its newest entry, in a single
+   write, so that the entries of shells sharing the file are never
+   mixed.  Return 0, or -1 with errno set if it cannot be written. */
+
+int History_add(History_T oHistory, const char *pcLine, size_t uLength)
+{
+   struct iovec asParts[2];
+   ssize_t lWritten;
+
+   assert(oHistory != NULL);
+   assert(pcLine != NULL);
+   assert(memchr(pcLine, '\n', uLength) == NULL);
+
+   asParts[0].iov_base = (void*)pcLine;
+   asParts[0].iov_len = uLength;
+   asParts[1].iov_base = (void*)"\n";
+   asParts[1].iov_len = 1;
+   do
+      lWritten = writev(oHistory->iFd, asParts, 2);
+   while (lWritten == -1 && errno == EINTR);
+   if (lWritten == -1)
+      return -1;
+   if ((size_t)lWritten != uLength + 1)
+   {
+      errno = ENOSPC;
+      return -1;
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of entries of oHistory, including those that
+   other shells have added to its file. */
+
+size_t History_getCount(History_T oHistory)
+{
+   assert(oHistory != NULL);
+
+   (void)History_refresh(oHistory);
+   return oHistory->uCount;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Apply pfApply to each entry of oHistory numbered uFirst or more,
+   oldest first.  Only the entries from uFirst on are read. */
+
+void History_map(History_T oHistory, size_t uFirst,
+                 HistoryFunc_T pfApply, void *pvExtra)
+{
+   const char *pcText;
+   const char *pcLine;
+   const char *pcNewline;
+   size_t uNumber;
+
+   assert(oHistory != NULL);
+   assert(pfApply != NULL);
+
+   (void)History_refresh(oHistory);
+   if (uFirst == 0)
+      uFirst = 1;
+   if (uFirst > oHistory->uCount)
+      return;
+
+   /* Find the line of entry uFirst by counting back from the end */
+   pcText = oHistory->pcText;
+   pcLine = pcText + oHistory->uLength - 1;
+   for (uNumber = oHistory->uCount; uNumber >= uFirst; uNumber--)
+   {
+      while (pcLine > pcText && pcLine[-1] != '\n')
+         pcLine--;
+      if (uNumber > uFirst)
+         pcLine--;
+      else
+         break;
+   }
+
+   for (uNumber = uFirst; uNumber <= oHistory->uCount; uNumber++)
+   {
+      pcNewline = (const char*)memchr(pcLine, '\n',
+         oHistory->uLength - (size_t)(pcLine - pcText));
+      assert(pcNewline != NULL);
+      pfApply(pcLine, (size_t)(pcNewline - pcLine), uNumber, pvExtra);
+      pcLine = pcNewline + 1;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *puFirst and *puEnd the bounds of the range of the
+   uCount entries psEntries of oHistory, in the order of an index,
+   whose lines begin with pcPrefix. */
+
+static void History_findPrefix(History_T oHistory,
+                               const struct IndexEntry *psEntries,
+                               size_t uCount, const char *pcPrefix,
+                               size_t *puFirst, size_t *puEnd)
+{
+   size_t uLow = 0;
+   size_t uHigh = uCount;
+   size_t uMiddle;
+
+   /* The first entry not before pcPrefix */
+   while (uLow < uHigh)
+   {
+      uMiddle = uLow + (uHigh - uLow) / 2;
+      if (History_comparePrefix(oHistory->pcText
+             + psEntries[uMiddle].ulOffset, pcPrefix) < 0)
+         uLow = uMiddle + 1;
+      else
+         uHigh = uMiddle;
+   }
+   *puFirst = uLow;
+
+   /* The first entry after it that does not begin with pcPrefix */
+   uHigh = uCount;
+   while (uLow < uHigh)
+   {
+      uMiddle = uLow + (uHigh - uLow) / 2;
+      if (History_comparePrefix(oHistory->pcText
+             + psEntries[uMiddle].ulOffset, pcPrefix) == 0)
+         uLow = uMiddle + 1;
+      else
+         uHigh = uMiddle;
+   }
+   *puEnd = uLow;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Apply pfApply to the newest entry of each distinct text of
+   oHistory that begins with string pcPrefix, in the order of their
+   texts, and return how many there are.  Finding them takes time
+   logarithmic in the number of entries, plus that of applying
+   pfApply. */
+
+size_t History_mapPrefix(History_T oHistory, const char *pcPrefix,
+                         HistoryFunc_T pfApply, void *pvExtra)
+{
+   const struct IndexEntry *psNewest;
+   const char *pcLine;
+   size_t uIndexed;
+   size_t uIndexedEnd;
+   size_t uTail;
+   size_t uTailEnd;
+   size_t uFound = 0;
+
+   assert(oHistory != NULL);
+   assert(pcPrefix != NULL);
+   assert(pfApply != NULL);
+
+   (void)History_refresh(oHistory);
+   History_sortTail(oHistory);
+   History_findPrefix(oHistory, oHistory->psIndexed, oHistory->uIndexed,
+                      pcPrefix, &uIndexed, &uIndexedEnd);
+   History_findPrefix(oHistory, oHistory->psTail, oHistory->uTail,
+                      pcPrefix, &uTail, &uTailEnd);
+
+   /* Merge the two ranges, taking each text once; the newest entry
+      of a text is its last one, and one of the tail if it has any */
+   while (uIndexed < uIndexedEnd || uTail < uTailEnd)
+   {
+      if (uTail == uTailEnd
+          || (uIndexed < uIndexedEnd
+              && History_compareLines(
+                    oHistory->pcText
+                       + oHistory->psIndexed[uIndexed].ulOffset,
+                    oHistory->pcText
+                       + oHistory->psTail[uTail].ulOffset) <= 0))
+         pcLine = oHistory->pcText
+            + oHistory->psIndexed[uIndexed].ulOffset;
+      else
+         pcLine = oHistory->pcText + oHistory->psTail[uTail].ulOffset;
+
+      psNewest = NULL;
+      while (uIndexed < uIndexedEnd
+             && History_compareLines(oHistory->pcText
+                   + oHistory->psIndexed[uIndexed].ulOffset, pcLine) == 0)
+         psNewest = &oHistory->psIndexed[uIndexed++];
+      while (uTail < uTailEnd
+             && History_compareLines(oHistory->pcText
+                   + oHistory->psTail[uTail].ulOffset, pcLine) == 0)
+         psNewest = &oHistory->psTail[uTail++];
+
+      pfApply(pcLine, (size_t)((const char*)memchr(pcLine, '\n',
+                 oHistory->uLength - (size_t)(pcLine - oHistory->pcText))
+                 - pcLine), (size_t)psNewest->ulNumber, pvExtra);
+      uFound++;
+   }
+   return uFound;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Apply pfApply to each entry of oHistory that contains string
+   pcText, oldest first, and return how many there are.  Every entry
+   is read. */
+
+size_t History_mapContaining(History_T oHistory, const char *pcText,
+                             HistoryFunc_T pfApply, void *pvExtra)
+{
+   const char *pcLine;
+   const char *pcNewline;
+   const char *pcEnd;
+   size_t uText;
+   size_t uNumber;
+   size_t uFound = 0;
+
+   assert(oHistory != NULL);
+   assert(pcText != NULL);
+   assert(pfApply != NULL);
+
+   (void)History_refresh(oHistory);
+   if (oHistory->uCount == 0)
+      return 0;
+   uText = strlen(pcText);
+   pcLine = oHistory->pcText;
+   pcEnd = oHistory->pcText + oHistory->uLength;
+   for (uNumber = 1; pcLine < pcEnd; uNumber++)
+   {
+      pcNewline = (const char*)memchr(pcLine, '\n',
+                                      (size_t)(pcEnd - pcLine));
+      if (memmem(pcLine, (size_t)(pcNewline - pcLine), pcText, uText)
+          != NULL)
+      {
+         pfApply(pcLine, (size_t)(pcNewline - pcLine), uNumber,
+                 pvExtra);
+         uFound++;
+      }
+      pcLine = pcNewline + 1;
+   }
+   return uFound;
+}
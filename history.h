@@ -0,0 +1,95 @@
+/*--------------------------------------------------------------------*/
+/* history.h                                                          */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef HISTORY_INCLUDED
+#define HISTORY_INCLUDED
+
+#include <stddef.h>
+
+/*--------------------------------------------------------------------*/
+
+/* A History_T object is the history of the lines that users of the
+   shell have entered, kept in a file that every shell appends to.
+   The file holds one entry per line, oldest first, and is mapped
+   into memory rather than read.  Next to it, a file whose name adds
+   ".idx" holds the entries of all but the newest lines sorted by
+   their text, so that the entries that begin with a prefix are found
+   by binary search; the newest lines, whose number is bounded, are
+   sorted in memory.  Entries are numbered from 1, oldest first. */
+
+typedef struct History *History_T;
+
+/*--------------------------------------------------------------------*/
+
+/* A HistoryFunc_T function is applied to the entry number uNumber,
+   whose text is the uLength characters at pcLine, which are not
+   null-terminated, and to pvExtra. */
+
+typedef void (*HistoryFunc_T)(const char *pcLine, size_t uLength,
+                              size_t uNumber, void *pvExtra);
+
+/*--------------------------------------------------------------------*/
+
+/* Open the history file named pcFile, creating it if need be, and
+   return a History of it.  If the index of the file is missing, is
+   not of that file, or leaves too many lines out, write a new one.
+   If the file cannot be opened or mapped, write a message to stderr
+   and return NULL.  The caller owns the History. */
+
+History_T History_open(const char *pcFile);
+
+/*--------------------------------------------------------------------*/
+
+/* Close oHistory. */
+
+void History_free(History_T oHistory);
+
+/*--------------------------------------------------------------------*/
+
+/* Append the uLength characters at pcLine, which must contain no
+   newline, to the file of oHistory as its newest entry, in a single
+   write, so that the entries of shells sharing the file are never
+   mixed.  Return 0, or -1 with errno set if it cannot be written. */
+
+int History_add(History_T oHistory, const char *pcLine, size_t uLength);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of entries of oHistory, including those that
+   other shells have added to its file. */
+
+size_t History_getCount(History_T oHistory);
+
+/*--------------------------------------------------------------------*/
+
+/* Apply pfApply to each entry of oHistory numbered uFirst or more,
+   oldest first.  Only the entries from uFirst on are read. */
+
+void History_map(History_T oHistory, size_t uFirst,
+                 HistoryFunc_T pfApply, void *pvExtra);
+
+/*--------------------------------------------------------------------*/
+
+/* Apply pfApply to the newest entry of each distinct text of
+   oHistory that begins with string pcPrefix, in the order of their
+   texts, and return how many there are.  Finding them takes time
+   logarithmic in the number of entries, plus that of applying
+   pfApply. */
+
+size_t History_mapPrefix(History_T oHistory, const char *pcPrefix,
+                         HistoryFunc_T pfApply, void *pvExtra);
+
+/*--------------------------------------------------------------------*/
+
+/* Apply pfApply to each entry of oHistory that contains string
+   pcText, oldest first, and return how many there are.  Every entry
+   is read. */
+
+size_t History_mapContaining(History_T oHistory, const char *pcText,
+                             HistoryFunc_T pfApply, void *pvExtra);
+
+/*--------------------------------------------------------------------*/
+
+#endif
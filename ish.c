@@ -9,15 +9,35 @@
 #include "ish.h"
 #include "lexer.h"
 #include "token.h"
+#include "linereader.h"
 #include "syner.h"
 #include "command.h"
+#include "arena.h"
+#include "pipeline.h"
+#include "spawner.h"
+#include "forkserver.h"
+#include "pathcache.h"
+#include "builtin.h"
+#include "jobs.h"
+#include "eventloop.h"
+#include "parsecache.h"
+#include "scriptimage.h"
+#include "scheduler.h"
+#include "usage.h"
+#include "vartable.h"
+#include "pathglob.h"
+#include "history.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include <unistd.h>
-#include <fcntl.h>
+#include <signal.h>
+#include <errno.h>
+#include <getopt.h>
+#include <time.h>
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
@@ -26,6 +46,57 @@
 /* The name of the executable binary file. */
 static const char *pcPgmName;
 
+/* The environment that the shell started with. */
+extern char **environ;
+
+/* The number of lines whose Pipelines are kept, unless -C is given,
+   and the most that -C accepts. */
+enum {DEFAULT_PARSE_CACHE_SIZE = 256};
+enum {MAX_PARSE_CACHE_SIZE = 65536};
+
+/* The most lines of a script that -j runs at once. */
+enum {MAX_JOBS = 1024};
+
+/* The values that getopt_long() returns for the options that have
+   only long names. */
+enum {OPT_COMPILE = 256, OPT_IMAGE};
+
+/* The usage message, which describes each option. */
+static const char acUsage[] =
+   "usage: %s [-f script [--compile image] | --image image]\n"
+   "           [-s method] [-p bytes] [-T] [-C entries] [-j jobs] [-E]\n"
+   "  -f script        read the lines of script instead of stdin,\n"
+   "                   without a prompt or an echo of each line\n"
+   "  --compile image  parse the script once and write it to image\n"
+   "                   instead of running it\n"
+   "  --image image    run a compiled script without parsing it again,\n"
+   "                   unless the script has changed\n"
+   "  -s method        start external commands with fork, vfork,\n"
+   "                   posix_spawn, clone or forkserver, a helper\n"
+   "                   process whose cost does not grow with the\n"
+   "                   shell's heap; if the helper dies, its jobs\n"
+   "                   are reported lost and posix_spawn is used\n"
+   "  -p bytes         set the capacity of each pipe\n"
+   "  -T               report the time taken by each stage of a\n"
+   "                   pipeline\n"
+   "  -C entries       keep the pipelines of that many recent lines, so\n"
+   "                   that a repeated line is not parsed again; 0\n"
+   "                   keeps none\n"
+   "  -j jobs          read the whole script first, reporting its\n"
+   "                   errors, and then run up to that many of its\n"
+   "                   lines at once, as their redirects and builtins\n"
+   "                   allow\n"
+   "  -E               run the external commands echo, printf, test,\n"
+   "                   [, true, false and pwd instead of the builtins\n";
+
+/* The long names of options. */
+static const struct option asLongOptions[] =
+{
+   {"compile", required_argument, NULL, OPT_COMPILE},
+   {"image", required_argument, NULL, OPT_IMAGE},
+   {NULL, 0, NULL, 0}
+};
+
 /*--------------------------------------------------------------------*/
 
 /* Returns the name of the executable binary file. */
@@ -37,344 +108,637 @@ const char *getPgmName()
 
 /*--------------------------------------------------------------------*/
 
-/* This function is intended to be a signal handler.  Write a message
-   to stdout that contains iSignal, the number of the signal that
-   caused the function to be called. */
+/* A LineSource is where the shell reads its lines from: a LineReader
+   of stdin or of a script, or a compiled script image. */
 
-void myHandler(int iSignal)
+struct LineSource
 {
-   int iRet;
-   void (*pfRet)(int);
-   
-   /* Install myHandler2 as the handler for SIGINT signals. */
-   pfRet = signal(SIGINT, myHandler2);
-   if (pfRet == SIG_ERR) {perror(pcPgmName); exit(EXIT_FAILURE); }
+   /* Splits stdin, or the script file, into lines, or NULL */
+   LineReader_T oReader;
+
+   /* The compiled script whose lines are read instead, or NULL */
+   ScriptImage_T oImage;
+
+   /* 1 iff stdin is watched by oLoop, and set to 1 when it is
+      readable */
+   int iWatchInput;
+   int iInputReady;
+   EventLoop_T oLoop;
+};
 
-   alarm(5);
+/*--------------------------------------------------------------------*/
+
+/* The EventFunc_T of stdin: set the flag *pvReady to 1. */
+
+static void setInputReady(void *pvReady)
+{
+   *(int*)pvReady = 1;
 }
 
 /*--------------------------------------------------------------------*/
 
-/* This function is intended to be a signal handler.  Write a message
-   to stdout that contains iSignal, the number of the signal that
-   caused the function to be called. */
+/* Read the next line of psSource, handling events until a whole line
+   can be read, and return it, or NULL at end-of-file.  Store its
+   length in *puLength, and in *poPipeline its Pipeline if psSource
+   is an image, or NULL if the line has an error or psSource is not
+   an image.  The line is valid until the next line is read. */
 
-void myHandler2(int iSignal)
+static const char *readLine(struct LineSource *psSource,
+                            Pipeline_T *poPipeline, size_t *puLength)
 {
-   printf("To exit the shell, issue an 'exit' command");
+   const char *pcLine;
+   int iRet;
+
+   if (psSource->iWatchInput && ! LineReader_isReady(psSource->oReader))
+   {
+      iRet = fflush(stdout);
+      if (iRet == EOF) {perror(pcPgmName); exit(EXIT_FAILURE); }
+      psSource->iInputReady = 0;
+      EventLoop_rearm(psSource->oLoop, STDIN_FILENO);
+      while (! psSource->iInputReady)
+         (void)EventLoop_wait(psSource->oLoop, -1);
+   }
+
+   *poPipeline = NULL;
+   if (psSource->oImage == NULL)
+      return LineReader_readLine(psSource->oReader, puLength);
+   pcLine = ScriptImage_readLine(psSource->oImage, poPipeline);
+   if (pcLine != NULL)
+      *puLength = strlen(pcLine);
+   return pcLine;
 }
 
 /*--------------------------------------------------------------------*/
 
-void alarmHandler(int iSignal)
+/* Open and return the history file that the variables oVars name:
+   the value of HISTFILE, or .ish_history in the directory HOME.
+   Return NULL if neither is set or the file cannot be opened. */
+
+static History_T openHistory(VarTable_T oVars)
 {
-   void (*pfRet)(int);
-   pfRet = signal(SIGINT, myHandler);
+   static const char acName[] = "/.ish_history";
+   const char *pcFile;
+   const char *pcHome;
+   char *pcPath;
+   History_T oHistory;
+
+   pcFile = VarTable_get(oVars, "HISTFILE");
+   if (pcFile != NULL && *pcFile != '\0')
+      return History_open(pcFile);
+
+   pcHome = VarTable_get(oVars, "HOME");
+   if (pcHome == NULL || *pcHome == '\0')
+      return NULL;
+   pcPath = (char*)malloc(strlen(pcHome) + sizeof(acName));
+   if (pcPath == NULL) {perror(pcPgmName); exit(EXIT_FAILURE); }
+   strcpy(pcPath, pcHome);
+   strcat(pcPath, acName);
+   oHistory = History_open(pcPath);
+   free(pcPath);
+   return oHistory;
 }
 
 /*--------------------------------------------------------------------*/
 
-/* Accepts a DynArray of tokens, and parses it to return a command.
-   A command must begin with an ordinary token, must have at most one
-   stdin redirect and stdout redirect each, and cannot follow a 
-   redirect token with another special character or terminating the 
-   program. Executes the command, and repeats until EOF. Returns 0 
-   iff successful. As always, argc is the command-line argument count 
-   and argv is an array of arguments. */
+/* Read the bodies of the uCount here-documents of oPipeline from
+   psSource: the lines up to a line that is the delimiter of each, in
+   order.  Unless iBatch, prompt for each line with "> " and echo it.
+   Return a copy of oPipeline in which the here-documents have those
+   bodies, which are allocated, with the copy, from oArena.  A body
+   that reaches end-of-file is reported, and ends there. */
 
-int main(int argc, char *argv[])
+static Pipeline_T readHereDocs(struct LineSource *psSource,
+                               Pipeline_T oPipeline, size_t uCount,
+                               int iBatch, Arena_T oArena)
 {
-   /* Line read in from user from stdin */
-   char *pcLine;
+   enum {INITIAL_BODY_SIZE = 256};
+
+   const char **apcBodies;
+   const char *pcDelimiter;
+   const char *pcText;
+   Pipeline_T oIgnored;
+   char *pcBody;
+   char *pcOldBody;
+   size_t uBodyLength;
+   size_t uPhysBody;
+   size_t uLength;
+   size_t u;
+   int iEof = 0;
 
-   /* Process ID, used to determine if parent or child */
-   pid_t iPid;
+   apcBodies = (const char**)Arena_alloc(oArena,
+                                         uCount * sizeof(const char*));
+   for (u = 0; u < uCount; u++)
+   {
+      pcDelimiter = Pipeline_getHereDocDelimiter(oPipeline, u);
+      uPhysBody = INITIAL_BODY_SIZE;
+      pcBody = (char*)Arena_alloc(oArena, uPhysBody);
+      uBodyLength = 0;
 
-   /* Used to determine the success of functions */
-   int iRet;
+      while (! iEof)
+      {
+         if (! iBatch)
+            printf("> ");
+         pcText = readLine(psSource, &oIgnored, &uLength);
+         if (pcText == NULL)
+         {
+            fprintf(stderr, "%s: here-document ended by end of file\n",
+                    pcPgmName);
+            iEof = 1;
+            break;
+         }
+         if (! iBatch)
+            printf("%s\n", pcText);
+         if (strcmp(pcText, pcDelimiter) == 0)
+            break;
+
+         /* Keep the line and its newline, and room for the null
+            character; an outgrown body stays in oArena until it is
+            reset */
+         if (uBodyLength + uLength + 2 > uPhysBody)
+         {
+            pcOldBody = pcBody;
+            while (uBodyLength + uLength + 2 > uPhysBody)
+               uPhysBody *= 2;
+            pcBody = (char*)Arena_alloc(oArena, uPhysBody);
+            memcpy(pcBody, pcOldBody, uBodyLength);
+         }
+         memcpy(pcBody + uBodyLength, pcText, uLength);
+         uBodyLength += uLength;
+         pcBody[uBodyLength++] = '\n';
+      }
+      pcBody[uBodyLength] = '\0';
+      apcBodies[u] = pcBody;
+   }
+   return Pipeline_bindHereDocs(oPipeline, apcBodies, oArena);
+}
 
-   /* Holds the Tokens created after a lexLine() call */
-   DynArray_T oTokens;
-   /* Holds the Command created after a synArr() call */
-   Command_T oCommand;
+/*--------------------------------------------------------------------*/
 
-   /* Stores the name of the command */
-   char* pcCommandName;
-   /* Stores the arguments of the command */
-   DynArray_T oArgs;
+/* Run every stage of oPipeline, which was read from line pcLine, as
+   an external command, all at once, as a job of psState->oJobs.  A
+   stage whose command cannot be found is reported and not started.
+   If oPipeline runs in the background, write its job number and the
+   process ID of its last stage, and return at once; it runs in a
+   process group of its own, so that signals from the terminal do not
+   reach it.  Otherwise wait for all of the stages to exit, add what
+   each cost to psState->oUsage, and if iTimed, write that to stderr.
+   If psState->iReportTimes, also write to stderr how long each stage
+   ran, from the start of the pipeline until it exited.  The arrays
+   used to track the stages are allocated from oArena. */
+
+static void runPipeline(Pipeline_T oPipeline, const char *pcLine,
+                        struct ShellState *psState, int iTimed,
+                        Arena_T oArena)
+{
+   /* The file that each stage executes, its process ID, and what it
+      cost */
+   const char **apcFiles;
+   pid_t *aiPids;
+   struct Usage *asUsage;
 
-   /* Used to iterate through the arguments of the Command */
-   size_t u;
+   struct timespec sStart;
    size_t uLength;
+   size_t u;
+   int iBackground;
+   int iJob;
+   /* The process group of a background job, and the process ID of
+      its last stage */
+   pid_t iPgid = 0;
+   pid_t iLastPid = -1;
+
+   uLength = Pipeline_getLength(oPipeline);
+   apcFiles = (const char**)Arena_alloc(oArena,
+                                        uLength * sizeof(const char*));
+   aiPids = (pid_t*)Arena_alloc(oArena, uLength * sizeof(pid_t));
+   asUsage = (struct Usage*)Arena_alloc(oArena,
+                                        uLength * sizeof(struct Usage));
+
+   /* Find each file once */
+   for (u = 0; u < uLength; u++)
+   {
+      apcFiles[u] = PathCache_lookup(psState->oPaths,
+         Command_getName(Pipeline_getCommand(oPipeline, u)));
+      if (apcFiles[u] == NULL)
+         perror(pcPgmName);
+   }
 
-   /* String for a path variable for the cd command */
-   char *pcPath;
+   if (clock_gettime(CLOCK_MONOTONIC, &sStart) == -1)
+   {perror(pcPgmName); exit(EXIT_FAILURE); }
+   iBackground = Pipeline_isBackground(oPipeline);
+   if (spawnPipeline(oPipeline, apcFiles, psState->uPipeSize,
+                     iBackground ? 0 : -1, psState->eSpawn, aiPids)
+       == 0)
+      return;
+
+   if (iBackground)
+   {
+      for (u = 0; u < uLength; u++)
+      {
+         if (aiPids[u] == -1)
+            continue;
+         if (iPgid == 0)
+            iPgid = aiPids[u];
+         iLastPid = aiPids[u];
+      }
+   }
+   iJob = JobTable_add(psState->oJobs, pcLine, aiPids, uLength, iPgid);
+   if (iBackground)
+   {
+      printf("[%d] %ld\n", iJob, (long)iLastPid);
+      return;
+   }
+
+   /* Reap the stages in whatever order they exit */
+   (void)JobTable_wait(psState->oJobs, iJob, &sStart, asUsage, 0);
+   UsageStats_addPipeline(psState->oUsage, oPipeline, aiPids, asUsage,
+                          iTimed);
+
+   if (psState->iReportTimes)
+   {
+      for (u = 0; u < uLength; u++)
+      {
+         if (aiPids[u] != -1)
+            fprintf(stderr, "%s: stage %lu (%s): %.3f ms\n",
+                    pcPgmName, (unsigned long)u + 1,
+                    Command_getName(Pipeline_getCommand(oPipeline, u)),
+                    asUsage[u].dMillis);
+      }
+   }
+}
 
-   /* For signal handling */
-   void (*pfRet)(int);
-   sigset_t sSet;
+/*--------------------------------------------------------------------*/
+
+/* Reads lines from stdin, or from the script that the options name,
+   and parses each one into a pipeline and runs it, until EOF.  The
+   syntax of a line is that of synLine(), the builtins are those of
+   Builtin_lookup(), and the options are those that acUsage lists.
+   Returns 0 iff successful.  As always, argc is the command-line
+   argument count and argv is an array of arguments. */
+
+int main(int argc, char *argv[])
+{
+   /* Line read in from user from stdin, and its length */
+   const char *pcLine;
+   size_t uLength;
+   /* Stdin, the script file, or the compiled script named with
+      --image, whose lines are read */
+   struct LineSource sSource = {NULL, NULL, 0, 0, NULL};
+   /* The image files named with --compile and --image, or NULL */
+   const char *pcCompile = NULL;
+   const char *pcImage = NULL;
+
+   /* Script file named with -f, or NULL to read stdin */
+   const char *pcScript = NULL;
+   /* 1 iff running a script, without prompts or echo */
+   int iBatch = 0;
+   /* Command-line option returned by getopt() */
+   int iOpt;
+   /* The value of a numeric option, and its first invalid
+      character */
+   unsigned long ulValue;
+   char *pcEnd;
+   /* The number of lines whose Pipelines are kept */
+   size_t uParseCacheSize;
+   /* The most lines run at once with -j, or 0 to run each line as
+      it is read, and the Scheduler that does so */
+   size_t uMaxJobs = 0;
+   Scheduler_T oScheduler = NULL;
+   /* Holds the Pipelines of the lines that oScheduler runs */
+   Arena_T oScriptArena = NULL;
+   /* Expands the patterns among the arguments of each line */
+   PathGlob_T oGlob;
+   /* The number of here-documents of the line */
+   size_t uHereDocs;
 
-   /* The permissions of the newly-created file. */
-   enum {PERMISSIONS = 0600};
+   /* Used to determine the success of functions */
+   int iRet;
 
-   /* Denotes that the setenv command can overwrite a variable */
-   enum {OVERWRITE_ON = 1};
+   /* Holds the Pipeline of the line, which must not be changed, and
+      its first Command */
+   Pipeline_T oPipeline;
+   Command_T oCommand;
+   /* The Pipeline of the rest of a line that begins with "time", and
+      1 iff the line does */
+   Pipeline_T oTimed;
+   int iTimed;
+   /* Holds everything else allocated while handling one line */
+   Arena_T oArena;
+   /* The state that builtin commands read and change */
+   struct ShellState sState;
+   /* The builtin named by the command, if any */
+   const struct Builtin *psBuiltin;
+
+   /* Handles signals and exits while the shell waits, and the signal
+      mask that it replaced */
+   EventLoop_T oLoop;
+   sigset_t sOldSet;
+
+   /* Starts external commands for the shell, or NULL */
+   ForkServer_T oServer = NULL;
 
    pcPgmName = argv[0];
 
-   /* Print shell prompt */
-   printf("%% ");
+   sState.eSpawn = SPAWN_POSIX;
+   sState.uPipeSize = 0;
+   sState.iReportTimes = 0;
+   sState.iExternalUtilities = 0;
+   uParseCacheSize = DEFAULT_PARSE_CACHE_SIZE;
 
-   while ((pcLine = readLine(stdin)) != NULL)
+   while ((iOpt = getopt_long(argc, argv, "f:s:p:TC:j:E", asLongOptions,
+                              NULL)) != -1)
    {
-      /* Read line from user stdin */
-      printf("%s\n", pcLine);
-      iRet = fflush(stdout);
-      if (iRet == -1)
-      {perror(pcPgmName); exit(EXIT_FAILURE);}
-
-      /* Parse the line and return DynArray of tokens */
-      oTokens = lexLine(pcLine);
-      if(oTokens != NULL)
-      {
-         /* Parse the tokens array and return */
-         oCommand = synArr(oTokens);
-         if (oCommand != NULL)
-         {
-            iRet = fflush(NULL);
-            if (iRet == EOF) {perror(pcPgmName); exit(EXIT_FAILURE); }
-
-            oArgs = Command_getArgs(oCommand);
-            uLength = DynArray_getLength(oArgs);
-
-            pcCommandName = Command_getName(oCommand);
-
-            /* Make sure SIGINT signals are not blocked. */
-            iRet = sigemptyset(&sSet);
-            if (iRet == -1) {perror(pcPgmName); exit(EXIT_FAILURE); }
-            iRet = sigaddset(&sSet, SIGINT);
-            if (iRet == -1) {perror(pcPgmName); exit(EXIT_FAILURE); }
-            iRet = sigprocmask(SIG_UNBLOCK, &sSet, NULL);
-            if (iRet == -1) {perror(pcPgmName); exit(EXIT_FAILURE); }
-            
-            /* Restore myHandler for SIGINT signals. */
-            pfRet = signal(SIGINT, myHandler);
-            if (pfRet == SIG_ERR) {perror(pcPgmName); exit(EXIT_FAILURE); }
-
-            /* Make sure that SIGALRM signals are not blocked. */
-            iRet = sigemptyset(&sSigSet);
-            if (iRet == -1) {perror(pcPgmName); exit(EXIT_FAILURE); }   
-            iRet = sigaddset(&sSigSet, SIGALRM);
-            if (iRet == -1) {perror(pcPgmName); exit(EXIT_FAILURE); }   
-            iRet = sigprocmask(SIG_UNBLOCK, &sSigSet, NULL);
-            if (iRet == -1) {perror(pcPgmName); exit(EXIT_FAILURE); }
-
-            /* Install myHandler as the handler for SIGALRM signals. */
-            pfRet = signal(SIGALRM, myHandler);
-            if (pfRet == SIG_ERR) {perror(pcPgmName); exit(EXIT_FAILURE); }
-
-
-            /* Implementation of the "exit" command */
-            if (strcmp(pcCommandName, "exit") == 0) 
+      switch (iOpt) {
+         case 'f':
+            pcScript = optarg;
+            break;
+         case 's':
+            if (Spawn_parseMethod(optarg, &sState.eSpawn))
+               break;
+            fprintf(stderr, "%s: unknown spawn method %s\n",
+                    pcPgmName, optarg);
+            exit(EXIT_FAILURE);
+         case 'p':
+            ulValue = strtoul(optarg, &pcEnd, 10);
+            if (*optarg != '\0' && *pcEnd == '\0' && ulValue > 0
+                && ulValue <= INT_MAX)
             {
-               if (uLength == 0) {exit(0); }
-               /* Error if the exit function has arguments */
-               else 
-               {
-                  fprintf(stderr, "%s: too many arguments\n", 
-                          getPgmName());
-               }
+               sState.uPipeSize = (size_t)ulValue;
+               break;
             }
-
-            /* Implementation of "setenv" command */
-            else if (strcmp(pcCommandName, "setenv") == 0) 
+            fprintf(stderr, "%s: invalid pipe size %s\n",
+                    pcPgmName, optarg);
+            exit(EXIT_FAILURE);
+         case 'T':
+            sState.iReportTimes = 1;
+            break;
+         case 'E':
+            sState.iExternalUtilities = 1;
+            break;
+         case 'C':
+            ulValue = strtoul(optarg, &pcEnd, 10);
+            if (*optarg != '\0' && *pcEnd == '\0'
+                && ulValue <= MAX_PARSE_CACHE_SIZE)
             {
-               switch(uLength) {
-                  case 0:
-                     /* Error to have 0 command line arguments */
-                     fprintf(stderr, "%s: missing variable\n", 
-                             getPgmName());
-                     break;
-                  case 1: 
-                     /* Value omitted, argument is the var */
-                     iRet = setenv(DynArray_get(oArgs, 0), "", 
-                                   OVERWRITE_ON);
-                     if(iRet == -1)
-                     {perror(pcPgmName); exit(EXIT_FAILURE); }
-                     break;
-                  case 2: 
-                     /* Var and value must have been specified */
-                     iRet = setenv(DynArray_get(oArgs, 0), 
-                                   DynArray_get(oArgs, 1), OVERWRITE_ON);
-                     if(iRet == -1)
-                     {perror(pcPgmName); exit(EXIT_FAILURE); }
-                     break;
-                  default:
-                     /* Over two command line arguments is an error */
-                     fprintf(stderr, "%s: too many arguments\n", 
-                             getPgmName());
-               }
+               uParseCacheSize = (size_t)ulValue;
+               break;
             }
-
-            /* Implementation of "unsetenv" command */
-            else if (strcmp(pcCommandName, "unsetenv") == 0) 
+            fprintf(stderr, "%s: invalid parse cache size %s\n",
+                    pcPgmName, optarg);
+            exit(EXIT_FAILURE);
+         case 'j':
+            ulValue = strtoul(optarg, &pcEnd, 10);
+            if (*optarg != '\0' && *pcEnd == '\0' && ulValue > 0
+                && ulValue <= MAX_JOBS)
             {
-               switch(uLength) {
-                  case 0:
-                     /* Error to have 0 command line arguments */
-                     fprintf(stderr, "%s: missing variable\n", 
-                             getPgmName());
-                     break;
-                  case 1: 
-                     /* Var has been specified, call unsetenv */
-                     iRet = unsetenv(DynArray_get(oArgs, 0));
-                     if(iRet == -1)
-                     {perror(pcPgmName); exit(EXIT_FAILURE); }
-                     break;
-                  default:
-                     /* Over one command line arguments is an error */
-                     fprintf(stderr, "%s: too many arguments\n", 
-                             getPgmName());
-               }
+               uMaxJobs = (size_t)ulValue;
+               break;
             }
+            fprintf(stderr, "%s: invalid number of jobs %s\n",
+                    pcPgmName, optarg);
+            exit(EXIT_FAILURE);
+         case OPT_COMPILE:
+            pcCompile = optarg;
+            break;
+         case OPT_IMAGE:
+            pcImage = optarg;
+            break;
+         default:
+            fprintf(stderr, acUsage, pcPgmName);
+            exit(EXIT_FAILURE);
+      }
+   }
 
-            /* Implementation of "cd [dir]" command */
-            else if (strcmp(pcCommandName, "cd") == 0) 
-            {
-               switch(uLength) {
-                  case 0:
-                     /* Stores value of HOME into pcPath */ 
-                     pcPath = getenv("HOME");
-                     /* Error to have 0 command line arguments if HOME 
-                        is not set */
-                     if(pcPath == NULL)
-                     {
-                        fprintf(stderr, "%s: HOME is not set\n", 
-                                getPgmName());
-                     }
-                     /* Calls chdir to change directory */
-                     iRet = chdir(pcPath);
-                     if(iRet == -1)
-                     {perror(pcPgmName); exit(EXIT_FAILURE); }
-                     break;
-                  case 1: 
-                     /* Calls chdir to change directory */
-                     iRet = chdir(DynArray_get(oArgs, 0));
-                     if(iRet == -1)
-                     {perror(pcPgmName); exit(EXIT_FAILURE); }
-                     break;
-                  default:
-                     /* Over one command line arguments is an error */
-                     fprintf(stderr, "%s: too many arguments\n", 
-                             getPgmName());
-               }
-            }
+   if (pcImage != NULL && pcScript != NULL)
+   {
+      fprintf(stderr, "%s: -f and --image cannot be used together\n",
+              pcPgmName);
+      exit(EXIT_FAILURE);
+   }
 
-            else 
-            {
-               iPid = fork();
-               if (iPid == -1) {perror(pcPgmName); exit(EXIT_FAILURE); }
-
-               if (iPid == 0)
-               {
-                  /* This code is executed by the child process only. */
-
-                  /* The working string argument */
-                  char *pcArgument;
-
-                  /* Integer file descriptor for IO redirection */
-                  int iFd;
-                  /* File names of stdIn and stdOut redirect */
-                  char *pcIn;
-                  char *pcOut;
-
-                  /* New string array to hold the args of the Command */
-                  char **pcArgs = (char **)malloc(sizeof(char*) 
-                                                  * (uLength + 1) + 1);
-                  if (pcArgs == NULL) 
-                  {
-                     perror(pcPgmName); 
-                     exit(EXIT_FAILURE); 
-                  }
-
-                  pcIn = Command_getStdin(oCommand);
-                  pcOut = Command_getStdout(oCommand);
-
-                  if (pcIn != NULL)
-                  {
-                     /* Opens the stdin redirect location */
-                     iFd = open(pcIn, O_RDONLY);
-                     if (iFd == -1) 
-                     {perror(pcPgmName); exit(EXIT_FAILURE); }
-
-                     /* Closes fd for stdin */
-                     iRet = close(0);
-                     if (iRet == -1) 
-                     {perror(pcPgmName); exit(EXIT_FAILURE); }
-
-                     /* The fd for stdin redirect now goes to fd 0 */
-                     iRet = dup(iFd);
-                     if (iRet == -1) 
-                     {perror(pcPgmName); exit(EXIT_FAILURE); }
-
-                     /* Closes the temporary stdin fd */
-                     iRet = close(iFd);
-                     if (iRet == -1) 
-                     {perror(pcPgmName); exit(EXIT_FAILURE); }
-                  }
-
-                  if (pcOut != NULL)
-                  {
-                     /* Opens the stdout redirect location */
-                     iFd = creat(pcOut, PERMISSIONS);
-                     if (iFd == -1) 
-                     {perror(pcPgmName); exit(EXIT_FAILURE); }
-
-                     /* Closes fd for stdout */
-                     iRet = close(1);
-                     if (iRet == -1) 
-                     {perror(pcPgmName); exit(EXIT_FAILURE); }
-
-                     /* The fd for stdout redirect now goes to fd 0 */
-                     iRet = dup(iFd);
-                     if (iRet == -1) 
-                     {perror(pcPgmName); exit(EXIT_FAILURE); }
-
-                     /* Closes the temporary stdout fd */
-                     iRet = close(iFd);
-                     if (iRet == -1) 
-                     {perror(pcPgmName); exit(EXIT_FAILURE); }
-                  }
-
-                  /* First element is the name of the command */
-                  *pcArgs = pcCommandName;
-
-                  for (u = 0; u < uLength; u++)
-                  {
-                     pcArgument = DynArray_get(oArgs, u);
-                     /* Set each element of pcArgs to the corresponding
-                        element of oArgs from oCommand */
-                     *(pcArgs + u + 1) = pcArgument;
-                  }
-                  /* Set last element to the null character */
-                  *(pcArgs + u + 1) = NULL;
-
-                  execvp(pcCommandName, pcArgs);
-                  perror(pcPgmName);
-                  exit(EXIT_FAILURE);
-               }
-
-               /* This code is executed by the parent process only. */
-
-               /* Wait for the child process to exit. */
-               iPid = wait(NULL);
-               if (iPid == -1) {perror(pcPgmName); exit(EXIT_FAILURE); }
-            }
-         }
+   /* Compile the script instead of running it */
+   if (pcCompile != NULL)
+   {
+      if (pcScript == NULL)
+      {
+         fprintf(stderr, "%s: --compile needs a script named with -f\n",
+                 pcPgmName);
+         exit(EXIT_FAILURE);
       }
-      free(pcLine);
+      if (ScriptImage_compile(pcScript, pcCompile) == -1)
+         exit(EXIT_FAILURE);
+      return 0;
+   }
+
+   if (pcImage != NULL)
+   {
+      /* Map the image, whose lines are already parsed */
+      sSource.oImage = ScriptImage_load(pcImage);
+      if (sSource.oImage == NULL)
+         exit(EXIT_FAILURE);
+      iBatch = 1;
+   }
+   else if (pcScript != NULL)
+   {
+      /* Map the script and walk its lines in place */
+      sSource.oReader = LineReader_newFile(pcScript);
+      if (sSource.oReader == NULL)
+      {perror(pcScript); exit(EXIT_FAILURE);}
+      iBatch = 1;
+   }
+   else
+      sSource.oReader = LineReader_new(STDIN_FILENO);
+
+   if (uMaxJobs > 0 && ! iBatch)
+   {
+      fprintf(stderr, "%s: -j needs a script\n", pcPgmName);
+      exit(EXIT_FAILURE);
+   }
+
+   /* Buffer the diagnostics of a script.  They are flushed with
+      everything else before each fork and at exit. */
+   if (iBatch)
+   {
+      iRet = setvbuf(stderr, NULL, _IOFBF, BUFSIZ);
+      if (iRet != 0) {perror(pcPgmName); exit(EXIT_FAILURE); }
+   }
+
+   oArena = Arena_new();
+   sState.oVars = VarTable_new(environ);
+   sState.oPaths = PathCache_new(sState.oVars);
+   sState.oParses = ParseCache_new(uParseCacheSize);
+   sState.oUsage = UsageStats_new();
+   sState.oHistory = iBatch ? NULL : openHistory(sState.oVars);
+   oGlob = PathGlob_new();
+
+   /* Set up signal handling once; children get the original mask */
+   oLoop = EventLoop_new(&sOldSet);
+   Spawn_setChildMask(&sOldSet);
+   Spawn_setVars(sState.oVars);
+   sState.oJobs = JobTable_new(oLoop);
+
+   /* Start the fork server while the shell is still small */
+   if (sState.eSpawn == SPAWN_SERVER)
+   {
+      oServer = ForkServer_new();
+      Spawn_setServer(oServer);
+      JobTable_setServer(sState.oJobs, oServer);
+   }
+
+   /* The lines of a script that a Scheduler runs are read with every
+      '$' and pattern standing for itself, and parsed again when they
+      start */
+   if (uMaxJobs > 0)
+   {
+      oScheduler = Scheduler_new(uMaxJobs, &sState);
+      oScriptArena = Arena_new();
+   }
+   else
+   {
+      lexSetVars(sState.oVars);
+      synSetGlob(oGlob);
+   }
+
+   /* Wait for stdin in the event loop, unless it is a file, which is
+      always readable */
+   sSource.oLoop = oLoop;
+   if (! iBatch)
+   {
+      if (EventLoop_add(oLoop, STDIN_FILENO, 1, setInputReady,
+                        &sSource.iInputReady) == 0)
+         sSource.iWatchInput = 1;
+      else if (errno != EPERM)
+      {perror(pcPgmName); exit(EXIT_FAILURE); }
+   }
+
+   /* Print shell prompt */
+   if (! iBatch)
       printf("%% ");
+
+   for (;;)
+   {
+      pcLine = readLine(&sSource, &oPipeline, &uLength);
+      if (pcLine == NULL)
+         break;
+
+      /* Collect the lines of the script, to run them all at its
+         end, with the bodies of their here-documents */
+      if (oScheduler != NULL)
+      {
+         /* A line of an image without a Pipeline is parsed again,
+            to write its message, to refer to the variables, or to
+            expand its patterns */
+         if (sSource.oImage == NULL || oPipeline == NULL)
+            oPipeline = synLine(pcLine, oScriptArena);
+         if (oPipeline == NULL)
+         {
+            Arena_reset(oArena);
+            continue;
+         }
+         uHereDocs = Pipeline_getHereDocCount(oPipeline);
+         if (uHereDocs > 0)
+         {
+            pcLine = Arena_strndup(oScriptArena, pcLine, uLength);
+            oPipeline = readHereDocs(&sSource, oPipeline, uHereDocs,
+                                     iBatch, oScriptArena);
+         }
+         Scheduler_add(oScheduler, pcLine, oPipeline);
+         continue;
+      }
+
+      /* Echo the line read in from user stdin */
+      if (! iBatch)
+      {
+         printf("%s\n", pcLine);
+         iRet = fflush(stdout);
+         if (iRet == -1)
+         {perror(pcPgmName); exit(EXIT_FAILURE);}
+      }
+
+      /* Add the line to the history, unless it is blank */
+      if (sState.oHistory != NULL && strspn(pcLine, " ") < uLength
+          && History_add(sState.oHistory, pcLine, uLength) == -1)
+         perror(pcPgmName);
+
+      /* Lex and parse the line in a single pass, unless it was
+         parsed recently.  A line of an image is already parsed,
+         unless it contains an error, which is parsed again to
+         write its message, or refers to variables or has
+         patterns. */
+      if (sSource.oImage == NULL)
+         oPipeline = ParseCache_parse(sState.oParses, pcLine, uLength);
+      else if (oPipeline == NULL)
+         oPipeline = synLine(pcLine, oArena);
+
+      /* Read the bodies of the here-documents, which come after the
+         line, keeping the line, which reading may overwrite */
+      if (oPipeline != NULL)
+      {
+         uHereDocs = Pipeline_getHereDocCount(oPipeline);
+         if (uHereDocs > 0)
+         {
+            pcLine = Arena_strndup(oArena, pcLine, uLength);
+            oPipeline = readHereDocs(&sSource, oPipeline, uHereDocs,
+                                     iBatch, oArena);
+         }
+      }
+
+      if (oPipeline != NULL)
+      {
+         /* Run the rest of a line that begins with "time" without
+            changing its Pipeline, which may be cached */
+         oTimed = Pipeline_dropTime(oPipeline, oArena);
+         iTimed = (oTimed != NULL);
+         if (iTimed)
+            oPipeline = oTimed;
+
+         iRet = fflush(NULL);
+         if (iRet == EOF) {perror(pcPgmName); exit(EXIT_FAILURE); }
+
+         oCommand = Pipeline_getCommand(oPipeline, 0);
+
+         /* Run a builtin command within the shell */
+         psBuiltin = Builtin_find(oPipeline, &sState);
+         if (psBuiltin != NULL)
+            (void)Builtin_run(psBuiltin, oCommand, &sState, iTimed);
+         else
+            runPipeline(oPipeline, pcLine, &sState, iTimed, oArena);
+      }
+
+      /* Release the stages' arrays all at once */
+      Arena_reset(oArena);
+
+      /* Reap the background jobs that have finished, reporting them
+         only to a user at a prompt */
+      JobTable_reap(sState.oJobs, iBatch ? NULL : stdout);
+
+      if (! iBatch)
+         printf("%% ");
+   }
+   if (oScheduler != NULL)
+   {
+      lexSetVars(sState.oVars);
+      synSetGlob(oGlob);
+      Scheduler_run(oScheduler);
+      Scheduler_free(oScheduler);
+      Arena_free(oScriptArena);
    }
-   printf("\n");
+   if (! iBatch)
+      printf("\n");
+   JobTable_free(sState.oJobs);
+   ForkServer_free(oServer);
+   EventLoop_free(oLoop);
+   ParseCache_free(sState.oParses);
+   UsageStats_free(sState.oUsage);
+   if (sState.oHistory != NULL)
+      History_free(sState.oHistory);
+   PathCache_free(sState.oPaths);
+   VarTable_free(sState.oVars);
+   synSetGlob(NULL);
+   PathGlob_free(oGlob);
+   Arena_free(oArena);
+   if (sSource.oImage != NULL)
+      ScriptImage_free(sSource.oImage);
+   else
+      LineReader_free(sSource.oReader);
    return 0;
 }
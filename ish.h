@@ -20,16 +20,4 @@ const char *getPgmName(void);
 
 /*--------------------------------------------------------------------*/
 
-void myHandler(int iSignal);
-
-/*--------------------------------------------------------------------*/
-
-void myHandler2(int iSignal);
-
-/*--------------------------------------------------------------------*/
-
-void alarmHandler(int iSignal)
-
-/*--------------------------------------------------------------------*/
-
 #endif
@@ -0,0 +1,1156 @@
+/*--------------------------------------------------------------------*/
+/* ishbench.c                                                         */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#include "ish.h"
+#include "dynarray.h"
+#include "linereader.h"
+#include "lexer.h"
+#include "token.h"
+#include "syner.h"
+#include "command.h"
+#include "pipeline.h"
+#include "arena.h"
+#include "spawner.h"
+#include "forkserver.h"
+#include "pathcache.h"
+#include "eventloop.h"
+#include "jobs.h"
+#include "usage.h"
+#include "builtin.h"
+#include "vartable.h"
+#include "pathglob.h"
+#include "history.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The name of the executable binary file. */
+static const char *pcPgmName;
+
+/* The environment that the benchmarks start from. */
+extern char **environ;
+
+/* The number of corpora, the number of lines of each, the default
+   number of times each benchmark runs through a corpus, and the
+   default number of spawns timed. */
+enum {CORPUS_COUNT = 5};
+enum {CORPUS_LINES = 4096};
+enum {DEFAULT_ROUNDS = 20};
+enum {DEFAULT_SPAWNS = 1000};
+
+/* The number of variables that benchEnviron() adds to the
+   environment, as a large environment would have. */
+enum {EXTRA_VARS = 1000};
+
+/* The number of files in the directory that benchGlob() expands
+   patterns in, as a large directory of data files would have. */
+enum {GLOB_FILES = 100000};
+
+/* The number of entries of the history file that benchHistory()
+   searches, as years of use would leave, and the fewest characters
+   of a prefix that it searches for, which must also go past the
+   command name; a shorter one, such as "ls", begins so many distinct
+   entries that listing them is all the search costs. */
+enum {HISTORY_ENTRIES = 1000000};
+enum {MIN_HISTORY_PREFIX = 8};
+
+/* The variables that the lines of the variables corpus refer to, and
+   their values; the last is never set. */
+static const char *apcVarNames[] =
+   {"ISHBENCH_DIR", "ISHBENCH_FILE", "ISHBENCH_USER", "ISHBENCH_UNSET"};
+static const char *apcVarValues[] =
+   {"/home/someone/projects/shell", "linereader.c", "someone"};
+enum {VAR_COUNT = sizeof(apcVarNames) / sizeof(apcVarNames[0])};
+
+/* The number of allocations made with malloc(), calloc() and
+   realloc(), and the bytes that they asked for. */
+static unsigned long ulAllocs;
+static unsigned long ulAllocBytes;
+
+/*--------------------------------------------------------------------*/
+
+/* The entry points of the C library's allocator, which the
+   functions below wrap so as to count allocations. */
+
+extern void *__libc_malloc(size_t uSize);
+extern void *__libc_calloc(size_t uCount, size_t uSize);
+extern void *__libc_realloc(void *pvOld, size_t uSize);
+
+/*--------------------------------------------------------------------*/
+
+/* Count an allocation of uSize bytes and make it. */
+
+void *malloc(size_t uSize)
+{
+   ulAllocs++;
+   ulAllocBytes += uSize;
+   return __libc_malloc(uSize);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Count an allocation of uCount elements of uSize bytes and make
+   it. */
+
+void *calloc(size_t uCount, size_t uSize)
+{
+   ulAllocs++;
+   ulAllocBytes += uCount * uSize;
+   return __libc_calloc(uCount, uSize);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Count a reallocation of pvOld to uSize bytes and make it. */
+
+void *realloc(void *pvOld, size_t uSize)
+{
+   ulAllocs++;
+   ulAllocBytes += uSize;
+   return __libc_realloc(pvOld, uSize);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* A Corpus is a named set of synthetic lines, kept both as one text
+   with a newline after each line and as an array of strings. */
+
+struct Corpus
+{
+   const char *pcName;
+   char *pcText;
+   size_t uTextLength;
+   char **ppcLines;
+   size_t *puLengths;
+   size_t uCount;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A Measure is the state at the start of a measurement. */
+
+struct Measure
+{
+   double dStart;
+   unsigned long ulAllocs;
+   unsigned long ulAllocBytes;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the name of the executable binary file. */
+
+const char *getPgmName()
+{
+   return pcPgmName;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the current time of the monotonic clock in nanoseconds. */
+
+static double now(void)
+{
+   struct timespec sTime;
+
+   if (clock_gettime(CLOCK_MONOTONIC, &sTime) == -1)
+   {perror(pcPgmName); exit(EXIT_FAILURE); }
+   return (double)sTime.tv_sec * 1e9 + (double)sTime.tv_nsec;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return a pseudo-random number from 0 to uBound-1, from a sequence
+   that is the same on every run, so that every run measures the same
+   corpora. */
+
+static size_t nextRandom(size_t uBound)
+{
+   static unsigned long ulState = 12345;
+
+   ulState = ulState * 6364136223846793005UL + 1442695040888963407UL;
+   return (size_t)(ulState >> 33) % uBound;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write a random word of 1 to 8 characters, none of them special,
+   to psFile. */
+
+static void writeWord(FILE *psFile)
+{
+   static const char acChars[] = "abcdefghijklmnopqrstuvwxyz0123-_./";
+   size_t uLength;
+
+   for (uLength = 1 + nextRandom(8); uLength > 0; uLength--)
+      putc(acChars[nextRandom(sizeof(acChars) - 1)], psFile);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write a random command name to psFile. */
+
+static void writeName(FILE *psFile)
+{
+   static const char *apcNames[] =
+      {"ls", "cat", "echo", "grep", "wc", "sort", "true", "/bin/true"};
+
+   fputs(apcNames[nextRandom(sizeof(apcNames) / sizeof(apcNames[0]))],
+         psFile);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write a line of a command name and up to 3 arguments to
+   psFile. */
+
+static void writeShortLine(FILE *psFile)
+{
+   size_t uArgs;
+
+   writeName(psFile);
+   for (uArgs = nextRandom(4); uArgs > 0; uArgs--)
+   {
+      putc(' ', psFile);
+      writeWord(psFile);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write a line of a command name and 200 to 399 arguments to
+   psFile. */
+
+static void writeLongLine(FILE *psFile)
+{
+   size_t uArgs;
+
+   writeName(psFile);
+   for (uArgs = 200 + nextRandom(200); uArgs > 0; uArgs--)
+   {
+      putc(' ', psFile);
+      writeWord(psFile);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write a line of a command name and 2 to 6 arguments, most of them
+   quoted and holding special characters and spaces, to psFile. */
+
+static void writeQuoteLine(FILE *psFile)
+{
+   static const char *apcSpecials[] = {" ", " | ", " > ", "<", "&"};
+   size_t uArgs;
+   size_t uParts;
+
+   writeName(psFile);
+   for (uArgs = 2 + nextRandom(5); uArgs > 0; uArgs--)
+   {
+      putc(' ', psFile);
+      if (nextRandom(4) == 0)
+      {
+         writeWord(psFile);
+         continue;
+      }
+
+      /* A word whose quoted part may sit between unquoted ones */
+      if (nextRandom(2) == 0)
+         writeWord(psFile);
+      putc('"', psFile);
+      for (uParts = 1 + nextRandom(4); uParts > 0; uParts--)
+      {
+         writeWord(psFile);
+         fputs(apcSpecials[nextRandom(
+            sizeof(apcSpecials) / sizeof(apcSpecials[0]))], psFile);
+      }
+      putc('"', psFile);
+      if (nextRandom(2) == 0)
+         writeWord(psFile);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write a pipeline of 1 to 4 stages to psFile, whose first stage
+   may redirect stdin and whose last may redirect stdout, and which
+   may run in the background. */
+
+static void writeRedirectLine(FILE *psFile)
+{
+   size_t uStages;
+   size_t uStage;
+   size_t uArgs;
+
+   uStages = 1 + nextRandom(4);
+   for (uStage = 0; uStage < uStages; uStage++)
+   {
+      if (uStage > 0)
+         fputs(" | ", psFile);
+      writeName(psFile);
+      for (uArgs = nextRandom(3); uArgs > 0; uArgs--)
+      {
+         putc(' ', psFile);
+         writeWord(psFile);
+      }
+      if (uStage == 0 && nextRandom(2) == 0)
+      {
+         fputs(nextRandom(2) == 0 ? " < " : " <", psFile);
+         writeWord(psFile);
+      }
+      if (uStage == uStages - 1 && nextRandom(3) != 0)
+      {
+         fputs(nextRandom(2) == 0 ? " > " : ">", psFile);
+         writeWord(psFile);
+      }
+   }
+   if (nextRandom(5) == 0)
+      fputs(" &", psFile);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write a line of a command name and 2 to 6 arguments to psFile,
+   each with 1 to 3 references to variables, plain, braced or quoted,
+   among its words. */
+
+static void writeVarLine(FILE *psFile)
+{
+   const char *pcName;
+   size_t uArgs;
+   size_t uRefs;
+
+   writeName(psFile);
+   for (uArgs = 2 + nextRandom(5); uArgs > 0; uArgs--)
+   {
+      putc(' ', psFile);
+      for (uRefs = 1 + nextRandom(3); uRefs > 0; uRefs--)
+      {
+         pcName = apcVarNames[nextRandom(VAR_COUNT)];
+         switch (nextRandom(3))
+         {
+            case 0:
+               fprintf(psFile, "$%s/", pcName);
+               break;
+            case 1:
+               fprintf(psFile, "${%s}", pcName);
+               break;
+            default:
+               fprintf(psFile, "\"$%s ", pcName);
+               writeWord(psFile);
+               putc('"', psFile);
+               break;
+         }
+      }
+      if (nextRandom(2) == 0)
+         writeWord(psFile);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *psCorpus a corpus named pcName of CORPUS_LINES lines,
+   each written by pfWrite. */
+
+static void makeCorpus(struct Corpus *psCorpus, const char *pcName,
+                       void (*pfWrite)(FILE *psFile))
+{
+   FILE *psFile;
+   char *pcText;
+   char *pcLine;
+   size_t uLength;
+   size_t u;
+
+   psFile = open_memstream(&pcText, &uLength);
+   if (psFile == NULL) {perror(pcPgmName); exit(EXIT_FAILURE); }
+   for (u = 0; u < CORPUS_LINES; u++)
+   {
+      (*pfWrite)(psFile);
+      putc('\n', psFile);
+   }
+   if (fclose(psFile) == EOF) {perror(pcPgmName); exit(EXIT_FAILURE); }
+
+   psCorpus->pcName = pcName;
+   psCorpus->pcText = pcText;
+   psCorpus->uTextLength = uLength;
+   psCorpus->uCount = CORPUS_LINES;
+
+   /* The lines are a copy of the text, split at its newlines */
+   psCorpus->ppcLines = (char**)malloc(CORPUS_LINES * sizeof(char*));
+   psCorpus->puLengths = (size_t*)malloc(CORPUS_LINES * sizeof(size_t));
+   pcLine = (char*)malloc(uLength + 1);
+   if (psCorpus->ppcLines == NULL || psCorpus->puLengths == NULL
+       || pcLine == NULL)
+   {perror(pcPgmName); exit(EXIT_FAILURE); }
+   memcpy(pcLine, pcText, uLength + 1);
+   for (u = 0; u < CORPUS_LINES; u++)
+   {
+      psCorpus->ppcLines[u] = pcLine;
+      pcLine = strchr(pcLine, '\n');
+      *pcLine++ = '\0';
+      psCorpus->puLengths[u] = strlen(psCorpus->ppcLines[u]);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Free the memory of *psCorpus. */
+
+static void freeCorpus(struct Corpus *psCorpus)
+{
+   free(psCorpus->ppcLines[0]);
+   free(psCorpus->ppcLines);
+   free(psCorpus->puLengths);
+   free(psCorpus->pcText);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Start the measurement *psMeasure. */
+
+static void startMeasure(struct Measure *psMeasure)
+{
+   psMeasure->ulAllocs = ulAllocs;
+   psMeasure->ulAllocBytes = ulAllocBytes;
+   psMeasure->dStart = now();
+}
+
+/*--------------------------------------------------------------------*/
+
+/* End the measurement *psMeasure of uOps operations of benchmark
+   pcBench on input pcInput, and write its result in one line,
+   starting with pcLabel. */
+
+static void endMeasure(const struct Measure *psMeasure,
+                       const char *pcLabel, const char *pcBench,
+                       const char *pcInput, size_t uOps)
+{
+   double dNanos = now() - psMeasure->dStart;
+   unsigned long ulOpAllocs = ulAllocs - psMeasure->ulAllocs;
+   unsigned long ulOpBytes = ulAllocBytes - psMeasure->ulAllocBytes;
+
+   printf("%s\t%s\t%s\t%lu\t%.1f\t%.3f\t%.1f\n", pcLabel, pcBench,
+          pcInput, (unsigned long)uOps, dNanos / (double)uOps,
+          (double)ulOpAllocs / (double)uOps,
+          (double)ulOpBytes / (double)uOps);
+   if (fflush(stdout) == EOF) {perror(pcPgmName); exit(EXIT_FAILURE); }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Read the lines of the file open as iFd, from its start, with a
+   LineReader, and return how many there were. */
+
+static size_t readFd(int iFd)
+{
+   LineReader_T oReader;
+   size_t uLines = 0;
+
+   if (lseek(iFd, 0, SEEK_SET) == -1)
+   {perror(pcPgmName); exit(EXIT_FAILURE); }
+   oReader = LineReader_new(iFd);
+   while (LineReader_readLine(oReader, NULL) != NULL)
+      uLines++;
+   LineReader_free(oReader);
+   return uLines;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Read the lines of the file named pcFile, mapped into memory, with
+   a LineReader, and return how many there were. */
+
+static size_t readFile(const char *pcFile)
+{
+   LineReader_T oReader;
+   size_t uLines = 0;
+
+   oReader = LineReader_newFile(pcFile);
+   if (oReader == NULL) {perror(pcFile); exit(EXIT_FAILURE); }
+   while (LineReader_readLine(oReader, NULL) != NULL)
+      uLines++;
+   LineReader_free(oReader);
+   return uLines;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Measure reading the lines of psCorpus uRounds times, from a file
+   descriptor and from a mapped file, writing results labeled
+   pcLabel. */
+
+static void benchReadLine(const struct Corpus *psCorpus, size_t uRounds,
+                          const char *pcLabel)
+{
+   char acFile[] = "/tmp/ishbenchXXXXXX";
+   struct Measure sMeasure;
+   size_t uLines = 0;
+   size_t u;
+   int iFd;
+
+   iFd = mkstemp(acFile);
+   if (iFd == -1) {perror(pcPgmName); exit(EXIT_FAILURE); }
+   if (write(iFd, psCorpus->pcText, psCorpus->uTextLength)
+       != (ssize_t)psCorpus->uTextLength)
+   {perror(pcPgmName); exit(EXIT_FAILURE); }
+
+   (void)readFd(iFd);
+   startMeasure(&sMeasure);
+   for (u = 0; u < uRounds; u++)
+      uLines += readFd(iFd);
+   endMeasure(&sMeasure, pcLabel, "readLine", psCorpus->pcName, uLines);
+
+   uLines = 0;
+   (void)readFile(acFile);
+   startMeasure(&sMeasure);
+   for (u = 0; u < uRounds; u++)
+      uLines += readFile(acFile);
+   endMeasure(&sMeasure, pcLabel, "readLineFile", psCorpus->pcName,
+              uLines);
+
+   (void)close(iFd);
+   (void)unlink(acFile);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Lex each line of psCorpus with lexLine(), resetting oArena after
+   each. */
+
+static void lexRound(const struct Corpus *psCorpus, Arena_T oArena)
+{
+   DynArray_T oTokens;
+   size_t u;
+
+   for (u = 0; u < psCorpus->uCount; u++)
+   {
+      oTokens = lexLine(psCorpus->ppcLines[u], oArena);
+      if (oTokens != NULL)
+         DynArray_free(oTokens);
+      Arena_reset(oArena);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Lex each line of psCorpus with lexStream(), resetting oArena after
+   each. */
+
+static void lexStreamRound(const struct Corpus *psCorpus,
+                           Arena_T oArena)
+{
+   size_t u;
+
+   for (u = 0; u < psCorpus->uCount; u++)
+   {
+      (void)lexStream(psCorpus->ppcLines[u], oArena);
+      Arena_reset(oArena);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Parse each of the lexed lines aoTokens[0..uCount) with synArr(),
+   resetting oArena after each. */
+
+static void synRound(DynArray_T aoTokens[], size_t uCount,
+                     Arena_T oArena)
+{
+   size_t u;
+
+   for (u = 0; u < uCount; u++)
+   {
+      (void)synArr(aoTokens[u], oArena);
+      Arena_reset(oArena);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Lex and parse each line of psCorpus with synLine(), as the shell
+   does, resetting oArena after each. */
+
+static void synLineRound(const struct Corpus *psCorpus, Arena_T oArena)
+{
+   size_t u;
+
+   for (u = 0; u < psCorpus->uCount; u++)
+   {
+      (void)synLine(psCorpus->ppcLines[u], oArena);
+      Arena_reset(oArena);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Build a Command of each line of psCorpus from the ordinary tokens
+   aoTokens[u] of that line, and free it by resetting oArena. */
+
+static void commandRound(const struct Corpus *psCorpus,
+                         DynArray_T aoTokens[], Arena_T oArena)
+{
+   Command_T oCommand;
+   Token_T oToken;
+   const char *pcValue;
+   size_t u;
+   size_t uToken;
+
+   for (u = 0; u < psCorpus->uCount; u++)
+   {
+      oCommand = newCommand(psCorpus->puLengths[u], oArena);
+      for (uToken = 0; uToken < DynArray_getLength(aoTokens[u]);
+           uToken++)
+      {
+         oToken = (Token_T)DynArray_get(aoTokens[u], uToken);
+         if (Token_getType(oToken) != ORDINARY_TOKEN)
+            continue;
+         pcValue = Token_getVal(oToken);
+         Command_addChars(oCommand, pcValue, strlen(pcValue));
+         Command_endWord(oCommand, WORD_ARG);
+      }
+      Arena_reset(oArena);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Measure lexing, parsing and building Commands of the lines of
+   psCorpus, each uRounds times, writing results labeled pcLabel.
+   Each benchmark first runs once unmeasured, so that its arena has
+   grown to the size it needs. */
+
+static void benchParse(const struct Corpus *psCorpus, size_t uRounds,
+                       const char *pcLabel)
+{
+   struct Measure sMeasure;
+   DynArray_T *aoTokens;
+   Arena_T oTokenArena;
+   Arena_T oArena;
+   size_t uOps = uRounds * psCorpus->uCount;
+   size_t u;
+
+   oArena = Arena_new();
+
+   lexRound(psCorpus, oArena);
+   startMeasure(&sMeasure);
+   for (u = 0; u < uRounds; u++)
+      lexRound(psCorpus, oArena);
+   endMeasure(&sMeasure, pcLabel, "lexLine", psCorpus->pcName, uOps);
+
+   lexStreamRound(psCorpus, oArena);
+   startMeasure(&sMeasure);
+   for (u = 0; u < uRounds; u++)
+      lexStreamRound(psCorpus, oArena);
+   endMeasure(&sMeasure, pcLabel, "lexStream", psCorpus->pcName, uOps);
+
+   /* Lex every line once for the benchmarks that start from
+      tokens */
+   oTokenArena = Arena_new();
+   aoTokens = (DynArray_T*)malloc(psCorpus->uCount * sizeof(DynArray_T));
+   if (aoTokens == NULL) {perror(pcPgmName); exit(EXIT_FAILURE); }
+   for (u = 0; u < psCorpus->uCount; u++)
+   {
+      aoTokens[u] = lexLine(psCorpus->ppcLines[u], oTokenArena);
+      if (aoTokens[u] == NULL)
+      {
+         fprintf(stderr, "%s: %s: line %lu does not lex\n", pcPgmName,
+                 psCorpus->pcName, (unsigned long)u + 1);
+         exit(EXIT_FAILURE);
+      }
+   }
+
+   synRound(aoTokens, psCorpus->uCount, oArena);
+   startMeasure(&sMeasure);
+   for (u = 0; u < uRounds; u++)
+      synRound(aoTokens, psCorpus->uCount, oArena);
+   endMeasure(&sMeasure, pcLabel, "synArr", psCorpus->pcName, uOps);
+
+   synLineRound(psCorpus, oArena);
+   startMeasure(&sMeasure);
+   for (u = 0; u < uRounds; u++)
+      synLineRound(psCorpus, oArena);
+   endMeasure(&sMeasure, pcLabel, "synLine", psCorpus->pcName, uOps);
+
+   commandRound(psCorpus, aoTokens, oArena);
+   startMeasure(&sMeasure);
+   for (u = 0; u < uRounds; u++)
+      commandRound(psCorpus, aoTokens, oArena);
+   endMeasure(&sMeasure, pcLabel, "newCommand", psCorpus->pcName,
+              uOps);
+
+   for (u = 0; u < psCorpus->uCount; u++)
+      DynArray_free(aoTokens[u]);
+   free(aoTokens);
+   Arena_free(oTokenArena);
+   Arena_free(oArena);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Measure getting the environment of a command from the variables of
+   the shell, which hold the benchmark's environment and EXTRA_VARS
+   more, CORPUS_LINES times per round for uRounds rounds: when no
+   variable has changed since the last command, after a variable
+   that is not exported has, and after an exported one has.  Write
+   the results labeled pcLabel. */
+
+static void benchEnviron(size_t uRounds, const char *pcLabel)
+{
+   struct Measure sMeasure;
+   VarTable_T oVars;
+   char acName[32];
+   size_t uOps = uRounds * CORPUS_LINES;
+   size_t u;
+
+   oVars = VarTable_new(environ);
+   for (u = 0; u < EXTRA_VARS; u++)
+   {
+      snprintf(acName, sizeof(acName), "ISHBENCH_%lu", (unsigned long)u);
+      (void)VarTable_set(oVars, acName, "a value of a typical length",
+                         1);
+   }
+   (void)VarTable_getEnvp(oVars);
+
+   startMeasure(&sMeasure);
+   for (u = 0; u < uOps; u++)
+      (void)VarTable_getEnvp(oVars);
+   endMeasure(&sMeasure, pcLabel, "envp", "unchanged", uOps);
+
+   startMeasure(&sMeasure);
+   for (u = 0; u < uOps; u++)
+   {
+      (void)VarTable_set(oVars, "ISHBENCH_LOCAL", "x", 0);
+      (void)VarTable_getEnvp(oVars);
+   }
+   endMeasure(&sMeasure, pcLabel, "envp", "local", uOps);
+
+   startMeasure(&sMeasure);
+   for (u = 0; u < uOps; u++)
+   {
+      (void)VarTable_set(oVars, "ISHBENCH_EXPORTED", "x", 1);
+      (void)VarTable_getEnvp(oVars);
+   }
+   endMeasure(&sMeasure, pcLabel, "envp", "exported", uOps);
+
+   VarTable_free(oVars);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Measure expanding a pattern that matches a tenth of the GLOB_FILES
+   files of a temporary directory, uRounds times each: with a new
+   PathGlob each time, which reads the directory, and with one that
+   remembers its listing.  Write the results labeled pcLabel. */
+
+static void benchGlob(size_t uRounds, const char *pcLabel)
+{
+   char acDir[] = "/tmp/ishbenchXXXXXX";
+   char acPath[64];
+   char acPattern[64];
+   struct timespec asTimes[2];
+   struct Measure sMeasure;
+   PathGlob_T oGlob;
+   const char **ppcPaths;
+   size_t u;
+   int iFd;
+
+   if (mkdtemp(acDir) == NULL) {perror(pcPgmName); exit(EXIT_FAILURE);}
+   for (u = 0; u < GLOB_FILES; u++)
+   {
+      snprintf(acPath, sizeof(acPath), "%s/data%06lu.%s", acDir,
+               (unsigned long)u, (u % 10 == 5) ? "csv" : "txt");
+      iFd = open(acPath, O_WRONLY | O_CREAT | O_EXCL, 0600);
+      if (iFd == -1) {perror(acPath); exit(EXIT_FAILURE); }
+      close(iFd);
+   }
+   /* A directory changed within the last second is read again each
+      time, so date it back */
+   asTimes[0].tv_sec = asTimes[1].tv_sec = time(NULL) - 60;
+   asTimes[0].tv_nsec = asTimes[1].tv_nsec = 0;
+   if (utimensat(AT_FDCWD, acDir, asTimes, 0) == -1)
+   {perror(acDir); exit(EXIT_FAILURE); }
+   snprintf(acPattern, sizeof(acPattern), "%s/*5.csv", acDir);
+
+   startMeasure(&sMeasure);
+   for (u = 0; u < uRounds; u++)
+   {
+      oGlob = PathGlob_new();
+      if (PathGlob_expand(oGlob, acPattern, strlen(acPattern),
+                          &ppcPaths) != GLOB_FILES / 10)
+      {
+         fprintf(stderr, "%s: %s: wrong matches\n", pcPgmName,
+                 acPattern);
+         exit(EXIT_FAILURE);
+      }
+      PathGlob_free(oGlob);
+   }
+   endMeasure(&sMeasure, pcLabel, "glob", "cold", uRounds);
+
+   oGlob = PathGlob_new();
+   (void)PathGlob_expand(oGlob, acPattern, strlen(acPattern),
+                         &ppcPaths);
+   startMeasure(&sMeasure);
+   for (u = 0; u < uRounds; u++)
+      (void)PathGlob_expand(oGlob, acPattern, strlen(acPattern),
+                            &ppcPaths);
+   endMeasure(&sMeasure, pcLabel, "glob", "cached", uRounds);
+   PathGlob_free(oGlob);
+
+   for (u = 0; u < GLOB_FILES; u++)
+   {
+      snprintf(acPath, sizeof(acPath), "%s/data%06lu.%s", acDir,
+               (unsigned long)u, (u % 10 == 5) ? "csv" : "txt");
+      if (unlink(acPath) == -1) {perror(acPath); exit(EXIT_FAILURE); }
+   }
+   if (rmdir(acDir) == -1) {perror(acDir); exit(EXIT_FAILURE); }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Count the entry of a history that it is applied to in the size_t
+   at pvCount. */
+
+static void countEntry(const char *pcLine, size_t uLength,
+                       size_t uNumber, void *pvCount)
+{
+   (void)pcLine;
+   (void)uLength;
+   (void)uNumber;
+   (*(size_t*)pvCount)++;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Measure a history file of HISTORY_ENTRIES short commands: writing
+   its index once, opening it uRounds times, searching it for the
+   entries that begin with each line of psCorpus of at least
+   MIN_HISTORY_PREFIX characters and with an argument uRounds times,
+   as a search narrows down to one command, and appending each line
+   of psCorpus uRounds times.  Write the results labeled pcLabel. */
+
+static void benchHistory(const struct Corpus *psCorpus, size_t uRounds,
+                         const char *pcLabel)
+{
+   char acFile[] = "/tmp/ishbenchXXXXXX";
+   char acIndex[sizeof(acFile) + sizeof(".idx")];
+   struct Measure sMeasure;
+   History_T oHistory;
+   const char *pcLine;
+   FILE *psFile;
+   size_t uOps = uRounds * psCorpus->uCount;
+   size_t uSearches = 0;
+   size_t uFound = 0;
+   size_t u;
+   int iFd;
+
+   iFd = mkstemp(acFile);
+   if (iFd == -1) {perror(pcPgmName); exit(EXIT_FAILURE); }
+   psFile = fdopen(iFd, "w");
+   if (psFile == NULL) {perror(pcPgmName); exit(EXIT_FAILURE); }
+   for (u = 0; u < HISTORY_ENTRIES; u++)
+   {
+      writeShortLine(psFile);
+      putc('\n', psFile);
+   }
+   if (fclose(psFile) == EOF) {perror(pcPgmName); exit(EXIT_FAILURE); }
+   strcpy(acIndex, acFile);
+   strcat(acIndex, ".idx");
+
+   startMeasure(&sMeasure);
+   oHistory = History_open(acFile);
+   if (oHistory == NULL) exit(EXIT_FAILURE);
+   History_free(oHistory);
+   endMeasure(&sMeasure, pcLabel, "history", "index", 1);
+
+   startMeasure(&sMeasure);
+   for (u = 0; u < uRounds; u++)
+   {
+      oHistory = History_open(acFile);
+      if (oHistory == NULL) exit(EXIT_FAILURE);
+      History_free(oHistory);
+   }
+   endMeasure(&sMeasure, pcLabel, "history", "open", uRounds);
+
+   oHistory = History_open(acFile);
+   if (oHistory == NULL) exit(EXIT_FAILURE);
+   startMeasure(&sMeasure);
+   for (u = 0; u < uOps; u++)
+   {
+      pcLine = psCorpus->ppcLines[u % psCorpus->uCount];
+      if (psCorpus->puLengths[u % psCorpus->uCount]
+          >= MIN_HISTORY_PREFIX && strchr(pcLine, ' ') != NULL)
+      {
+         (void)History_mapPrefix(oHistory, pcLine, countEntry,
+                                 &uFound);
+         uSearches++;
+      }
+   }
+   endMeasure(&sMeasure, pcLabel, "history", "prefix", uSearches);
+
+   startMeasure(&sMeasure);
+   for (u = 0; u < uOps; u++)
+      if (History_add(oHistory, psCorpus->ppcLines[u % psCorpus->uCount],
+                      psCorpus->puLengths[u % psCorpus->uCount]) == -1)
+      {perror(acFile); exit(EXIT_FAILURE); }
+   endMeasure(&sMeasure, pcLabel, "history", "add", uOps);
+   History_free(oHistory);
+
+   if (unlink(acFile) == -1 || unlink(acIndex) == -1)
+   {perror(acFile); exit(EXIT_FAILURE); }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Run the line "/bin/true" uCount times the way the shell runs a
+   foreground pipeline: look up its file, flush, spawn it with method
+   eMethod as a job, wait for the job, and record what it cost.
+   Write the result labeled pcLabel. */
+
+static void benchSpawn(size_t uCount, enum SpawnMethod eMethod,
+                       const char *pcLabel)
+{
+   static const char acLine[] = "/bin/true";
+   struct Measure sMeasure;
+   struct timespec sStart;
+   struct Usage sUsage;
+   const char *pcFile;
+   Pipeline_T oPipeline;
+   VarTable_T oVars;
+   PathCache_T oPaths;
+   EventLoop_T oLoop;
+   JobTable_T oJobs;
+   ForkServer_T oServer = NULL;
+   UsageStats_T oStats;
+   Arena_T oArena;
+   sigset_t sOldSet;
+   pid_t iPid;
+   size_t u;
+   int iJob;
+
+   oArena = Arena_new();
+   oPipeline = synLine(acLine, oArena);
+   oVars = VarTable_new(environ);
+   oPaths = PathCache_new(oVars);
+   oLoop = EventLoop_new(&sOldSet);
+   Spawn_setChildMask(&sOldSet);
+   Spawn_setVars(oVars);
+   oJobs = JobTable_new(oLoop);
+   if (eMethod == SPAWN_SERVER)
+   {
+      oServer = ForkServer_new();
+      Spawn_setServer(oServer);
+      JobTable_setServer(oJobs, oServer);
+   }
+   oStats = UsageStats_new();
+
+   startMeasure(&sMeasure);
+   for (u = 0; u < uCount; u++)
+   {
+      pcFile = PathCache_lookup(oPaths,
+         Command_getName(Pipeline_getCommand(oPipeline, 0)));
+      if (pcFile == NULL) {perror(acLine); exit(EXIT_FAILURE); }
+      if (fflush(NULL) == EOF)
+      {perror(pcPgmName); exit(EXIT_FAILURE); }
+      if (clock_gettime(CLOCK_MONOTONIC, &sStart) == -1)
+      {perror(pcPgmName); exit(EXIT_FAILURE); }
+      if (spawnPipeline(oPipeline, &pcFile, 0, -1, eMethod, &iPid)
+          == 0)
+         exit(EXIT_FAILURE);
+      iJob = JobTable_add(oJobs, acLine, &iPid, 1, 0);
+      if (JobTable_wait(oJobs, iJob, &sStart, &sUsage, 0) == -1)
+      {perror(pcPgmName); exit(EXIT_FAILURE); }
+      UsageStats_addPipeline(oStats, oPipeline, &iPid, &sUsage, 0);
+   }
+   endMeasure(&sMeasure, pcLabel, "spawn", Spawn_getMethodName(eMethod),
+              uCount);
+
+   UsageStats_free(oStats);
+   JobTable_free(oJobs);
+   ForkServer_free(oServer);
+   EventLoop_free(oLoop);
+   Spawn_setVars(NULL);
+   PathCache_free(oPaths);
+   VarTable_free(oVars);
+   Arena_free(oArena);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Run each of a few lines that name builtins that are also standard
+   utilities uCount times the way the shell runs a builtin, within
+   itself, with its redirects applied to the shell's descriptors,
+   and record what each run cost.  Write the results labeled pcLabel,
+   for comparison with spawning an external command. */
+
+static void benchBuiltin(size_t uCount, const char *pcLabel)
+{
+   static const char *apcLines[] =
+   {
+      "true",
+      "test -f /bin/sh",
+      "echo hello > /dev/null",
+      "printf \"%s %d\\n\" hello 42 > /dev/null"
+   };
+   enum {LINE_COUNT = sizeof(apcLines) / sizeof(apcLines[0])};
+   const struct Builtin *psBuiltin;
+   struct ShellState sState;
+   struct Measure sMeasure;
+   Pipeline_T oPipeline;
+   Command_T oCommand;
+   Arena_T oArena;
+   size_t uLine;
+   size_t u;
+
+   oArena = Arena_new();
+   sState.oVars = VarTable_new(environ);
+   sState.oPaths = PathCache_new(sState.oVars);
+   sState.eSpawn = SPAWN_POSIX;
+   sState.uPipeSize = 0;
+   sState.iReportTimes = 0;
+   sState.oJobs = NULL;
+   sState.oParses = NULL;
+   sState.oUsage = UsageStats_new();
+   sState.oHistory = NULL;
+   sState.iExternalUtilities = 0;
+
+   for (uLine = 0; uLine < LINE_COUNT; uLine++)
+   {
+      oPipeline = synLine(apcLines[uLine], oArena);
+      oCommand = Pipeline_getCommand(oPipeline, 0);
+      psBuiltin = Builtin_lookup(Command_getName(oCommand), &sState);
+      if (psBuiltin == NULL)
+      {
+         fprintf(stderr, "%s: %s: not a builtin\n", pcPgmName,
+                 apcLines[uLine]);
+         exit(EXIT_FAILURE);
+      }
+
+      (void)Builtin_run(psBuiltin, oCommand, &sState, 0);
+      startMeasure(&sMeasure);
+      for (u = 0; u < uCount; u++)
+         (void)Builtin_run(psBuiltin, oCommand, &sState, 0);
+      endMeasure(&sMeasure, pcLabel, "builtin", apcLines[uLine],
+                 uCount);
+   }
+
+   UsageStats_free(sState.oUsage);
+   PathCache_free(sState.oPaths);
+   VarTable_free(sState.oVars);
+   Arena_free(oArena);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Measure the stages that the shell puts each line through, on
+   synthetic corpora of short commands, very long argument lists,
+   quote-heavy lines, redirect-heavy pipelines and lines full of
+   references to variables: reading lines from a file descriptor and
+   from a mapped file, lexLine(), lexStream(), synArr(), synLine()
+   and building Commands, getting the environment of a command from
+   the shell's variables, expanding a pattern in a directory of
+   GLOB_FILES files, opening, searching and appending to a history
+   of HISTORY_ENTRIES entries, and then running /bin/true end to end
+   as the shell runs a pipeline, and the builtins true, test, echo
+   and printf within the shell.  -r sets how many times each
+   benchmark runs through a corpus, -n the number of spawns and of
+   runs of each builtin (0 skips them), -s the spawn method, and -l a
+   label, such as a commit, that starts each line of output so that
+   the results of several builds can be concatenated and compared.
+   Writes a header and then one tab-separated line per benchmark and
+   input: the label, the benchmark, the corpus, change, listing,
+   history operation, spawn method or builtin line, the number of
+   operations, and the nanoseconds, allocations and allocated bytes
+   per operation.  Returns 0 iff successful.  As always, argc is the
+   command-line argument count and argv is an array of arguments. */
+
+int main(int argc, char *argv[])
+{
+   size_t uRounds = DEFAULT_ROUNDS;
+   size_t uSpawns = DEFAULT_SPAWNS;
+   enum SpawnMethod eMethod = SPAWN_POSIX;
+   const char *pcLabel = "-";
+   struct Corpus asCorpora[CORPUS_COUNT];
+   VarTable_T oVars;
+   size_t uCorpus;
+   size_t u;
+   int iOpt;
+
+   pcPgmName = argv[0];
+
+   while ((iOpt = getopt(argc, argv, "r:n:s:l:")) != -1)
+   {
+      switch (iOpt) {
+         case 'r':
+            uRounds = (size_t)strtoul(optarg, NULL, 10);
+            break;
+         case 'n':
+            uSpawns = (size_t)strtoul(optarg, NULL, 10);
+            break;
+         case 's':
+            if (! Spawn_parseMethod(optarg, &eMethod))
+            {
+               fprintf(stderr, "%s: unknown spawn method %s\n",
+                       pcPgmName, optarg);
+               exit(EXIT_FAILURE);
+            }
+            break;
+         case 'l':
+            pcLabel = optarg;
+            break;
+         default:
+            fprintf(stderr, "usage: %s [-r rounds] [-n spawns] "
+                    "[-s fork|vfork|posix_spawn|clone|forkserver] "
+                    "[-l label]\n",
+                    pcPgmName);
+            exit(EXIT_FAILURE);
+      }
+   }
+   if (uRounds == 0) uRounds = 1;
+
+   makeCorpus(&asCorpora[0], "short", writeShortLine);
+   makeCorpus(&asCorpora[1], "longargs", writeLongLine);
+   makeCorpus(&asCorpora[2], "quotes", writeQuoteLine);
+   makeCorpus(&asCorpora[3], "redirects", writeRedirectLine);
+   makeCorpus(&asCorpora[4], "variables", writeVarLine);
+
+   /* lexLine() and synLine() replace references as the shell does;
+      lexStream() does not */
+   oVars = VarTable_new(environ);
+   for (u = 0; u + 1 < VAR_COUNT; u++)
+      (void)VarTable_set(oVars, apcVarNames[u], apcVarValues[u], 1);
+   lexSetVars(oVars);
+
+   printf("label\tbench\tinput\tops\tns_per_op\tallocs_per_op"
+          "\tbytes_per_op\n");
+   for (uCorpus = 0; uCorpus < CORPUS_COUNT; uCorpus++)
+   {
+      benchReadLine(&asCorpora[uCorpus], uRounds, pcLabel);
+      benchParse(&asCorpora[uCorpus], uRounds, pcLabel);
+   }
+   benchEnviron(uRounds, pcLabel);
+   benchGlob(uRounds, pcLabel);
+   benchHistory(&asCorpora[0], uRounds, pcLabel);
+   if (uSpawns > 0)
+   {
+      benchSpawn(uSpawns, eMethod, pcLabel);
+      benchBuiltin(uSpawns, pcLabel);
+   }
+
+   lexSetVars(NULL);
+   VarTable_free(oVars);
+   for (uCorpus = 0; uCorpus < CORPUS_COUNT; uCorpus++)
+      freeCorpus(&asCorpora[uCorpus]);
+   return 0;
+}
@@ -7,11 +7,14 @@
 #include "ish.h"
 #include "lexer.h"
 #include "token.h"
+#include "arena.h"
+#include "linereader.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
 
 /*--------------------------------------------------------------------*/
 
@@ -41,16 +44,23 @@ int main(int argc, char *argv[])
 {
    /* Holds the line read in from standard input */
    char *pcLine;
+   /* Splits standard input into lines */
+   LineReader_T oReader;
    /* Holds the tokens parsed from the line */
-   DynArray_T oTokens;
+   TokenStream_T oStream;
+   /* Holds the tokens themselves, released after each line */
+   Arena_T oArena;
    /* Used to determine the success of functions */
    int iRet;
 
    pcPgmName = argv[0];
 
+   oReader = LineReader_new(STDIN_FILENO);
+   oArena = Arena_new();
+
    printf("%% ");
 
-   while ((pcLine = readLine(stdin)) != NULL)
+   while ((pcLine = LineReader_readLine(oReader, NULL)) != NULL)
    {
       /* Print shell prompt */
       printf("%s\n", pcLine);
@@ -58,19 +68,16 @@ int main(int argc, char *argv[])
       if (iRet == -1)
       {perror(pcPgmName); exit(EXIT_FAILURE);}
 
-      /* Parse line, return as DynArray of Tokens */
-      oTokens = lexLine(pcLine);
-      /* Print the Tokens, then free oTokens and Tokens inside it */
-      if (oTokens != NULL)
-      {
-         writeTokens(oTokens);
-         freeTokens(oTokens);
-         DynArray_free(oTokens);
-      }
-      /* Free the parsed line */
-      free(pcLine);
+      /* Parse line, return as a stream of Tokens */
+      oStream = lexStream(pcLine, oArena);
+      /* Print the Tokens */
+      if (oStream != NULL)
+         writeTokenStream(oStream);
+      Arena_reset(oArena);
       printf("%% ");
    }
    printf("\n");
+   Arena_free(oArena);
+   LineReader_free(oReader);
    return 0;
 }
@@ -7,8 +7,11 @@
 #include "ish.h"
 #include "lexer.h"
 #include "token.h"
+#include "linereader.h"
 #include "syner.h"
 #include "command.h"
+#include "pipeline.h"
+#include "arena.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -45,28 +48,41 @@ const char *getPgmName()
 int main(int argc, char *argv[])
 {
    char *pcLine;
+   LineReader_T oReader;
    pid_t iPid;
    int iRet;
 
    DynArray_T oTokens;
+   Pipeline_T oPipeline;
    Command_T oCommand;
+   Arena_T oArena;
 
    pcPgmName = argv[0];
 
+   oReader = LineReader_new(STDIN_FILENO);
+   oArena = Arena_new();
+
    printf("%% ");
 
-   while ((pcLine = readLine(stdin)) != NULL)
+   while ((pcLine = LineReader_readLine(oReader, NULL)) != NULL)
    {
       printf("%s\n", pcLine);
       iRet = fflush(stdout);
       if (iRet == -1)
       {perror(pcPgmName); exit(EXIT_FAILURE);}
-      oTokens = lexLine(pcLine);
+      oTokens = lexLine(pcLine, oArena);
       if (oTokens != NULL)
       {
-         oCommand = synArr(oTokens);
-         if (oCommand != NULL) {
-            
+         oPipeline = synArr(oTokens, oArena);
+         if (oPipeline != NULL && Pipeline_getLength(oPipeline) > 1)
+            fprintf(stderr, "%s: pipelines are not supported\n",
+                    pcPgmName);
+         else if (oPipeline != NULL && Pipeline_isBackground(oPipeline))
+            fprintf(stderr, "%s: background jobs are not supported\n",
+                    pcPgmName);
+         else if (oPipeline != NULL) {
+            oCommand = Pipeline_getCommand(oPipeline, 0);
+
             iRet = fflush(NULL);
             if (iRet == EOF) {perror(pcPgmName); exit(EXIT_FAILURE); }
 
@@ -76,32 +92,8 @@ int main(int argc, char *argv[])
             if (iPid == 0)
             {
                /* This code is executed by the child process only. */
-               DynArray_T oArgs = Command_getArgs(oCommand);
-               size_t u;
-               size_t uLength = DynArray_getLength(oArgs);
-               char* pcCommandName = Command_getName(oCommand);
-
-               /* The working string argument */
-               char *pcArgument;
-
-               /* New string array to hold the arguments of the Command */
-               char **pcArgs = (char **)malloc(sizeof(char*) * (uLength + 1) + 1);
-               if (pcArgs == NULL) {perror(pcPgmName); exit(EXIT_FAILURE); }
-
-               /* First element is the name of the command */
-               *pcArgs = pcCommandName;
-
-               for (u = 0; u < uLength; u++)
-               {
-                  pcArgument = DynArray_get(oArgs, u);
-                  /* Set each element of pcArgs to be the corresponding
-                     element of oArgs from oCommand */
-                  *(pcArgs + u + 1) = pcArgument;
-               }
-               /* Set last element to the null character */
-               *(pcArgs + u + 1) = '\0';
-
-               execvp(pcCommandName, pcArgs);
+               execvp(Command_getName(oCommand),
+                      Command_getArgv(oCommand));
                perror(pcPgmName);
                exit(EXIT_FAILURE);
             }
@@ -112,10 +104,13 @@ int main(int argc, char *argv[])
             iPid = wait(NULL);
             if (iPid == -1) {perror(pcPgmName); exit(EXIT_FAILURE); }
          }
+         DynArray_free(oTokens);
       }
-      free(pcLine);
+      Arena_reset(oArena);
       printf("%% ");
    }
    printf("\n");
+   Arena_free(oArena);
+   LineReader_free(oReader);
    return 0;
 }
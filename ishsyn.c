@@ -7,13 +7,17 @@
 #include "ish.h"
 #include "lexer.h"
 #include "token.h"
+#include "linereader.h"
 #include "syner.h"
 #include "command.h"
+#include "pipeline.h"
+#include "arena.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <unistd.h>
 
 /*--------------------------------------------------------------------*/
 
@@ -43,18 +47,25 @@ int main(int argc, char *argv[])
 {
    /* Holds the line read in from standard input */
    char *pcLine;
+   /* Splits standard input into lines */
+   LineReader_T oReader;
    /* Holds the tokens parsed from the line */
-   DynArray_T oTokens;
+   TokenStream_T oStream;
    /* Used to determine the success of functions */
    int iRet;
-   /* Holds the finished command */
-   Command_T oCommand;
+   /* Holds the finished pipeline of commands */
+   Pipeline_T oPipeline;
+   /* Holds the tokens and the command, released after each line */
+   Arena_T oArena;
 
    pcPgmName = argv[0];
 
+   oReader = LineReader_new(STDIN_FILENO);
+   oArena = Arena_new();
+
    printf("%% ");
 
-   while ((pcLine = readLine(stdin)) != NULL)
+   while ((pcLine = LineReader_readLine(oReader, NULL)) != NULL)
    {
       /* Print shell prompt */
       printf("%s\n", pcLine);
@@ -62,24 +73,23 @@ int main(int argc, char *argv[])
       if (iRet == -1)
       {perror(pcPgmName); exit(EXIT_FAILURE);}
 
-      /* Parse the line for tokens, returned in DynArray */
-      oTokens = lexLine(pcLine);
+      /* Parse the line for tokens, returned in a stream */
+      oStream = lexStream(pcLine, oArena);
 
-      if (oTokens != NULL)
+      if (oStream != NULL)
       {
-         /* Use the token array to create a Command object */
-         oCommand = synArr(oTokens);
-         /* Print the Command, then clear the Command */
-         if (oCommand != NULL) {
-            writeCommand(oCommand);
-            freeCommand(oCommand);
-            DynArray_free(oTokens);
-         }
+         /* Use the token stream to create a Pipeline object */
+         oPipeline = synStream(oStream, oArena);
+         /* Print the Commands of the Pipeline */
+         if (oPipeline != NULL)
+            writePipeline(oPipeline);
       }
-      /* Free up the line read in from stdin */
-      free(pcLine);
+      /* Release the tokens and the Pipeline */
+      Arena_reset(oArena);
       printf("%% ");
    }
    printf("\n");
+   Arena_free(oArena);
+   LineReader_free(oReader);
    return 0;
 }
@@ -0,0 +1,708 @@
+/*--------------------------------------------------------------------*/
+/* jobs.c                                                             */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#include "jobs.h"
+#include "eventloop.h"
+#include "forkserver.h"
+#include "shellfd.h"
+#include "ish.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/*--------------------------------------------------------------------*/
+
+/* A Process is one process of a job. */
+
+struct Process
+{
+   /* The process ID, and a pidfd that becomes readable when the
+      process exits, or -1 if pidfds are not available or the process
+      is a child of a ForkServer. */
+   pid_t iPid;
+   int iPidfd;
+
+   /* The index of the process in the array given to JobTable_add(). */
+   size_t uIndex;
+
+   /* 1 iff the process has not been reaped, and otherwise when it
+      was reaped and the resources it used. */
+   int iLive;
+   struct timespec sReaped;
+   struct rusage sRusage;
+
+   /* The job of the process. */
+   struct Job *psJob;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A Job is the processes of one pipeline. */
+
+struct Job
+{
+   /* The number of the job, and its pipeline. */
+   int iNumber;
+   char *pcText;
+
+   /* The process group of the job, or 0 for the shell's. */
+   pid_t iPgid;
+
+   /* The processes, the number of them, and the number of them that
+      have not been reaped. */
+   struct Process *psProcesses;
+   size_t uCount;
+   size_t uLive;
+
+   /* 1 iff some process of the job was started by a server that died
+      before reporting its exit, so that its exit is unknown. */
+   int iLost;
+
+   /* The job with the next larger number, and the table that holds
+      the job. */
+   struct Job *psNext;
+   JobTable_T oJobs;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A JobTable is a list of Jobs in increasing order of number, whose
+   pidfds are watched by an EventLoop. */
+
+struct JobTable
+{
+   struct Job *psFirst;
+
+   /* The number of the most recently added job that still exists,
+      or 0. */
+   int iLatest;
+
+   /* The number of live processes, and how many of them have no
+      pidfd and so are reaped when a SIGCHLD arrives. */
+   size_t uLive;
+   size_t uUnwatched;
+
+   EventLoop_T oLoop;
+
+   /* The server that starts the processes and reports their exits,
+      or NULL if they are children of the shell. */
+   ForkServer_T oServer;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Return a pidfd for child process iPid, or -1 if the kernel does
+   not provide them.  The pidfd is one of the shell's own
+   descriptors, as ShellFd_move() numbers them. */
+
+static int Job_openPidfd(pid_t iPid)
+{
+#ifdef SYS_pidfd_open
+   return ShellFd_move((int)syscall(SYS_pidfd_open, iPid, 0));
+#else
+   (void)iPid;
+   return -1;
+#endif
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Record that psProcess, which has been reaped, is no longer live,
+   and when. */
+
+static void Job_markReaped(struct Process *psProcess)
+{
+   if (clock_gettime(CLOCK_MONOTONIC, &psProcess->sReaped) == -1)
+   {perror(getPgmName()); exit(EXIT_FAILURE); }
+   psProcess->iLive = 0;
+   psProcess->psJob->uLive--;
+   psProcess->psJob->oJobs->uLive--;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* The EventFunc_T of a pidfd: reap the Process pvProcess, which has
+   exited, recording the resources it used, and stop watching its
+   pidfd.  The process is a zombie until it is reaped, so its process
+   ID cannot have been reused. */
+
+static void Job_handleExit(void *pvProcess)
+{
+   struct Process *psProcess = (struct Process*)pvProcess;
+   int iStatus;
+   pid_t iRet;
+
+   assert(psProcess != NULL);
+   assert(psProcess->iLive);
+
+   do
+      iRet = wait4(psProcess->iPid, &iStatus, 0, &psProcess->sRusage);
+   while (iRet == -1 && errno == EINTR);
+
+   /* A process that a server started before it died is not a child
+      of the shell, which sees only that it has exited */
+   if (iRet == -1 && errno == ECHILD)
+   {
+      memset(&psProcess->sRusage, 0, sizeof(struct rusage));
+      psProcess->psJob->iLost = 1;
+   }
+   else if (iRet == -1) {perror(getPgmName()); exit(EXIT_FAILURE); }
+
+   EventLoop_remove(psProcess->psJob->oJobs->oLoop, psProcess->iPidfd);
+   (void)close(psProcess->iPidfd);
+   Job_markReaped(psProcess);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Free psJob and everything it owns, closing the pidfds of its
+   processes that have not been reaped. */
+
+static void Job_free(struct Job *psJob)
+{
+   struct Process *psProcess;
+   size_t u;
+
+   assert(psJob != NULL);
+
+   for (u = 0; u < psJob->uCount; u++)
+   {
+      psProcess = &psJob->psProcesses[u];
+      if (! psProcess->iLive)
+         continue;
+      psJob->oJobs->uLive--;
+      if (psProcess->iPidfd != -1)
+      {
+         EventLoop_remove(psJob->oJobs->oLoop, psProcess->iPidfd);
+         (void)close(psProcess->iPidfd);
+      }
+      else if (psJob->oJobs->oServer == NULL)
+         psJob->oJobs->uUnwatched--;
+   }
+   free(psJob->psProcesses);
+   free(psJob->pcText);
+   free(psJob);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty JobTable whose processes oLoop
+   watches.  The caller owns it. */
+
+JobTable_T JobTable_new(EventLoop_T oLoop)
+{
+   JobTable_T oJobs;
+
+   assert(oLoop != NULL);
+
+   oJobs = (JobTable_T)malloc(sizeof(struct JobTable));
+   if (oJobs == NULL) {perror(getPgmName()); exit(EXIT_FAILURE); }
+   oJobs->psFirst = NULL;
+   oJobs->iLatest = 0;
+   oJobs->uLive = 0;
+   oJobs->uUnwatched = 0;
+   oJobs->oLoop = oLoop;
+   oJobs->oServer = NULL;
+   return oJobs;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Free oJobs.  Its processes are neither waited for nor reaped. */
+
+void JobTable_free(JobTable_T oJobs)
+{
+   struct Job *psJob;
+   struct Job *psNext;
+
+   assert(oJobs != NULL);
+
+   for (psJob = oJobs->psFirst; psJob != NULL; psJob = psNext)
+   {
+      psNext = psJob->psNext;
+      Job_free(psJob);
+   }
+   if (oJobs->oServer != NULL)
+      EventLoop_remove(oJobs->oLoop, ForkServer_getFd(oJobs->oServer));
+   free(oJobs);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* If the server of oJobs has died, stop watching its socket and
+   forget the server, so that the processes started after that are
+   reaped as children of the shell.  Each process that the server
+   started and that has not been reaped counts as reaped, having used
+   nothing, and its job is marked lost. */
+
+static void JobTable_checkServer(JobTable_T oJobs)
+{
+   struct Job *psJob;
+   struct Process *psProcess;
+   size_t u;
+
+   assert(oJobs->oServer != NULL);
+
+   if (! ForkServer_isLost(oJobs->oServer))
+      return;
+
+   EventLoop_remove(oJobs->oLoop, ForkServer_getFd(oJobs->oServer));
+   for (psJob = oJobs->psFirst; psJob != NULL; psJob = psJob->psNext)
+      for (u = 0; u < psJob->uCount; u++)
+      {
+         psProcess = &psJob->psProcesses[u];
+         if (! psProcess->iLive)
+            continue;
+         memset(&psProcess->sRusage, 0, sizeof(struct rusage));
+         Job_markReaped(psProcess);
+         psJob->iLost = 1;
+      }
+   oJobs->oServer = NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Add to oJobs a job for the processes aiPids[0..uCount) of
+   pipeline pcText, skipping elements that are -1, and return its
+   number.  iPgid is the process group of the job, or 0 if it runs in
+   the shell's group.  oJobs keeps a copy of pcText. */
+
+int JobTable_add(JobTable_T oJobs, const char *pcText,
+                 const pid_t aiPids[], size_t uCount, pid_t iPgid)
+{
+   struct Job *psJob;
+   struct Job **ppsLink;
+   int iNumber = 1;
+   size_t uLength;
+   size_t u;
+
+   assert(oJobs != NULL);
+   assert(pcText != NULL);
+   assert(aiPids != NULL);
+
+   /* A process started after the server died is a child of the
+      shell */
+   if (oJobs->oServer != NULL)
+      JobTable_checkServer(oJobs);
+
+   psJob = (struct Job*)malloc(sizeof(struct Job));
+   if (psJob == NULL) {perror(getPgmName()); exit(EXIT_FAILURE); }
+
+   uLength = strlen(pcText);
+   psJob->pcText = (char*)malloc(uLength + 1);
+   psJob->psProcesses = (struct Process*)malloc(
+      (uCount > 0 ? uCount : 1) * sizeof(struct Process));
+   if (psJob->pcText == NULL || psJob->psProcesses == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE); }
+   memcpy(psJob->pcText, pcText, uLength + 1);
+   psJob->iPgid = iPgid;
+   psJob->iLost = 0;
+
+   psJob->uCount = 0;
+   for (u = 0; u < uCount; u++)
+   {
+      struct Process *psProcess;
+
+      if (aiPids[u] == -1)
+         continue;
+      psProcess = &psJob->psProcesses[psJob->uCount++];
+      psProcess->iPid = aiPids[u];
+      psProcess->iPidfd = (oJobs->oServer == NULL)
+         ? Job_openPidfd(aiPids[u]) : -1;
+      psProcess->uIndex = u;
+      psProcess->iLive = 1;
+      psProcess->psJob = psJob;
+   }
+   psJob->uLive = psJob->uCount;
+   psJob->oJobs = oJobs;
+   oJobs->uLive += psJob->uCount;
+
+   /* The array is complete, so the Processes no longer move */
+   for (u = 0; u < psJob->uCount; u++)
+   {
+      struct Process *psProcess = &psJob->psProcesses[u];
+
+      if (psProcess->iPidfd != -1)
+      {
+         if (EventLoop_add(oJobs->oLoop, psProcess->iPidfd, 0,
+                           Job_handleExit, psProcess) == -1)
+         {perror(getPgmName()); exit(EXIT_FAILURE); }
+      }
+      else if (oJobs->oServer == NULL)
+         oJobs->uUnwatched++;
+   }
+
+   /* Take the smallest free number, keeping the list in order */
+   for (ppsLink = &oJobs->psFirst; *ppsLink != NULL;
+        ppsLink = &(*ppsLink)->psNext)
+   {
+      if ((*ppsLink)->iNumber != iNumber)
+         break;
+      iNumber++;
+   }
+   psJob->iNumber = iNumber;
+   psJob->psNext = *ppsLink;
+   *ppsLink = psJob;
+
+   oJobs->iLatest = iNumber;
+   return iNumber;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the job of oJobs whose number is iJob, or NULL. */
+
+static struct Job *JobTable_find(JobTable_T oJobs, int iJob)
+{
+   struct Job *psJob;
+
+   for (psJob = oJobs->psFirst; psJob != NULL; psJob = psJob->psNext)
+      if (psJob->iNumber == iJob)
+         return psJob;
+   return NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Remove psJob from oJobs and free it. */
+
+static void JobTable_remove(JobTable_T oJobs, struct Job *psJob)
+{
+   struct Job **ppsLink;
+   struct Job *psOther;
+
+   for (ppsLink = &oJobs->psFirst; *ppsLink != psJob;
+        ppsLink = &(*ppsLink)->psNext)
+      assert(*ppsLink != NULL);
+   *ppsLink = psJob->psNext;
+
+   /* The latest job becomes the one with the largest number */
+   if (oJobs->iLatest == psJob->iNumber)
+   {
+      oJobs->iLatest = 0;
+      for (psOther = oJobs->psFirst; psOther != NULL;
+           psOther = psOther->psNext)
+         oJobs->iLatest = psOther->iNumber;
+   }
+   Job_free(psJob);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of the most recently added job of oJobs, or 0
+   if it has none. */
+
+int JobTable_getLatest(JobTable_T oJobs)
+{
+   assert(oJobs != NULL);
+   return oJobs->iLatest;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of the job of oJobs that process iPid belongs
+   to, or 0 if there is none. */
+
+int JobTable_findPid(JobTable_T oJobs, pid_t iPid)
+{
+   struct Job *psJob;
+   size_t u;
+
+   assert(oJobs != NULL);
+
+   for (psJob = oJobs->psFirst; psJob != NULL; psJob = psJob->psNext)
+      for (u = 0; u < psJob->uCount; u++)
+         if (psJob->psProcesses[u].iPid == iPid)
+            return psJob->iNumber;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the pipeline of job iJob of oJobs, and store its process
+   group in *piPgid, or return NULL if there is no such job. */
+
+const char *JobTable_getText(JobTable_T oJobs, int iJob,
+                             pid_t *piPgid)
+{
+   struct Job *psJob;
+
+   assert(oJobs != NULL);
+   assert(piPgid != NULL);
+
+   psJob = JobTable_find(oJobs, iJob);
+   if (psJob == NULL)
+      return NULL;
+   *piPgid = psJob->iPgid;
+   return psJob->pcText;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Reap, without blocking, each process of oJobs that has no pidfd
+   and has exited, recording the resources it used. */
+
+static void JobTable_reapUnwatched(JobTable_T oJobs)
+{
+   struct Job *psJob;
+   struct Process *psProcess;
+   pid_t iRet;
+   size_t u;
+
+   for (psJob = oJobs->psFirst;
+        psJob != NULL && oJobs->uUnwatched > 0; psJob = psJob->psNext)
+      for (u = 0; u < psJob->uCount; u++)
+      {
+         psProcess = &psJob->psProcesses[u];
+         if (! psProcess->iLive || psProcess->iPidfd != -1)
+            continue;
+         iRet = wait4(psProcess->iPid, NULL, WNOHANG,
+                      &psProcess->sRusage);
+
+         /* A process that a server started before it died is not a
+            child of the shell, and cannot be waited for */
+         if (iRet == -1 && errno == ECHILD)
+         {
+            memset(&psProcess->sRusage, 0, sizeof(struct rusage));
+            psJob->iLost = 1;
+         }
+         else if (iRet <= 0)
+            continue;
+         oJobs->uUnwatched--;
+         Job_markReaped(psProcess);
+      }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Record, without blocking, the exit of each process of oJobs that
+   its server has reported.  The shell adds each job as soon as it
+   has started it, so every exit belongs to a process of a job.  If
+   the server has died, forget it, as JobTable_checkServer() does. */
+
+static void JobTable_reapServed(JobTable_T oJobs)
+{
+   struct Job *psJob;
+   struct Process *psProcess;
+   struct rusage sRusage;
+   pid_t iPid;
+   int iStatus;
+   size_t u;
+
+   while (ForkServer_readExit(oJobs->oServer, 0, &iPid, &iStatus,
+                              &sRusage))
+      for (psJob = oJobs->psFirst; psJob != NULL; psJob = psJob->psNext)
+         for (u = 0; u < psJob->uCount; u++)
+         {
+            psProcess = &psJob->psProcesses[u];
+            if (psProcess->iLive && psProcess->iPid == iPid)
+            {
+               psProcess->sRusage = sRusage;
+               Job_markReaped(psProcess);
+            }
+         }
+   JobTable_checkServer(oJobs);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* The EventFunc_T of the socket of a ForkServer: record the exits
+   that the server of JobTable pvJobs has reported. */
+
+static void JobTable_handleServer(void *pvJobs)
+{
+   JobTable_reapServed((JobTable_T)pvJobs);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make oJobs learn of the exits of its processes from oServer, which
+   starts them, instead of waiting for them itself.  oJobs must be
+   empty. */
+
+void JobTable_setServer(JobTable_T oJobs, ForkServer_T oServer)
+{
+   assert(oJobs != NULL);
+   assert(oServer != NULL);
+   assert(oJobs->psFirst == NULL);
+
+   oJobs->oServer = oServer;
+   if (EventLoop_add(oJobs->oLoop, ForkServer_getFd(oServer), 0,
+                     JobTable_handleServer, oJobs) == -1)
+   {perror(getPgmName()); exit(EXIT_FAILURE); }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Reap, without blocking, every process of oJobs that has exited,
+   handling any other events of its EventLoop too, and remove each
+   job whose processes have all exited.  Unless psFile is NULL, write
+   "[n] Done", or "[n] Lost" if the job is lost, and the pipeline of
+   each such job to psFile. */
+
+void JobTable_reap(JobTable_T oJobs, FILE *psFile)
+{
+   struct Job *psJob;
+   struct Job *psNext;
+
+   assert(oJobs != NULL);
+
+   /* Handle the exits that the event loop has not yet seen */
+   if (oJobs->oServer != NULL)
+      JobTable_reapServed(oJobs);
+   if (oJobs->uLive > oJobs->uUnwatched)
+      (void)EventLoop_wait(oJobs->oLoop, 0);
+   if (oJobs->uUnwatched > 0)
+      JobTable_reapUnwatched(oJobs);
+
+   for (psJob = oJobs->psFirst; psJob != NULL; psJob = psNext)
+   {
+      psNext = psJob->psNext;
+      if (psJob->uLive == 0)
+      {
+         if (psFile != NULL)
+            fprintf(psFile, "[%d] %s\t%s\n", psJob->iNumber,
+                    psJob->iLost ? "Lost" : "Done", psJob->pcText);
+         JobTable_remove(oJobs, psJob);
+      }
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Handle the events of the EventLoop of oJobs until every process
+   of job iJob has exited, and then remove the job.  If asUsage is
+   not NULL, store in asUsage[u], for process aiPids[u] given to
+   JobTable_add(), the milliseconds from *psStart until it was reaped
+   and the resources that wait4() reported for it; if asUsage is NULL,
+   psStart may be NULL and nothing is stored.  If iInterruptible and
+   a SIGINT arrives, return -1 with errno set to EINTR, leaving the
+   job in oJobs.  Return 0 if the job finished, or -1 with errno set
+   to ESRCH if there is no such job. */
+
+int JobTable_wait(JobTable_T oJobs, int iJob,
+                  const struct timespec *psStart, struct Usage asUsage[],
+                  int iInterruptible)
+{
+   struct Job *psJob;
+   struct Process *psProcess;
+   size_t u;
+   int iFlags;
+
+   assert(oJobs != NULL);
+   assert(asUsage == NULL || psStart != NULL);
+
+   psJob = JobTable_find(oJobs, iJob);
+   if (psJob == NULL)
+   {
+      errno = ESRCH;
+      return -1;
+   }
+
+   /* Every exit is handled by the event loop, through a pidfd, the
+      socket of the server, or, for a process without either, a
+      SIGCHLD.  The server may have reported some exits already. */
+   if (oJobs->oServer != NULL)
+      JobTable_reapServed(oJobs);
+   if (oJobs->uUnwatched > 0)
+      JobTable_reapUnwatched(oJobs);
+   while (psJob->uLive > 0)
+   {
+      iFlags = EventLoop_wait(oJobs->oLoop, -1);
+      if ((iFlags & EVENT_CHILD) && oJobs->uUnwatched > 0)
+         JobTable_reapUnwatched(oJobs);
+      if ((iFlags & EVENT_INTERRUPT) && iInterruptible
+          && psJob->uLive > 0)
+      {
+         errno = EINTR;
+         return -1;
+      }
+   }
+
+   if (asUsage != NULL)
+      for (u = 0; u < psJob->uCount; u++)
+      {
+         psProcess = &psJob->psProcesses[u];
+         asUsage[psProcess->uIndex].dMillis =
+            (double)(psProcess->sReaped.tv_sec - psStart->tv_sec) * 1e3
+            + (double)(psProcess->sReaped.tv_nsec - psStart->tv_nsec)
+              / 1e6;
+         asUsage[psProcess->uIndex].sRusage = psProcess->sRusage;
+      }
+
+   JobTable_remove(oJobs, psJob);
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Handle the events of the EventLoop of oJobs until every process of
+   one of the jobs aiJobs[0..uCount) has exited, and return the index
+   of that job in aiJobs.  The job stays in oJobs, so that
+   JobTable_wait() can then collect what it used and remove it.
+   Return -1 with errno set to ESRCH if one of the jobs does not
+   exist. */
+
+int JobTable_waitAny(JobTable_T oJobs, const int aiJobs[],
+                     size_t uCount)
+{
+   struct Job *psJob;
+   size_t u;
+   int iFlags;
+
+   assert(oJobs != NULL);
+   assert(aiJobs != NULL);
+   assert(uCount > 0);
+
+   if (oJobs->oServer != NULL)
+      JobTable_reapServed(oJobs);
+   if (oJobs->uUnwatched > 0)
+      JobTable_reapUnwatched(oJobs);
+   for (;;)
+   {
+      for (u = 0; u < uCount; u++)
+      {
+         psJob = JobTable_find(oJobs, aiJobs[u]);
+         if (psJob == NULL)
+         {
+            errno = ESRCH;
+            return -1;
+         }
+         if (psJob->uLive == 0)
+            return (int)u;
+      }
+
+      iFlags = EventLoop_wait(oJobs->oLoop, -1);
+      if ((iFlags & EVENT_CHILD) && oJobs->uUnwatched > 0)
+         JobTable_reapUnwatched(oJobs);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write each job of oJobs, whose processes have not all exited, to
+   psFile: its number, "Running", and its pipeline. */
+
+void JobTable_write(JobTable_T oJobs, FILE *psFile)
+{
+   struct Job *psJob;
+
+   assert(oJobs != NULL);
+   assert(psFile != NULL);
+
+   for (psJob = oJobs->psFirst; psJob != NULL; psJob = psJob->psNext)
+      fprintf(psFile, "[%d] Running\t%s\n", psJob->iNumber,
+              psJob->pcText);
+}
@@ -0,0 +1,131 @@
+/*--------------------------------------------------------------------*/
+/* jobs.h                                                             */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef JOBS_INCLUDED
+#define JOBS_INCLUDED
+
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include "eventloop.h"
+#include "usage.h"
+#include "forkserver.h"
+
+/*--------------------------------------------------------------------*/
+
+/* A JobTable_T object tracks jobs: the processes started for one
+   pipeline, each watched through a pidfd by an EventLoop, so that
+   they are reaped as they exit whenever the shell waits for
+   anything.  Processes started by a ForkServer are instead reaped by
+   the server, which reports their exits.  If the server dies, the
+   processes it started that have not exited are counted as exited,
+   and their jobs are lost: nothing is known of how they ended.  The
+   processes started after that are children of the shell again.
+   Each job has a number, the smallest that no other job has. */
+
+typedef struct JobTable *JobTable_T;
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty JobTable whose processes oLoop
+   watches.  The caller owns it. */
+
+JobTable_T JobTable_new(EventLoop_T oLoop);
+
+/*--------------------------------------------------------------------*/
+
+/* Free oJobs.  Its processes are neither waited for nor reaped. */
+
+void JobTable_free(JobTable_T oJobs);
+
+/*--------------------------------------------------------------------*/
+
+/* Make oJobs learn of the exits of its processes from oServer, which
+   starts them, instead of waiting for them itself.  oJobs must be
+   empty. */
+
+void JobTable_setServer(JobTable_T oJobs, ForkServer_T oServer);
+
+/*--------------------------------------------------------------------*/
+
+/* Add to oJobs a job for the processes aiPids[0..uCount) of
+   pipeline pcText, skipping elements that are -1, and return its
+   number.  iPgid is the process group of the job, or 0 if it runs in
+   the shell's group.  oJobs keeps a copy of pcText. */
+
+int JobTable_add(JobTable_T oJobs, const char *pcText,
+                 const pid_t aiPids[], size_t uCount, pid_t iPgid);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of the most recently added job of oJobs, or 0
+   if it has none. */
+
+int JobTable_getLatest(JobTable_T oJobs);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of the job of oJobs that process iPid belongs
+   to, or 0 if there is none. */
+
+int JobTable_findPid(JobTable_T oJobs, pid_t iPid);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the pipeline of job iJob of oJobs, and store its process
+   group in *piPgid, or return NULL if there is no such job. */
+
+const char *JobTable_getText(JobTable_T oJobs, int iJob,
+                             pid_t *piPgid);
+
+/*--------------------------------------------------------------------*/
+
+/* Reap, without blocking, every process of oJobs that has exited,
+   handling any other events of its EventLoop too, and remove each
+   job whose processes have all exited.  Unless psFile is NULL, write
+   "[n] Done", or "[n] Lost" if the job is lost, and the pipeline of
+   each such job to psFile. */
+
+void JobTable_reap(JobTable_T oJobs, FILE *psFile);
+
+/*--------------------------------------------------------------------*/
+
+/* Handle the events of the EventLoop of oJobs until every process
+   of job iJob has exited, and then remove the job.  If asUsage is
+   not NULL, store in asUsage[u], for process aiPids[u] given to
+   JobTable_add(), the milliseconds from *psStart until it was reaped
+   and the resources that wait4() reported for it; if asUsage is NULL,
+   psStart may be NULL and nothing is stored.  If iInterruptible and
+   a SIGINT arrives, return -1 with errno set to EINTR, leaving the
+   job in oJobs.  Return 0 if the job finished, or -1 with errno set
+   to ESRCH if there is no such job. */
+
+int JobTable_wait(JobTable_T oJobs, int iJob,
+                  const struct timespec *psStart, struct Usage asUsage[],
+                  int iInterruptible);
+
+/*--------------------------------------------------------------------*/
+
+/* Handle the events of the EventLoop of oJobs until every process of
+   one of the jobs aiJobs[0..uCount) has exited, and return the index
+   of that job in aiJobs.  The job stays in oJobs, so that
+   JobTable_wait() can then collect what it used and remove it.
+   Return -1 with errno set to ESRCH if one of the jobs does not
+   exist. */
+
+int JobTable_waitAny(JobTable_T oJobs, const int aiJobs[],
+                     size_t uCount);
+
+/*--------------------------------------------------------------------*/
+
+/* Write each job of oJobs, whose processes have not all exited, to
+   psFile: its number, "Running", and its pipeline. */
+
+void JobTable_write(JobTable_T oJobs, FILE *psFile);
+
+/*--------------------------------------------------------------------*/
+
+#endif
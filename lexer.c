@@ -6,21 +6,308 @@
 #include "lexer.h"
 #include "dynarray.h"
 #include "token.h"
+#include "vartable.h"
 #include "ish.h"
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <stdint.h>
+
+/* Define ISH_NO_SIMD to force the scalar scanning loops. */
+#if defined(__AVX2__) && ! defined(ISH_NO_SIMD)
+#include <immintrin.h>
+#define LEX_AVX2
+#elif defined(__SSE2__) && ! defined(ISH_NO_SIMD)
+#include <emmintrin.h>
+#define LEX_SSE2
+#endif
+
+/*--------------------------------------------------------------------*/
+
+/* The most digits of a descriptor before a redirect operator. */
+enum {MAX_FD_DIGITS = 9};
+
+/* The variables that references are replaced by, or NULL if a '$'
+   always stands for itself. */
+static VarTable_T oLexVars = NULL;
+
+/*--------------------------------------------------------------------*/
+
+/* The scanning functions below look at whole aligned blocks of the
+   line at a time.  An aligned block never crosses a page boundary,
+   so reading the part of a block that lies past the terminating null
+   character, or before pc, cannot fault. */
+
+#if defined(LEX_AVX2)
+
+/* The number of characters in a block. */
+enum {LEX_BLOCK = 32};
+
+/* Return a bit mask with bit i set iff character i of the aligned
+   block at pcBlock is a null character or one of the characters in
+   acStop[0..iStops). */
+
+static unsigned lexMatch(const char *pcBlock, const char acStop[],
+                         int iStops)
+{
+   __m256i vBlock = _mm256_load_si256((const __m256i*)pcBlock);
+   __m256i vHits = _mm256_cmpeq_epi8(vBlock, _mm256_setzero_si256());
+   int i;
+
+   for (i = 0; i < iStops; i++)
+      vHits = _mm256_or_si256(vHits,
+         _mm256_cmpeq_epi8(vBlock, _mm256_set1_epi8(acStop[i])));
+   return (unsigned)_mm256_movemask_epi8(vHits);
+}
+
+#elif defined(LEX_SSE2)
+
+/* The number of characters in a block. */
+enum {LEX_BLOCK = 16};
+
+/* Return a bit mask with bit i set iff character i of the aligned
+   block at pcBlock is a null character or one of the characters in
+   acStop[0..iStops). */
+
+static unsigned lexMatch(const char *pcBlock, const char acStop[],
+                         int iStops)
+{
+   __m128i vBlock = _mm_load_si128((const __m128i*)pcBlock);
+   __m128i vHits = _mm_cmpeq_epi8(vBlock, _mm_setzero_si128());
+   int i;
+
+   for (i = 0; i < iStops; i++)
+      vHits = _mm_or_si128(vHits,
+         _mm_cmpeq_epi8(vBlock, _mm_set1_epi8(acStop[i])));
+   return (unsigned)_mm_movemask_epi8(vHits);
+}
+
+#endif
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of characters at the start of string pc that
+   are not a null character or one of the characters in
+   acStop[0..iStops).  acStop[iStops] must be a null character, and
+   acIsStop[c] must be nonzero exactly for those characters. */
+
+static size_t lexRun(const char *pc, const char acIsStop[],
+                     const char acStop[], int iStops)
+{
+   /* The number of characters checked one at a time first */
+   enum {SHORT_RUN = 8};
+
+   size_t u;
+
+   /* Most words are short, so look at their first few characters
+      before setting up the vector comparisons. */
+   for (u = 0; u < SHORT_RUN; u++)
+      if (acIsStop[(unsigned char)pc[u]])
+         return u;
+   pc += SHORT_RUN;
+
+   {
+#if defined(LEX_AVX2) || defined(LEX_SSE2)
+      const char *pcBlock;
+      unsigned uMask;
+
+      /* Look at the block containing pc, ignoring what precedes
+         pc. */
+      pcBlock = (const char*)((uintptr_t)pc
+                              & ~(uintptr_t)(LEX_BLOCK - 1));
+      uMask = lexMatch(pcBlock, acStop, iStops) >> (pc - pcBlock);
+      if (uMask != 0)
+         return SHORT_RUN + (size_t)__builtin_ctz(uMask);
+
+      for (;;)
+      {
+         pcBlock += LEX_BLOCK;
+         uMask = lexMatch(pcBlock, acStop, iStops);
+         if (uMask != 0)
+            return SHORT_RUN + (size_t)(pcBlock - pc)
+               + (size_t)__builtin_ctz(uMask);
+      }
+#else
+      return SHORT_RUN + strcspn(pc, acStop);
+#endif
+   }
+}
 
 /*--------------------------------------------------------------------*/
 
-/* Lexically analyze string pcLine.  If pcLine contains a lexical
-   error, then return NULL.  Otherwise return a DynArray object
-   containing the tokens in pcLine.  The caller owns the DynArray
-   object and the tokens that it contains. */
+/* Return the number of characters at the start of string pc that
+   the ORDINARY state would append to a token one at a time: those
+   before the first space, '<', '>', '|', '&', '"', '$' or null
+   character. */
 
-DynArray_T lexLine(const char *pcLine)
+size_t lexOrdinaryRun(const char *pc)
+{
+   static const char acStop[] = " <>|&\"$";
+   static const char acIsStop[256] =
+      {['\0'] = 1, [' '] = 1, ['<'] = 1, ['>'] = 1, ['|'] = 1,
+       ['&'] = 1, ['"'] = 1, ['$'] = 1};
+   return lexRun(pc, acIsStop, acStop, (int)sizeof(acStop) - 1);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of characters at the start of string pc that
+   the QUOTE state would append to a token one at a time: those
+   before the first '"', '$' or null character. */
+
+size_t lexQuotedRun(const char *pc)
+{
+   static const char acStop[] = "\"$";
+   static const char acIsStop[256] =
+      {['\0'] = 1, ['"'] = 1, ['$'] = 1};
+   return lexRun(pc, acIsStop, acStop, (int)sizeof(acStop) - 1);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of characters of the special token that starts
+   at string pc, whose first character is '<', '>', '|' or '&'.  A
+   redirect operator is one of "<", ">", ">>", "<&", ">&", "<<" and
+   "<<<"; any other special character is a token by itself. */
+
+size_t lexSpecialLength(const char *pc)
+{
+   assert(pc != NULL);
+
+   if (pc[0] != '<' && pc[0] != '>')
+      return 1;
+   if (pc[0] == '<' && pc[1] == '<' && pc[2] == '<')
+      return 3;
+   if (pc[1] == '&' || pc[1] == pc[0])
+      return 2;
+   return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 iff the uLength characters at pc are the digits of a file
+   descriptor that a redirect operator right after them applies to:
+   from one to nine decimal digits.  Otherwise return 0. */
+
+int lexIsDescriptor(const char *pc, size_t uLength)
+{
+   size_t u;
+
+   assert(pc != NULL);
+
+   if (uLength == 0 || uLength > MAX_FD_DIGITS)
+      return 0;
+   for (u = 0; u < uLength; u++)
+      if (! isdigit((unsigned char)pc[u]))
+         return 0;
+   return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make lexLine() and synLine() replace each reference to a variable
+   with the value of that variable of oVars, or, if oVars is NULL,
+   leave every '$' as it is. */
+
+void lexSetVars(VarTable_T oVars)
+{
+   oLexVars = oVars;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 iff string pc, whose first character is '$', starts with
+   "${" or with a '$' followed by a letter or underscore, which
+   lexVariable() replaces, or rejects, once lexSetVars() has set
+   variables.  Otherwise return 0. */
+
+int lexIsReference(const char *pc)
+{
+   assert(pc != NULL);
+   assert(*pc == '$');
+
+   return pc[1] == '{' || isalpha((unsigned char)pc[1]) || pc[1] == '_';
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of characters at the start of string pc, whose
+   first character is '$', that stand for one value, and store that
+   value in *ppcValue.  A reference to a variable, "$NAME" or
+   "${NAME}", stands for the value of the variable, or for nothing if
+   it is not set; any other '$' stands for itself.  Return 0 if pc
+   starts with "${" but not with a reference. */
+
+size_t lexVariable(const char *pc, const char **ppcValue)
+{
+   /* The characters before the name */
+   size_t uStart;
+
+   /* The number of characters of the name */
+   size_t uName = 0;
+
+   assert(pc != NULL);
+   assert(*pc == '$');
+   assert(ppcValue != NULL);
+
+   *ppcValue = "$";
+   if (oLexVars == NULL)
+      return 1;
+
+   uStart = (pc[1] == '{') ? 2 : 1;
+   if (isalpha((unsigned char)pc[uStart]) || pc[uStart] == '_')
+      do
+         uName++;
+      while (isalnum((unsigned char)pc[uStart + uName])
+             || pc[uStart + uName] == '_');
+
+   if (uStart == 2 && (uName == 0 || pc[uStart + uName] != '}'))
+      return 0;
+   if (uName == 0)
+      return 1;
+
+   *ppcValue = VarTable_getRange(oLexVars, pc + uStart, uName);
+   if (*ppcValue == NULL)
+      *ppcValue = "";
+   return uStart + uName + (uStart == 2);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 iff the last token of oTokens is a "<<" operator, so that
+   the word after it is the delimiter of a here-document, in which a
+   '$' stands for itself.  Otherwise return 0. */
+
+static int lexIsHereDocOperator(DynArray_T oTokens)
+{
+   Token_T psToken;
+   const char *pcValue;
+   size_t uLength;
+
+   uLength = DynArray_getLength(oTokens);
+   if (uLength == 0)
+      return 0;
+   psToken = (Token_T)DynArray_get(oTokens, uLength - 1);
+   if (Token_getType(psToken) != SPECIAL_TOKEN)
+      return 0;
+   pcValue = Token_getVal(psToken);
+   uLength = strlen(pcValue);
+   return uLength >= 2 && strcmp(pcValue + uLength - 2, "<<") == 0
+      && (uLength == 2 || pcValue[uLength - 3] != '<');
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Lexically analyze string pcLine, replacing each reference to a
+   variable as lexVariable() does, except in the delimiter of a
+   here-document.  If pcLine contains a lexical error, then return
+   NULL.  Otherwise return a DynArray object containing the tokens in
+   pcLine.  The caller owns the DynArray object; the tokens that it
+   contains are allocated from oArena. */
+
+DynArray_T lexLine(const char *pcLine, Arena_T oArena)
 {
    /* lexLine() uses a DFA approach.  It "reads" its characters from
       pcLine. The DFA has these four states: */
@@ -30,15 +317,35 @@ DynArray_T lexLine(const char *pcLine)
    /* The current state of the DFA. */
    enum LexState eState = STATE_START;
 
-   /* An index into pcLine. */
+   /* An index into pcLine, and the length of pcLine. */
    size_t uLineIndex = 0;
+   size_t uLineLength;
 
    /* Pointer to a buffer in which the characters comprising each
       token are accumulated. */
    char *pcBuffer;
 
-   /* An index into the buffer. */
-   int uBufferIndex = 0;
+   /* The size of the buffer, and an index into it. */
+   size_t uBufferSize;
+   size_t uBufferIndex = 0;
+
+   /* 1 iff the token in the buffer contained quotes, and 1 iff it
+      contained a '$'. */
+   int iQuoted = 0;
+   int iExpanded = 0;
+
+   /* The number of characters of a special token */
+   size_t uSpecial;
+
+   /* The length of a run of characters that can be copied at once */
+   size_t uRun;
+
+   /* The number of characters of a '$' and what follows it that
+      stand for pcValue, and the length of pcValue */
+   size_t uRef;
+   const char *pcValue;
+   size_t uValue;
+   char *pcGrown;
 
    /* Holds each character and the finished token, which are
       all stored within the DynArray oTokens */
@@ -50,6 +357,7 @@ DynArray_T lexLine(const char *pcLine)
    int iSuccessful;
 
    assert(pcLine != NULL);
+   assert(oArena != NULL);
 
    /* Create an empty token DynArray object. */
    oTokens = DynArray_new(0);
@@ -57,16 +365,73 @@ DynArray_T lexLine(const char *pcLine)
    {perror(getPgmName()); exit(EXIT_FAILURE);}
 
    /* Allocate memory for a buffer that is large enough to store the
-      largest token that might appear within pcLine. */
-   pcBuffer = (char*)malloc(strlen(pcLine) + 1);
-   if (pcBuffer == NULL)
-   {perror(getPgmName()); exit(EXIT_FAILURE);}
+      largest token that might appear within pcLine.  It grows only
+      when a value is longer than the reference it replaces, so that
+      it always has room for the rest of pcLine. */
+   uLineLength = strlen(pcLine);
+   uBufferSize = uLineLength + 1;
+   pcBuffer = (char*)Arena_alloc(oArena, uBufferSize);
 
    for (;;)
    {
+      /* Inside a word or a quote, copy the whole run of characters
+         that the DFA would append one at a time, so that the switch
+         below sees only the character that ends it. */
+      if (eState == STATE_ORDINARY || eState == STATE_QUOTE)
+      {
+         if (eState == STATE_ORDINARY)
+            uRun = lexOrdinaryRun(pcLine + uLineIndex);
+         else
+            uRun = lexQuotedRun(pcLine + uLineIndex);
+         memcpy(pcBuffer + uBufferIndex, pcLine + uLineIndex, uRun);
+         uBufferIndex += uRun;
+         uLineIndex += uRun;
+      }
+
       /* "Read" the next character from pcLine. */
       c = pcLine[uLineIndex++];
 
+      /* Append what a '$' stands for to the token, starting one
+         outside a word, without looking at it again.  The delimiter
+         of a here-document is not expanded. */
+      if (c == '$')
+      {
+         if (lexIsHereDocOperator(oTokens))
+         {
+            uRef = 1;
+            pcValue = "$";
+         }
+         else
+            uRef = lexVariable(pcLine + uLineIndex - 1, &pcValue);
+         if (uRef == 0)
+         {
+            fprintf(stderr, "%s: bad substitution\n", getPgmName());
+            DynArray_free(oTokens);
+            return NULL;
+         }
+         uLineIndex += uRef - 1;
+         uValue = strlen(pcValue);
+         if (uBufferIndex + uValue + (uLineLength - uLineIndex) + 1
+             > uBufferSize)
+         {
+            uBufferSize = 2 * (uBufferIndex + uValue
+                               + (uLineLength - uLineIndex) + 1);
+            pcGrown = (char*)Arena_alloc(oArena, uBufferSize);
+            memcpy(pcGrown, pcBuffer, uBufferIndex);
+            pcBuffer = pcGrown;
+         }
+         memcpy(pcBuffer + uBufferIndex, pcValue, uValue);
+         uBufferIndex += uValue;
+
+         if (eState == STATE_START || eState == STATE_SPECIAL)
+         {
+            iQuoted = 0;
+            eState = STATE_ORDINARY;
+         }
+         iExpanded = 1;
+         continue;
+      }
+
       switch (eState)
       {
          /* Handle the START state. */
@@ -75,17 +440,19 @@ DynArray_T lexLine(const char *pcLine)
             if (c == '\0')
             {
                /* Exit */
-               free(pcBuffer);
                return oTokens;
             }
             /* Special characters */
-            else if (c == '<' || c == '>')
+            else if (c == '<' || c == '>' || c == '|' || c == '&')
             {
-               pcBuffer[uBufferIndex++] = c;
+               uSpecial = lexSpecialLength(pcLine + uLineIndex - 1);
+               memcpy(pcBuffer, pcLine + uLineIndex - 1, uSpecial);
+               uBufferIndex = uSpecial;
+               uLineIndex += uSpecial - 1;
 
                /* Create a SPECIAL token. */
                pcBuffer[uBufferIndex] = '\0';
-               psToken = newToken(SPECIAL_TOKEN, pcBuffer);
+               psToken = newToken(SPECIAL_TOKEN, pcBuffer, oArena);
                iSuccessful = DynArray_add(oTokens, psToken);
                if (! iSuccessful)
                {perror(getPgmName()); exit(EXIT_FAILURE);}
@@ -96,12 +463,16 @@ DynArray_T lexLine(const char *pcLine)
             /* Start of a quote */
             else if (c == '"')
             {
+               iQuoted = 1;
+               iExpanded = 0;
                eState = STATE_QUOTE;
             }
             else if (c == ' ')
                eState = STATE_START;
             else
             {
+               iQuoted = 0;
+               iExpanded = 0;
                pcBuffer[uBufferIndex++] = c;
                eState = STATE_ORDINARY;
             }
@@ -112,16 +483,18 @@ DynArray_T lexLine(const char *pcLine)
             if (c == '\0')
             {
                /* Exit */
-               free(pcBuffer);
                return oTokens;
             }
-            else if (c == '<' || c == '>')
+            else if (c == '<' || c == '>' || c == '|' || c == '&')
             {
-               pcBuffer[uBufferIndex++] = c;
+               uSpecial = lexSpecialLength(pcLine + uLineIndex - 1);
+               memcpy(pcBuffer, pcLine + uLineIndex - 1, uSpecial);
+               uBufferIndex = uSpecial;
+               uLineIndex += uSpecial - 1;
 
                /* Create a SPECIAL token. */
                pcBuffer[uBufferIndex] = '\0';
-               psToken = newToken(SPECIAL_TOKEN, pcBuffer);
+               psToken = newToken(SPECIAL_TOKEN, pcBuffer, oArena);
                iSuccessful = DynArray_add(oTokens, psToken);
                if (! iSuccessful)
                {perror(getPgmName()); exit(EXIT_FAILURE);}
@@ -136,10 +509,14 @@ DynArray_T lexLine(const char *pcLine)
             /* Start of a quote */
             else if (c == '"')
             {
+               iQuoted = 1;
+               iExpanded = 0;
                eState = STATE_QUOTE;
             }
             else
             {
+               iQuoted = 0;
+               iExpanded = 0;
                pcBuffer[uBufferIndex++] = c;
                eState = STATE_ORDINARY;
             }
@@ -149,33 +526,51 @@ DynArray_T lexLine(const char *pcLine)
          case STATE_ORDINARY:
             if (c == '\0')
             {
-               /* Create an ORDINARY token. */
-               pcBuffer[uBufferIndex] = '\0';
-               psToken = newToken(ORDINARY_TOKEN, pcBuffer);
-               iSuccessful = DynArray_add(oTokens, psToken);
-               if (! iSuccessful)
-               {perror(getPgmName()); exit(EXIT_FAILURE);}
+               /* Create an ORDINARY token, unless it is nothing but
+                  references to unset variables. */
+               if (uBufferIndex > 0 || iQuoted)
+               {
+                  pcBuffer[uBufferIndex] = '\0';
+                  psToken = newToken(ORDINARY_TOKEN, pcBuffer, oArena);
+                  iSuccessful = DynArray_add(oTokens, psToken);
+                  if (! iSuccessful)
+                  {perror(getPgmName()); exit(EXIT_FAILURE);}
+               }
                uBufferIndex = 0;
                /* Exit */
-               free(pcBuffer);
                return oTokens;
             }
             /* Special character */
-            else if (c == '<' || c == '>')
+            else if (c == '<' || c == '>' || c == '|' || c == '&')
             {
-               /* Create an ORDINARY token. */
-               pcBuffer[uBufferIndex] = '\0';
-               psToken = newToken(ORDINARY_TOKEN, pcBuffer);
-               iSuccessful = DynArray_add(oTokens, psToken);
-               if (! iSuccessful)
-               {perror(getPgmName()); exit(EXIT_FAILURE);}
-               uBufferIndex = 0;
+               /* Unquoted digits right before a redirect operator are
+                  part of it, and otherwise create an ORDINARY token,
+                  unless it is nothing but references to unset
+                  variables. */
+               if ((c == '|' || c == '&') || iQuoted || iExpanded
+                   || ! lexIsDescriptor(pcBuffer, uBufferIndex))
+               {
+                  if (uBufferIndex > 0 || iQuoted)
+                  {
+                     pcBuffer[uBufferIndex] = '\0';
+                     psToken = newToken(ORDINARY_TOKEN, pcBuffer,
+                                        oArena);
+                     iSuccessful = DynArray_add(oTokens, psToken);
+                     if (! iSuccessful)
+                     {perror(getPgmName()); exit(EXIT_FAILURE);}
+                  }
+                  uBufferIndex = 0;
+               }
 
-               pcBuffer[uBufferIndex++] = c;
+               uSpecial = lexSpecialLength(pcLine + uLineIndex - 1);
+               memcpy(pcBuffer + uBufferIndex, pcLine + uLineIndex - 1,
+                      uSpecial);
+               uBufferIndex += uSpecial;
+               uLineIndex += uSpecial - 1;
 
                /* Create a SPECIAL token. */
                pcBuffer[uBufferIndex] = '\0';
-               psToken = newToken(SPECIAL_TOKEN, pcBuffer);
+               psToken = newToken(SPECIAL_TOKEN, pcBuffer, oArena);
                iSuccessful = DynArray_add(oTokens, psToken);
                if (! iSuccessful)
                {perror(getPgmName()); exit(EXIT_FAILURE);}
@@ -186,16 +581,21 @@ DynArray_T lexLine(const char *pcLine)
             /* Start of a quote */
             else if (c == '"')
             {
+               iQuoted = 1;
                eState = STATE_QUOTE;
             }
             else if (c == ' ')
             {
-               /* Create an ORDINARY token. */
-               pcBuffer[uBufferIndex] = '\0';
-               psToken = newToken(ORDINARY_TOKEN, pcBuffer);
-               iSuccessful = DynArray_add(oTokens, psToken);
-               if (! iSuccessful)
-               {perror(getPgmName()); exit(EXIT_FAILURE);}
+               /* Create an ORDINARY token, unless it is nothing but
+                  references to unset variables. */
+               if (uBufferIndex > 0 || iQuoted)
+               {
+                  pcBuffer[uBufferIndex] = '\0';
+                  psToken = newToken(ORDINARY_TOKEN, pcBuffer, oArena);
+                  iSuccessful = DynArray_add(oTokens, psToken);
+                  if (! iSuccessful)
+                  {perror(getPgmName()); exit(EXIT_FAILURE);}
+               }
                uBufferIndex = 0;
 
                eState = STATE_START;
@@ -213,8 +613,6 @@ DynArray_T lexLine(const char *pcLine)
             if (c == '\0')
             {
                fprintf(stderr, "%s: unmatched quote\n", getPgmName());
-               free(pcBuffer);
-               freeTokens(oTokens);
                DynArray_free(oTokens);
                return NULL;
             }
@@ -235,3 +633,196 @@ DynArray_T lexLine(const char *pcLine)
       }
    }
 }
+
+/*--------------------------------------------------------------------*/
+
+/* Lexically analyze string pcLine with the same DFA as lexLine().  If
+   pcLine contains a lexical error, then return NULL.  Otherwise
+   return a TokenStream object containing the tokens in pcLine.  A
+   token is copied only if it contains quotes, which must be removed;
+   every other token is recorded as a slice of pcLine.  References to
+   variables are not replaced, so a '$' stands for itself.  The
+   stream is allocated from oArena. */
+
+TokenStream_T lexStream(const char *pcLine, Arena_T oArena)
+{
+   enum LexState {STATE_START, STATE_SPECIAL,
+                  STATE_ORDINARY, STATE_QUOTE};
+
+   /* The current state of the DFA. */
+   enum LexState eState = STATE_START;
+
+   /* An index into pcLine. */
+   size_t uLineIndex = 0;
+
+   /* The offset in pcLine where the current token began. */
+   size_t uTokenStart = 0;
+
+   /* 1 iff the current token is being copied into pcText because it
+      contains quotes. */
+   int iCopying = 0;
+
+   /* The text buffer of the stream, the offset in it where the
+      current copied token began, and the offset of its next
+      character. */
+   char *pcText = NULL;
+   size_t uTextStart = 0;
+   size_t uTextIndex = 0;
+
+   /* The length of a run of characters that can be handled at once */
+   size_t uRun;
+
+   /* The number of characters of a special token */
+   size_t uSpecial;
+
+   char c;
+   TokenStream_T oStream;
+
+   assert(pcLine != NULL);
+   assert(oArena != NULL);
+
+   oStream = newTokenStream(pcLine, strlen(pcLine), oArena);
+
+   for (;;)
+   {
+      /* Inside a word or a quote, skip the whole run of characters
+         that the DFA would handle one at a time, copying it only if
+         the token is being copied. */
+      if (eState == STATE_ORDINARY)
+      {
+         uRun = lexOrdinaryRun(pcLine + uLineIndex);
+         if (iCopying)
+         {
+            memcpy(pcText + uTextIndex, pcLine + uLineIndex, uRun);
+            uTextIndex += uRun;
+         }
+         uLineIndex += uRun;
+      }
+      else if (eState == STATE_QUOTE)
+      {
+         uRun = lexQuotedRun(pcLine + uLineIndex);
+         memcpy(pcText + uTextIndex, pcLine + uLineIndex, uRun);
+         uTextIndex += uRun;
+         uLineIndex += uRun;
+      }
+
+      /* "Read" the next character from pcLine. */
+      c = pcLine[uLineIndex++];
+
+      switch (eState)
+      {
+         /* The START and SPECIAL states accept the same input. */
+         case STATE_START:
+         case STATE_SPECIAL:
+            if (c == '\0')
+               return oStream;
+            else if (c == '<' || c == '>' || c == '|' || c == '&')
+            {
+               uSpecial = lexSpecialLength(pcLine + uLineIndex - 1);
+               TokenStream_addSlice(oStream, SPECIAL_TOKEN,
+                                    uLineIndex - 1, uSpecial);
+               uLineIndex += uSpecial - 1;
+               eState = STATE_SPECIAL;
+            }
+            /* A token that starts with a quote is always copied */
+            else if (c == '"')
+            {
+               if (pcText == NULL)
+                  pcText = TokenStream_getTextBuffer(oStream);
+               iCopying = 1;
+               uTextStart = uTextIndex;
+               eState = STATE_QUOTE;
+            }
+            else if (c == ' ')
+               ;
+            else
+            {
+               iCopying = 0;
+               uTokenStart = uLineIndex - 1;
+               eState = STATE_ORDINARY;
+            }
+            break;
+
+            /* Handle the ORDINARY state. */
+         case STATE_ORDINARY:
+            if (c == '\0' || c == '<' || c == '>' || c == '|'
+                || c == '&' || c == ' ')
+            {
+               /* Unquoted digits right before a redirect operator are
+                  part of it */
+               if ((c == '<' || c == '>') && ! iCopying
+                   && lexIsDescriptor(pcLine + uTokenStart,
+                                      uLineIndex - 1 - uTokenStart))
+               {
+                  uSpecial = lexSpecialLength(pcLine + uLineIndex - 1);
+                  TokenStream_addSlice(oStream, SPECIAL_TOKEN,
+                                       uTokenStart,
+                                       uLineIndex - 1 - uTokenStart
+                                       + uSpecial);
+                  uLineIndex += uSpecial - 1;
+                  eState = STATE_SPECIAL;
+                  break;
+               }
+
+               /* Create an ORDINARY token. */
+               if (iCopying)
+                  TokenStream_addText(oStream, uTextStart,
+                                      uTextIndex - uTextStart);
+               else
+                  TokenStream_addSlice(oStream, ORDINARY_TOKEN,
+                                       uTokenStart,
+                                       uLineIndex - 1 - uTokenStart);
+
+               if (c == '\0')
+                  return oStream;
+               else if (c == ' ')
+                  eState = STATE_START;
+               else
+               {
+                  uSpecial = lexSpecialLength(pcLine + uLineIndex - 1);
+                  TokenStream_addSlice(oStream, SPECIAL_TOKEN,
+                                       uLineIndex - 1, uSpecial);
+                  uLineIndex += uSpecial - 1;
+                  eState = STATE_SPECIAL;
+               }
+            }
+            /* Start of a quote */
+            else if (c == '"')
+            {
+               /* Copy what the token holds so far into pcText */
+               if (! iCopying)
+               {
+                  if (pcText == NULL)
+                     pcText = TokenStream_getTextBuffer(oStream);
+                  uTextStart = uTextIndex;
+                  memcpy(pcText + uTextIndex, pcLine + uTokenStart,
+                         uLineIndex - 1 - uTokenStart);
+                  uTextIndex += uLineIndex - 1 - uTokenStart;
+                  iCopying = 1;
+               }
+               eState = STATE_QUOTE;
+            }
+            else if (iCopying)
+               pcText[uTextIndex++] = c;
+            break;
+
+            /* Handle the QUOTE state. */
+         case STATE_QUOTE:
+            /* Cannot exit with an open quote */
+            if (c == '\0')
+            {
+               fprintf(stderr, "%s: unmatched quote\n", getPgmName());
+               return NULL;
+            }
+            /* End of a quote */
+            else if (c == '"')
+               eState = STATE_ORDINARY;
+            else
+               pcText[uTextIndex++] = c;
+            break;
+
+         default:
+            assert(0);
+      }
+   }
+}
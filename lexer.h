@@ -8,14 +8,97 @@
 
 #include <stddef.h>
 #include "dynarray.h"
+#include "arena.h"
+#include "token.h"
+#include "vartable.h"
 
 /*--------------------------------------------------------------------*/
 
 /* Analyzes the line pcLine and classifies each token as ordinary or
-   special (IO redirect). Return a new DynArray_T object whose length 
-   is uLength, or NULL if insufficient memory is available. */
+   special (redirect operator, pipe or background), replacing each
+   reference to a variable as lexVariable() does, except in the
+   delimiter of a here-document.  Return a new
+   DynArray_T object containing the tokens, or NULL if pcLine
+   contains a lexical error.  The tokens are allocated from oArena;
+   the caller owns the DynArray. */
 
-DynArray_T lexLine(const char *pcLine);
+DynArray_T lexLine(const char *pcLine, Arena_T oArena);
+
+/*--------------------------------------------------------------------*/
+
+/* Analyzes the line pcLine in the same way as lexLine(), but returns
+   its tokens as a TokenStream_T object that refers back into pcLine,
+   or NULL if pcLine contains a lexical error.  References to
+   variables are not replaced.  The stream is allocated from
+   oArena. */
+
+TokenStream_T lexStream(const char *pcLine, Arena_T oArena);
+
+/*--------------------------------------------------------------------*/
+
+/* Make lexLine() and synLine() replace each reference to a variable
+   with the value of that variable of oVars, or, if oVars is NULL,
+   leave every '$' as it is.  Nothing is replaced until this is
+   called. */
+
+void lexSetVars(VarTable_T oVars);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of characters at the start of string pc, whose
+   first character is '$', that stand for one value, and store that
+   value in *ppcValue.  A reference to a variable, "$NAME" or
+   "${NAME}", where NAME is a letter or underscore followed by any
+   letters, digits and underscores, stands for the value of the
+   variable, or for nothing if it is not set.  Any other '$' stands
+   for itself, as does every '$' while lexSetVars() has set no
+   variables.  Return 0 if pc starts with "${" but not with a
+   reference.  The value is valid until the variable changes. */
+
+size_t lexVariable(const char *pc, const char **ppcValue);
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 iff string pc, whose first character is '$', starts with
+   "${" or with a '$' followed by a letter or underscore, which
+   lexVariable() replaces, or rejects, once lexSetVars() has set
+   variables.  Otherwise return 0. */
+
+int lexIsReference(const char *pc);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of characters of the special token that starts
+   at string pc, whose first character is '<', '>', '|' or '&'.  A
+   redirect operator is one of "<", ">", ">>", "<&", ">&", "<<" and
+   "<<<"; any other special character is a token by itself. */
+
+size_t lexSpecialLength(const char *pc);
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 iff the uLength characters at pc are the digits of a file
+   descriptor that a redirect operator right after them applies to:
+   from one to nine decimal digits.  Otherwise return 0. */
+
+int lexIsDescriptor(const char *pc, size_t uLength);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of characters at the start of string pc that
+   the ORDINARY state would append to a token one at a time: those
+   before the first space, '<', '>', '|', '&', '"', '$' or null
+   character. */
+
+size_t lexOrdinaryRun(const char *pc);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the number of characters at the start of string pc that
+   the QUOTE state would append to a token one at a time: those
+   before the first '"', '$' or null character. */
+
+size_t lexQuotedRun(const char *pc);
 
 /*--------------------------------------------------------------------*/
 
@@ -0,0 +1,353 @@
+/*--------------------------------------------------------------------*/
+/* linereader.c                                                       */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#include "linereader.h"
+#include "shellfd.h"
+#include "ish.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The number of bytes requested from each read(2) call, and the
+   initial size of the buffer. */
+enum {BLOCK_SIZE = 65536};
+
+/* The factor by which the buffer grows when a line does not fit. */
+enum {GROWTH_FACTOR = 2};
+
+/*--------------------------------------------------------------------*/
+
+/* A LineReader owns a buffer holding the bytes that have been read
+   from its file descriptor but not yet handed out as lines. */
+
+struct LineReader
+{
+   /* The file descriptor from which bytes are read, and 1 iff the
+      LineReader opened it, and so closes it. */
+   int iFd;
+   int iOwnsFd;
+
+   /* 1 iff read(2) has reported end-of-file. */
+   int iEof;
+
+   /* The buffer, and its physical size. */
+   char *pcBuffer;
+   size_t uPhysLength;
+
+   /* pcBuffer[uStart..uEnd) holds the bytes not yet handed out. */
+   size_t uStart;
+   size_t uEnd;
+
+   /* pcBuffer[uStart..uScanned) is known to contain no newline. */
+   size_t uScanned;
+
+   /* For a LineReader created by LineReader_newFile(), the private
+      writable mapping of the file and its length, or NULL.  Lines are
+      handed out from pcMap[uStart..uMapLength). */
+   char *pcMap;
+   size_t uMapLength;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return a LineReader that reads from file descriptor
+   iFd.  The caller owns the LineReader, but not iFd. */
+
+LineReader_T LineReader_new(int iFd)
+{
+   struct LineReader *psReader;
+
+   assert(iFd >= 0);
+
+   psReader = (struct LineReader*)malloc(sizeof(struct LineReader));
+   if (psReader == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE);}
+
+   psReader->pcBuffer = (char*)malloc(BLOCK_SIZE);
+   if (psReader->pcBuffer == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE);}
+
+   psReader->iFd = iFd;
+   psReader->iOwnsFd = 0;
+   psReader->iEof = 0;
+   psReader->uPhysLength = BLOCK_SIZE;
+   psReader->uStart = 0;
+   psReader->uEnd = 0;
+   psReader->uScanned = 0;
+   psReader->pcMap = NULL;
+   psReader->uMapLength = 0;
+
+   return psReader;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return a LineReader that reads the file named pcFile by
+   mapping it into memory and handing out lines in place.  A file
+   that is not a regular file, such as a pipe, or that cannot be
+   mapped, is read with read(2) instead, from a descriptor that the
+   LineReader owns.  Return NULL and set errno if pcFile cannot be
+   opened.  The caller owns the LineReader. */
+
+LineReader_T LineReader_newFile(const char *pcFile)
+{
+   struct LineReader *psReader;
+   struct stat sStat;
+   int iFd;
+   int iErrno;
+   char *pcMap = NULL;
+
+   assert(pcFile != NULL);
+
+   iFd = ShellFd_move(open(pcFile, O_RDONLY | O_CLOEXEC));
+   if (iFd == -1)
+      return NULL;
+
+   if (fstat(iFd, &sStat) == -1)
+   {iErrno = errno; close(iFd); errno = iErrno; return NULL;}
+
+   /* The mapping is private and writable so that each newline can be
+      overwritten with a null character without touching the file.
+      Only a regular file's size says how much there is to map; an
+      empty one, which may be one that the kernel generates, such as
+      those of /proc, is read like a pipe. */
+   if (S_ISREG(sStat.st_mode) && sStat.st_size > 0)
+   {
+      pcMap = (char*)mmap(NULL, (size_t)sStat.st_size,
+                          PROT_READ | PROT_WRITE, MAP_PRIVATE, iFd, 0);
+      if (pcMap == MAP_FAILED)
+         pcMap = NULL;
+   }
+   if (pcMap == NULL)
+   {
+      psReader = LineReader_new(iFd);
+      psReader->iOwnsFd = 1;
+      return psReader;
+   }
+   madvise(pcMap, (size_t)sStat.st_size, MADV_SEQUENTIAL);
+   close(iFd);
+
+   psReader = (struct LineReader*)malloc(sizeof(struct LineReader));
+   if (psReader == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE);}
+
+   psReader->iFd = -1;
+   psReader->iOwnsFd = 0;
+   psReader->iEof = 1;
+   psReader->pcBuffer = NULL;
+   psReader->uPhysLength = 0;
+   psReader->uStart = 0;
+   psReader->uEnd = 0;
+   psReader->uScanned = 0;
+   psReader->pcMap = pcMap;
+   psReader->uMapLength = (size_t)sStat.st_size;
+
+   return psReader;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the next line of the mapped file of psReader, or NULL if no
+   lines remain, storing its length in *puLength. */
+
+static char *LineReader_readMappedLine(struct LineReader *psReader,
+                                       size_t *puLength)
+{
+   char *pcLine;
+   char *pcNewline;
+   size_t uRemaining;
+   long lPageSize;
+
+   if (psReader->uStart == psReader->uMapLength)
+      return NULL;
+
+   pcLine = psReader->pcMap + psReader->uStart;
+   uRemaining = psReader->uMapLength - psReader->uStart;
+
+   pcNewline = (char*)memchr(pcLine, '\n', uRemaining);
+   if (pcNewline != NULL)
+   {
+      *pcNewline = '\0';
+      *puLength = (size_t)(pcNewline - pcLine);
+      psReader->uStart += *puLength + 1;
+      return pcLine;
+   }
+
+   /* The last line has no newline.  The rest of the final page of
+      the mapping reads as zeros, so it is already terminated unless
+      the file ends exactly on a page boundary. */
+   psReader->uStart = psReader->uMapLength;
+   *puLength = uRemaining;
+   lPageSize = sysconf(_SC_PAGESIZE);
+   if (psReader->uMapLength % (size_t)lPageSize != 0)
+      return pcLine;
+
+   psReader->pcBuffer = (char*)malloc(uRemaining + 1);
+   if (psReader->pcBuffer == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE);}
+   memcpy(psReader->pcBuffer, pcLine, uRemaining);
+   psReader->pcBuffer[uRemaining] = '\0';
+   return psReader->pcBuffer;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make room for at least one more block after the unread bytes of
+   psReader, moving them to the front of the buffer or growing the
+   buffer as needed.  Always leaves space for a terminating null
+   character. */
+
+static void LineReader_makeRoom(struct LineReader *psReader)
+{
+   size_t uUnread = psReader->uEnd - psReader->uStart;
+
+   /* Slide the unread bytes to the front of the buffer. */
+   if (psReader->uStart > 0)
+   {
+      memmove(psReader->pcBuffer, psReader->pcBuffer + psReader->uStart,
+              uUnread);
+      psReader->uScanned -= psReader->uStart;
+      psReader->uStart = 0;
+      psReader->uEnd = uUnread;
+   }
+
+   /* Grow the buffer if a partial line is filling it. */
+   if (psReader->uPhysLength - psReader->uEnd < BLOCK_SIZE / 2)
+   {
+      psReader->uPhysLength *= GROWTH_FACTOR;
+      psReader->pcBuffer = (char*)realloc(psReader->pcBuffer,
+                                          psReader->uPhysLength);
+      if (psReader->pcBuffer == NULL)
+      {perror(getPgmName()); exit(EXIT_FAILURE);}
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* If no lines remain in oReader, then return NULL.  Otherwise return
+   the next line as a string that does not contain the terminating
+   newline character, and store its length in *puLength if puLength
+   is not NULL.  oReader owns the string, which is valid only until
+   the next call of a LineReader function on oReader. */
+
+char *LineReader_readLine(LineReader_T oReader, size_t *puLength)
+{
+   char *pcLine;
+   char *pcNewline;
+   size_t uLength;
+   ssize_t iCount;
+
+   assert(oReader != NULL);
+
+   if (oReader->pcMap != NULL)
+   {
+      pcLine = LineReader_readMappedLine(oReader, &uLength);
+      if (pcLine != NULL && puLength != NULL)
+         *puLength = uLength;
+      return pcLine;
+   }
+
+   for (;;)
+   {
+      /* Look for a newline among the bytes not yet scanned. */
+      pcNewline = (char*)memchr(oReader->pcBuffer + oReader->uScanned,
+                                '\n',
+                                oReader->uEnd - oReader->uScanned);
+      if (pcNewline != NULL)
+      {
+         *pcNewline = '\0';
+         break;
+      }
+      oReader->uScanned = oReader->uEnd;
+
+      if (oReader->iEof)
+      {
+         /* If no lines remain, return NULL. */
+         if (oReader->uStart == oReader->uEnd)
+            return NULL;
+
+         /* The last line has no newline.  makeRoom() always left a
+            byte free after it for the null character. */
+         pcNewline = oReader->pcBuffer + oReader->uEnd;
+         *pcNewline = '\0';
+         break;
+      }
+
+      /* Read the next block. */
+      LineReader_makeRoom(oReader);
+      do
+         iCount = read(oReader->iFd, oReader->pcBuffer + oReader->uEnd,
+                       oReader->uPhysLength - oReader->uEnd - 1);
+      while (iCount == -1 && errno == EINTR);
+      if (iCount == -1)
+      {perror(getPgmName()); exit(EXIT_FAILURE);}
+
+      if (iCount == 0)
+         oReader->iEof = 1;
+      oReader->uEnd += (size_t)iCount;
+   }
+
+   pcLine = oReader->pcBuffer + oReader->uStart;
+   uLength = (size_t)(pcNewline - pcLine);
+
+   /* Consume the line and its newline, if any. */
+   oReader->uStart += uLength;
+   if (oReader->uStart < oReader->uEnd)
+      oReader->uStart++;
+   oReader->uScanned = oReader->uStart;
+
+   if (puLength != NULL)
+      *puLength = uLength;
+   return pcLine;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 if oReader holds a whole line, has reached end-of-file,
+   or reads a mapped file, so that LineReader_readLine() returns
+   without reading from its file descriptor.  Otherwise return 0;
+   LineReader_readLine() then blocks until a whole line arrives. */
+
+int LineReader_isReady(LineReader_T oReader)
+{
+   assert(oReader != NULL);
+
+   if (oReader->pcMap != NULL || oReader->iEof)
+      return 1;
+
+   /* Remember how far there is no newline, as readLine() does. */
+   if (memchr(oReader->pcBuffer + oReader->uScanned, '\n',
+              oReader->uEnd - oReader->uScanned) != NULL)
+      return 1;
+   oReader->uScanned = oReader->uEnd;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Free oReader and its buffer or mapping, and close the file that
+   LineReader_newFile() opened.  Does not close a file descriptor
+   given to LineReader_new(). */
+
+void LineReader_free(LineReader_T oReader)
+{
+   assert(oReader != NULL);
+
+   if (oReader->pcMap != NULL)
+      munmap(oReader->pcMap, oReader->uMapLength);
+   if (oReader->iOwnsFd)
+      close(oReader->iFd);
+
+   free(oReader->pcBuffer);
+   free(oReader);
+}
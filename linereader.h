@@ -0,0 +1,66 @@
+/*--------------------------------------------------------------------*/
+/* linereader.h                                                       */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef LINEREADER_INCLUDED
+#define LINEREADER_INCLUDED
+
+#include <stddef.h>
+
+/*--------------------------------------------------------------------*/
+
+/* A LineReader_T object splits the bytes read from a file descriptor
+   into lines.  It reads large blocks and hands out lines from a
+   buffer that it reuses, so reading a line does not allocate. */
+
+typedef struct LineReader *LineReader_T;
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return a LineReader that reads from file descriptor
+   iFd.  The caller owns the LineReader, but not iFd. */
+
+LineReader_T LineReader_new(int iFd);
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return a LineReader that reads the file named pcFile by
+   mapping it into memory and handing out lines in place.  A file
+   that is not a regular file, such as a pipe, or that cannot be
+   mapped, is read with read(2) instead, from a descriptor that the
+   LineReader owns.  Return NULL and set errno if pcFile cannot be
+   opened.  The caller owns the LineReader. */
+
+LineReader_T LineReader_newFile(const char *pcFile);
+
+/*--------------------------------------------------------------------*/
+
+/* If no lines remain in oReader, then return NULL.  Otherwise return
+   the next line as a string that does not contain the terminating
+   newline character, and store its length in *puLength if puLength
+   is not NULL.  oReader owns the string, which is valid only until
+   the next call of a LineReader function on oReader. */
+
+char *LineReader_readLine(LineReader_T oReader, size_t *puLength);
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 if oReader holds a whole line, has reached end-of-file,
+   or reads a mapped file, so that LineReader_readLine() returns
+   without reading from its file descriptor.  Otherwise return 0;
+   LineReader_readLine() then blocks until a whole line arrives. */
+
+int LineReader_isReady(LineReader_T oReader);
+
+/*--------------------------------------------------------------------*/
+
+/* Free oReader and its buffer or mapping, and close the file that
+   LineReader_newFile() opened.  Does not close a file descriptor
+   given to LineReader_new(). */
+
+void LineReader_free(LineReader_T oReader);
+
+/*--------------------------------------------------------------------*/
+
+#endif
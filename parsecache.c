@@ -0,0 +1,336 @@
+/*--------------------------------------------------------------------*/
+/* parsecache.c                                                       */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#include "parsecache.h"
+#include "pipeline.h"
+#include "syner.h"
+#include "arena.h"
+#include "ish.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The bucket counts from which a cache takes the first that is at
+   least its number of entries, or the last. */
+static const size_t auBucketCounts[] =
+   {61, 127, 251, 509, 1021, 2039, 4093, 8191, 16381, 32749, 65521};
+enum {BUCKET_COUNT_COUNT =
+   sizeof(auBucketCounts) / sizeof(auBucketCounts[0])};
+
+/* An entry's arena starts with room for the entry, its line, and
+   ENTRY_BYTES_PER_CHAR bytes of Pipeline per character of the line,
+   plus ENTRY_EXTRA_BYTES.  A Command takes about five bytes per
+   character, so one chunk is usually enough. */
+enum {ENTRY_BYTES_PER_CHAR = 6};
+enum {ENTRY_EXTRA_BYTES = 512};
+
+/*--------------------------------------------------------------------*/
+
+/* A ParseEntry is one line of a ParseCache and its Pipeline.  The
+   entry, the copy of its line, and the Pipeline are all allocated
+   from the entry's own arena, so that freeing the arena frees the
+   entry. */
+
+struct ParseEntry
+{
+   /* The line, its length, and its hash code. */
+   char *pcLine;
+   size_t uLength;
+   size_t uHash;
+
+   /* The Pipeline parsed from the line, and the arena that holds
+      it. */
+   Pipeline_T oPipeline;
+   Arena_T oArena;
+
+   /* The next entry in the same bucket. */
+   struct ParseEntry *psNextInBucket;
+
+   /* The entries used just before and just after this one. */
+   struct ParseEntry *psOlder;
+   struct ParseEntry *psNewer;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A ParseCache is a hash table of ParseEntry structures, chained in
+   their buckets, that also keeps its entries in order of use. */
+
+struct ParseCache
+{
+   /* The buckets, and their number. */
+   struct ParseEntry **ppsBuckets;
+   size_t uBucketCount;
+
+   /* The number of entries, and the most there can be. */
+   size_t uLength;
+   size_t uMaxEntries;
+
+   /* The least and most recently used entries. */
+   struct ParseEntry *psOldest;
+   struct ParseEntry *psNewest;
+
+   /* The arena that parses a line that is not cached, until it
+      becomes the arena of the line's entry, and the arena of a
+      Pipeline that is not cached. */
+   Arena_T oSpare;
+   Arena_T oUncached;
+
+   /* The number of lines found, and not found, in the cache. */
+   unsigned long ulHits;
+   unsigned long ulMisses;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Return a hash code for the uLength characters at pcLine. */
+
+static size_t ParseCache_hash(const char *pcLine, size_t uLength)
+{
+   const size_t HASH_MULTIPLIER = 65599;
+   size_t u;
+   size_t uHash = 0;
+
+   assert(pcLine != NULL);
+
+   for (u = 0; u < uLength; u++)
+      uHash = uHash * HASH_MULTIPLIER + (size_t)pcLine[u];
+
+   return uHash;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty ParseCache that holds at most
+   uMaxEntries lines.  If uMaxEntries is 0, every line is parsed
+   again.  The caller owns the ParseCache. */
+
+ParseCache_T ParseCache_new(size_t uMaxEntries)
+{
+   ParseCache_T oCache;
+   size_t u;
+
+   oCache = (ParseCache_T)malloc(sizeof(struct ParseCache));
+   if (oCache == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+
+   for (u = 0; u < BUCKET_COUNT_COUNT - 1; u++)
+      if (auBucketCounts[u] >= uMaxEntries)
+         break;
+   oCache->uBucketCount = auBucketCounts[u];
+   oCache->ppsBuckets = (struct ParseEntry**)calloc(
+      oCache->uBucketCount, sizeof(struct ParseEntry*));
+   if (oCache->ppsBuckets == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE);}
+
+   oCache->uLength = 0;
+   oCache->uMaxEntries = uMaxEntries;
+   oCache->psOldest = NULL;
+   oCache->psNewest = NULL;
+   oCache->oSpare = NULL;
+   oCache->oUncached = NULL;
+   oCache->ulHits = 0;
+   oCache->ulMisses = 0;
+   return oCache;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Free oCache and all of its Pipelines. */
+
+void ParseCache_free(ParseCache_T oCache)
+{
+   struct ParseEntry *psEntry;
+   struct ParseEntry *psNewer;
+
+   assert(oCache != NULL);
+
+   for (psEntry = oCache->psOldest; psEntry != NULL; psEntry = psNewer)
+   {
+      psNewer = psEntry->psNewer;
+      Arena_free(psEntry->oArena);
+   }
+   if (oCache->oSpare != NULL)
+      Arena_free(oCache->oSpare);
+   if (oCache->oUncached != NULL)
+      Arena_free(oCache->oUncached);
+   free(oCache->ppsBuckets);
+   free(oCache);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Remove psEntry from the order of use of oCache. */
+
+static void ParseCache_unlink(ParseCache_T oCache,
+                              struct ParseEntry *psEntry)
+{
+   if (psEntry->psOlder == NULL)
+      oCache->psOldest = psEntry->psNewer;
+   else
+      psEntry->psOlder->psNewer = psEntry->psNewer;
+   if (psEntry->psNewer == NULL)
+      oCache->psNewest = psEntry->psOlder;
+   else
+      psEntry->psNewer->psOlder = psEntry->psOlder;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make psEntry the most recently used entry of oCache. */
+
+static void ParseCache_makeNewest(ParseCache_T oCache,
+                                  struct ParseEntry *psEntry)
+{
+   psEntry->psOlder = oCache->psNewest;
+   psEntry->psNewer = NULL;
+   if (oCache->psNewest == NULL)
+      oCache->psOldest = psEntry;
+   else
+      oCache->psNewest->psNewer = psEntry;
+   oCache->psNewest = psEntry;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Remove the least recently used entry of oCache, and free it. */
+
+static void ParseCache_evict(ParseCache_T oCache)
+{
+   struct ParseEntry *psEntry;
+   struct ParseEntry **ppsLink;
+
+   psEntry = oCache->psOldest;
+   assert(psEntry != NULL);
+
+   for (ppsLink = &oCache->ppsBuckets[psEntry->uHash
+                                      % oCache->uBucketCount];
+        *ppsLink != psEntry; ppsLink = &(*ppsLink)->psNextInBucket)
+      assert(*ppsLink != NULL);
+   *ppsLink = psEntry->psNextInBucket;
+
+   ParseCache_unlink(oCache, psEntry);
+   oCache->uLength--;
+   Arena_free(psEntry->oArena);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the Pipeline for the line pcLine of uLength characters, as
+   synLine() would: from oCache if the line is in it, and otherwise
+   parsed with synLine() and added to oCache.  If the line contains
+   an error, write the same message as synLine() and return NULL;
+   such lines are never cached, nor are lines with a '$', "*", "?"
+   or "[", whose words depend on the variables or on the files that
+   match a pattern.  oCache owns the Pipeline, which must not be
+   changed, and which is valid only until the next call of a
+   ParseCache function on oCache. */
+
+Pipeline_T ParseCache_parse(ParseCache_T oCache, const char *pcLine,
+                            size_t uLength)
+{
+   struct ParseEntry *psEntry;
+   struct ParseEntry **ppsBucket;
+   Pipeline_T oPipeline;
+   Arena_T oArena;
+   size_t uHash;
+
+   assert(oCache != NULL);
+   assert(pcLine != NULL);
+
+   /* Without room for entries, or for a line whose words may change
+      with the variables it refers to or the files that its patterns
+      match, parse into an arena that is reused */
+   if (oCache->uMaxEntries == 0 || strpbrk(pcLine, "$*?[") != NULL)
+   {
+      if (oCache->oUncached == NULL)
+         oCache->oUncached = Arena_new();
+      else
+         Arena_reset(oCache->oUncached);
+      oCache->ulMisses++;
+      return synLine(pcLine, oCache->oUncached);
+   }
+
+   uHash = ParseCache_hash(pcLine, uLength);
+   ppsBucket = &oCache->ppsBuckets[uHash % oCache->uBucketCount];
+   for (psEntry = *ppsBucket; psEntry != NULL;
+        psEntry = psEntry->psNextInBucket)
+   {
+      if (psEntry->uHash == uHash && psEntry->uLength == uLength
+          && memcmp(psEntry->pcLine, pcLine, uLength) == 0)
+      {
+         oCache->ulHits++;
+         ParseCache_unlink(oCache, psEntry);
+         ParseCache_makeNewest(oCache, psEntry);
+         return psEntry->oPipeline;
+      }
+   }
+   oCache->ulMisses++;
+
+   /* Parse into a new arena; a line with an error leaves it spare */
+   oArena = oCache->oSpare;
+   if (oArena == NULL)
+      oArena = Arena_newSized(sizeof(struct ParseEntry) + uLength + 1
+                              + ENTRY_BYTES_PER_CHAR * uLength
+                              + ENTRY_EXTRA_BYTES);
+   else
+      Arena_reset(oArena);
+   oCache->oSpare = oArena;
+
+   oPipeline = synLine(pcLine, oArena);
+   if (oPipeline == NULL)
+      return NULL;
+   oCache->oSpare = NULL;
+
+   if (oCache->uLength == oCache->uMaxEntries)
+      ParseCache_evict(oCache);
+
+   psEntry = (struct ParseEntry*)Arena_alloc(oArena,
+                                             sizeof(struct ParseEntry));
+   psEntry->pcLine = Arena_strndup(oArena, pcLine, uLength);
+   psEntry->uLength = uLength;
+   psEntry->uHash = uHash;
+   psEntry->oPipeline = oPipeline;
+   psEntry->oArena = oArena;
+   psEntry->psNextInBucket = *ppsBucket;
+   *ppsBucket = psEntry;
+   ParseCache_makeNewest(oCache, psEntry);
+   oCache->uLength++;
+   return oPipeline;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *pulHits and *pulMisses the number of lines that
+   ParseCache_parse() found in oCache and did not. */
+
+void ParseCache_getCounts(ParseCache_T oCache, unsigned long *pulHits,
+                          unsigned long *pulMisses)
+{
+   assert(oCache != NULL);
+   assert(pulHits != NULL);
+   assert(pulMisses != NULL);
+
+   *pulHits = oCache->ulHits;
+   *pulMisses = oCache->ulMisses;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write the hits, misses, and number of lines of oCache to
+   psFile. */
+
+void ParseCache_write(ParseCache_T oCache, FILE *psFile)
+{
+   assert(oCache != NULL);
+   assert(psFile != NULL);
+
+   fprintf(psFile, "parse cache: %lu hits, %lu misses, %lu of %lu "
+           "lines\n", oCache->ulHits, oCache->ulMisses,
+           (unsigned long)oCache->uLength,
+           (unsigned long)oCache->uMaxEntries);
+}
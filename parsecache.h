@@ -0,0 +1,69 @@
+/*--------------------------------------------------------------------*/
+/* parsecache.h                                                       */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef PARSECACHE_INCLUDED
+#define PARSECACHE_INCLUDED
+
+#include <stdio.h>
+#include <stddef.h>
+#include "pipeline.h"
+
+/*--------------------------------------------------------------------*/
+
+/* A ParseCache_T object remembers the Pipelines parsed from the
+   lines most recently seen, so that a line that is seen again is
+   neither lexed nor parsed.  It holds at most a fixed number of
+   lines, and forgets the least recently used one to make room for
+   another. */
+
+typedef struct ParseCache *ParseCache_T;
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty ParseCache that holds at most
+   uMaxEntries lines.  If uMaxEntries is 0, every line is parsed
+   again.  The caller owns the ParseCache. */
+
+ParseCache_T ParseCache_new(size_t uMaxEntries);
+
+/*--------------------------------------------------------------------*/
+
+/* Free oCache and all of its Pipelines. */
+
+void ParseCache_free(ParseCache_T oCache);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the Pipeline for the line pcLine of uLength characters, as
+   synLine() would: from oCache if the line is in it, and otherwise
+   parsed with synLine() and added to oCache.  If the line contains
+   an error, write the same message as synLine() and return NULL;
+   such lines are never cached, nor are lines with a '$', "*", "?"
+   or "[", whose words depend on the variables or on the files that
+   match a pattern.  oCache owns the Pipeline, which must not be
+   changed, and which is valid only until the next call of a
+   ParseCache function on oCache. */
+
+Pipeline_T ParseCache_parse(ParseCache_T oCache, const char *pcLine,
+                            size_t uLength);
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *pulHits and *pulMisses the number of lines that
+   ParseCache_parse() found in oCache and did not. */
+
+void ParseCache_getCounts(ParseCache_T oCache, unsigned long *pulHits,
+                          unsigned long *pulMisses);
+
+/*--------------------------------------------------------------------*/
+
+/* Write the hits, misses, and number of lines of oCache to
+   psFile. */
+
+void ParseCache_write(ParseCache_T oCache, FILE *psFile);
+
+/*--------------------------------------------------------------------*/
+
+#endif
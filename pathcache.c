@@ -0,0 +1,398 @@
+/*--------------------------------------------------------------------*/
+/* pathcache.c                                                        */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#include "pathcache.h"
+#include "vartable.h"
+#include "ish.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The bucket counts that the table grows through.  The table stops
+   growing once it has the last of them. */
+static const size_t auBucketCounts[] =
+   {509, 1021, 2039, 4093, 8191, 16381, 32749, 65521};
+enum {BUCKET_COUNT_COUNT =
+   sizeof(auBucketCounts) / sizeof(auBucketCounts[0])};
+
+/* The PATH that execvp() uses when PATH is not set. */
+static const char pcDefaultPath[] = "/bin:/usr/bin";
+
+/*--------------------------------------------------------------------*/
+
+/* A PathEntry is what a PathCache knows about one command name. */
+
+struct PathEntry
+{
+   /* The command name. */
+   char *pcName;
+
+   /* The file that the name runs, or NULL if PATH does not hold
+      it. */
+   char *pcPath;
+
+   /* If pcPath is NULL, the errno value that explains why. */
+   int iErrno;
+
+   /* The number of times that the name has been looked up. */
+   unsigned long ulHits;
+
+   /* The next entry in the same bucket. */
+   struct PathEntry *psNextInBucket;
+
+   /* The entry that was added after this one. */
+   struct PathEntry *psNextAdded;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A PathCache is a hash table of PathEntry structures, chained in
+   their buckets, that also keeps its entries in the order in which
+   they were added. */
+
+struct PathCache
+{
+   /* The buckets, and the index in auBucketCounts of their count. */
+   struct PathEntry **ppsBuckets;
+   size_t uBucketIndex;
+
+   /* The number of entries. */
+   size_t uLength;
+
+   /* The first and last entries added. */
+   struct PathEntry *psFirstAdded;
+   struct PathEntry *psLastAdded;
+
+   /* 1 iff the PATH last searched has a relative directory. */
+   int iRelative;
+
+   /* The variables that hold PATH. */
+   VarTable_T oVars;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Return a hash code for pcName that is between 0 and uBucketCount-1,
+   inclusive. */
+
+static size_t PathCache_hash(const char *pcName, size_t uBucketCount)
+{
+   const size_t HASH_MULTIPLIER = 65599;
+   size_t u;
+   size_t uHash = 0;
+
+   assert(pcName != NULL);
+
+   for (u = 0; pcName[u] != '\0'; u++)
+      uHash = uHash * HASH_MULTIPLIER + (size_t)pcName[u];
+
+   return uHash % uBucketCount;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return a new array of uBucketCount empty buckets. */
+
+static struct PathEntry **PathCache_newBuckets(size_t uBucketCount)
+{
+   struct PathEntry **ppsBuckets;
+
+   ppsBuckets = (struct PathEntry**)calloc(uBucketCount,
+                                           sizeof(struct PathEntry*));
+   if (ppsBuckets == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+   return ppsBuckets;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty PathCache that searches the directories
+   of the PATH variable of oVars.  The caller owns it. */
+
+PathCache_T PathCache_new(VarTable_T oVars)
+{
+   PathCache_T oCache;
+
+   assert(oVars != NULL);
+
+   oCache = (PathCache_T)malloc(sizeof(struct PathCache));
+   if (oCache == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+
+   oCache->uBucketIndex = 0;
+   oCache->ppsBuckets = PathCache_newBuckets(auBucketCounts[0]);
+   oCache->uLength = 0;
+   oCache->psFirstAdded = NULL;
+   oCache->psLastAdded = NULL;
+   oCache->iRelative = 0;
+   oCache->oVars = oVars;
+   return oCache;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Forget every entry of oCache.  Must be called whenever PATH
+   changes. */
+
+void PathCache_clear(PathCache_T oCache)
+{
+   struct PathEntry *psEntry;
+   struct PathEntry *psNext;
+
+   assert(oCache != NULL);
+
+   for (psEntry = oCache->psFirstAdded; psEntry != NULL;
+        psEntry = psNext)
+   {
+      psNext = psEntry->psNextAdded;
+      free(psEntry->pcPath);
+      free(psEntry);
+   }
+
+   memset(oCache->ppsBuckets, 0,
+          auBucketCounts[oCache->uBucketIndex]
+          * sizeof(struct PathEntry*));
+   oCache->uLength = 0;
+   oCache->psFirstAdded = NULL;
+   oCache->psLastAdded = NULL;
+   oCache->iRelative = 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Free oCache and all of its entries. */
+
+void PathCache_free(PathCache_T oCache)
+{
+   assert(oCache != NULL);
+
+   PathCache_clear(oCache);
+   free(oCache->ppsBuckets);
+   free(oCache);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Tell oCache that the working directory changed.  Forgets every
+   entry if the PATH that oCache last searched has a relative
+   directory, since its results depend on the working directory. */
+
+void PathCache_changeDir(PathCache_T oCache)
+{
+   assert(oCache != NULL);
+
+   if (oCache->iRelative)
+      PathCache_clear(oCache);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Move the entries of oCache to the next larger array of buckets. */
+
+static void PathCache_grow(PathCache_T oCache)
+{
+   struct PathEntry **ppsBuckets;
+   struct PathEntry *psEntry;
+   size_t uBucketCount;
+   size_t uHash;
+
+   assert(oCache != NULL);
+
+   oCache->uBucketIndex++;
+   uBucketCount = auBucketCounts[oCache->uBucketIndex];
+   ppsBuckets = PathCache_newBuckets(uBucketCount);
+
+   for (psEntry = oCache->psFirstAdded; psEntry != NULL;
+        psEntry = psEntry->psNextAdded)
+   {
+      uHash = PathCache_hash(psEntry->pcName, uBucketCount);
+      psEntry->psNextInBucket = ppsBuckets[uHash];
+      ppsBuckets[uHash] = psEntry;
+   }
+
+   free(oCache->ppsBuckets);
+   oCache->ppsBuckets = ppsBuckets;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Search the directories of PATH for an executable file named pcName
+   of uNameLength characters, as execvp() does: an empty directory
+   means the working directory.  Return a new string holding the
+   path of the first one, or NULL with *piErrno set to ENOENT or
+   EACCES if there is none.  Set oCache->iRelative to 1 if PATH has
+   a relative directory. */
+
+static char *PathCache_search(PathCache_T oCache, const char *pcName,
+                              size_t uNameLength, int *piErrno)
+{
+   const char *pcPathVar;
+   const char *pcDir;
+   const char *pcDirEnd;
+   size_t uDirLength;
+   char *pcFile = NULL;
+   size_t uPhysFile = 0;
+   struct stat sStat;
+
+   assert(oCache != NULL);
+   assert(pcName != NULL);
+   assert(piErrno != NULL);
+
+   pcPathVar = VarTable_get(oCache->oVars, "PATH");
+   if (pcPathVar == NULL)
+      pcPathVar = pcDefaultPath;
+
+   *piErrno = ENOENT;
+   for (pcDir = pcPathVar; ; pcDir = pcDirEnd + 1)
+   {
+      pcDirEnd = strchr(pcDir, ':');
+      if (pcDirEnd == NULL)
+         pcDirEnd = pcDir + strlen(pcDir);
+      uDirLength = (size_t)(pcDirEnd - pcDir);
+      if (uDirLength == 0 || *pcDir != '/')
+         oCache->iRelative = 1;
+
+      /* Make room for the directory, a slash, the name, and a null
+         character */
+      if (uDirLength + uNameLength + 2 > uPhysFile)
+      {
+         uPhysFile = uDirLength + uNameLength + 2;
+         free(pcFile);
+         pcFile = (char*)malloc(uPhysFile);
+         if (pcFile == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+      }
+      if (uDirLength == 0)
+         memcpy(pcFile, pcName, uNameLength + 1);
+      else
+      {
+         memcpy(pcFile, pcDir, uDirLength);
+         pcFile[uDirLength] = '/';
+         memcpy(pcFile + uDirLength + 1, pcName, uNameLength + 1);
+      }
+
+      if (stat(pcFile, &sStat) == 0)
+      {
+         if (S_ISREG(sStat.st_mode) && access(pcFile, X_OK) == 0)
+            return pcFile;
+         /* Like execvp(), report EACCES if the name was found */
+         *piErrno = EACCES;
+      }
+
+      if (*pcDirEnd == '\0')
+         break;
+   }
+
+   free(pcFile);
+   return NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the file that execv() should run for command name pcName.
+   A name that contains a slash is returned as is.  Otherwise the
+   directories of PATH are searched in order the first time pcName is
+   looked up, as execvp() would search them, and the result is
+   cached.  If no directory holds an executable pcName, then return
+   NULL and set errno to ENOENT, or to EACCES if a file named pcName
+   was found but could not be executed.  oCache owns the returned
+   string, which is valid until the next call of PathCache_clear()
+   or PathCache_free(). */
+
+const char *PathCache_lookup(PathCache_T oCache, const char *pcName)
+{
+   struct PathEntry *psEntry;
+   size_t uNameLength;
+   size_t uHash;
+
+   assert(oCache != NULL);
+   assert(pcName != NULL);
+
+   if (strchr(pcName, '/') != NULL)
+      return pcName;
+   if (*pcName == '\0')
+   {
+      errno = ENOENT;
+      return NULL;
+   }
+
+   uHash = PathCache_hash(pcName,
+                          auBucketCounts[oCache->uBucketIndex]);
+   for (psEntry = oCache->ppsBuckets[uHash]; psEntry != NULL;
+        psEntry = psEntry->psNextInBucket)
+   {
+      if (strcmp(psEntry->pcName, pcName) == 0)
+         break;
+   }
+
+   if (psEntry == NULL)
+   {
+      /* The name and the entry share one allocation */
+      uNameLength = strlen(pcName);
+      psEntry = (struct PathEntry*)malloc(sizeof(struct PathEntry)
+                                          + uNameLength + 1);
+      if (psEntry == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+      psEntry->pcName = (char*)(psEntry + 1);
+      memcpy(psEntry->pcName, pcName, uNameLength + 1);
+      psEntry->pcPath = PathCache_search(oCache, pcName, uNameLength,
+                                         &psEntry->iErrno);
+      psEntry->ulHits = 0;
+
+      psEntry->psNextInBucket = oCache->ppsBuckets[uHash];
+      oCache->ppsBuckets[uHash] = psEntry;
+      psEntry->psNextAdded = NULL;
+      if (oCache->psLastAdded == NULL)
+         oCache->psFirstAdded = psEntry;
+      else
+         oCache->psLastAdded->psNextAdded = psEntry;
+      oCache->psLastAdded = psEntry;
+
+      oCache->uLength++;
+      if (oCache->uLength > auBucketCounts[oCache->uBucketIndex]
+          && oCache->uBucketIndex < BUCKET_COUNT_COUNT - 1)
+         PathCache_grow(oCache);
+   }
+
+   psEntry->ulHits++;
+   if (psEntry->pcPath == NULL)
+      errno = psEntry->iErrno;
+   return psEntry->pcPath;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write the entries of oCache to psFile in the order in which they
+   were added, one per line: the number of lookups of the name, and
+   the file that it runs, or the name followed by "(not found)". */
+
+void PathCache_write(PathCache_T oCache, FILE *psFile)
+{
+   struct PathEntry *psEntry;
+
+   assert(oCache != NULL);
+   assert(psFile != NULL);
+
+   if (oCache->psFirstAdded == NULL)
+   {
+      fprintf(psFile, "hash table empty\n");
+      return;
+   }
+
+   fprintf(psFile, "hits\tcommand\n");
+   for (psEntry = oCache->psFirstAdded; psEntry != NULL;
+        psEntry = psEntry->psNextAdded)
+   {
+      if (psEntry->pcPath != NULL)
+         fprintf(psFile, "%4lu\t%s\n", psEntry->ulHits,
+                 psEntry->pcPath);
+      else
+         fprintf(psFile, "%4lu\t%s (not found)\n", psEntry->ulHits,
+                 psEntry->pcName);
+   }
+}
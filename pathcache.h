@@ -0,0 +1,73 @@
+/*--------------------------------------------------------------------*/
+/* pathcache.h                                                        */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef PATHCACHE_INCLUDED
+#define PATHCACHE_INCLUDED
+
+#include <stdio.h>
+#include "vartable.h"
+
+/*--------------------------------------------------------------------*/
+
+/* A PathCache_T object remembers where the directories of the PATH
+   environment variable hold each command name that has been looked
+   up, including the names that they do not hold, and how many times
+   each name has been looked up. */
+
+typedef struct PathCache *PathCache_T;
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty PathCache that searches the directories
+   of the PATH variable of oVars.  The caller owns it. */
+
+PathCache_T PathCache_new(VarTable_T oVars);
+
+/*--------------------------------------------------------------------*/
+
+/* Free oCache and all of its entries. */
+
+void PathCache_free(PathCache_T oCache);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the file that execv() should run for command name pcName.
+   A name that contains a slash is returned as is.  Otherwise the
+   directories of PATH are searched in order the first time pcName is
+   looked up, as execvp() would search them, and the result is
+   cached.  If no directory holds an executable pcName, then return
+   NULL and set errno to ENOENT, or to EACCES if a file named pcName
+   was found but could not be executed.  oCache owns the returned
+   string, which is valid until the next call of PathCache_clear()
+   or PathCache_free(). */
+
+const char *PathCache_lookup(PathCache_T oCache, const char *pcName);
+
+/*--------------------------------------------------------------------*/
+
+/* Forget every entry of oCache.  Must be called whenever PATH
+   changes. */
+
+void PathCache_clear(PathCache_T oCache);
+
+/*--------------------------------------------------------------------*/
+
+/* Tell oCache that the working directory changed.  Forgets every
+   entry if the PATH that oCache last searched has a relative
+   directory, since its results depend on the working directory. */
+
+void PathCache_changeDir(PathCache_T oCache);
+
+/*--------------------------------------------------------------------*/
+
+/* Write the entries of oCache to psFile in the order in which they
+   were added, one per line: the number of lookups of the name, and
+   the file that it runs, or the name followed by "(not found)". */
+
+void PathCache_write(PathCache_T oCache, FILE *psFile);
+
+/*--------------------------------------------------------------------*/
+
+#endif
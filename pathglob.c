@@ -0,0 +1,920 @@
+/*--------------------------------------------------------------------*/
+/* pathglob.c                                                         */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#include "pathglob.h"
+#include "arena.h"
+#include "ish.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The most directories that a PathGlob remembers, and the number of
+   buckets of its table of them. */
+enum {MAX_LISTINGS = 64};
+enum {BUCKET_COUNT = 127};
+
+/* The size of the buffer into which getdents64 reads the entries of
+   a directory, so that even a very large directory takes few
+   calls. */
+enum {DENTS_BUFFER_SIZE = 256 * 1024};
+
+/* The number of names, and of bytes of names, that a new listing
+   has room for, and the number of paths that a new path list has
+   room for.  Each grows by a factor of GROWTH_FACTOR. */
+enum {INITIAL_PHYS_NAMES = 64};
+enum {INITIAL_PHYS_NAME_BYTES = 1024};
+enum {INITIAL_PHYS_PATHS = 16};
+enum {GROWTH_FACTOR = 2};
+
+/* The number of seconds by which a directory must have been modified
+   before it was read for its listing to be trusted while its
+   modification time is unchanged.  A directory changed again within
+   the same tick of the clock of its file system may keep the same
+   time. */
+enum {RACY_SECONDS = 1};
+
+/*--------------------------------------------------------------------*/
+
+/* A DirEntry is an entry that getdents64 returns, as the kernel lays
+   it out. */
+
+struct DirEntry
+{
+   uint64_t ulIno;
+   int64_t lOffset;
+   unsigned short usRecordLength;
+   unsigned char ucType;
+   char acName[];
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A Listing is the names in one directory, as they were when it was
+   read. */
+
+struct Listing
+{
+   /* The path of the directory as patterns name it, and its hash
+      code. */
+   char *pcDir;
+   size_t uHash;
+
+   /* The device, inode and modification time of the directory when
+      it was read, and 1 iff it was modified too shortly before to
+      trust that time. */
+   dev_t iDev;
+   ino_t iIno;
+   struct timespec sModified;
+   int iRacy;
+
+   /* The names, each followed by a null character, the offset of
+      each in pcNames, and the file type of each, as d_type gives it;
+      uCount names, with room for uPhysCount and uPhysBytes. */
+   char *pcNames;
+   size_t uNameBytes;
+   size_t uPhysBytes;
+   size_t *puOffsets;
+   unsigned char *pucTypes;
+   size_t uCount;
+   size_t uPhysCount;
+
+   /* The next Listing in the same bucket, and the one read after
+      this one. */
+   struct Listing *psNextInBucket;
+   struct Listing *psNextAdded;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* An Op is one step of a compiled pattern component. */
+
+struct Op
+{
+   /* OP_CHAR matches ucChar, OP_ANY any character, OP_STAR any
+      string, and OP_CLASS the characters whose bits are set in
+      aucClass. */
+   enum {OP_CHAR, OP_ANY, OP_STAR, OP_CLASS} eKind;
+   unsigned char ucChar;
+   unsigned char aucClass[32];
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A Matcher is a compiled pattern component: its Ops, and what every
+   name that it matches must have, so that most names can be
+   rejected without running the Ops. */
+
+struct Matcher
+{
+   struct Op *psOps;
+   size_t uOps;
+
+   /* 1 iff an Op is OP_STAR, 1 iff any Op is not OP_CHAR, and the
+      number of characters that the Ops other than OP_STAR match. */
+   int iStar;
+   int iWild;
+   size_t uMinLength;
+
+   /* The character of each OP_CHAR Op, at the index of the Op, and
+      the literal characters that every name starts with, and, if
+      iStar, that every name ends with, which are among them. */
+   char *pcChars;
+   const char *pcPrefix;
+   size_t uPrefix;
+   const char *pcSuffix;
+   size_t uSuffix;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A PathList is a growable array of paths. */
+
+struct PathList
+{
+   const char **ppcPaths;
+   size_t uLength;
+   size_t uPhysLength;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A PathGlob is a hash table of Listings, chained in their buckets,
+   that also keeps them in the order in which they were added, and
+   what one expansion needs. */
+
+struct PathGlob
+{
+   struct Listing *apsBuckets[BUCKET_COUNT];
+   size_t uListings;
+   struct Listing *psFirstAdded;
+   struct Listing *psLastAdded;
+
+   /* The buffer of getdents64, allocated when it is first needed. */
+   char *pcDents;
+
+   /* The paths matched so far, and those that the next component
+      matches. */
+   struct PathList sPaths;
+   struct PathList sNext;
+
+   /* The arena of the pattern, its Matchers and the paths of one
+      expansion. */
+   Arena_T oScratch;
+
+   /* The number of Listings used as they were, and read. */
+   unsigned long ulHits;
+   unsigned long ulScans;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return a PathGlob that remembers no directories.  The
+   caller owns it. */
+
+PathGlob_T PathGlob_new(void)
+{
+   PathGlob_T oGlob;
+
+   oGlob = (PathGlob_T)calloc(1, sizeof(struct PathGlob));
+   if (oGlob == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+   oGlob->oScratch = Arena_new();
+   return oGlob;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Free psListing and its names. */
+
+static void PathGlob_freeListing(struct Listing *psListing)
+{
+   free(psListing->pcDir);
+   free(psListing->pcNames);
+   free(psListing->puOffsets);
+   free(psListing->pucTypes);
+   free(psListing);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Free oGlob and the directories that it remembers. */
+
+void PathGlob_free(PathGlob_T oGlob)
+{
+   struct Listing *psListing;
+   struct Listing *psNext;
+
+   assert(oGlob != NULL);
+
+   for (psListing = oGlob->psFirstAdded; psListing != NULL;
+        psListing = psNext)
+   {
+      psNext = psListing->psNextAdded;
+      PathGlob_freeListing(psListing);
+   }
+   free(oGlob->pcDents);
+   free(oGlob->sPaths.ppcPaths);
+   free(oGlob->sNext.ppcPaths);
+   Arena_free(oGlob->oScratch);
+   free(oGlob);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return a hash code for the string pcDir. */
+
+static size_t PathGlob_hash(const char *pcDir)
+{
+   const size_t HASH_MULTIPLIER = 65599;
+   size_t uHash = 0;
+
+   for (; *pcDir != '\0'; pcDir++)
+      uHash = uHash * HASH_MULTIPLIER + (size_t)(unsigned char)*pcDir;
+   return uHash;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Remove psListing from the bucket of oGlob that holds it. */
+
+static void PathGlob_unlink(PathGlob_T oGlob, struct Listing *psListing)
+{
+   struct Listing **ppsLink;
+
+   for (ppsLink = &oGlob->apsBuckets[psListing->uHash % BUCKET_COUNT];
+        *ppsLink != psListing; ppsLink = &(*ppsLink)->psNextInBucket)
+      assert(*ppsLink != NULL);
+   *ppsLink = psListing->psNextInBucket;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Forget psListing, a Listing of oGlob. */
+
+static void PathGlob_forget(PathGlob_T oGlob, struct Listing *psListing)
+{
+   struct Listing *psPrev = NULL;
+   struct Listing *ps;
+
+   PathGlob_unlink(oGlob, psListing);
+   for (ps = oGlob->psFirstAdded; ps != psListing; ps = ps->psNextAdded)
+   {
+      assert(ps != NULL);
+      psPrev = ps;
+   }
+   if (psPrev == NULL)
+      oGlob->psFirstAdded = psListing->psNextAdded;
+   else
+      psPrev->psNextAdded = psListing->psNextAdded;
+   if (oGlob->psLastAdded == psListing)
+      oGlob->psLastAdded = psPrev;
+   oGlob->uListings--;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Append the uLength characters at pcName, whose file type is
+   ucType, to the names of psListing. */
+
+static void PathGlob_addName(struct Listing *psListing,
+                             const char *pcName, size_t uLength,
+                             unsigned char ucType)
+{
+   char *pcNames;
+   size_t *puOffsets;
+   unsigned char *pucTypes;
+
+   if (psListing->uNameBytes + uLength + 1 > psListing->uPhysBytes)
+   {
+      while (psListing->uNameBytes + uLength + 1
+             > psListing->uPhysBytes)
+         psListing->uPhysBytes *= GROWTH_FACTOR;
+      pcNames = (char*)realloc(psListing->pcNames,
+                               psListing->uPhysBytes);
+      if (pcNames == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+      psListing->pcNames = pcNames;
+   }
+   if (psListing->uCount == psListing->uPhysCount)
+   {
+      psListing->uPhysCount *= GROWTH_FACTOR;
+      puOffsets = (size_t*)realloc(psListing->puOffsets,
+         psListing->uPhysCount * sizeof(size_t));
+      if (puOffsets == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+      psListing->puOffsets = puOffsets;
+      pucTypes = (unsigned char*)realloc(psListing->pucTypes,
+                                         psListing->uPhysCount);
+      if (pucTypes == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+      psListing->pucTypes = pucTypes;
+   }
+
+   memcpy(psListing->pcNames + psListing->uNameBytes, pcName,
+          uLength + 1);
+   psListing->puOffsets[psListing->uCount] = psListing->uNameBytes;
+   psListing->pucTypes[psListing->uCount] = ucType;
+   psListing->uNameBytes += uLength + 1;
+   psListing->uCount++;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Read the names of the directory psListing->pcDir into psListing,
+   replacing those that it had, with getdents64 and the buffer of
+   oGlob.  "." and ".." are left out.  Return 0, or -1 with errno set
+   if the directory cannot be read. */
+
+static int PathGlob_read(PathGlob_T oGlob, struct Listing *psListing)
+{
+   struct DirEntry *psEntry;
+   struct stat sStat;
+   struct timespec sNow;
+   const char *pcName;
+   long lRead;
+   long lOffset;
+   int iFd;
+
+   if (oGlob->pcDents == NULL)
+   {
+      oGlob->pcDents = (char*)malloc(DENTS_BUFFER_SIZE);
+      if (oGlob->pcDents == NULL)
+      {perror(getPgmName()); exit(EXIT_FAILURE);}
+   }
+
+   iFd = open(psListing->pcDir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+   if (iFd == -1)
+      return -1;
+   if (fstat(iFd, &sStat) == -1
+       || clock_gettime(CLOCK_REALTIME, &sNow) == -1)
+   {
+      (void)close(iFd);
+      return -1;
+   }
+
+   psListing->uNameBytes = 0;
+   psListing->uCount = 0;
+   for (;;)
+   {
+      lRead = syscall(SYS_getdents64, iFd, oGlob->pcDents,
+                      DENTS_BUFFER_SIZE);
+      if (lRead == -1)
+      {
+         (void)close(iFd);
+         return -1;
+      }
+      if (lRead == 0)
+         break;
+      for (lOffset = 0; lOffset < lRead;
+           lOffset += psEntry->usRecordLength)
+      {
+         psEntry = (struct DirEntry*)(oGlob->pcDents + lOffset);
+         pcName = psEntry->acName;
+         if (pcName[0] == '.' && (pcName[1] == '\0'
+             || (pcName[1] == '.' && pcName[2] == '\0')))
+            continue;
+         PathGlob_addName(psListing, pcName, strlen(pcName),
+                          psEntry->ucType);
+      }
+   }
+   (void)close(iFd);
+
+   psListing->iDev = sStat.st_dev;
+   psListing->iIno = sStat.st_ino;
+   psListing->sModified = sStat.st_mtim;
+   psListing->iRacy =
+      (sStat.st_mtim.tv_sec + RACY_SECONDS >= sNow.tv_sec);
+   oGlob->ulScans++;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the Listing of the directory pcDir, read again if it has
+   changed since oGlob read it, or NULL if it cannot be read. */
+
+static struct Listing *PathGlob_list(PathGlob_T oGlob, const char *pcDir)
+{
+   struct Listing *psListing;
+   struct Listing *psEvicted;
+   struct stat sStat;
+   size_t uHash;
+
+   uHash = PathGlob_hash(pcDir);
+   for (psListing = oGlob->apsBuckets[uHash % BUCKET_COUNT];
+        psListing != NULL; psListing = psListing->psNextInBucket)
+      if (psListing->uHash == uHash
+          && strcmp(psListing->pcDir, pcDir) == 0)
+         break;
+
+   if (psListing != NULL)
+   {
+      if (! psListing->iRacy && stat(pcDir, &sStat) == 0
+          && sStat.st_dev == psListing->iDev
+          && sStat.st_ino == psListing->iIno
+          && sStat.st_mtim.tv_sec == psListing->sModified.tv_sec
+          && sStat.st_mtim.tv_nsec == psListing->sModified.tv_nsec)
+      {
+         oGlob->ulHits++;
+         return psListing;
+      }
+      if (PathGlob_read(oGlob, psListing) == 0)
+         return psListing;
+
+      /* The directory is gone */
+      PathGlob_forget(oGlob, psListing);
+      PathGlob_freeListing(psListing);
+      return NULL;
+   }
+
+   psListing = (struct Listing*)calloc(1, sizeof(struct Listing));
+   if (psListing == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+   psListing->pcDir = (char*)malloc(strlen(pcDir) + 1);
+   psListing->uPhysBytes = INITIAL_PHYS_NAME_BYTES;
+   psListing->pcNames = (char*)malloc(psListing->uPhysBytes);
+   psListing->uPhysCount = INITIAL_PHYS_NAMES;
+   psListing->puOffsets = (size_t*)malloc(psListing->uPhysCount
+                                          * sizeof(size_t));
+   psListing->pucTypes = (unsigned char*)malloc(psListing->uPhysCount);
+   if (psListing->pcDir == NULL || psListing->pcNames == NULL
+       || psListing->puOffsets == NULL || psListing->pucTypes == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE);}
+   strcpy(psListing->pcDir, pcDir);
+   psListing->uHash = uHash;
+
+   if (PathGlob_read(oGlob, psListing) == -1)
+   {
+      PathGlob_freeListing(psListing);
+      return NULL;
+   }
+
+   /* Forget the directory read first to make room */
+   if (oGlob->uListings == MAX_LISTINGS)
+   {
+      psEvicted = oGlob->psFirstAdded;
+      PathGlob_forget(oGlob, psEvicted);
+      PathGlob_freeListing(psEvicted);
+   }
+   psListing->psNextInBucket = oGlob->apsBuckets[uHash % BUCKET_COUNT];
+   oGlob->apsBuckets[uHash % BUCKET_COUNT] = psListing;
+   if (oGlob->psLastAdded == NULL)
+      oGlob->psFirstAdded = psListing;
+   else
+      oGlob->psLastAdded->psNextAdded = psListing;
+   oGlob->psLastAdded = psListing;
+   oGlob->uListings++;
+   return psListing;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the character at index *pu of the uLength characters at pc,
+   which is the one after it if it is a "\" that is not the last,
+   and advance *pu past it. */
+
+static unsigned char PathGlob_nextChar(const char *pc, size_t uLength,
+                                       size_t *pu)
+{
+   if (pc[*pu] == '\\' && *pu + 1 < uLength)
+      (*pu)++;
+   return (unsigned char)pc[(*pu)++];
+}
+
+/*--------------------------------------------------------------------*/
+
+/* If the uLength characters at pc start with a bracket expression
+   that has a closing "]", set the bits of the characters that it
+   matches in aucClass and return its number of characters.
+   Otherwise return 0: the "[" stands for itself. */
+
+static size_t PathGlob_compileClass(const char *pc, size_t uLength,
+                                    unsigned char aucClass[32])
+{
+   size_t u = 1;
+   size_t uStart;
+   int iNegated = 0;
+   unsigned char ucFirst;
+   unsigned char ucLast;
+   unsigned c;
+
+   assert(uLength > 0 && pc[0] == '[');
+
+   memset(aucClass, 0, 32);
+   if (u < uLength && (pc[u] == '!' || pc[u] == '^'))
+   {
+      iNegated = 1;
+      u++;
+   }
+
+   /* A "]" right after the "[", or one after a "\", is one of the
+      characters */
+   uStart = u;
+   while (u == uStart || pc[u] != ']')
+   {
+      if (u == uLength)
+         return 0;
+      ucFirst = PathGlob_nextChar(pc, uLength, &u);
+      ucLast = ucFirst;
+      if (u + 1 < uLength && pc[u] == '-' && pc[u + 1] != ']')
+      {
+         u++;
+         ucLast = PathGlob_nextChar(pc, uLength, &u);
+      }
+      for (c = ucFirst; c <= ucLast; c++)
+         aucClass[c / 8] |= (unsigned char)(1u << (c % 8));
+      if (u == uLength)
+         return 0;
+   }
+
+   if (iNegated)
+      for (c = 0; c < 32; c++)
+         aucClass[c] = (unsigned char)~aucClass[c];
+   return u + 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Compile the pattern component that is the uLength characters at
+   pc into *psMatcher, allocating from oArena. */
+
+static void PathGlob_compile(const char *pc, size_t uLength,
+                             struct Matcher *psMatcher, Arena_T oArena)
+{
+   struct Op *psOp;
+   size_t uClass;
+   size_t u;
+
+   psMatcher->psOps = (struct Op*)Arena_alloc(oArena,
+      (uLength + 1) * sizeof(struct Op));
+   psMatcher->pcChars = (char*)Arena_alloc(oArena, uLength + 1);
+   psMatcher->uOps = 0;
+   psMatcher->iStar = 0;
+   psMatcher->iWild = 0;
+   psMatcher->uMinLength = 0;
+
+   for (u = 0; u < uLength; )
+   {
+      psOp = &psMatcher->psOps[psMatcher->uOps];
+      if (pc[u] == '*')
+      {
+         u++;
+         psMatcher->iStar = 1;
+         psMatcher->iWild = 1;
+
+         /* Several stars match what one does */
+         if (psMatcher->uOps > 0 && psOp[-1].eKind == OP_STAR)
+            continue;
+         psOp->eKind = OP_STAR;
+         psMatcher->uOps++;
+         continue;
+      }
+
+      if (pc[u] == '?')
+      {
+         psOp->eKind = OP_ANY;
+         psMatcher->iWild = 1;
+         u++;
+      }
+      else if (pc[u] == '['
+               && (uClass = PathGlob_compileClass(pc + u, uLength - u,
+                                                  psOp->aucClass)) > 0)
+      {
+         psOp->eKind = OP_CLASS;
+         psMatcher->iWild = 1;
+         u += uClass;
+      }
+      else
+      {
+         psOp->eKind = OP_CHAR;
+         psOp->ucChar = PathGlob_nextChar(pc, uLength, &u);
+         psMatcher->pcChars[psMatcher->uOps] = (char)psOp->ucChar;
+      }
+      psMatcher->uOps++;
+      psMatcher->uMinLength++;
+   }
+
+   /* The literal characters at the ends, which are the characters
+      of the Ops only while every Op before them, or after them, is
+      OP_CHAR */
+   for (u = 0; u < psMatcher->uOps; u++)
+      if (psMatcher->psOps[u].eKind != OP_CHAR)
+         break;
+   psMatcher->pcPrefix = psMatcher->pcChars;
+   psMatcher->uPrefix = u;
+   psMatcher->pcSuffix = psMatcher->pcChars + psMatcher->uOps;
+   psMatcher->uSuffix = 0;
+   if (psMatcher->iStar)
+   {
+      for (u = psMatcher->uOps; u > 0; u--)
+         if (psMatcher->psOps[u - 1].eKind != OP_CHAR)
+            break;
+      psMatcher->uSuffix = psMatcher->uOps - u;
+      psMatcher->pcSuffix -= psMatcher->uSuffix;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 iff psOp, which is not OP_STAR, matches character c. */
+
+static int PathGlob_matchOne(const struct Op *psOp, unsigned char c)
+{
+   switch (psOp->eKind)
+   {
+      case OP_CHAR:
+         return psOp->ucChar == c;
+      case OP_ANY:
+         return 1;
+      case OP_CLASS:
+         return (psOp->aucClass[c / 8] >> (c % 8)) & 1;
+      default:
+         assert(0);
+         return 0;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 iff psMatcher matches the name pcName of uLength
+   characters.  Otherwise return 0. */
+
+static int PathGlob_match(const struct Matcher *psMatcher,
+                          const char *pcName, size_t uLength)
+{
+   const struct Op *psOps = psMatcher->psOps;
+   size_t uOps = psMatcher->uOps;
+   size_t uOp = 0;
+   size_t u = 0;
+
+   /* The Op after the last star, and the character of pcName from
+      which that star is next tried to match one more, if a star has
+      been seen */
+   size_t uStarOp = 0;
+   size_t uStarName = 0;
+   int iStarSeen = 0;
+
+   if (uLength < psMatcher->uMinLength
+       || (! psMatcher->iStar && uLength != psMatcher->uMinLength)
+       || memcmp(pcName, psMatcher->pcPrefix, psMatcher->uPrefix) != 0
+       || memcmp(pcName + uLength - psMatcher->uSuffix,
+                 psMatcher->pcSuffix, psMatcher->uSuffix) != 0)
+      return 0;
+
+   /* A star matches as little as it can, and one more character
+      each time that what follows it fails */
+   while (u < uLength)
+   {
+      if (uOp < uOps && psOps[uOp].eKind == OP_STAR)
+      {
+         iStarSeen = 1;
+         uStarOp = ++uOp;
+         uStarName = u;
+      }
+      else if (uOp < uOps
+               && PathGlob_matchOne(&psOps[uOp], (unsigned char)pcName[u]))
+      {
+         uOp++;
+         u++;
+      }
+      else if (iStarSeen)
+      {
+         uOp = uStarOp;
+         u = ++uStarName;
+      }
+      else
+         return 0;
+   }
+   while (uOp < uOps && psOps[uOp].eKind == OP_STAR)
+      uOp++;
+   return uOp == uOps;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Append pcPath to *psList. */
+
+static void PathGlob_addPath(struct PathList *psList, const char *pcPath)
+{
+   const char **ppcPaths;
+
+   if (psList->uLength == psList->uPhysLength)
+   {
+      psList->uPhysLength = (psList->uPhysLength == 0)
+         ? INITIAL_PHYS_PATHS : GROWTH_FACTOR * psList->uPhysLength;
+      ppcPaths = (const char**)realloc(psList->ppcPaths,
+         psList->uPhysLength * sizeof(const char*));
+      if (ppcPaths == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+      psList->ppcPaths = ppcPaths;
+   }
+   psList->ppcPaths[psList->uLength++] = pcPath;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return a new string, allocated from oArena, of pcPath followed by
+   the uLength characters at pcName, and by "/" iff iSlash. */
+
+static char *PathGlob_join(const char *pcPath, const char *pcName,
+                           size_t uLength, int iSlash, Arena_T oArena)
+{
+   size_t uPath = strlen(pcPath);
+   char *pcJoined;
+
+   pcJoined = (char*)Arena_alloc(oArena, uPath + uLength + 2);
+   memcpy(pcJoined, pcPath, uPath);
+   memcpy(pcJoined + uPath, pcName, uLength);
+   if (iSlash)
+      pcJoined[uPath + uLength++] = '/';
+   pcJoined[uPath + uLength] = '\0';
+   return pcJoined;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 iff pcPath, an entry whose file type is ucType, is a
+   directory or a symbolic link to one. */
+
+static int PathGlob_isDir(const char *pcPath, unsigned char ucType)
+{
+   struct stat sStat;
+
+   if (ucType == DT_DIR)
+      return 1;
+   if (ucType != DT_UNKNOWN && ucType != DT_LNK)
+      return 0;
+   return stat(pcPath, &sStat) == 0 && S_ISDIR(sStat.st_mode);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Compare the paths at pv1 and pv2 as qsort() requires. */
+
+static int PathGlob_compare(const void *pv1, const void *pv2)
+{
+   return strcmp(*(const char * const *)pv1, *(const char * const *)pv2);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *pppcPaths an array of the paths that the pattern that is
+   the uLength characters at pcPattern matches, in the order of
+   strcmp(), and return their number.  If it matches none, or has no
+   wildcard, store NULL and return 0.  oGlob owns the array
+   and the paths, which are valid until the next call of a PathGlob
+   function on oGlob. */
+
+size_t PathGlob_expand(PathGlob_T oGlob, const char *pcPattern,
+                       size_t uLength, const char ***pppcPaths)
+{
+   struct Matcher sMatcher;
+   struct Listing *psListing;
+   struct PathList sSwap;
+   struct stat sStat;
+   const char *pcComponent;
+   const char *pcEnd;
+   const char *pcName;
+   const char *pcPath;
+   size_t uComponent;
+   size_t uName;
+   size_t u;
+   size_t v;
+   int iLast;
+   int iDot;
+   int iWild = 0;
+
+   assert(oGlob != NULL);
+   assert(pcPattern != NULL);
+   assert(pppcPaths != NULL);
+
+   *pppcPaths = NULL;
+   Arena_reset(oGlob->oScratch);
+   oGlob->sPaths.uLength = 0;
+
+   /* Nothing is read for a word without a wildcard, such as "[" */
+   if (memchr(pcPattern, '*', uLength) == NULL
+       && memchr(pcPattern, '?', uLength) == NULL
+       && memchr(pcPattern, '[', uLength) == NULL)
+      return 0;
+
+   pcComponent = pcPattern;
+   pcEnd = pcPattern + uLength;
+   if (uLength > 0 && pcPattern[0] == '/')
+   {
+      PathGlob_addPath(&oGlob->sPaths, "/");
+      while (pcComponent < pcEnd && *pcComponent == '/')
+         pcComponent++;
+   }
+   else
+      PathGlob_addPath(&oGlob->sPaths, "");
+
+   do
+   {
+      pcName = (const char*)memchr(pcComponent, '/',
+                                   (size_t)(pcEnd - pcComponent));
+      iLast = (pcName == NULL);
+      uComponent = (size_t)((iLast ? pcEnd : pcName) - pcComponent);
+
+      PathGlob_compile(pcComponent, uComponent, &sMatcher,
+                       oGlob->oScratch);
+      iDot = (sMatcher.uPrefix > 0 && sMatcher.pcChars[0] == '.');
+      oGlob->sNext.uLength = 0;
+      for (u = 0; u < oGlob->sPaths.uLength; u++)
+      {
+         pcPath = oGlob->sPaths.ppcPaths[u];
+
+         /* A component without a wildcard, whose Ops are all
+            OP_CHAR, is only appended; whether the path exists is
+            found out later */
+         if (! sMatcher.iWild)
+         {
+            PathGlob_addPath(&oGlob->sNext,
+               PathGlob_join(pcPath, sMatcher.pcChars, sMatcher.uOps,
+                             ! iLast, oGlob->oScratch));
+            continue;
+         }
+
+         psListing = PathGlob_list(oGlob,
+                                   (*pcPath == '\0') ? "." : pcPath);
+         if (psListing == NULL)
+            continue;
+         for (v = 0; v < psListing->uCount; v++)
+         {
+            pcName = psListing->pcNames + psListing->puOffsets[v];
+            if (pcName[0] == '.' && ! iDot)
+               continue;
+            uName = (v + 1 < psListing->uCount)
+               ? psListing->puOffsets[v + 1] - psListing->puOffsets[v] - 1
+               : psListing->uNameBytes - psListing->puOffsets[v] - 1;
+            if (! PathGlob_match(&sMatcher, pcName, uName))
+               continue;
+            pcName = PathGlob_join(pcPath, pcName, uName, 0,
+                                   oGlob->oScratch);
+            if (! iLast)
+            {
+               if (! PathGlob_isDir(pcName, psListing->pucTypes[v]))
+                  continue;
+               pcName = PathGlob_join(pcName, "/", 1, 0,
+                                      oGlob->oScratch);
+            }
+            PathGlob_addPath(&oGlob->sNext, pcName);
+         }
+      }
+      iWild |= sMatcher.iWild;
+
+      sSwap = oGlob->sPaths;
+      oGlob->sPaths = oGlob->sNext;
+      oGlob->sNext = sSwap;
+      if (! iLast)
+         pcComponent += uComponent + 1;
+   }
+   while (! iLast && oGlob->sPaths.uLength > 0);
+
+   if (! iWild)
+   {
+      oGlob->sPaths.uLength = 0;
+      return 0;
+   }
+
+   /* Keep the paths whose last component was only appended if they
+      exist */
+   if (! sMatcher.iWild)
+   {
+      v = 0;
+      for (u = 0; u < oGlob->sPaths.uLength; u++)
+         if (lstat(oGlob->sPaths.ppcPaths[u], &sStat) == 0)
+            oGlob->sPaths.ppcPaths[v++] = oGlob->sPaths.ppcPaths[u];
+      oGlob->sPaths.uLength = v;
+   }
+   if (oGlob->sPaths.uLength == 0)
+      return 0;
+
+   qsort(oGlob->sPaths.ppcPaths, oGlob->sPaths.uLength,
+         sizeof(const char*), PathGlob_compare);
+   *pppcPaths = oGlob->sPaths.ppcPaths;
+   return oGlob->sPaths.uLength;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *pulHits and *pulScans the number of times that oGlob
+   used a directory that it remembered, and that it read one. */
+
+void PathGlob_getCounts(PathGlob_T oGlob, unsigned long *pulHits,
+                        unsigned long *pulScans)
+{
+   assert(oGlob != NULL);
+   assert(pulHits != NULL);
+   assert(pulScans != NULL);
+
+   *pulHits = oGlob->ulHits;
+   *pulScans = oGlob->ulScans;
+}
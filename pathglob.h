@@ -0,0 +1,64 @@
+/*--------------------------------------------------------------------*/
+/* pathglob.h                                                         */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef PATHGLOB_INCLUDED
+#define PATHGLOB_INCLUDED
+
+#include <stddef.h>
+
+/*--------------------------------------------------------------------*/
+
+/* A PathGlob_T object expands patterns into the paths that they
+   match.  In a pattern, "*" matches any string, "?" any one
+   character, and "[...]" any one of the characters that it lists,
+   which may include ranges such as "a-z", or any other character if
+   it starts with "!" or "^"; a "[" without a matching "]" stands for
+   itself, as does every other character.  A "\" makes the character
+   after it stand for itself, in a bracket expression too; it must
+   not come before a "/".  A pattern is matched component by
+   component; a "/" is only matched by a "/", and a name that starts
+   with "." only by a component that starts with ".".  A PathGlob
+   remembers the names in each directory that it has read, and reads
+   a directory again only if its modification time or inode has
+   changed since. */
+
+typedef struct PathGlob *PathGlob_T;
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return a PathGlob that remembers no directories.  The
+   caller owns it. */
+
+PathGlob_T PathGlob_new(void);
+
+/*--------------------------------------------------------------------*/
+
+/* Free oGlob and the directories that it remembers. */
+
+void PathGlob_free(PathGlob_T oGlob);
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *pppcPaths an array of the paths that the pattern that is
+   the uLength characters at pcPattern matches, in the order of
+   strcmp(), and return their number.  If it matches none, or has no
+   wildcard, store NULL and return 0.  oGlob owns the array
+   and the paths, which are valid until the next call of a PathGlob
+   function on oGlob. */
+
+size_t PathGlob_expand(PathGlob_T oGlob, const char *pcPattern,
+                       size_t uLength, const char ***pppcPaths);
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *pulHits and *pulScans the number of times that oGlob
+   used a directory that it remembered, and that it read one. */
+
+void PathGlob_getCounts(PathGlob_T oGlob, unsigned long *pulHits,
+                        unsigned long *pulScans);
+
+/*--------------------------------------------------------------------*/
+
+#endif
@@ -0,0 +1,325 @@
+/*--------------------------------------------------------------------*/
+/* pipeline.c                                                         */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#include "pipeline.h"
+#include "command.h"
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The number of stages that a new pipeline has room for, and the
+   factor by which that room grows when it is full. */
+enum {INITIAL_PHYS_LENGTH = 2};
+enum {GROWTH_FACTOR = 2};
+
+/*--------------------------------------------------------------------*/
+
+/* A Pipeline is an array of Commands allocated from an arena. */
+
+struct Pipeline
+{
+   /* The stages, the number of them, and the number of elements of
+      the array. */
+   Command_T *poCommands;
+   size_t uLength;
+   size_t uPhysLength;
+
+   /* 1 iff the pipeline runs in the background. */
+   int iBackground;
+
+   /* 1 iff a word of its line refers to a variable or is an argument
+      with an unquoted pattern. */
+   int iExpands;
+
+   /* The arena that holds the pipeline and its array. */
+   Arena_T oArena;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty pipeline.  The pipeline is allocated
+   from oArena, which owns it. */
+
+Pipeline_T newPipeline(Arena_T oArena)
+{
+   struct Pipeline *psPipeline;
+
+   assert(oArena != NULL);
+
+   psPipeline = (struct Pipeline*)Arena_alloc(oArena,
+                                              sizeof(struct Pipeline));
+   psPipeline->oArena = oArena;
+   psPipeline->uLength = 0;
+   psPipeline->uPhysLength = INITIAL_PHYS_LENGTH;
+   psPipeline->iBackground = 0;
+   psPipeline->iExpands = 0;
+   psPipeline->poCommands = (Command_T*)Arena_alloc(oArena,
+      INITIAL_PHYS_LENGTH * sizeof(Command_T));
+   return psPipeline;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Append oCommand to oPipeline as its last stage. */
+
+void Pipeline_addCommand(Pipeline_T oPipeline, Command_T oCommand)
+{
+   Command_T *poCommands;
+
+   assert(oPipeline != NULL);
+   assert(oCommand != NULL);
+
+   /* The old array stays in the arena until it is reset. */
+   if (oPipeline->uLength == oPipeline->uPhysLength)
+   {
+      oPipeline->uPhysLength *= GROWTH_FACTOR;
+      poCommands = (Command_T*)Arena_alloc(oPipeline->oArena,
+         oPipeline->uPhysLength * sizeof(Command_T));
+      memcpy(poCommands, oPipeline->poCommands,
+             oPipeline->uLength * sizeof(Command_T));
+      oPipeline->poCommands = poCommands;
+   }
+
+   oPipeline->poCommands[oPipeline->uLength++] = oCommand;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the number of stages of oPipeline. */
+
+size_t Pipeline_getLength(Pipeline_T oPipeline)
+{
+   assert(oPipeline != NULL);
+   return oPipeline->uLength;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns stage uIndex of oPipeline.  uIndex must be less than
+   Pipeline_getLength(oPipeline). */
+
+Command_T Pipeline_getCommand(Pipeline_T oPipeline, size_t uIndex)
+{
+   assert(oPipeline != NULL);
+   assert(uIndex < oPipeline->uLength);
+   return oPipeline->poCommands[uIndex];
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Mark oPipeline to run in the background. */
+
+void Pipeline_setBackground(Pipeline_T oPipeline)
+{
+   assert(oPipeline != NULL);
+   oPipeline->iBackground = 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns 1 if oPipeline runs in the background, or 0 otherwise. */
+
+int Pipeline_isBackground(Pipeline_T oPipeline)
+{
+   assert(oPipeline != NULL);
+   return oPipeline->iBackground;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Mark oPipeline as parsed from a line whose words may change with
+   the variables or the files: one that refers to a variable, or has
+   an argument with an unquoted "*", "?" or "[". */
+
+void Pipeline_setExpands(Pipeline_T oPipeline)
+{
+   assert(oPipeline != NULL);
+   oPipeline->iExpands = 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns 1 if Pipeline_setExpands() has marked oPipeline, or 0
+   otherwise. */
+
+int Pipeline_expands(Pipeline_T oPipeline)
+{
+   assert(oPipeline != NULL);
+   return oPipeline->iExpands;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* If the first word of oPipeline is "time" and more words follow it,
+   then return a copy of oPipeline, allocated from oArena, whose first
+   stage is a view of the first stage of oPipeline without that word.
+   Otherwise return NULL.  oPipeline itself is not changed, so it may
+   be one that must stay as it is, such as one in a cache. */
+
+Pipeline_T Pipeline_dropTime(Pipeline_T oPipeline, Arena_T oArena)
+{
+   Pipeline_T oTimed;
+   Command_T oFirst;
+   size_t u;
+
+   assert(oPipeline != NULL);
+   assert(oArena != NULL);
+
+   oFirst = oPipeline->poCommands[0];
+   if (strcmp(Command_getName(oFirst), "time") != 0
+       || Command_getArgCount(oFirst) == 0)
+      return NULL;
+
+   /* The argv of the view starts at the word after "time" */
+   oTimed = newPipeline(oArena);
+   Pipeline_addCommand(oTimed, Command_newView(
+      Command_getArgv(oFirst) + 1, Command_getArgCount(oFirst),
+      Command_getRedirects(oFirst), Command_getRedirectCount(oFirst),
+      oArena));
+   for (u = 1; u < oPipeline->uLength; u++)
+      Pipeline_addCommand(oTimed, oPipeline->poCommands[u]);
+   oTimed->iBackground = oPipeline->iBackground;
+   oTimed->iExpands = oPipeline->iExpands;
+   return oTimed;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the number of here-document redirects of all the stages of
+   oPipeline. */
+
+size_t Pipeline_getHereDocCount(Pipeline_T oPipeline)
+{
+   const struct Redirect *psRedirects;
+   size_t uRedirects;
+   size_t uCount = 0;
+   size_t u;
+   size_t v;
+
+   assert(oPipeline != NULL);
+
+   for (u = 0; u < oPipeline->uLength; u++)
+   {
+      psRedirects = Command_getRedirects(oPipeline->poCommands[u]);
+      uRedirects = Command_getRedirectCount(oPipeline->poCommands[u]);
+      for (v = 0; v < uRedirects; v++)
+         if (psRedirects[v].eKind == REDIRECT_HEREDOC)
+            uCount++;
+   }
+   return uCount;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the delimiter of here-document uIndex of oPipeline,
+   counting the redirects of its stages in order.  uIndex must be
+   less than Pipeline_getHereDocCount(oPipeline). */
+
+const char *Pipeline_getHereDocDelimiter(Pipeline_T oPipeline,
+                                         size_t uIndex)
+{
+   const struct Redirect *psRedirects;
+   size_t uRedirects;
+   size_t u;
+   size_t v;
+
+   assert(oPipeline != NULL);
+
+   for (u = 0; u < oPipeline->uLength; u++)
+   {
+      psRedirects = Command_getRedirects(oPipeline->poCommands[u]);
+      uRedirects = Command_getRedirectCount(oPipeline->poCommands[u]);
+      for (v = 0; v < uRedirects; v++)
+         if (psRedirects[v].eKind == REDIRECT_HEREDOC
+             && uIndex-- == 0)
+            return psRedirects[v].pcWord;
+   }
+   assert(0);
+   return NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return a copy of oPipeline, allocated from oArena, in which the
+   body of here-document u, counted as by
+   Pipeline_getHereDocDelimiter(), is the string apcBodies[u], which
+   must remain valid for as long as the copy is used.  oPipeline
+   itself is not changed, so it may be one that must stay as it is,
+   such as one in a cache. */
+
+Pipeline_T Pipeline_bindHereDocs(Pipeline_T oPipeline,
+                                 const char *apcBodies[],
+                                 Arena_T oArena)
+{
+   Pipeline_T oBound;
+   Command_T oCommand;
+   const struct Redirect *psRedirects;
+   struct Redirect *psCopy;
+   size_t uRedirects;
+   size_t uBody = 0;
+   size_t u;
+   size_t v;
+
+   assert(oPipeline != NULL);
+   assert(apcBodies != NULL);
+   assert(oArena != NULL);
+
+   oBound = newPipeline(oArena);
+   for (u = 0; u < oPipeline->uLength; u++)
+   {
+      oCommand = oPipeline->poCommands[u];
+      psRedirects = Command_getRedirects(oCommand);
+      uRedirects = Command_getRedirectCount(oCommand);
+      for (v = 0; v < uRedirects; v++)
+         if (psRedirects[v].eKind == REDIRECT_HEREDOC)
+            break;
+
+      /* A stage with here-documents becomes a view with a copy of its
+         redirects; the others are shared */
+      if (v < uRedirects)
+      {
+         psCopy = (struct Redirect*)Arena_alloc(oArena,
+            uRedirects * sizeof(struct Redirect));
+         memcpy(psCopy, psRedirects,
+                uRedirects * sizeof(struct Redirect));
+         for (; v < uRedirects; v++)
+            if (psCopy[v].eKind == REDIRECT_HEREDOC)
+               psCopy[v].pcBody = apcBodies[uBody++];
+         oCommand = Command_newView(Command_getArgv(oCommand),
+                                    Command_getArgCount(oCommand) + 1,
+                                    psCopy, uRedirects, oArena);
+      }
+      Pipeline_addCommand(oBound, oCommand);
+   }
+   oBound->iBackground = oPipeline->iBackground;
+   oBound->iExpands = oPipeline->iExpands;
+   return oBound;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Outputs the details of each stage of oPipeline to stdout in the
+   format of writeCommand(), with a line "Pipe" between stages and a
+   line "Background" after the last if it runs in the background. */
+
+void writePipeline(Pipeline_T oPipeline)
+{
+   size_t u;
+
+   assert(oPipeline != NULL);
+
+   for (u = 0; u < oPipeline->uLength; u++)
+   {
+      if (u > 0)
+         printf("Pipe\n");
+      writeCommand(oPipeline->poCommands[u]);
+   }
+   if (oPipeline->iBackground)
+      printf("Background\n");
+}
@@ -0,0 +1,124 @@
+/*--------------------------------------------------------------------*/
+/* pipeline.h                                                         */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef PIPELINE_INCLUDED
+#define PIPELINE_INCLUDED
+
+#include <stddef.h>
+#include "command.h"
+#include "arena.h"
+
+/*--------------------------------------------------------------------*/
+
+/* A Pipeline_T object is a sequence of one or more Commands, called
+   stages, in which the stdout of each stage is connected to the
+   stdin of the next.  The shell either waits for a pipeline or runs
+   it in the background. */
+
+typedef struct Pipeline *Pipeline_T;
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty pipeline.  The pipeline is allocated
+   from oArena, which owns it. */
+
+Pipeline_T newPipeline(Arena_T oArena);
+
+/*--------------------------------------------------------------------*/
+
+/* Append oCommand to oPipeline as its last stage. */
+
+void Pipeline_addCommand(Pipeline_T oPipeline, Command_T oCommand);
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the number of stages of oPipeline. */
+
+size_t Pipeline_getLength(Pipeline_T oPipeline);
+
+/*--------------------------------------------------------------------*/
+
+/* Returns stage uIndex of oPipeline.  uIndex must be less than
+   Pipeline_getLength(oPipeline). */
+
+Command_T Pipeline_getCommand(Pipeline_T oPipeline, size_t uIndex);
+
+/*--------------------------------------------------------------------*/
+
+/* Mark oPipeline to run in the background. */
+
+void Pipeline_setBackground(Pipeline_T oPipeline);
+
+/*--------------------------------------------------------------------*/
+
+/* Returns 1 if oPipeline runs in the background, or 0 otherwise. */
+
+int Pipeline_isBackground(Pipeline_T oPipeline);
+
+/*--------------------------------------------------------------------*/
+
+/* Mark oPipeline as parsed from a line whose words may change with
+   the variables or the files: one that refers to a variable, or has
+   an argument with an unquoted "*", "?" or "[". */
+
+void Pipeline_setExpands(Pipeline_T oPipeline);
+
+/*--------------------------------------------------------------------*/
+
+/* Returns 1 if Pipeline_setExpands() has marked oPipeline, or 0
+   otherwise. */
+
+int Pipeline_expands(Pipeline_T oPipeline);
+
+/*--------------------------------------------------------------------*/
+
+/* If the first word of oPipeline is "time" and more words follow it,
+   then return a copy of oPipeline, allocated from oArena, whose first
+   stage is a view of the first stage of oPipeline without that word.
+   Otherwise return NULL.  oPipeline itself is not changed, so it may
+   be one that must stay as it is, such as one in a cache. */
+
+Pipeline_T Pipeline_dropTime(Pipeline_T oPipeline, Arena_T oArena);
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the number of here-document redirects of all the stages of
+   oPipeline. */
+
+size_t Pipeline_getHereDocCount(Pipeline_T oPipeline);
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the delimiter of here-document uIndex of oPipeline,
+   counting the redirects of its stages in order.  uIndex must be
+   less than Pipeline_getHereDocCount(oPipeline). */
+
+const char *Pipeline_getHereDocDelimiter(Pipeline_T oPipeline,
+                                         size_t uIndex);
+
+/*--------------------------------------------------------------------*/
+
+/* Return a copy of oPipeline, allocated from oArena, in which the
+   body of here-document u, counted as by
+   Pipeline_getHereDocDelimiter(), is the string apcBodies[u], which
+   must remain valid for as long as the copy is used.  oPipeline
+   itself is not changed, so it may be one that must stay as it is,
+   such as one in a cache. */
+
+Pipeline_T Pipeline_bindHereDocs(Pipeline_T oPipeline,
+                                 const char *apcBodies[],
+                                 Arena_T oArena);
+
+/*--------------------------------------------------------------------*/
+
+/* Outputs the details of each stage of oPipeline to stdout in the
+   format of writeCommand(), with a line "Pipe" between stages and a
+   line "Background" after the last if it runs in the background. */
+
+void writePipeline(Pipeline_T oPipeline);
+
+/*--------------------------------------------------------------------*/
+
+#endif
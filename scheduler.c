@@ -0,0 +1,700 @@
+/*--------------------------------------------------------------------*/
+/* scheduler.c                                                        */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#include "scheduler.h"
+#include "pipeline.h"
+#include "command.h"
+#include "syner.h"
+#include "builtin.h"
+#include "spawner.h"
+#include "pathcache.h"
+#include "jobs.h"
+#include "usage.h"
+#include "arena.h"
+#include "ish.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The number of lines that a new Scheduler has room for, and the
+   factor by which that room grows when it is full. */
+enum {INITIAL_PHYS_NODES = 64};
+enum {GROWTH_FACTOR = 2};
+
+/* The bucket counts from which the file table takes the first that
+   is at least twice the number of lines, or the last. */
+static const size_t auBucketCounts[] =
+   {61, 127, 251, 509, 1021, 2039, 4093, 8191, 16381, 32749, 65521};
+enum {BUCKET_COUNT_COUNT =
+   sizeof(auBucketCounts) / sizeof(auBucketCounts[0])};
+
+/* The index of no line. */
+static const size_t NO_NODE = SIZE_MAX;
+
+/*--------------------------------------------------------------------*/
+
+/* An Edge is an element of a list of lines. */
+
+struct Edge
+{
+   size_t uNode;
+   struct Edge *psNext;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A Node is one line of the script. */
+
+struct Node
+{
+   /* The text of the line, and its Pipeline. */
+   const char *pcLine;
+   Pipeline_T oPipeline;
+
+   /* The builtin that the line runs, or NULL, and 1 iff the line
+      began with "time", which its Pipeline no longer has. */
+   const struct Builtin *psBuiltin;
+   int iTimed;
+
+   /* 1 iff the line refers to a variable or has an unquoted pattern,
+      as Pipeline_expands() tells, and so may see variables, or match
+      files, that the lines before it change. */
+   int iExpands;
+
+   /* Once the line has started in the foreground: when, the process
+      ID of each stage, and what each stage cost. */
+   struct timespec sStart;
+   pid_t *aiPids;
+   struct Usage *asUsage;
+
+   /* The number of lines that must finish before this one starts,
+      and the lines that wait for this one.  uLastSuccessor is the
+      line most recently added to psSuccessors, so that no line is
+      added twice. */
+   size_t uBlockers;
+   struct Edge *psSuccessors;
+   size_t uLastSuccessor;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A FileState is what the lines so far do with one file. */
+
+struct FileState
+{
+   /* The name of the file, or NULL for the shell's stdin and
+      stdout. */
+   const char *pcName;
+
+   /* The last line that writes the file, or NO_NODE, and the lines
+      that read it after that. */
+   size_t uWriter;
+   struct Edge *psReaders;
+
+   /* The next FileState in the same bucket. */
+   struct FileState *psNextInBucket;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A Scheduler is an array of Nodes, and the graph of the lines that
+   each one waits for, which is built when it runs. */
+
+struct Scheduler
+{
+   /* The lines, the number of them, and the number of elements of
+      the array. */
+   struct Node *psNodes;
+   size_t uLength;
+   size_t uPhysLength;
+
+   /* The most lines that run at once, and the shell that runs
+      them. */
+   size_t uMaxJobs;
+   struct ShellState *psState;
+
+   /* The file table: the buckets and their number, and the
+      FileStates of the shell's stdin and stdout. */
+   struct FileState **ppsBuckets;
+   size_t uBucketCount;
+   struct FileState sStdin;
+   struct FileState sStdout;
+
+   /* The arena that holds the copies of the lines, their Pipelines,
+      and the graph. */
+   Arena_T oArena;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty Scheduler that runs at most uMaxJobs
+   lines at once, with the shell whose state is psState.  The caller
+   owns the Scheduler. */
+
+Scheduler_T Scheduler_new(size_t uMaxJobs, struct ShellState *psState)
+{
+   Scheduler_T oScheduler;
+
+   assert(uMaxJobs > 0);
+   assert(psState != NULL);
+
+   oScheduler = (Scheduler_T)malloc(sizeof(struct Scheduler));
+   if (oScheduler == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+   oScheduler->psNodes = (struct Node*)malloc(INITIAL_PHYS_NODES
+                                              * sizeof(struct Node));
+   if (oScheduler->psNodes == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE);}
+
+   oScheduler->uLength = 0;
+   oScheduler->uPhysLength = INITIAL_PHYS_NODES;
+   oScheduler->uMaxJobs = uMaxJobs;
+   oScheduler->psState = psState;
+   oScheduler->ppsBuckets = NULL;
+   oScheduler->uBucketCount = 0;
+   oScheduler->oArena = Arena_new();
+   return oScheduler;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Free oScheduler and the lines that it holds. */
+
+void Scheduler_free(Scheduler_T oScheduler)
+{
+   assert(oScheduler != NULL);
+
+   Arena_free(oScheduler->oArena);
+   free(oScheduler->ppsBuckets);
+   free(oScheduler->psNodes);
+   free(oScheduler);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make oPipeline the Pipeline of psNode, a line of oScheduler,
+   without changing it: run the rest of a line that begins with
+   "time", and find the builtin that the line runs, as at the
+   prompt. */
+
+static void Scheduler_setPipeline(Scheduler_T oScheduler,
+                                  struct Node *psNode,
+                                  Pipeline_T oPipeline)
+{
+   Pipeline_T oTimed;
+
+   oTimed = Pipeline_dropTime(oPipeline, oScheduler->oArena);
+   psNode->iTimed = (oTimed != NULL);
+   psNode->oPipeline = psNode->iTimed ? oTimed : oPipeline;
+   psNode->psBuiltin = Builtin_find(psNode->oPipeline,
+                                    oScheduler->psState);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Add the line pcLine, whose Pipeline is oPipeline, to the end of the
+   script of oScheduler.  If oPipeline is NULL, parse pcLine with
+   synLine() instead, and if it contains an error, write the message
+   and add nothing.  oScheduler keeps a copy of pcLine, but oPipeline
+   must stay valid, unchanged, until oScheduler is freed. */
+
+void Scheduler_add(Scheduler_T oScheduler, const char *pcLine,
+                   Pipeline_T oPipeline)
+{
+   struct Node *psNodes;
+   struct Node *psNode;
+   char *pcCopy;
+
+   assert(oScheduler != NULL);
+   assert(pcLine != NULL);
+
+   pcCopy = Arena_strndup(oScheduler->oArena, pcLine, strlen(pcLine));
+   if (oPipeline == NULL)
+   {
+      oPipeline = synLine(pcCopy, oScheduler->oArena);
+      if (oPipeline == NULL)
+         return;
+   }
+
+   if (oScheduler->uLength == oScheduler->uPhysLength)
+   {
+      oScheduler->uPhysLength *= GROWTH_FACTOR;
+      psNodes = (struct Node*)realloc(oScheduler->psNodes,
+         oScheduler->uPhysLength * sizeof(struct Node));
+      if (psNodes == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+      oScheduler->psNodes = psNodes;
+   }
+
+   psNode = &oScheduler->psNodes[oScheduler->uLength++];
+   psNode->pcLine = pcCopy;
+   psNode->iExpands = Pipeline_expands(oPipeline);
+   Scheduler_setPipeline(oScheduler, psNode, oPipeline);
+
+   psNode->uBlockers = 0;
+   psNode->psSuccessors = NULL;
+   psNode->uLastSuccessor = NO_NODE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make line uTo of oScheduler wait for line uFrom, unless uFrom is
+   NO_NODE or uTo, or uTo already waits for it. */
+
+static void Scheduler_addEdge(Scheduler_T oScheduler, size_t uFrom,
+                              size_t uTo)
+{
+   struct Node *psFrom;
+   struct Edge *psEdge;
+
+   if (uFrom == NO_NODE || uFrom == uTo)
+      return;
+
+   /* The lines that wait for uFrom are added in order, so uTo can
+      only be the last of them */
+   psFrom = &oScheduler->psNodes[uFrom];
+   if (psFrom->uLastSuccessor == uTo)
+      return;
+
+   psEdge = (struct Edge*)Arena_alloc(oScheduler->oArena,
+                                      sizeof(struct Edge));
+   psEdge->uNode = uTo;
+   psEdge->psNext = psFrom->psSuccessors;
+   psFrom->psSuccessors = psEdge;
+   psFrom->uLastSuccessor = uTo;
+   oScheduler->psNodes[uTo].uBlockers++;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Forget what the lines so far do with every file. */
+
+static void Scheduler_clearFiles(Scheduler_T oScheduler)
+{
+   memset(oScheduler->ppsBuckets, 0,
+          oScheduler->uBucketCount * sizeof(struct FileState*));
+   oScheduler->sStdin.pcName = NULL;
+   oScheduler->sStdin.uWriter = NO_NODE;
+   oScheduler->sStdin.psReaders = NULL;
+   oScheduler->sStdout.pcName = NULL;
+   oScheduler->sStdout.uWriter = NO_NODE;
+   oScheduler->sStdout.psReaders = NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the FileState of the file named pcName in the file table of
+   oScheduler, adding one if there is none. */
+
+static struct FileState *Scheduler_getFile(Scheduler_T oScheduler,
+                                           const char *pcName)
+{
+   const size_t HASH_MULTIPLIER = 65599;
+   struct FileState *psFile;
+   size_t uHash = 0;
+   size_t u;
+
+   for (u = 0; pcName[u] != '\0'; u++)
+      uHash = uHash * HASH_MULTIPLIER + (size_t)pcName[u];
+   uHash %= oScheduler->uBucketCount;
+
+   for (psFile = oScheduler->ppsBuckets[uHash]; psFile != NULL;
+        psFile = psFile->psNextInBucket)
+      if (strcmp(psFile->pcName, pcName) == 0)
+         return psFile;
+
+   psFile = (struct FileState*)Arena_alloc(oScheduler->oArena,
+                                           sizeof(struct FileState));
+   psFile->pcName = pcName;
+   psFile->uWriter = NO_NODE;
+   psFile->psReaders = NULL;
+   psFile->psNextInBucket = oScheduler->ppsBuckets[uHash];
+   oScheduler->ppsBuckets[uHash] = psFile;
+   return psFile;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Record that line uNode of oScheduler reads the file of psFile: it
+   waits for the last line that writes the file. */
+
+static void Scheduler_read(Scheduler_T oScheduler,
+                           struct FileState *psFile, size_t uNode)
+{
+   struct Edge *psEdge;
+
+   Scheduler_addEdge(oScheduler, psFile->uWriter, uNode);
+
+   psEdge = (struct Edge*)Arena_alloc(oScheduler->oArena,
+                                      sizeof(struct Edge));
+   psEdge->uNode = uNode;
+   psEdge->psNext = psFile->psReaders;
+   psFile->psReaders = psEdge;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Record that line uNode of oScheduler writes the file of psFile: it
+   waits for the last line that writes the file, and for the lines
+   that read it since, which must not see what uNode writes. */
+
+static void Scheduler_write(Scheduler_T oScheduler,
+                            struct FileState *psFile, size_t uNode)
+{
+   struct Edge *psEdge;
+
+   Scheduler_addEdge(oScheduler, psFile->uWriter, uNode);
+   for (psEdge = psFile->psReaders; psEdge != NULL;
+        psEdge = psEdge->psNext)
+      Scheduler_addEdge(oScheduler, psEdge->uNode, uNode);
+
+   psFile->uWriter = uNode;
+   psFile->psReaders = NULL;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 iff the last redirect of descriptor iFd of oCommand names
+   a file, so that the command does not use the shell's own.  A copy
+   of another descriptor, as "1>&2" makes, may still be the shell's
+   own, as in "2>&1 1>&2". */
+
+static int Scheduler_redirects(Command_T oCommand, int iFd)
+{
+   const struct Redirect *psRedirects;
+   size_t uRedirects;
+   size_t u;
+   int iRedirected = 0;
+
+   psRedirects = Command_getRedirects(oCommand);
+   uRedirects = Command_getRedirectCount(oCommand);
+   for (u = 0; u < uRedirects; u++)
+      if (psRedirects[u].iFd == iFd)
+         iRedirected = (psRedirects[u].eKind != REDIRECT_DUP_IN
+                        && psRedirects[u].eKind != REDIRECT_DUP_OUT);
+   return iRedirected;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make each line of oScheduler wait for the earlier lines that it
+   conflicts with, and for the barrier before it, and make each
+   barrier wait for every line since the barrier before it. */
+
+static void Scheduler_buildGraph(Scheduler_T oScheduler)
+{
+   const struct Builtin *psBuiltin;
+   Pipeline_T oPipeline;
+   Command_T oCommand;
+   const struct Redirect *psRedirects;
+   size_t uRedirects;
+   size_t uBarrier = NO_NODE;
+   size_t uSince = 0;
+   size_t uStages;
+   size_t uNode;
+   size_t u;
+   size_t v;
+
+   for (u = 0; u < BUCKET_COUNT_COUNT - 1; u++)
+      if (auBucketCounts[u] >= 2 * oScheduler->uLength)
+         break;
+   oScheduler->uBucketCount = auBucketCounts[u];
+   oScheduler->ppsBuckets = (struct FileState**)calloc(
+      oScheduler->uBucketCount, sizeof(struct FileState*));
+   if (oScheduler->ppsBuckets == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE);}
+   Scheduler_clearFiles(oScheduler);
+
+   for (uNode = 0; uNode < oScheduler->uLength; uNode++)
+   {
+      psBuiltin = oScheduler->psNodes[uNode].psBuiltin;
+      if ((psBuiltin != NULL && ! psBuiltin->iUtility)
+          || oScheduler->psNodes[uNode].iExpands)
+      {
+         for (u = uSince; u < uNode; u++)
+            Scheduler_addEdge(oScheduler, u, uNode);
+         Scheduler_addEdge(oScheduler, uBarrier, uNode);
+
+         /* Every later line waits for the barrier, and so for every
+            line before it */
+         Scheduler_clearFiles(oScheduler);
+         uBarrier = uNode;
+         uSince = uNode + 1;
+         continue;
+      }
+      Scheduler_addEdge(oScheduler, uBarrier, uNode);
+
+      /* Reads first, so that a line that reads and writes one file
+         does not wait for itself */
+      oPipeline = oScheduler->psNodes[uNode].oPipeline;
+      uStages = Pipeline_getLength(oPipeline);
+      for (u = 0; u < uStages; u++)
+      {
+         oCommand = Pipeline_getCommand(oPipeline, u);
+         psRedirects = Command_getRedirects(oCommand);
+         uRedirects = Command_getRedirectCount(oCommand);
+         for (v = 0; v < uRedirects; v++)
+            if (psRedirects[v].eKind == REDIRECT_READ)
+               Scheduler_read(oScheduler, Scheduler_getFile(oScheduler,
+                  psRedirects[v].pcWord), uNode);
+         if (u == 0 && ! Scheduler_redirects(oCommand, STDIN_FILENO))
+            Scheduler_write(oScheduler, &oScheduler->sStdin, uNode);
+      }
+      for (u = 0; u < uStages; u++)
+      {
+         oCommand = Pipeline_getCommand(oPipeline, u);
+         psRedirects = Command_getRedirects(oCommand);
+         uRedirects = Command_getRedirectCount(oCommand);
+         for (v = 0; v < uRedirects; v++)
+            if (psRedirects[v].eKind == REDIRECT_WRITE
+                || psRedirects[v].eKind == REDIRECT_APPEND)
+               Scheduler_write(oScheduler, Scheduler_getFile(oScheduler,
+                  psRedirects[v].pcWord), uNode);
+         if (u == uStages - 1
+             && ! Scheduler_redirects(oCommand, STDOUT_FILENO))
+            Scheduler_write(oScheduler, &oScheduler->sStdout, uNode);
+      }
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Parse line psNode of oScheduler again, and return its new Pipeline,
+   to which the bodies of the here-documents of its old one, which
+   were read with the line, are bound.  If the line now contains an
+   error, write the message and return NULL. */
+
+static Pipeline_T Scheduler_reparse(Scheduler_T oScheduler,
+                                    struct Node *psNode)
+{
+   Pipeline_T oPipeline;
+   Command_T oCommand;
+   const struct Redirect *psRedirects;
+   const char **apcBodies;
+   size_t uRedirects;
+   size_t uBodies;
+   size_t uBody = 0;
+   size_t u;
+   size_t v;
+
+   oPipeline = synLine(psNode->pcLine, oScheduler->oArena);
+   if (oPipeline == NULL)
+      return NULL;
+   uBodies = Pipeline_getHereDocCount(psNode->oPipeline);
+   if (uBodies == 0)
+      return oPipeline;
+
+   /* A reference to a variable is a word, and a pattern stands for
+      arguments, so the line has the same here-documents as before */
+   assert(Pipeline_getHereDocCount(oPipeline) == uBodies);
+   apcBodies = (const char**)Arena_alloc(oScheduler->oArena,
+                                         uBodies * sizeof(const char*));
+   for (u = 0; u < Pipeline_getLength(psNode->oPipeline); u++)
+   {
+      oCommand = Pipeline_getCommand(psNode->oPipeline, u);
+      psRedirects = Command_getRedirects(oCommand);
+      uRedirects = Command_getRedirectCount(oCommand);
+      for (v = 0; v < uRedirects; v++)
+         if (psRedirects[v].eKind == REDIRECT_HEREDOC)
+            apcBodies[uBody++] = psRedirects[v].pcBody;
+   }
+   return Pipeline_bindHereDocs(oPipeline, apcBodies,
+                                oScheduler->oArena);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Start line uNode of oScheduler.  Run a builtin at once.  Start the
+   stages of any other pipeline as a job, and return its number if
+   it runs in the foreground, recording in the Node what is needed
+   to collect what its stages cost.  A pipeline that runs in the
+   background is written, as at the prompt, and left running.  Return
+   0 if there is nothing to wait for. */
+
+static int Scheduler_start(Scheduler_T oScheduler, size_t uNode)
+{
+   struct Node *psNode = &oScheduler->psNodes[uNode];
+   struct ShellState *psState = oScheduler->psState;
+   Pipeline_T oPipeline;
+   const char **apcFiles;
+   pid_t *aiPids;
+   size_t uLength;
+   size_t u;
+   int iBackground;
+   int iJob;
+   pid_t iPgid = 0;
+   pid_t iLastPid = -1;
+
+   if (fflush(NULL) == EOF) {perror(getPgmName()); exit(EXIT_FAILURE);}
+
+   /* Parse a line with a variable or a pattern again, now that every
+      line before it has finished */
+   if (psNode->iExpands)
+   {
+      oPipeline = Scheduler_reparse(oScheduler, psNode);
+      if (oPipeline == NULL)
+         return 0;
+      Scheduler_setPipeline(oScheduler, psNode, oPipeline);
+   }
+
+   if (psNode->psBuiltin != NULL)
+   {
+      (void)Builtin_run(psNode->psBuiltin,
+                        Pipeline_getCommand(psNode->oPipeline, 0),
+                        psState, psNode->iTimed);
+      return 0;
+   }
+
+   uLength = Pipeline_getLength(psNode->oPipeline);
+   apcFiles = (const char**)Arena_alloc(oScheduler->oArena,
+                                        uLength * sizeof(const char*));
+   aiPids = (pid_t*)Arena_alloc(oScheduler->oArena,
+                                uLength * sizeof(pid_t));
+   psNode->aiPids = aiPids;
+   psNode->asUsage = (struct Usage*)Arena_alloc(oScheduler->oArena,
+      uLength * sizeof(struct Usage));
+   for (u = 0; u < uLength; u++)
+   {
+      apcFiles[u] = PathCache_lookup(psState->oPaths,
+         Command_getName(Pipeline_getCommand(psNode->oPipeline, u)));
+      if (apcFiles[u] == NULL)
+         perror(getPgmName());
+   }
+
+   if (clock_gettime(CLOCK_MONOTONIC, &psNode->sStart) == -1)
+   {perror(getPgmName()); exit(EXIT_FAILURE);}
+   iBackground = Pipeline_isBackground(psNode->oPipeline);
+   if (spawnPipeline(psNode->oPipeline, apcFiles, psState->uPipeSize,
+                     iBackground ? 0 : -1, psState->eSpawn, aiPids)
+       == 0)
+      return 0;
+
+   if (iBackground)
+   {
+      for (u = 0; u < uLength; u++)
+      {
+         if (aiPids[u] == -1)
+            continue;
+         if (iPgid == 0)
+            iPgid = aiPids[u];
+         iLastPid = aiPids[u];
+      }
+   }
+   iJob = JobTable_add(psState->oJobs, psNode->pcLine, aiPids, uLength,
+                       iPgid);
+   if (iBackground)
+   {
+      printf("[%d] %ld\n", iJob, (long)iLastPid);
+      return 0;
+   }
+   return iJob;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Record that line uNode of oScheduler has finished, appending each
+   line that waited only for it to auReady[*puReadyEnd...]. */
+
+static void Scheduler_finish(Scheduler_T oScheduler, size_t uNode,
+                             size_t auReady[], size_t *puReadyEnd)
+{
+   struct Edge *psEdge;
+   struct Node *psSuccessor;
+
+   for (psEdge = oScheduler->psNodes[uNode].psSuccessors;
+        psEdge != NULL; psEdge = psEdge->psNext)
+   {
+      psSuccessor = &oScheduler->psNodes[psEdge->uNode];
+      assert(psSuccessor->uBlockers > 0);
+      if (--psSuccessor->uBlockers == 0)
+         auReady[(*puReadyEnd)++] = psEdge->uNode;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Run every line added to oScheduler, and wait for all of them but
+   those that run in the background. */
+
+void Scheduler_run(Scheduler_T oScheduler)
+{
+   /* The lines that can start, in the order they became ready; each
+      line is added once */
+   size_t *auReady;
+   size_t uReadyStart = 0;
+   size_t uReadyEnd = 0;
+
+   /* The jobs that are running, and their lines */
+   int *aiJobs;
+   size_t *auRunning;
+   size_t uRunning = 0;
+
+   struct Node *psNode;
+   size_t uNode;
+   int iJob;
+   int iIndex;
+
+   assert(oScheduler != NULL);
+
+   if (oScheduler->uLength == 0)
+      return;
+   Scheduler_buildGraph(oScheduler);
+
+   auReady = (size_t*)malloc(oScheduler->uLength * sizeof(size_t));
+   aiJobs = (int*)malloc(oScheduler->uMaxJobs * sizeof(int));
+   auRunning = (size_t*)malloc(oScheduler->uMaxJobs * sizeof(size_t));
+   if (auReady == NULL || aiJobs == NULL || auRunning == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE);}
+
+   for (uNode = 0; uNode < oScheduler->uLength; uNode++)
+      if (oScheduler->psNodes[uNode].uBlockers == 0)
+         auReady[uReadyEnd++] = uNode;
+
+   while (uReadyStart < uReadyEnd || uRunning > 0)
+   {
+      /* Start ready lines while there is room */
+      while (uReadyStart < uReadyEnd && uRunning < oScheduler->uMaxJobs)
+      {
+         uNode = auReady[uReadyStart++];
+         iJob = Scheduler_start(oScheduler, uNode);
+         if (iJob == 0)
+            Scheduler_finish(oScheduler, uNode, auReady, &uReadyEnd);
+         else
+         {
+            aiJobs[uRunning] = iJob;
+            auRunning[uRunning++] = uNode;
+         }
+      }
+      if (uRunning == 0)
+         continue;
+
+      /* Wait for whichever job finishes first, and collect what it
+         cost */
+      iIndex = JobTable_waitAny(oScheduler->psState->oJobs, aiJobs,
+                                uRunning);
+      if (iIndex == -1) {perror(getPgmName()); exit(EXIT_FAILURE);}
+      uNode = auRunning[iIndex];
+      psNode = &oScheduler->psNodes[uNode];
+      if (JobTable_wait(oScheduler->psState->oJobs, aiJobs[iIndex],
+                        &psNode->sStart, psNode->asUsage, 0) == -1)
+      {perror(getPgmName()); exit(EXIT_FAILURE);}
+      UsageStats_addPipeline(oScheduler->psState->oUsage,
+                             psNode->oPipeline, psNode->aiPids,
+                             psNode->asUsage, psNode->iTimed);
+      uRunning--;
+      aiJobs[iIndex] = aiJobs[uRunning];
+      auRunning[iIndex] = auRunning[uRunning];
+      Scheduler_finish(oScheduler, uNode, auReady, &uReadyEnd);
+   }
+
+   free(auRunning);
+   free(aiJobs);
+   free(auReady);
+}
@@ -0,0 +1,76 @@
+/*--------------------------------------------------------------------*/
+/* scheduler.h                                                        */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef SCHEDULER_INCLUDED
+#define SCHEDULER_INCLUDED
+
+#include <stddef.h>
+#include "pipeline.h"
+#include "builtin.h"
+
+/*--------------------------------------------------------------------*/
+
+/* A Scheduler_T object runs the lines of a whole script, several at
+   once, in an order that gives the same results as running them one
+   after another.  Two lines conflict if one reads a file, with "<",
+   that the other writes, with ">" or ">>", or if both write it; a
+   line that conflicts with an earlier one starts only after that
+   line has finished.  The shell's stdin and stdout count as files
+   that every line reading or writing them writes, so such lines
+   keep their order; a line that redirects descriptor 0 of its first
+   stage, or 1 of its last, to a file does not use that one, though a
+   copy of another descriptor, as "1>&2" makes, does.  A builtin
+   command that may change the state of the shell is a barrier: it
+   runs after every earlier line has finished, and before any later
+   line starts.  So is a line that refers to a variable or has an
+   argument with an unquoted "*", "?" or "[", other than a lone "[",
+   which is parsed again when it starts, so that it sees the
+   variables, and its patterns match the files, as they are then.  A
+   builtin that is also a standard utility, such as echo, is ordered
+   by its redirects like an external command, though the shell runs
+   it to the end before it starts another line.  A line that runs in
+   the background is finished as soon as it has started.
+
+   Only redirects are considered, so a script whose commands use
+   files named by their arguments in other ways must not be run by a
+   Scheduler. */
+
+typedef struct Scheduler *Scheduler_T;
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty Scheduler that runs at most uMaxJobs
+   lines at once, with the shell whose state is psState.  The caller
+   owns the Scheduler. */
+
+Scheduler_T Scheduler_new(size_t uMaxJobs, struct ShellState *psState);
+
+/*--------------------------------------------------------------------*/
+
+/* Free oScheduler and the lines that it holds. */
+
+void Scheduler_free(Scheduler_T oScheduler);
+
+/*--------------------------------------------------------------------*/
+
+/* Add the line pcLine, whose Pipeline is oPipeline, to the end of the
+   script of oScheduler.  If oPipeline is NULL, parse pcLine with
+   synLine() instead, and if it contains an error, write the message
+   and add nothing.  oScheduler keeps a copy of pcLine, but oPipeline
+   must stay valid, unchanged, until oScheduler is freed. */
+
+void Scheduler_add(Scheduler_T oScheduler, const char *pcLine,
+                   Pipeline_T oPipeline);
+
+/*--------------------------------------------------------------------*/
+
+/* Run every line added to oScheduler, and wait for all of them but
+   those that run in the background. */
+
+void Scheduler_run(Scheduler_T oScheduler);
+
+/*--------------------------------------------------------------------*/
+
+#endif
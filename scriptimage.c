@@ -0,0 +1,960 @@
+/*--------------------------------------------------------------------*/
+/* scriptimage.c                                                      */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#include "scriptimage.h"
+#include "pipeline.h"
+#include "command.h"
+#include "lexer.h"
+#include "syner.h"
+#include "linereader.h"
+#include "dynarray.h"
+#include "arena.h"
+#include "ish.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The first bytes of every image, and the version of its format,
+   which must change whenever the format does. */
+static const char acImageMagic[4] = {'I', 'S', 'H', 'C'};
+enum {IMAGE_VERSION = 5};
+
+/* The alignment of each record of an image. */
+enum {IMAGE_ALIGNMENT = 8};
+
+/* The number of bytes that the buffer of a new image, and the line
+   table, start with room for, and the factor by which they grow. */
+enum {INITIAL_PHYS_IMAGE = 4096};
+enum {INITIAL_PHYS_LINES = 64};
+enum {GROWTH_FACTOR = 2};
+
+/*--------------------------------------------------------------------*/
+
+/* An image begins with an ImageHeader.  Every other record is found
+   by its offset from the start of the image, and an offset of 0
+   means that there is no such record.  The image ends with at least
+   one null character, so that every string in it is terminated. */
+
+struct ImageHeader
+{
+   /* acImageMagic, IMAGE_VERSION, and the size of a pointer of the
+      program that wrote the image. */
+   char acMagic[4];
+   uint32_t uiVersion;
+   uint32_t uiPointerSize;
+   uint32_t uiUnused;
+
+   /* The size of the image in bytes. */
+   uint64_t ulImageSize;
+
+   /* The offset of the absolute name of the script, and the size,
+      modification time and hash code of the script when it was
+      compiled. */
+   uint64_t ulSource;
+   uint64_t ulSourceSize;
+   int64_t lSourceSec;
+   int64_t lSourceNsec;
+   uint64_t ulSourceHash;
+
+   /* The offset of the line table, an array of ImageLines, and its
+      number of elements. */
+   uint64_t ulLines;
+   uint64_t ulLineCount;
+};
+
+/* An element of the line table: the offsets of the text of a line
+   and of its ImagePipeline, or 0 if the line contains an error. */
+
+struct ImageLine
+{
+   uint64_t ulText;
+   uint64_t ulPipeline;
+};
+
+/* An ImagePipeline is followed by the offsets, each a uint64_t, of
+   the ImageCommands of its ulLength stages. */
+
+struct ImagePipeline
+{
+   uint64_t ulLength;
+   uint64_t ulBackground;
+};
+
+/* An ImageCommand is followed by its argv: ulArgc + 1 slots the size
+   of a pointer, holding the offsets of the arguments and then 0.  A
+   loaded image replaces each offset with the address of its
+   string, so that the slots are an argv that exec functions accept
+   as is.  Its redirects are an array of ulRedirects ImageRedirects
+   at offset ulRedirectTable. */
+
+struct ImageCommand
+{
+   uint64_t ulArgc;
+   uint64_t ulRedirects;
+   uint64_t ulRedirectTable;
+};
+
+/* An ImageRedirect is a struct Redirect, with the offset of its word
+   in place of the word.  Here-documents have no body in an image;
+   the lines of each body follow the line of its command as lines
+   without Pipelines. */
+
+struct ImageRedirect
+{
+   int64_t lFd;
+   uint64_t ulKind;
+   uint64_t ulWord;
+   int64_t lSourceFd;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* An ImageBuffer holds an image while it is written. */
+
+struct ImageBuffer
+{
+   /* The bytes, the number of them, and the number the buffer has
+      room for. */
+   char *pcData;
+   size_t uLength;
+   size_t uPhysLength;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A LineTable holds the line table of an image while it is
+   written. */
+
+struct LineTable
+{
+   /* The lines, the number of them, and the number the table has
+      room for. */
+   struct ImageLine *psLines;
+   size_t uLength;
+   size_t uPhysLength;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A ScriptLine is a line of a loaded image. */
+
+struct ScriptLine
+{
+   /* The text of the line, in the mapping. */
+   const char *pcText;
+
+   /* The Pipeline of the line, or NULL if it contains an error. */
+   Pipeline_T oPipeline;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A ScriptImage is the mapping of an image, and Pipelines whose
+   Commands refer to the strings in it. */
+
+struct ScriptImage
+{
+   /* The mapping, and its size in bytes. */
+   char *pcMap;
+   size_t uMapLength;
+
+   /* The lines, their number, and the index of the next to hand
+      out. */
+   struct ScriptLine *psLines;
+   size_t uLineCount;
+   size_t uNext;
+
+   /* The arena that holds the lines, Pipelines and Commands. */
+   Arena_T oArena;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Read the file named pcFile, storing its status in *psStat and the
+   hash code of its contents in *pulHash.  Return 0, or -1 with errno
+   set if the file cannot be read. */
+
+static int ScriptImage_hashFile(const char *pcFile, struct stat *psStat,
+                                uint64_t *pulHash)
+{
+   const uint64_t HASH_MULTIPLIER = 65599;
+   const unsigned char *pucMap;
+   uint64_t ulHash = 0;
+   size_t u;
+   int iFd;
+   int iErrno;
+
+   assert(pcFile != NULL);
+   assert(psStat != NULL);
+   assert(pulHash != NULL);
+
+   iFd = open(pcFile, O_RDONLY | O_CLOEXEC);
+   if (iFd == -1)
+      return -1;
+   if (fstat(iFd, psStat) == -1)
+   {iErrno = errno; close(iFd); errno = iErrno; return -1;}
+
+   /* An empty file cannot be mapped, and hashes to 0 */
+   if (psStat->st_size > 0)
+   {
+      pucMap = (const unsigned char*)mmap(NULL,
+                                          (size_t)psStat->st_size,
+                                          PROT_READ, MAP_PRIVATE, iFd, 0);
+      if (pucMap == MAP_FAILED)
+      {iErrno = errno; close(iFd); errno = iErrno; return -1;}
+      for (u = 0; u < (size_t)psStat->st_size; u++)
+         ulHash = ulHash * HASH_MULTIPLIER + pucMap[u];
+      munmap((void*)pucMap, (size_t)psStat->st_size);
+   }
+   close(iFd);
+
+   *pulHash = ulHash;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Append uSize zero bytes to the image in psBuffer, first padding it
+   to a multiple of uAlignment bytes, and return their offset. */
+
+static uint64_t ImageBuffer_reserve(struct ImageBuffer *psBuffer,
+                                    size_t uSize, size_t uAlignment)
+{
+   size_t uOffset;
+   size_t uPhysLength;
+   char *pcData;
+
+   assert(psBuffer != NULL);
+   assert(uAlignment > 0);
+
+   uOffset = (psBuffer->uLength + uAlignment - 1)
+             / uAlignment * uAlignment;
+
+   if (uOffset + uSize > psBuffer->uPhysLength)
+   {
+      uPhysLength = psBuffer->uPhysLength;
+      while (uOffset + uSize > uPhysLength)
+         uPhysLength *= GROWTH_FACTOR;
+      pcData = (char*)realloc(psBuffer->pcData, uPhysLength);
+      if (pcData == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+      psBuffer->pcData = pcData;
+      psBuffer->uPhysLength = uPhysLength;
+   }
+
+   memset(psBuffer->pcData + psBuffer->uLength, 0,
+          uOffset + uSize - psBuffer->uLength);
+   psBuffer->uLength = uOffset + uSize;
+   return (uint64_t)uOffset;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Append the string pcString, with its null character, to the image
+   in psBuffer, and return its offset. */
+
+static uint64_t ImageBuffer_addString(struct ImageBuffer *psBuffer,
+                                      const char *pcString)
+{
+   size_t uSize;
+   uint64_t ulOffset;
+
+   assert(psBuffer != NULL);
+   assert(pcString != NULL);
+
+   uSize = strlen(pcString) + 1;
+   ulOffset = ImageBuffer_reserve(psBuffer, uSize, 1);
+   memcpy(psBuffer->pcData + ulOffset, pcString, uSize);
+   return ulOffset;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Append an ImageCommand for oCommand, and its strings, to the image
+   in psBuffer, and return its offset. */
+
+static uint64_t ImageBuffer_addCommand(struct ImageBuffer *psBuffer,
+                                       Command_T oCommand)
+{
+   struct ImageCommand *psRecord;
+   struct ImageRedirect *psRedirect;
+   const struct Redirect *psRedirects;
+   char **ppcArgv;
+   uintptr_t uArgOffset;
+   uint64_t ulCommand;
+   uint64_t ulRedirectTable = 0;
+   uint64_t ulWord;
+   size_t uArgc;
+   size_t uRedirects;
+   size_t u;
+
+   assert(psBuffer != NULL);
+   assert(oCommand != NULL);
+
+   ppcArgv = Command_getArgv(oCommand);
+   uArgc = Command_getArgCount(oCommand) + 1;
+   ulCommand = ImageBuffer_reserve(psBuffer,
+                                   sizeof(struct ImageCommand)
+                                   + (uArgc + 1) * sizeof(char*),
+                                   IMAGE_ALIGNMENT);
+
+   /* Each string can move the buffer, so the record is found again
+      from its offset.  The final slot stays 0. */
+   for (u = 0; u < uArgc; u++)
+   {
+      uArgOffset = (uintptr_t)ImageBuffer_addString(psBuffer,
+                                                    ppcArgv[u]);
+      memcpy(psBuffer->pcData + ulCommand + sizeof(struct ImageCommand)
+             + u * sizeof(char*), &uArgOffset, sizeof(uArgOffset));
+   }
+
+   psRedirects = Command_getRedirects(oCommand);
+   uRedirects = Command_getRedirectCount(oCommand);
+   if (uRedirects > 0)
+      ulRedirectTable = ImageBuffer_reserve(psBuffer,
+         uRedirects * sizeof(struct ImageRedirect), IMAGE_ALIGNMENT);
+   for (u = 0; u < uRedirects; u++)
+   {
+      ulWord = ImageBuffer_addString(psBuffer, psRedirects[u].pcWord);
+      psRedirect = (struct ImageRedirect*)(psBuffer->pcData
+         + ulRedirectTable) + u;
+      psRedirect->lFd = (int64_t)psRedirects[u].iFd;
+      psRedirect->ulKind = (uint64_t)psRedirects[u].eKind;
+      psRedirect->ulWord = ulWord;
+      psRedirect->lSourceFd = (int64_t)psRedirects[u].iSourceFd;
+   }
+
+   psRecord = (struct ImageCommand*)(psBuffer->pcData + ulCommand);
+   psRecord->ulArgc = (uint64_t)uArgc;
+   psRecord->ulRedirects = (uint64_t)uRedirects;
+   psRecord->ulRedirectTable = ulRedirectTable;
+   return ulCommand;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Append an ImagePipeline for oPipeline, and its ImageCommands, to
+   the image in psBuffer, and return its offset. */
+
+static uint64_t ImageBuffer_addPipeline(struct ImageBuffer *psBuffer,
+                                        Pipeline_T oPipeline)
+{
+   struct ImagePipeline *psRecord;
+   uint64_t ulPipeline;
+   uint64_t ulCommand;
+   size_t uLength;
+   size_t u;
+
+   assert(psBuffer != NULL);
+   assert(oPipeline != NULL);
+
+   uLength = Pipeline_getLength(oPipeline);
+   ulPipeline = ImageBuffer_reserve(psBuffer,
+                                    sizeof(struct ImagePipeline)
+                                    + uLength * sizeof(uint64_t),
+                                    IMAGE_ALIGNMENT);
+
+   for (u = 0; u < uLength; u++)
+   {
+      ulCommand = ImageBuffer_addCommand(psBuffer,
+         Pipeline_getCommand(oPipeline, u));
+      memcpy(psBuffer->pcData + ulPipeline
+             + sizeof(struct ImagePipeline) + u * sizeof(uint64_t),
+             &ulCommand, sizeof(ulCommand));
+   }
+
+   psRecord = (struct ImagePipeline*)(psBuffer->pcData + ulPipeline);
+   psRecord->ulLength = (uint64_t)uLength;
+   psRecord->ulBackground = (uint64_t)Pipeline_isBackground(oPipeline);
+   return ulPipeline;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write the uLength bytes at pcData to file descriptor iFd.  Return
+   0, or -1 with errno set. */
+
+static int ScriptImage_writeAll(int iFd, const char *pcData,
+                                size_t uLength)
+{
+   ssize_t iWritten;
+   size_t uDone = 0;
+
+   while (uDone < uLength)
+   {
+      iWritten = write(iFd, pcData + uDone, uLength - uDone);
+      if (iWritten == -1)
+      {
+         if (errno == EINTR)
+            continue;
+         return -1;
+      }
+      uDone += (size_t)iWritten;
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write the uLength bytes at pcData to a new file that then replaces
+   the file named pcImage, so that a shell loading the image never
+   sees it half written.  Return 0, or -1 with errno set. */
+
+static int ScriptImage_writeFile(const char *pcImage, const char *pcData,
+                                 size_t uLength)
+{
+   char *pcTemp;
+   mode_t uMask;
+   int iFd;
+   int iErrno;
+
+   pcTemp = (char*)malloc(strlen(pcImage) + sizeof(".XXXXXX"));
+   if (pcTemp == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+   strcpy(pcTemp, pcImage);
+   strcat(pcTemp, ".XXXXXX");
+
+   iFd = mkstemp(pcTemp);
+   if (iFd == -1)
+   {iErrno = errno; free(pcTemp); errno = iErrno; return -1;}
+
+   /* mkstemp() makes the file private; give it the usual mode */
+   uMask = umask(0);
+   umask(uMask);
+   if (fchmod(iFd, 0666 & ~uMask) == -1
+       || ScriptImage_writeAll(iFd, pcData, uLength) == -1)
+   {
+      iErrno = errno;
+      close(iFd);
+      unlink(pcTemp);
+      free(pcTemp);
+      errno = iErrno;
+      return -1;
+   }
+   if (close(iFd) == -1 || rename(pcTemp, pcImage) == -1)
+   {
+      iErrno = errno;
+      unlink(pcTemp);
+      free(pcTemp);
+      errno = iErrno;
+      return -1;
+   }
+
+   free(pcTemp);
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Append to psTable a line whose text and ImagePipeline are at
+   offsets ulText and ulPipeline. */
+
+static void LineTable_add(struct LineTable *psTable, uint64_t ulText,
+                          uint64_t ulPipeline)
+{
+   struct ImageLine *psLines;
+
+   if (psTable->uLength == psTable->uPhysLength)
+   {
+      psTable->uPhysLength *= GROWTH_FACTOR;
+      psLines = (struct ImageLine*)realloc(psTable->psLines,
+         psTable->uPhysLength * sizeof(struct ImageLine));
+      if (psLines == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+      psTable->psLines = psLines;
+   }
+
+   psTable->psLines[psTable->uLength].ulText = ulText;
+   psTable->psLines[psTable->uLength].ulPipeline = ulPipeline;
+   psTable->uLength++;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Lex and parse each line of the script named pcScript, writing the
+   error message of each line that contains an error, and write an
+   image of the script to the file named pcImage, replacing it at
+   once.  Lines with errors, and lines with a '$', "*", "?" or "[",
+   are kept in the image without Pipelines, and parsed again when it
+   runs.  The lines of the bodies of here-documents are kept without
+   Pipelines too, after the line of their command.  Return 0, or
+   write an error message and return -1 if the script cannot be read
+   or the image cannot be written. */
+
+int ScriptImage_compile(const char *pcScript, const char *pcImage)
+{
+   struct ImageBuffer sBuffer;
+   struct ImageHeader *psHeader;
+   struct LineTable sTable;
+   struct stat sStat;
+   uint64_t ulHash;
+   uint64_t ulSource;
+   uint64_t ulText;
+   uint64_t ulLines;
+   uint64_t ulPipeline;
+   char *pcSource;
+   char *pcLine;
+   const char *pcDelimiter;
+   size_t uHereDocs;
+   size_t u;
+   LineReader_T oReader;
+   DynArray_T oTokens;
+   Pipeline_T oPipeline;
+   Arena_T oArena;
+   int iRet;
+
+   assert(pcScript != NULL);
+   assert(pcImage != NULL);
+
+   /* The image names its script wherever the shell runs from */
+   pcSource = realpath(pcScript, NULL);
+   if (pcSource == NULL) {perror(pcScript); return -1;}
+   if (ScriptImage_hashFile(pcSource, &sStat, &ulHash) == -1)
+   {perror(pcScript); free(pcSource); return -1;}
+   oReader = LineReader_newFile(pcSource);
+   if (oReader == NULL) {perror(pcScript); free(pcSource); return -1;}
+
+   sBuffer.pcData = (char*)malloc(INITIAL_PHYS_IMAGE);
+   if (sBuffer.pcData == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+   sBuffer.uLength = 0;
+   sBuffer.uPhysLength = INITIAL_PHYS_IMAGE;
+   sTable.uLength = 0;
+   sTable.uPhysLength = INITIAL_PHYS_LINES;
+   sTable.psLines = (struct ImageLine*)malloc(sTable.uPhysLength
+                                              * sizeof(struct ImageLine));
+   if (sTable.psLines == NULL)
+   {perror(getPgmName()); exit(EXIT_FAILURE);}
+
+   (void)ImageBuffer_reserve(&sBuffer, sizeof(struct ImageHeader),
+                             IMAGE_ALIGNMENT);
+   ulSource = ImageBuffer_addString(&sBuffer, pcSource);
+
+   /* Parse each line as the shell would, keeping the lines with
+      errors so that they are reported again when the image runs,
+      and the lines with a '$', "*", "?" or "[", whose words depend
+      on the variables and files when the image runs, so that they
+      are parsed then */
+   oArena = Arena_new();
+   while ((pcLine = LineReader_readLine(oReader, NULL)) != NULL)
+   {
+      ulText = ImageBuffer_addString(&sBuffer, pcLine);
+      ulPipeline = 0;
+      oPipeline = NULL;
+      oTokens = lexLine(pcLine, oArena);
+      if (oTokens != NULL)
+      {
+         oPipeline = synArr(oTokens, oArena);
+         if (oPipeline != NULL && strpbrk(pcLine, "$*?[") == NULL)
+            ulPipeline = ImageBuffer_addPipeline(&sBuffer, oPipeline);
+         DynArray_free(oTokens);
+      }
+      LineTable_add(&sTable, ulText, ulPipeline);
+
+      /* The lines of the bodies of its here-documents, up to and
+         including their delimiters, are not parsed */
+      uHereDocs = (oPipeline != NULL)
+         ? Pipeline_getHereDocCount(oPipeline) : 0;
+      for (u = 0; u < uHereDocs; u++)
+      {
+         pcDelimiter = Pipeline_getHereDocDelimiter(oPipeline, u);
+         while ((pcLine = LineReader_readLine(oReader, NULL)) != NULL)
+         {
+            LineTable_add(&sTable,
+                          ImageBuffer_addString(&sBuffer, pcLine), 0);
+            if (strcmp(pcLine, pcDelimiter) == 0)
+               break;
+         }
+      }
+      Arena_reset(oArena);
+   }
+   Arena_free(oArena);
+   LineReader_free(oReader);
+
+   ulLines = ImageBuffer_reserve(&sBuffer,
+      sTable.uLength * sizeof(struct ImageLine), IMAGE_ALIGNMENT);
+   memcpy(sBuffer.pcData + ulLines, sTable.psLines,
+          sTable.uLength * sizeof(struct ImageLine));
+   (void)ImageBuffer_reserve(&sBuffer, IMAGE_ALIGNMENT, IMAGE_ALIGNMENT);
+
+   psHeader = (struct ImageHeader*)sBuffer.pcData;
+   memcpy(psHeader->acMagic, acImageMagic, sizeof(acImageMagic));
+   psHeader->uiVersion = IMAGE_VERSION;
+   psHeader->uiPointerSize = (uint32_t)sizeof(char*);
+   psHeader->ulImageSize = (uint64_t)sBuffer.uLength;
+   psHeader->ulSource = ulSource;
+   psHeader->ulSourceSize = (uint64_t)sStat.st_size;
+   psHeader->lSourceSec = (int64_t)sStat.st_mtim.tv_sec;
+   psHeader->lSourceNsec = (int64_t)sStat.st_mtim.tv_nsec;
+   psHeader->ulSourceHash = ulHash;
+   psHeader->ulLines = ulLines;
+   psHeader->ulLineCount = (uint64_t)sTable.uLength;
+
+   iRet = ScriptImage_writeFile(pcImage, sBuffer.pcData,
+                                sBuffer.uLength);
+   if (iRet == -1)
+      perror(pcImage);
+
+   free(sTable.psLines);
+   free(sBuffer.pcData);
+   free(pcSource);
+   return iRet;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the string at offset ulOffset of the mapping of psImage,
+   or NULL if ulOffset is 0 or past the end of the mapping. */
+
+static char *ScriptImage_getString(struct ScriptImage *psImage,
+                                   uint64_t ulOffset)
+{
+   if (ulOffset == 0 || ulOffset >= psImage->uMapLength)
+      return NULL;
+   return psImage->pcMap + ulOffset;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the record of ulSize bytes at offset ulOffset of the
+   mapping of psImage, or NULL if it is not aligned or does not fit
+   in the mapping. */
+
+static void *ScriptImage_getRecord(struct ScriptImage *psImage,
+                                   uint64_t ulOffset, uint64_t ulSize)
+{
+   if (ulOffset == 0 || ulOffset % IMAGE_ALIGNMENT != 0
+       || ulOffset > psImage->uMapLength
+       || ulSize > psImage->uMapLength - ulOffset)
+      return NULL;
+   return psImage->pcMap + ulOffset;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return a Command whose strings are those of the ImageCommand at
+   offset ulCommand of psImage, replacing the offsets of its argv
+   with the addresses of its strings, or NULL if the record is
+   corrupt. */
+
+static Command_T ScriptImage_loadCommand(struct ScriptImage *psImage,
+                                         uint64_t ulCommand)
+{
+   struct ImageCommand *psRecord;
+   const struct ImageRedirect *psImageRedirects = NULL;
+   const struct ImageRedirect *psImageRedirect;
+   struct Redirect *psRedirects = NULL;
+   char **ppcArgv;
+   uintptr_t uArgOffset;
+   size_t u;
+
+   psRecord = (struct ImageCommand*)ScriptImage_getRecord(psImage,
+      ulCommand, sizeof(struct ImageCommand));
+   if (psRecord == NULL || psRecord->ulArgc == 0
+       || psRecord->ulArgc >= psImage->uMapLength / sizeof(char*))
+      return NULL;
+   ppcArgv = (char**)ScriptImage_getRecord(psImage,
+      ulCommand + sizeof(struct ImageCommand),
+      (psRecord->ulArgc + 1) * sizeof(char*));
+   if (ppcArgv == NULL)
+      return NULL;
+
+   for (u = 0; u <= psRecord->ulArgc; u++)
+   {
+      memcpy(&uArgOffset, &ppcArgv[u], sizeof(uArgOffset));
+      ppcArgv[u] = ScriptImage_getString(psImage, uArgOffset);
+      if ((ppcArgv[u] == NULL) != (u == psRecord->ulArgc))
+         return NULL;
+   }
+
+   if (psRecord->ulRedirects > 0)
+   {
+      if (psRecord->ulRedirects >= psImage->uMapLength
+                                   / sizeof(struct ImageRedirect))
+         return NULL;
+      psImageRedirects = (const struct ImageRedirect*)
+         ScriptImage_getRecord(psImage, psRecord->ulRedirectTable,
+            psRecord->ulRedirects * sizeof(struct ImageRedirect));
+      if (psImageRedirects == NULL)
+         return NULL;
+      psRedirects = (struct Redirect*)Arena_alloc(psImage->oArena,
+         (size_t)psRecord->ulRedirects * sizeof(struct Redirect));
+   }
+
+   for (u = 0; u < psRecord->ulRedirects; u++)
+   {
+      psImageRedirect = &psImageRedirects[u];
+      if (psImageRedirect->lFd < 0 || psImageRedirect->lFd > INT_MAX
+          || psImageRedirect->ulKind > REDIRECT_HERESTRING
+          || psImageRedirect->lSourceFd < -1
+          || psImageRedirect->lSourceFd > INT_MAX)
+         return NULL;
+      psRedirects[u].iFd = (int)psImageRedirect->lFd;
+      psRedirects[u].eKind = (enum RedirectKind)psImageRedirect->ulKind;
+      psRedirects[u].pcWord = ScriptImage_getString(psImage,
+         psImageRedirect->ulWord);
+      psRedirects[u].iSourceFd = (int)psImageRedirect->lSourceFd;
+      psRedirects[u].pcBody = NULL;
+      if (psRedirects[u].pcWord == NULL)
+         return NULL;
+   }
+
+   return Command_newView(ppcArgv, (size_t)psRecord->ulArgc,
+                          psRedirects, (size_t)psRecord->ulRedirects,
+                          psImage->oArena);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return a Pipeline of the ImagePipeline at offset ulPipeline of
+   psImage, or NULL if the record is corrupt. */
+
+static Pipeline_T ScriptImage_loadPipeline(struct ScriptImage *psImage,
+                                           uint64_t ulPipeline)
+{
+   struct ImagePipeline *psRecord;
+   const char *pcCommands;
+   Pipeline_T oPipeline;
+   Command_T oCommand;
+   uint64_t ulCommand;
+   size_t u;
+
+   psRecord = (struct ImagePipeline*)ScriptImage_getRecord(psImage,
+      ulPipeline, sizeof(struct ImagePipeline));
+   if (psRecord == NULL || psRecord->ulLength == 0
+       || psRecord->ulLength >= psImage->uMapLength / sizeof(uint64_t))
+      return NULL;
+   pcCommands = (const char*)ScriptImage_getRecord(psImage,
+      ulPipeline + sizeof(struct ImagePipeline),
+      psRecord->ulLength * sizeof(uint64_t));
+   if (pcCommands == NULL)
+      return NULL;
+
+   oPipeline = newPipeline(psImage->oArena);
+   for (u = 0; u < psRecord->ulLength; u++)
+   {
+      memcpy(&ulCommand, pcCommands + u * sizeof(uint64_t),
+             sizeof(ulCommand));
+      oCommand = ScriptImage_loadCommand(psImage, ulCommand);
+      if (oCommand == NULL)
+         return NULL;
+      Pipeline_addCommand(oPipeline, oCommand);
+   }
+   if (psRecord->ulBackground)
+      Pipeline_setBackground(oPipeline);
+   return oPipeline;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 if the script pcSource of the image whose header is
+   psHeader has not changed since the image was compiled, or 0
+   otherwise.  The script is hashed again only if its modification
+   time has changed, as copying or touching it does. */
+
+static int ScriptImage_isFresh(const struct ImageHeader *psHeader,
+                               const char *pcSource)
+{
+   struct stat sStat;
+   uint64_t ulHash;
+
+   if (stat(pcSource, &sStat) == -1
+       || (uint64_t)sStat.st_size != psHeader->ulSourceSize)
+      return 0;
+   if ((int64_t)sStat.st_mtim.tv_sec == psHeader->lSourceSec
+       && (int64_t)sStat.st_mtim.tv_nsec == psHeader->lSourceNsec)
+      return 1;
+   if (ScriptImage_hashFile(pcSource, &sStat, &ulHash) == -1)
+      return 0;
+   return (uint64_t)sStat.st_size == psHeader->ulSourceSize
+          && ulHash == psHeader->ulSourceHash;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the header of the image of psImage, or NULL if it is not
+   an image that this program wrote. */
+
+static const struct ImageHeader *ScriptImage_getHeader(
+   struct ScriptImage *psImage)
+{
+   const struct ImageHeader *psHeader;
+
+   if (psImage->uMapLength < sizeof(struct ImageHeader))
+      return NULL;
+
+   psHeader = (const struct ImageHeader*)psImage->pcMap;
+   if (memcmp(psHeader->acMagic, acImageMagic, sizeof(acImageMagic))
+          != 0
+       || psHeader->uiVersion != IMAGE_VERSION
+       || psHeader->uiPointerSize != sizeof(char*)
+       || psHeader->ulImageSize != psImage->uMapLength
+       || psImage->pcMap[psImage->uMapLength - 1] != '\0'
+       || psHeader->ulLineCount >= psImage->uMapLength
+       || ScriptImage_getString(psImage, psHeader->ulSource) == NULL)
+      return NULL;
+   return psHeader;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make the lines of psImage, whose header is psHeader, and all of
+   their Pipelines.  Return 0, or -1 if the image is corrupt. */
+
+static int ScriptImage_loadLines(struct ScriptImage *psImage,
+                                 const struct ImageHeader *psHeader)
+{
+   const struct ImageLine *psLine;
+   struct ScriptLine *psScriptLine;
+   size_t u;
+
+   psLine = (const struct ImageLine*)ScriptImage_getRecord(psImage,
+      psHeader->ulLines,
+      psHeader->ulLineCount * sizeof(struct ImageLine));
+   if (psLine == NULL)
+      return -1;
+
+   psImage->psLines = (struct ScriptLine*)Arena_alloc(psImage->oArena,
+      (size_t)psHeader->ulLineCount * sizeof(struct ScriptLine));
+   for (u = 0; u < (size_t)psHeader->ulLineCount; u++, psLine++)
+   {
+      psScriptLine = &psImage->psLines[u];
+      psScriptLine->pcText = ScriptImage_getString(psImage,
+                                                   psLine->ulText);
+      if (psScriptLine->pcText == NULL)
+         return -1;
+      psScriptLine->oPipeline = NULL;
+      if (psLine->ulPipeline != 0)
+      {
+         psScriptLine->oPipeline =
+            ScriptImage_loadPipeline(psImage, psLine->ulPipeline);
+         if (psScriptLine->oPipeline == NULL)
+            return -1;
+      }
+      psImage->uLineCount++;
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Map the image file named pcImage into memory, and create and return
+   a ScriptImage that hands out its lines.  If the image cannot be
+   read, is not an image that this program wrote, or is stale, then
+   write an error message and return NULL.  The caller owns the
+   ScriptImage. */
+
+ScriptImage_T ScriptImage_load(const char *pcImage)
+{
+   struct ScriptImage *psImage;
+   const struct ImageHeader *psHeader;
+   const char *pcSource;
+   struct stat sStat;
+   int iFd;
+
+   assert(pcImage != NULL);
+
+   iFd = open(pcImage, O_RDONLY | O_CLOEXEC);
+   if (iFd == -1) {perror(pcImage); return NULL;}
+   if (fstat(iFd, &sStat) == -1)
+   {perror(pcImage); close(iFd); return NULL;}
+   if (sStat.st_size == 0)
+   {
+      close(iFd);
+      fprintf(stderr, "%s: %s: not a compiled script\n",
+              getPgmName(), pcImage);
+      return NULL;
+   }
+
+   psImage = (struct ScriptImage*)malloc(sizeof(struct ScriptImage));
+   if (psImage == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+
+   /* The mapping is private and writable so that the argv of each
+      command can be made of addresses without touching the file */
+   psImage->uMapLength = (size_t)sStat.st_size;
+   psImage->pcMap = (char*)mmap(NULL, psImage->uMapLength,
+                                PROT_READ | PROT_WRITE, MAP_PRIVATE,
+                                iFd, 0);
+   close(iFd);
+   if (psImage->pcMap == MAP_FAILED)
+   {perror(pcImage); free(psImage); return NULL;}
+   psImage->oArena = Arena_new();
+   psImage->psLines = NULL;
+   psImage->uLineCount = 0;
+   psImage->uNext = 0;
+
+   psHeader = ScriptImage_getHeader(psImage);
+   if (psHeader == NULL)
+   {
+      fprintf(stderr, "%s: %s: not a compiled script\n",
+              getPgmName(), pcImage);
+      ScriptImage_free(psImage);
+      return NULL;
+   }
+
+   pcSource = ScriptImage_getString(psImage, psHeader->ulSource);
+   if (! ScriptImage_isFresh(psHeader, pcSource))
+   {
+      fprintf(stderr, "%s: %s: %s has changed since it was compiled\n",
+              getPgmName(), pcImage, pcSource);
+      ScriptImage_free(psImage);
+      return NULL;
+   }
+
+   /* Make every Pipeline now, so that running a line allocates
+      nothing */
+   if (ScriptImage_loadLines(psImage, psHeader) == -1)
+   {
+      fprintf(stderr, "%s: %s: not a compiled script\n",
+              getPgmName(), pcImage);
+      ScriptImage_free(psImage);
+      return NULL;
+   }
+   return psImage;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* If no lines remain in oImage, then return NULL.  Otherwise return
+   the text of the next line, and store its Pipeline in *poPipeline,
+   or NULL if the line must be parsed again: if it contains an error
+   or a '$', "*", "?" or "[", or belongs to the body of a
+   here-document.  oImage owns the string and the Pipeline, which
+   must not be changed, and which are valid until oImage is freed. */
+
+const char *ScriptImage_readLine(ScriptImage_T oImage,
+                                 Pipeline_T *poPipeline)
+{
+   struct ScriptLine *psLine;
+
+   assert(oImage != NULL);
+   assert(poPipeline != NULL);
+
+   if (oImage->uNext == oImage->uLineCount)
+      return NULL;
+
+   psLine = &oImage->psLines[oImage->uNext++];
+   *poPipeline = psLine->oPipeline;
+   return psLine->pcText;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Free oImage, its Pipelines, and its mapping. */
+
+void ScriptImage_free(ScriptImage_T oImage)
+{
+   assert(oImage != NULL);
+
+   Arena_free(oImage->oArena);
+   munmap(oImage->pcMap, oImage->uMapLength);
+   free(oImage);
+}
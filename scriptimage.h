@@ -0,0 +1,70 @@
+/*--------------------------------------------------------------------*/
+/* scriptimage.h                                                      */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef SCRIPTIMAGE_INCLUDED
+#define SCRIPTIMAGE_INCLUDED
+
+#include "pipeline.h"
+
+/*--------------------------------------------------------------------*/
+
+/* A ScriptImage_T object is a script that was parsed ahead of time
+   into a binary image file.  The image holds the text of each line
+   and, for each line that parses, its Pipeline flattened into
+   records whose strings are found by their offsets in the image.  A
+   ScriptImage maps the image into memory and runs its lines without
+   lexing or parsing them.
+
+   An image names the script it was compiled from and records the
+   size, modification time and hash code of its contents.  An image
+   whose script has changed since is stale, and is not loaded. */
+
+typedef struct ScriptImage *ScriptImage_T;
+
+/*--------------------------------------------------------------------*/
+
+/* Lex and parse each line of the script named pcScript, writing the
+   error message of each line that contains an error, and write an
+   image of the script to the file named pcImage, replacing it at
+   once.  Lines with errors, and lines with a '$', "*", "?" or "[",
+   are kept in the image without Pipelines, and parsed again when it
+   runs.  The lines of the bodies of here-documents are kept without
+   Pipelines too, after the line of their command.  Return 0, or
+   write an error message and return -1 if the script cannot be read
+   or the image cannot be written. */
+
+int ScriptImage_compile(const char *pcScript, const char *pcImage);
+
+/*--------------------------------------------------------------------*/
+
+/* Map the image file named pcImage into memory, and create and return
+   a ScriptImage that hands out its lines.  If the image cannot be
+   read, is not an image that this program wrote, or is stale, then
+   write an error message and return NULL.  The caller owns the
+   ScriptImage. */
+
+ScriptImage_T ScriptImage_load(const char *pcImage);
+
+/*--------------------------------------------------------------------*/
+
+/* If no lines remain in oImage, then return NULL.  Otherwise return
+   the text of the next line, and store its Pipeline in *poPipeline,
+   or NULL if the line must be parsed again: if it contains an error
+   or a '$', "*", "?" or "[", or belongs to the body of a
+   here-document.  oImage owns the string and the Pipeline, which
+   must not be changed, and which are valid until oImage is freed. */
+
+const char *ScriptImage_readLine(ScriptImage_T oImage,
+                                 Pipeline_T *poPipeline);
+
+/*--------------------------------------------------------------------*/
+
+/* Free oImage, its Pipelines, and its mapping. */
+
+void ScriptImage_free(ScriptImage_T oImage);
+
+/*--------------------------------------------------------------------*/
+
+#endif
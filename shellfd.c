@@ -0,0 +1,31 @@
+/*--------------------------------------------------------------------*/
+/* shellfd.c                                                          */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#include "shellfd.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+/*--------------------------------------------------------------------*/
+
+/* Return close-on-exec descriptor iFd, or, if it is below
+   MIN_SHELL_FD, a close-on-exec copy of it numbered MIN_SHELL_FD or
+   above, closing iFd.  If iFd is -1, as it is when the call that
+   should have opened it failed, or it cannot be copied, return -1
+   with errno set. */
+
+int ShellFd_move(int iFd)
+{
+   int iMoved;
+   int iErrno;
+
+   if (iFd == -1 || iFd >= MIN_SHELL_FD)
+      return iFd;
+   iMoved = fcntl(iFd, F_DUPFD_CLOEXEC, MIN_SHELL_FD);
+   iErrno = errno;
+   (void)close(iFd);
+   errno = iErrno;
+   return iMoved;
+}
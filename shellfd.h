@@ -0,0 +1,32 @@
+/*--------------------------------------------------------------------*/
+/* shellfd.h                                                          */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef SHELLFD_INCLUDED
+#define SHELLFD_INCLUDED
+
+/*--------------------------------------------------------------------*/
+
+/* The descriptors that the shell keeps open for itself, such as
+   those of its EventLoop, of its jobs, of its history and of its fork
+   server, are numbered MIN_SHELL_FD or above and are close-on-exec,
+   out of the way of the descriptors 0 to 9 that redirects name.  A
+   redirect may not name a descriptor of MIN_SHELL_FD or above, so
+   neither a builtin nor a command can replace or inherit one. */
+
+enum {MIN_SHELL_FD = 10};
+
+/*--------------------------------------------------------------------*/
+
+/* Return close-on-exec descriptor iFd, or, if it is below
+   MIN_SHELL_FD, a close-on-exec copy of it numbered MIN_SHELL_FD or
+   above, closing iFd.  If iFd is -1, as it is when the call that
+   should have opened it failed, or it cannot be copied, return -1
+   with errno set. */
+
+int ShellFd_move(int iFd);
+
+/*--------------------------------------------------------------------*/
+
+#endif
@@ -0,0 +1,186 @@
+/*--------------------------------------------------------------------*/
+/* spawnbench.c                                                       */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#include "ish.h"
+#include "command.h"
+#include "arena.h"
+#include "spawner.h"
+#include "forkserver.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The name of the executable binary file. */
+static const char *pcPgmName;
+
+/* The number of bytes in a mebibyte. */
+enum {MEBIBYTE = 1024 * 1024};
+
+/* The default number of spawns timed for each heap size and method,
+   and the default largest heap size in mebibytes. */
+enum {DEFAULT_COUNT = 2000};
+enum {DEFAULT_MAX_HEAP = 256};
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the name of the executable binary file. */
+
+const char *getPgmName()
+{
+   return pcPgmName;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the current time of the monotonic clock in nanoseconds. */
+
+static double now(void)
+{
+   struct timespec sTime;
+
+   if (clock_gettime(CLOCK_MONOTONIC, &sTime) == -1)
+   {perror(pcPgmName); exit(EXIT_FAILURE); }
+   return (double)sTime.tv_sec * 1e9 + (double)sTime.tv_nsec;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Spawn oCommand uCount times with method eMethod, waiting for each
+   child to exit before starting the next; the children of
+   SPAWN_SERVER are reported by oServer.  Return the mean time from
+   the start of a spawn to the exit of its child in microseconds. */
+
+static double timeSpawns(Command_T oCommand, enum SpawnMethod eMethod,
+                         ForkServer_T oServer, size_t uCount)
+{
+   struct rusage sRusage;
+   double dStart;
+   pid_t iPid;
+   pid_t iExited;
+   int iStatus;
+   size_t u;
+
+   dStart = now();
+   for (u = 0; u < uCount; u++)
+   {
+      iPid = spawnCommand(oCommand, Command_getName(oCommand),
+                          STDIN_FILENO, STDOUT_FILENO, -1, eMethod);
+      if (iPid == -1) {perror(pcPgmName); exit(EXIT_FAILURE); }
+      if (eMethod == SPAWN_SERVER)
+      {
+         /* Only a server that has died reports no exit */
+         do
+            if (ForkServer_readExit(oServer, 1, &iExited, &iStatus,
+                                    &sRusage) == 0)
+               exit(EXIT_FAILURE);
+         while (iExited != iPid);
+      }
+      else if (waitpid(iPid, NULL, 0) == -1)
+      {perror(pcPgmName); exit(EXIT_FAILURE); }
+   }
+   return (now() - dStart) / (double)uCount / 1e3;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Measure how the latency of starting and reaping a trivial command
+   grows with the size of the shell's heap for each spawn method.
+   The fork server is started first, while the heap is empty, as the
+   shell starts it.  The heap grows from 0 to the -m size in
+   mebibytes, doubling each step from 16, and is touched so that it
+   is resident; -n sets the number of spawns per measurement and -c
+   the file to run.
+   Writes one line per heap size and method: the heap size in
+   mebibytes, the method name, and the mean latency in
+   microseconds.  Returns 0 iff successful.  As always, argc is the
+   command-line argument count and argv is an array of arguments. */
+
+int main(int argc, char *argv[])
+{
+   size_t uCount = DEFAULT_COUNT;
+   size_t uMaxHeap = DEFAULT_MAX_HEAP;
+   const char *pcProgram = "/bin/true";
+   size_t uHeap;
+   size_t uMethod;
+   char *pcHeap = NULL;
+   Arena_T oArena;
+   Command_T oCommand;
+   ForkServer_T oServer;
+   int iOpt;
+
+   pcPgmName = argv[0];
+
+   while ((iOpt = getopt(argc, argv, "n:m:c:")) != -1)
+   {
+      switch (iOpt) {
+         case 'n':
+            uCount = (size_t)strtoul(optarg, NULL, 10);
+            break;
+         case 'm':
+            uMaxHeap = (size_t)strtoul(optarg, NULL, 10);
+            break;
+         case 'c':
+            pcProgram = optarg;
+            break;
+         default:
+            fprintf(stderr, "usage: %s [-n count] [-m megabytes] "
+                    "[-c file]\n", pcPgmName);
+            exit(EXIT_FAILURE);
+      }
+   }
+   if (uCount == 0) uCount = 1;
+
+   oServer = ForkServer_new();
+   Spawn_setServer(oServer);
+
+   oArena = Arena_new();
+   oCommand = newCommand(strlen(pcProgram), oArena);
+   Command_addChars(oCommand, pcProgram, strlen(pcProgram));
+   Command_endWord(oCommand, WORD_ARG);
+
+   printf("heap_mb\tmethod\tusec\n");
+   uHeap = 0;
+   for (;;)
+   {
+      free(pcHeap);
+      pcHeap = NULL;
+      if (uHeap > 0)
+      {
+         pcHeap = (char*)malloc(uHeap * MEBIBYTE);
+         if (pcHeap == NULL) {perror(pcPgmName); exit(EXIT_FAILURE); }
+         memset(pcHeap, 1, uHeap * MEBIBYTE);
+      }
+
+      for (uMethod = SPAWN_FORK; uMethod <= SPAWN_SERVER; uMethod++)
+      {
+         double dUsec = timeSpawns(oCommand, (enum SpawnMethod)uMethod,
+                                   oServer, uCount);
+         printf("%lu\t%s\t%.1f\n", (unsigned long)uHeap,
+                Spawn_getMethodName((enum SpawnMethod)uMethod), dUsec);
+         if (fflush(stdout) == EOF)
+         {perror(pcPgmName); exit(EXIT_FAILURE); }
+      }
+
+      if (uHeap >= uMaxHeap)
+         break;
+      uHeap = (uHeap == 0) ? 16 : uHeap * 2;
+      if (uHeap > uMaxHeap)
+         uHeap = uMaxHeap;
+   }
+
+   free(pcHeap);
+   Arena_free(oArena);
+   ForkServer_free(oServer);
+   return 0;
+}
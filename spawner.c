@@ -0,0 +1,1015 @@
+/*--------------------------------------------------------------------*/
+/* spawner.c                                                          */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#include "spawner.h"
+#include "command.h"
+#include "pipeline.h"
+#include "forkserver.h"
+#include "vartable.h"
+#include "shellfd.h"
+#include "ish.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sched.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The environment that the command inherits, unless the shell keeps
+   its variables in a VarTable. */
+extern char **environ;
+
+/* The permissions of a newly-created redirect file, before the umask
+   of the shell is applied. */
+enum {PERMISSIONS = 0666};
+
+/* The size of the stack that a SPAWN_CLONE child runs on until it
+   execs, and of the buffer for a child's error message. */
+enum {CLONE_STACK_SIZE = 128 * 1024};
+enum {MESSAGE_SIZE = 256};
+
+/* The names of the spawn methods, indexed by enum SpawnMethod. */
+static const char *apcMethodNames[] =
+   {"fork", "vfork", "posix_spawn", "clone", "forkserver"};
+enum {METHOD_COUNT = sizeof(apcMethodNames) / sizeof(apcMethodNames[0])};
+
+/* The stack of a SPAWN_CLONE child.  The parent is suspended until
+   the child execs or exits, so one stack serves every child. */
+static long alCloneStack[CLONE_STACK_SIZE / sizeof(long)];
+
+/* The signal mask that children start with, if iHaveChildMask is 1.
+   Otherwise they start with the mask of the shell. */
+static sigset_t sChildMask;
+static int iHaveChildMask = 0;
+
+/* The server that starts the processes of SPAWN_SERVER, or NULL. */
+static ForkServer_T oSpawnServer = NULL;
+
+/* The variables whose environment children start with, or NULL for
+   environ. */
+static VarTable_T oSpawnVars = NULL;
+
+/*--------------------------------------------------------------------*/
+
+/* What a child needs to run a command: the command, the file to
+   execute, the descriptors to make its stdin and stdout, the
+   descriptor that holds the text of each here-document or
+   here-string redirect, indexed like the redirects, or NULL if there
+   are none, the process group to join as spawnCommand() describes,
+   the environment to exec with, and the shell's signal mask, which
+   it restores just before it execs unless children have a mask of
+   their own. */
+
+struct SpawnArgs
+{
+   Command_T oCommand;
+   const char *pcFile;
+   int iInFd;
+   int iOutFd;
+   int *aiDocFds;
+   pid_t iPgid;
+   char **ppcEnvp;
+   const sigset_t *psOldSet;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* If pcName is the name of a spawn method ("fork", "vfork",
+   "posix_spawn", "clone", or "forkserver"), then store that method
+   in *peMethod and return 1.  Otherwise return 0. */
+
+int Spawn_parseMethod(const char *pcName, enum SpawnMethod *peMethod)
+{
+   size_t u;
+
+   assert(pcName != NULL);
+   assert(peMethod != NULL);
+
+   for (u = 0; u < METHOD_COUNT; u++)
+   {
+      if (strcmp(pcName, apcMethodNames[u]) == 0)
+      {
+         *peMethod = (enum SpawnMethod)u;
+         return 1;
+      }
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the name of spawn method eMethod. */
+
+const char *Spawn_getMethodName(enum SpawnMethod eMethod)
+{
+   assert((size_t)eMethod < METHOD_COUNT);
+   return apcMethodNames[eMethod];
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make every child process start with the signal mask *psMask
+   instead of that of the shell, which may block signals that it
+   receives through a signalfd. */
+
+void Spawn_setChildMask(const sigset_t *psMask)
+{
+   assert(psMask != NULL);
+
+   sChildMask = *psMask;
+   iHaveChildMask = 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make SPAWN_SERVER start processes through oServer. */
+
+void Spawn_setServer(ForkServer_T oServer)
+{
+   assert(oServer != NULL);
+   oSpawnServer = oServer;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make every child process start with the environment of the
+   exported variables of oVars, or with environ if oVars is NULL, as
+   it is at first. */
+
+void Spawn_setVars(VarTable_T oVars)
+{
+   oSpawnVars = oVars;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write an error message for errno to stderr with a single write(2),
+   without touching the stdio buffers that a vfork or clone child
+   shares with the shell, and exit the child with EXIT_FAILURE. */
+
+static void spawnFail(void)
+{
+   char acMessage[MESSAGE_SIZE];
+   const char *apcParts[3];
+   size_t uLength = 0;
+   size_t uPart;
+   size_t uPartLength;
+
+   apcParts[0] = getPgmName();
+   apcParts[1] = ": ";
+   apcParts[2] = strerror(errno);
+
+   for (uPart = 0; uPart < 3; uPart++)
+   {
+      uPartLength = strlen(apcParts[uPart]);
+      if (uPartLength > MESSAGE_SIZE - 1 - uLength)
+         uPartLength = MESSAGE_SIZE - 1 - uLength;
+      memcpy(acMessage + uLength, apcParts[uPart], uPartLength);
+      uLength += uPartLength;
+   }
+   acMessage[uLength++] = '\n';
+
+   (void)write(STDERR_FILENO, acMessage, uLength);
+   _exit(EXIT_FAILURE);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the flags with which the file of a redirect of kind eKind
+   is opened. */
+
+static int spawnOpenFlags(enum RedirectKind eKind)
+{
+   switch (eKind)
+   {
+      case REDIRECT_READ:
+         return O_RDONLY;
+      case REDIRECT_WRITE:
+         return O_WRONLY | O_CREAT | O_TRUNC;
+      case REDIRECT_APPEND:
+         return O_WRONLY | O_CREAT | O_APPEND;
+      default:
+         assert(0);
+         return O_RDONLY;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make iTargetFd of the child a copy of iFd, which stays open, and
+   which need not be cleared of close-on-exec otherwise.  On failure,
+   write an error message and exit the child. */
+
+static void spawnDup(int iFd, int iTargetFd)
+{
+   /* dup2() clears close-on-exec on the copy, but does nothing if the
+      descriptors are the same */
+   if (iFd == iTargetFd)
+   {
+      if (fcntl(iFd, F_SETFD, 0) == -1)
+         spawnFail();
+   }
+   else if (dup2(iFd, iTargetFd) == -1)
+      spawnFail();
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Apply the redirects of the command of *psArgs in order.  A file is
+   opened and moved to its descriptor; a here-document or here-string
+   is copied there from the descriptor that the parent prepared.  On
+   failure, write an error message and exit the child. */
+
+static void spawnRedirects(const struct SpawnArgs *psArgs)
+{
+   const struct Redirect *psRedirects;
+   const struct Redirect *psRedirect;
+   size_t uRedirects;
+   size_t u;
+   int iFd;
+
+   psRedirects = Command_getRedirects(psArgs->oCommand);
+   uRedirects = Command_getRedirectCount(psArgs->oCommand);
+   for (u = 0; u < uRedirects; u++)
+   {
+      psRedirect = &psRedirects[u];
+      switch (psRedirect->eKind)
+      {
+         case REDIRECT_READ:
+         case REDIRECT_WRITE:
+         case REDIRECT_APPEND:
+            iFd = open(psRedirect->pcWord,
+                       spawnOpenFlags(psRedirect->eKind), PERMISSIONS);
+            if (iFd == -1)
+               spawnFail();
+            if (iFd != psRedirect->iFd)
+            {
+               if (dup2(iFd, psRedirect->iFd) == -1)
+                  spawnFail();
+               if (close(iFd) == -1)
+                  spawnFail();
+            }
+            break;
+         case REDIRECT_DUP_IN:
+         case REDIRECT_DUP_OUT:
+            if (psRedirect->iSourceFd == -1)
+               (void)close(psRedirect->iFd);
+            else
+               spawnDup(psRedirect->iSourceFd, psRedirect->iFd);
+            break;
+         default:
+            spawnDup(psArgs->aiDocFds[u], psRedirect->iFd);
+            break;
+      }
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Run in a child created by fork, vfork, or clone: give every signal
+   with a handler its default action, so that a handler of the shell
+   never runs in a child that shares its memory, join its process
+   group, set the signal mask for children or restore the shell's
+   mask *psArgs->psOldSet, connect stdin and stdout to the given
+   descriptors, apply the redirects, and exec the command.  Never
+   returns. */
+
+static void spawnChild(const struct SpawnArgs *psArgs)
+{
+   struct sigaction sAction;
+   int iSignal;
+
+   for (iSignal = 1; iSignal < NSIG; iSignal++)
+   {
+      if (sigaction(iSignal, NULL, &sAction) == -1)
+         continue;
+      if (sAction.sa_handler == SIG_IGN || sAction.sa_handler == SIG_DFL)
+         continue;
+      sAction.sa_handler = SIG_DFL;
+      sAction.sa_flags = 0;
+      (void)sigaction(iSignal, &sAction, NULL);
+   }
+   if (psArgs->iPgid != -1 && setpgid(0, psArgs->iPgid) == -1)
+      spawnFail();
+   if (sigprocmask(SIG_SETMASK,
+                   iHaveChildMask ? &sChildMask : psArgs->psOldSet,
+                   NULL) == -1)
+      spawnFail();
+
+   /* dup2() clears close-on-exec on the copies */
+   if (psArgs->iInFd != STDIN_FILENO)
+      if (dup2(psArgs->iInFd, STDIN_FILENO) == -1)
+         spawnFail();
+   if (psArgs->iOutFd != STDOUT_FILENO)
+      if (dup2(psArgs->iOutFd, STDOUT_FILENO) == -1)
+         spawnFail();
+
+   /* The redirects come after the pipes, which they override */
+   spawnRedirects(psArgs);
+
+   execve(psArgs->pcFile, Command_getArgv(psArgs->oCommand),
+          psArgs->ppcEnvp);
+   spawnFail();
+}
+
+/*--------------------------------------------------------------------*/
+
+/* The function that a SPAWN_CLONE child starts in.  pvArgs is the
+   struct SpawnArgs of the command. */
+
+static int spawnCloneMain(void *pvArgs)
+{
+   spawnChild((const struct SpawnArgs*)pvArgs);
+   return EXIT_FAILURE;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Add to psActions the file actions that apply the redirects of
+   oCommand in order, copying each here-document or here-string from
+   aiDocFds[u], as spawnRedirects() does.  Return 0, or an error
+   number. */
+
+static int spawnAddRedirects(posix_spawn_file_actions_t *psActions,
+                             Command_T oCommand, const int *aiDocFds)
+{
+   const struct Redirect *psRedirects;
+   const struct Redirect *psRedirect;
+   size_t uRedirects;
+   size_t u;
+   int iRet = 0;
+
+   psRedirects = Command_getRedirects(oCommand);
+   uRedirects = Command_getRedirectCount(oCommand);
+   for (u = 0; u < uRedirects && iRet == 0; u++)
+   {
+      psRedirect = &psRedirects[u];
+      switch (psRedirect->eKind)
+      {
+         case REDIRECT_READ:
+         case REDIRECT_WRITE:
+         case REDIRECT_APPEND:
+            iRet = posix_spawn_file_actions_addopen(psActions,
+               psRedirect->iFd, psRedirect->pcWord,
+               spawnOpenFlags(psRedirect->eKind), PERMISSIONS);
+            break;
+         case REDIRECT_DUP_IN:
+         case REDIRECT_DUP_OUT:
+            if (psRedirect->iSourceFd == -1)
+               iRet = posix_spawn_file_actions_addclose(psActions,
+                  psRedirect->iFd);
+            else
+               iRet = posix_spawn_file_actions_adddup2(psActions,
+                  psRedirect->iSourceFd, psRedirect->iFd);
+            break;
+         default:
+            iRet = posix_spawn_file_actions_adddup2(psActions,
+               aiDocFds[u], psRedirect->iFd);
+            break;
+      }
+   }
+   return iRet;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Start oCommand from pcFile with posix_spawn(), connecting its
+   stdin and stdout to iInFd and iOutFd and applying its redirects
+   with file actions, in process group iPgid as spawnCommand()
+   describes, with the signal mask for children, and with the
+   environment ppcEnvp.  aiDocFds is as in struct SpawnArgs.  Return
+   the process ID of the child, or -1 with errno set if the child
+   could not be created or the command could not be started. */
+
+static pid_t spawnPosix(Command_T oCommand, const char *pcFile,
+                        int iInFd, int iOutFd, const int *aiDocFds,
+                        pid_t iPgid, char **ppcEnvp)
+{
+   posix_spawn_file_actions_t sActions;
+   posix_spawn_file_actions_t *psActions = NULL;
+   posix_spawnattr_t sAttr;
+   posix_spawnattr_t *psAttr = NULL;
+   pid_t iPid;
+   int iRet = 0;
+
+   if (Command_getRedirectCount(oCommand) > 0
+       || iInFd != STDIN_FILENO || iOutFd != STDOUT_FILENO)
+   {
+      iRet = posix_spawn_file_actions_init(&sActions);
+      if (iRet != 0) {errno = iRet; return -1; }
+      psActions = &sActions;
+
+      if (iInFd != STDIN_FILENO)
+         iRet = posix_spawn_file_actions_adddup2(psActions, iInFd,
+                                                 STDIN_FILENO);
+      if (iRet == 0 && iOutFd != STDOUT_FILENO)
+         iRet = posix_spawn_file_actions_adddup2(psActions, iOutFd,
+                                                 STDOUT_FILENO);
+      if (iRet == 0)
+         iRet = spawnAddRedirects(psActions, oCommand, aiDocFds);
+      if (iRet != 0)
+      {
+         posix_spawn_file_actions_destroy(psActions);
+         errno = iRet;
+         return -1;
+      }
+   }
+
+   if (iRet == 0 && (iPgid != -1 || iHaveChildMask))
+   {
+      iRet = posix_spawnattr_init(&sAttr);
+      if (iRet == 0)
+      {
+         psAttr = &sAttr;
+         iRet = posix_spawnattr_setflags(psAttr,
+            (iPgid != -1 ? POSIX_SPAWN_SETPGROUP : 0)
+            | (iHaveChildMask ? POSIX_SPAWN_SETSIGMASK : 0));
+      }
+      if (iRet == 0 && iPgid != -1)
+         iRet = posix_spawnattr_setpgroup(psAttr, iPgid);
+      if (iRet == 0 && iHaveChildMask)
+         iRet = posix_spawnattr_setsigmask(psAttr, &sChildMask);
+   }
+
+   if (iRet == 0)
+      iRet = posix_spawn(&iPid, pcFile, psActions, psAttr,
+                         Command_getArgv(oCommand), ppcEnvp);
+
+   if (psAttr != NULL)
+      posix_spawnattr_destroy(psAttr);
+   if (psActions != NULL)
+      posix_spawn_file_actions_destroy(psActions);
+
+   if (iRet != 0) {errno = iRet; return -1; }
+   return iPid;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write the uLength characters at pc to descriptor iFd.  Return 0,
+   or -1 with errno set. */
+
+static int spawnWriteAll(int iFd, const char *pc, size_t uLength)
+{
+   ssize_t iWritten;
+
+   while (uLength > 0)
+   {
+      iWritten = write(iFd, pc, uLength);
+      if (iWritten == -1)
+      {
+         if (errno == EINTR)
+            continue;
+         return -1;
+      }
+      pc += iWritten;
+      uLength -= (size_t)iWritten;
+   }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return a close-on-exec descriptor of an anonymous file in memory
+   that holds the text of the here-document or here-string redirect
+   *psRedirect, positioned at its start, or -1 with errno set.  The
+   file is in memory, so that a text larger than a pipe never
+   blocks. */
+
+static int spawnOpenDoc(const struct Redirect *psRedirect)
+{
+   int iFd;
+   int iErrno;
+   int iRet;
+
+   iFd = ShellFd_move(memfd_create("ish-heredoc", MFD_CLOEXEC));
+   if (iFd == -1)
+      return -1;
+
+   if (psRedirect->eKind == REDIRECT_HERESTRING)
+   {
+      iRet = spawnWriteAll(iFd, psRedirect->pcWord,
+                           strlen(psRedirect->pcWord));
+      if (iRet == 0)
+         iRet = spawnWriteAll(iFd, "\n", 1);
+   }
+   else if (psRedirect->pcBody != NULL)
+      iRet = spawnWriteAll(iFd, psRedirect->pcBody,
+                           strlen(psRedirect->pcBody));
+   else
+      iRet = 0;
+
+   if (iRet == 0 && lseek(iFd, 0, SEEK_SET) == -1)
+      iRet = -1;
+   if (iRet == -1)
+   {
+      iErrno = errno;
+      (void)close(iFd);
+      errno = iErrno;
+      return -1;
+   }
+   return iFd;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Close the descriptors in aiDocFds, which spawnOpenDocs() returned
+   for oCommand, and free the array, keeping errno. */
+
+static void spawnCloseDocs(Command_T oCommand, int *aiDocFds)
+{
+   size_t uRedirects;
+   size_t u;
+   int iErrno;
+
+   if (aiDocFds == NULL)
+      return;
+
+   iErrno = errno;
+   uRedirects = Command_getRedirectCount(oCommand);
+   for (u = 0; u < uRedirects; u++)
+      if (aiDocFds[u] != -1)
+         (void)close(aiDocFds[u]);
+   free(aiDocFds);
+   errno = iErrno;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *paiDocFds NULL if oCommand has no here-document or
+   here-string redirects, and otherwise an array, indexed like its
+   redirects, that holds a descriptor of the text of each such
+   redirect and -1 for the others.  Return 0, or -1 with errno set
+   and nothing left open. */
+
+static int spawnOpenDocs(Command_T oCommand, int **paiDocFds)
+{
+   const struct Redirect *psRedirects;
+   size_t uRedirects;
+   size_t u;
+   int *aiDocFds = NULL;
+
+   psRedirects = Command_getRedirects(oCommand);
+   uRedirects = Command_getRedirectCount(oCommand);
+   for (u = 0; u < uRedirects; u++)
+   {
+      if (psRedirects[u].eKind != REDIRECT_HEREDOC
+          && psRedirects[u].eKind != REDIRECT_HERESTRING)
+         continue;
+
+      if (aiDocFds == NULL)
+      {
+         aiDocFds = (int*)malloc(uRedirects * sizeof(int));
+         if (aiDocFds == NULL)
+            return -1;
+         memset(aiDocFds, -1, uRedirects * sizeof(int));
+      }
+      aiDocFds[u] = spawnOpenDoc(&psRedirects[u]);
+      if (aiDocFds[u] == -1)
+      {
+         spawnCloseDocs(oCommand, aiDocFds);
+         return -1;
+      }
+   }
+   *paiDocFds = aiDocFds;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 0 if no redirect of oCommand names one of the shell's own
+   descriptors, which are numbered MIN_SHELL_FD or above, as the
+   descriptor that it redirects or the one that it copies.  Otherwise
+   return -1 with errno set to EBADF. */
+
+static int spawnCheckRedirects(Command_T oCommand)
+{
+   const struct Redirect *psRedirects;
+   size_t uRedirects;
+   size_t u;
+
+   psRedirects = Command_getRedirects(oCommand);
+   uRedirects = Command_getRedirectCount(oCommand);
+   for (u = 0; u < uRedirects; u++)
+      if (psRedirects[u].iFd >= MIN_SHELL_FD
+          || ((psRedirects[u].eKind == REDIRECT_DUP_IN
+               || psRedirects[u].eKind == REDIRECT_DUP_OUT)
+              && psRedirects[u].iSourceFd >= MIN_SHELL_FD))
+      {
+         errno = EBADF;
+         return -1;
+      }
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Start a child process that runs oCommand by executing the file
+   pcFile, using method eMethod.  The child's stdin and stdout are
+   iInFd and iOutFd (STDIN_FILENO and STDOUT_FILENO to keep the
+   shell's), and then the redirects of oCommand are applied in order,
+   which may override them.  The shell writes the text of each
+   here-document or here-string to a file in memory that the child
+   reads it from.  iInFd and iOutFd should be close-on-exec, so that
+   the command does not also inherit them under their own numbers.
+   The child stays in the shell's process group if iPgid is -1, leads
+   a new group if iPgid is 0, and otherwise joins group iPgid.  Its
+   environment is the one that Spawn_setVars() chose.  pcFile is used
+   as is, without searching PATH.  Return the process ID of the
+   child, which the caller must wait for.  If a redirect file
+   cannot be opened or pcFile cannot be executed, then either the
+   child writes an error message and exits with EXIT_FAILURE, or,
+   when eMethod reports such failures to the parent, -1 is returned
+   with errno set.  Also return -1 with errno set if the child cannot
+   be created, or, with errno set to EBADF, if a redirect names one of
+   the shell's own descriptors (see shellfd.h).  With SPAWN_SERVER
+   the child must be waited for with ForkServer_readExit(), as it is
+   not a child of the shell, unless the server has died, which
+   ForkServer_isLost() tells: then SPAWN_POSIX is used instead, and
+   the child is the shell's.  The caller must flush its output
+   streams first. */
+
+pid_t spawnCommand(Command_T oCommand, const char *pcFile, int iInFd,
+                   int iOutFd, pid_t iPgid, enum SpawnMethod eMethod)
+{
+   struct SpawnArgs sArgs;
+   sigset_t sAllSet;
+   sigset_t sOldSet;
+   int *aiDocFds;
+   char **ppcEnvp = environ;
+   unsigned long ulGeneration = 0;
+   pid_t iPid;
+   int iErrno;
+
+   assert(oCommand != NULL);
+   assert(pcFile != NULL);
+   assert((size_t)eMethod < METHOD_COUNT);
+
+   /* The environment is rebuilt only after a variable changes */
+   if (oSpawnVars != NULL)
+   {
+      ppcEnvp = VarTable_getEnvp(oSpawnVars);
+      ulGeneration = VarTable_getGeneration(oSpawnVars);
+   }
+
+   if (spawnCheckRedirects(oCommand) == -1)
+      return -1;
+
+   /* The server writes the text of here-documents itself */
+   if (eMethod == SPAWN_SERVER)
+   {
+      assert(oSpawnServer != NULL);
+      iPid = ForkServer_spawn(oSpawnServer, oCommand, pcFile, iInFd,
+                              iOutFd, iPgid, ppcEnvp, ulGeneration);
+      if (iPid != -1 || ! ForkServer_isLost(oSpawnServer))
+         return iPid;
+
+      /* Once the server has died, the shell starts processes itself */
+      eMethod = SPAWN_POSIX;
+   }
+
+   /* The text of here-documents is written by the shell, before the
+      child exists */
+   if (spawnOpenDocs(oCommand, &aiDocFds) == -1)
+      return -1;
+
+   /* posix_spawn() guards the child's signal state itself */
+   if (eMethod == SPAWN_POSIX)
+   {
+      iPid = spawnPosix(oCommand, pcFile, iInFd, iOutFd, aiDocFds,
+                        iPgid, ppcEnvp);
+      spawnCloseDocs(oCommand, aiDocFds);
+      return iPid;
+   }
+
+   /* Block every signal until the child has reset its handlers */
+   if (sigfillset(&sAllSet) == -1
+       || sigprocmask(SIG_BLOCK, &sAllSet, &sOldSet) == -1)
+   {
+      spawnCloseDocs(oCommand, aiDocFds);
+      return -1;
+   }
+
+   sArgs.oCommand = oCommand;
+   sArgs.pcFile = pcFile;
+   sArgs.iInFd = iInFd;
+   sArgs.iOutFd = iOutFd;
+   sArgs.aiDocFds = aiDocFds;
+   sArgs.iPgid = iPgid;
+   sArgs.ppcEnvp = ppcEnvp;
+   sArgs.psOldSet = &sOldSet;
+
+   switch (eMethod) {
+      case SPAWN_FORK:
+         iPid = fork();
+         if (iPid == 0)
+            spawnChild(&sArgs);
+         break;
+      case SPAWN_VFORK:
+         iPid = vfork();
+         if (iPid == 0)
+            spawnChild(&sArgs);
+         break;
+      default:
+         iPid = clone(spawnCloneMain,
+                      (char*)alCloneStack + sizeof(alCloneStack),
+                      CLONE_VM | CLONE_VFORK | SIGCHLD, &sArgs);
+         break;
+   }
+
+   /* This code is executed by the parent process only.  A fork child
+      may not have joined its group yet, so join it from here too. */
+   iErrno = errno;
+   if (iPid != -1 && sArgs.iPgid != -1)
+      (void)setpgid(iPid, sArgs.iPgid == 0 ? iPid : sArgs.iPgid);
+   (void)sigprocmask(SIG_SETMASK, &sOldSet, NULL);
+   spawnCloseDocs(oCommand, sArgs.aiDocFds);
+   errno = iErrno;
+   return iPid;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Start every stage of oPipeline at once, using method eMethod, with
+   the stdout of each stage connected to the stdin of the next by a
+   close-on-exec pipe.  If uPipeSize is not 0, ask for pipes of
+   uPipeSize bytes.  If iPgid is 0, the first stage started leads a
+   new process group that the others join; otherwise each stage is
+   placed in a group as by spawnCommand().  Stage u executes the
+   file apcFiles[u] as spawnCommand() would, and its process ID is
+   stored in aiPids[u].  If apcFiles[u] is NULL, or stage u cannot be
+   started, then aiPids[u] is -1 and its neighbours see the pipes
+   between them closed; a stage that cannot be started is reported on
+   stderr.  Return the number of stages started, which the caller must
+   wait for.  The caller must flush its output streams first. */
+
+size_t spawnPipeline(Pipeline_T oPipeline, const char *apcFiles[],
+                     size_t uPipeSize, pid_t iPgid,
+                     enum SpawnMethod eMethod, pid_t aiPids[])
+{
+   size_t uLength;
+   size_t uStarted = 0;
+   size_t u;
+   /* The read and write ends of the pipe after the current stage */
+   int aiPipe[2];
+   /* The descriptors that become the stdin and stdout of the current
+      stage */
+   int iInFd = STDIN_FILENO;
+   int iOutFd;
+
+   assert(oPipeline != NULL);
+   assert(apcFiles != NULL);
+   assert(aiPids != NULL);
+
+   uLength = Pipeline_getLength(oPipeline);
+   for (u = 0; u < uLength; u++)
+   {
+      aiPids[u] = -1;
+
+      /* The pipe ends stay open only while the stages on either side
+         of them are being started. */
+      iOutFd = STDOUT_FILENO;
+      if (u + 1 < uLength)
+      {
+         if (pipe2(aiPipe, O_CLOEXEC) == -1)
+         {
+            /* Start no more stages */
+            perror(getPgmName());
+            for (u++; u < uLength; u++)
+               aiPids[u] = -1;
+            break;
+         }
+         if (uPipeSize != 0
+             && fcntl(aiPipe[1], F_SETPIPE_SZ, (int)uPipeSize) == -1)
+            perror(getPgmName());
+         iOutFd = aiPipe[1];
+      }
+
+      if (apcFiles[u] != NULL)
+      {
+         aiPids[u] = spawnCommand(Pipeline_getCommand(oPipeline, u),
+                                  apcFiles[u], iInFd, iOutFd, iPgid,
+                                  eMethod);
+         if (aiPids[u] == -1)
+            perror(getPgmName());
+         else
+         {
+            /* The first stage started leads the new group */
+            if (iPgid == 0)
+               iPgid = aiPids[u];
+            uStarted++;
+         }
+      }
+
+      if (iInFd != STDIN_FILENO)
+      {
+         (void)close(iInFd);
+         iInFd = STDIN_FILENO;
+      }
+      if (iOutFd != STDOUT_FILENO)
+      {
+         (void)close(iOutFd);
+         iInFd = aiPipe[0];
+      }
+   }
+
+   if (iInFd != STDIN_FILENO)
+      (void)close(iInFd);
+   return uStarted;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Apply the redirect *psRedirect to the shell's own descriptors.
+   iDocFd is the descriptor of its text, if it is a here-document or
+   here-string.  Return 0, or -1 with errno set. */
+
+static int spawnRedirectOne(const struct Redirect *psRedirect,
+                            int iDocFd)
+{
+   int iFd;
+   int iErrno;
+
+   switch (psRedirect->eKind)
+   {
+      case REDIRECT_READ:
+      case REDIRECT_WRITE:
+      case REDIRECT_APPEND:
+         iFd = open(psRedirect->pcWord,
+                    spawnOpenFlags(psRedirect->eKind), PERMISSIONS);
+         if (iFd == -1)
+            return -1;
+         if (iFd == psRedirect->iFd)
+            return 0;
+         if (dup2(iFd, psRedirect->iFd) == -1)
+         {
+            iErrno = errno;
+            (void)close(iFd);
+            errno = iErrno;
+            return -1;
+         }
+         return close(iFd);
+      case REDIRECT_DUP_IN:
+      case REDIRECT_DUP_OUT:
+         if (psRedirect->iSourceFd == -1)
+         {
+            (void)close(psRedirect->iFd);
+            return 0;
+         }
+         if (psRedirect->iSourceFd == psRedirect->iFd)
+            return (fcntl(psRedirect->iFd, F_GETFD) == -1) ? -1 : 0;
+         return (dup2(psRedirect->iSourceFd, psRedirect->iFd) == -1)
+                ? -1 : 0;
+      default:
+         return (dup2(iDocFd, psRedirect->iFd) == -1) ? -1 : 0;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return a copy of the shell's descriptor iFd, numbered MIN_SHELL_FD
+   or above, where no redirect can replace it, that is close-on-exec
+   iff iFd is, so that the flag can be restored with it.  Return -1
+   with errno set if iFd is not open or cannot be copied. */
+
+static int spawnSaveFd(int iFd)
+{
+   int iFlags;
+
+   iFlags = fcntl(iFd, F_GETFD);
+   if (iFlags == -1)
+      return -1;
+   return fcntl(iFd, (iFlags & FD_CLOEXEC) ? F_DUPFD_CLOEXEC : F_DUPFD,
+                MIN_SHELL_FD);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Undo the first uCount redirects of psRedirects, last first, by
+   moving back each descriptor in aiSaved that spawnSaveFd() saved,
+   or closing the descriptor if it was not open. */
+
+static void spawnRestoreFds(const struct Redirect *psRedirects,
+                            const int aiSaved[], size_t uCount)
+{
+   int iFlags;
+
+   while (uCount > 0)
+   {
+      uCount--;
+      if (aiSaved[uCount] == -1)
+      {
+         (void)close(psRedirects[uCount].iFd);
+         continue;
+      }
+      iFlags = fcntl(aiSaved[uCount], F_GETFD);
+      if (iFlags == -1
+          || dup3(aiSaved[uCount], psRedirects[uCount].iFd,
+                  (iFlags & FD_CLOEXEC) ? O_CLOEXEC : 0) == -1)
+      {perror(getPgmName()); exit(EXIT_FAILURE); }
+      (void)close(aiSaved[uCount]);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Apply the redirects of oCommand in order to the shell's own
+   descriptors, as spawnCommand() applies them in a child, so that a
+   builtin command can run with them.  Each descriptor that a
+   redirect replaces is first copied out of the way.  Store in
+   *paiSaved what Spawn_restoreShell() needs to undo the redirects,
+   which is NULL if there are none.  Return 0, or -1 with errno set
+   and nothing changed; errno is EBADF if a redirect names one of the
+   shell's own descriptors (see shellfd.h).  The caller must flush
+   its output streams first. */
+
+int Spawn_redirectShell(Command_T oCommand, int **paiSaved)
+{
+   const struct Redirect *psRedirects;
+   size_t uRedirects;
+   size_t u;
+   int *aiDocFds;
+   int *aiSaved;
+   int iRet = 0;
+   int iErrno;
+
+   assert(oCommand != NULL);
+   assert(paiSaved != NULL);
+
+   *paiSaved = NULL;
+   uRedirects = Command_getRedirectCount(oCommand);
+   if (uRedirects == 0)
+      return 0;
+   psRedirects = Command_getRedirects(oCommand);
+   if (spawnCheckRedirects(oCommand) == -1)
+      return -1;
+
+   aiSaved = (int*)malloc(uRedirects * sizeof(int));
+   if (aiSaved == NULL)
+      return -1;
+   if (spawnOpenDocs(oCommand, &aiDocFds) == -1)
+   {
+      free(aiSaved);
+      return -1;
+   }
+
+   for (u = 0; u < uRedirects; u++)
+   {
+      /* A descriptor that is not open is closed again afterwards */
+      aiSaved[u] = spawnSaveFd(psRedirects[u].iFd);
+      if (aiSaved[u] == -1 && errno != EBADF)
+      {
+         iRet = -1;
+         break;
+      }
+      iRet = spawnRedirectOne(&psRedirects[u],
+                              (aiDocFds == NULL) ? -1 : aiDocFds[u]);
+      if (iRet == -1)
+      {
+         u++;
+         break;
+      }
+   }
+   spawnCloseDocs(oCommand, aiDocFds);
+
+   /* Undo the redirects applied before one failed */
+   if (iRet == -1)
+   {
+      iErrno = errno;
+      spawnRestoreFds(psRedirects, aiSaved, u);
+      free(aiSaved);
+      errno = iErrno;
+      return -1;
+   }
+   *paiSaved = aiSaved;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Undo the redirects that Spawn_redirectShell() applied for
+   oCommand, given what it stored as aiSaved, and free aiSaved.  The
+   caller must flush its output streams first. */
+
+void Spawn_restoreShell(Command_T oCommand, int *aiSaved)
+{
+   assert(oCommand != NULL);
+
+   if (aiSaved == NULL)
+      return;
+   spawnRestoreFds(Command_getRedirects(oCommand), aiSaved,
+                   Command_getRedirectCount(oCommand));
+   free(aiSaved);
+}
@@ -0,0 +1,140 @@
+/*--------------------------------------------------------------------*/
+/* spawner.h                                                          */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef SPAWNER_INCLUDED
+#define SPAWNER_INCLUDED
+
+#include <signal.h>
+#include <sys/types.h>
+#include "command.h"
+#include "pipeline.h"
+#include "forkserver.h"
+#include "vartable.h"
+
+/*--------------------------------------------------------------------*/
+
+/* The ways of creating the process that runs an external command.
+   SPAWN_FORK copies the shell's address space; SPAWN_VFORK and
+   SPAWN_CLONE share it with a child that runs only until it execs,
+   so their cost does not grow with the size of the shell;
+   SPAWN_POSIX uses posix_spawn() with file actions for the
+   redirects; SPAWN_SERVER asks the ForkServer given to
+   Spawn_setServer() to start the process with SPAWN_POSIX, so that
+   the process is a child of the server instead of the shell, or,
+   once the server has died, uses SPAWN_POSIX itself. */
+
+enum SpawnMethod {SPAWN_FORK, SPAWN_VFORK, SPAWN_POSIX, SPAWN_CLONE,
+                  SPAWN_SERVER};
+
+/*--------------------------------------------------------------------*/
+
+/* If pcName is the name of a spawn method ("fork", "vfork",
+   "posix_spawn", "clone", or "forkserver"), then store that method
+   in *peMethod and return 1.  Otherwise return 0. */
+
+int Spawn_parseMethod(const char *pcName, enum SpawnMethod *peMethod);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the name of spawn method eMethod. */
+
+const char *Spawn_getMethodName(enum SpawnMethod eMethod);
+
+/*--------------------------------------------------------------------*/
+
+/* Make every child process start with the signal mask *psMask
+   instead of that of the shell, which may block signals that it
+   receives through a signalfd. */
+
+void Spawn_setChildMask(const sigset_t *psMask);
+
+/*--------------------------------------------------------------------*/
+
+/* Make SPAWN_SERVER start processes through oServer. */
+
+void Spawn_setServer(ForkServer_T oServer);
+
+/*--------------------------------------------------------------------*/
+
+/* Make every child process start with the environment of the
+   exported variables of oVars, or with environ if oVars is NULL, as
+   it is at first. */
+
+void Spawn_setVars(VarTable_T oVars);
+
+/*--------------------------------------------------------------------*/
+
+/* Start a child process that runs oCommand by executing the file
+   pcFile, using method eMethod.  The child's stdin and stdout are
+   iInFd and iOutFd (STDIN_FILENO and STDOUT_FILENO to keep the
+   shell's), and then the redirects of oCommand are applied in order,
+   which may override them.  The shell writes the text of each
+   here-document or here-string to a file in memory that the child
+   reads it from.  iInFd and iOutFd should be close-on-exec, so that
+   the command does not also inherit them under their own numbers.
+   The child stays in the shell's process group if iPgid is -1, leads
+   a new group if iPgid is 0, and otherwise joins group iPgid.  Its
+   environment is the one that Spawn_setVars() chose.  pcFile is used
+   as is, without searching PATH.  Return the process ID of the
+   child, which the caller must wait for.  If a redirect file
+   cannot be opened or pcFile cannot be executed, then either the
+   child writes an error message and exits with EXIT_FAILURE, or,
+   when eMethod reports such failures to the parent, -1 is returned
+   with errno set.  Also return -1 with errno set if the child cannot
+   be created, or, with errno set to EBADF, if a redirect names one of
+   the shell's own descriptors (see shellfd.h).  With SPAWN_SERVER
+   the child must be waited for with ForkServer_readExit(), as it is
+   not a child of the shell, unless the server has died, which
+   ForkServer_isLost() tells: then SPAWN_POSIX is used instead, and
+   the child is the shell's.  The caller must flush its output
+   streams first. */
+
+pid_t spawnCommand(Command_T oCommand, const char *pcFile, int iInFd,
+                   int iOutFd, pid_t iPgid, enum SpawnMethod eMethod);
+
+/*--------------------------------------------------------------------*/
+
+/* Start every stage of oPipeline at once, using method eMethod, with
+   the stdout of each stage connected to the stdin of the next by a
+   close-on-exec pipe.  If uPipeSize is not 0, ask for pipes of
+   uPipeSize bytes.  If iPgid is 0, the first stage started leads a
+   new process group that the others join; otherwise each stage is
+   placed in a group as by spawnCommand().  Stage u executes the
+   file apcFiles[u] as spawnCommand() would, and its process ID is
+   stored in aiPids[u].  If apcFiles[u] is NULL, or stage u cannot be
+   started, then aiPids[u] is -1 and its neighbours see the pipes
+   between them closed; a stage that cannot be started is reported on
+   stderr.  Return the number of stages started, which the caller must
+   wait for.  The caller must flush its output streams first. */
+
+size_t spawnPipeline(Pipeline_T oPipeline, const char *apcFiles[],
+                     size_t uPipeSize, pid_t iPgid,
+                     enum SpawnMethod eMethod, pid_t aiPids[]);
+
+/*--------------------------------------------------------------------*/
+
+/* Apply the redirects of oCommand in order to the shell's own
+   descriptors, as spawnCommand() applies them in a child, so that a
+   builtin command can run with them.  Each descriptor that a
+   redirect replaces is first copied out of the way.  Store in
+   *paiSaved what Spawn_restoreShell() needs to undo the redirects,
+   which is NULL if there are none.  Return 0, or -1 with errno set
+   and nothing changed; errno is EBADF if a redirect names one of the
+   shell's own descriptors (see shellfd.h).  The caller must flush
+   its output streams first. */
+
+int Spawn_redirectShell(Command_T oCommand, int **paiSaved);
+
+/*--------------------------------------------------------------------*/
+
+/* Undo the redirects that Spawn_redirectShell() applied for
+   oCommand, given what it stored as aiSaved, and free aiSaved.  The
+   caller must flush its output streams first. */
+
+void Spawn_restoreShell(Command_T oCommand, int *aiSaved);
+
+/*--------------------------------------------------------------------*/
+
+#endif
@@ -5,8 +5,12 @@
 
 #include "syner.h"
 #include "command.h"
+#include "pipeline.h"
 #include "dynarray.h"
 #include "token.h"
+#include "lexer.h"
+#include "arena.h"
+#include "pathglob.h"
 #include "ish.h"
 #include <ctype.h>
 #include <stdio.h>
@@ -16,58 +20,120 @@
 
 /*--------------------------------------------------------------------*/
 
-/* Lexically analyze string pcLine.  If pcLine contains a lexical
-   error, then return NULL.  Otherwise return a DynArray object
-   containing the tokens in pcLine.  The caller owns the DynArray
-   object and the tokens that it contains. */
+/* The PathGlob that expands the patterns among the arguments that
+   synLine() builds, or NULL if they are left as they are. */
 
-Command_T synArr(DynArray_T tokens)
+static PathGlob_T oSynGlob = NULL;
+
+/*--------------------------------------------------------------------*/
+
+/* Add the uLength characters at pc to oCommand as a whole word, which
+   becomes the part of oCommand that eRole names.  Return what
+   Command_endWord() returns. */
+
+static int synAddWord(Command_T oCommand, const char *pc,
+                      size_t uLength, enum WordRole eRole)
+{
+   Command_addChars(oCommand, pc, uLength);
+   return Command_endWord(oCommand, eRole);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Add to oCommand the redirect whose operator, with the digits of
+   its descriptor if any, is the uLength characters at pc.  Its word
+   is the next word ended with role WORD_REDIRECT. */
+
+static void synAddRedirect(Command_T oCommand, const char *pc,
+                           size_t uLength)
+{
+   int iFd;
+   enum RedirectKind eKind;
+   int iSuccessful;
+
+   /* The lexer makes a special token of a redirect operator only */
+   iSuccessful = Command_parseRedirect(pc, uLength, &iFd, &eKind);
+   assert(iSuccessful);
+   (void)iSuccessful;
+   Command_addRedirect(oCommand, iFd, eKind);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the format of the message for the last redirect of
+   oCommand, which has no word.  A plain redirect of stdin or stdout
+   has a message of its own. */
+
+static const char *synMissingWord(Command_T oCommand)
+{
+   const struct Redirect *psRedirect;
+
+   psRedirect = &Command_getRedirects(oCommand)
+      [Command_getRedirectCount(oCommand) - 1];
+   if (psRedirect->eKind == REDIRECT_READ && psRedirect->iFd == 0)
+      return "%s: standard input redirection without file name\n";
+   if (psRedirect->eKind == REDIRECT_WRITE && psRedirect->iFd == 1)
+      return "%s: standard output redirection without file name\n";
+   return "%s: redirection without file name\n";
+}
+
+/*--------------------------------------------------------------------*/
+
+/* The format of the message for the word of a redirect that copies
+   a descriptor but is neither a descriptor nor "-". */
+
+static const char acBadDescriptor[] =
+   "%s: bad file descriptor in redirection\n";
+
+/*--------------------------------------------------------------------*/
+
+/* Syntactically analyze the token array tokens.  If tokens contains
+   a syntax error, then return NULL.  Otherwise return a Pipeline
+   object whose Commands are built from the tokens, starting a new
+   Command at each "|", and running in the background if the tokens
+   end with "&".  The Pipeline and its Commands, which hold copies of
+   the values of the tokens, are allocated from oArena. */
+
+Pipeline_T synArr(DynArray_T tokens, Arena_T oArena)
 {
    /* synArr() uses a DFA approach.  It "reads" its characters from
       pcLine. The DFA has these four states: */
    enum LexState {STATE_START, STATE_COMMAND, 
-                  STATE_INREDIR, STATE_OUTREDIR};
+                  STATE_REDIR, STATE_BACKGROUND};
 
    /* The current state of the DFA. */
    enum LexState eState = STATE_START;
 
 
-   /* Will store the final Command object that is returned */
+   /* Will store the final Pipeline object that is returned, and
+      the Command that is its last stage */
+   Pipeline_T oPipeline;
    Command_T oCommand;
 
-   /* Will store the new Command's name */
-   char *pcName;
-
-   /* Stores the arguments parsed from the token DynArray as strings */
-   DynArray_T oArgs;
-
-   /* Stores input/output redirect locations */
-   char *pcInFile = NULL;
-   char *pcOutFile = NULL;
-
 
    /* Will store the "working" token */
    Token_T psToken;
 
-   /* Flags to track whether stdin or stdout has been redirected */
-   int iInFlag = 0;
-   int iOutFlag = 0;
-
-   /* Checks the success of functions */
-   int iSuccessful;
-
    /* Index variables */
    size_t u;
-   size_t uLen = DynArray_getLength(tokens);
-   size_t uArgIdx;
+   size_t uLen;
+
+   /* The number of characters in the tokens not yet read, plus one
+      per token */
+   size_t uTextLength = 0;
 
 
    assert(tokens != NULL);
+   assert(oArena != NULL);
 
-   /* Create an empty token DynArray object. */
-   oArgs = DynArray_new(0);
-   if (oArgs == NULL)
-   {perror(getPgmName()); exit(EXIT_FAILURE);}
+   /* Size the first Command's block for the values of all the
+      tokens. */
+   uLen = DynArray_getLength(tokens);
+   for (u = 0; u < uLen; u++)
+      uTextLength += strlen(Token_getVal(DynArray_get(tokens, u))) + 1;
+   oPipeline = newPipeline(oArena);
+   oCommand = newCommand(uTextLength, oArena);
+   Pipeline_addCommand(oPipeline, oCommand);
 
    for (u = 0; u < uLen; u++)
    {
@@ -78,6 +144,7 @@ Command_T synArr(DynArray_T tokens)
          perror(getPgmName()); 
          exit(EXIT_FAILURE);
       }
+      uTextLength -= strlen(Token_getVal(psToken)) + 1;
 
       switch (eState)
       {
@@ -94,19 +161,14 @@ Command_T synArr(DynArray_T tokens)
             {
                fprintf(stderr, "%s: missing command name\n", 
                        getPgmName());
-               /* Iterate through array and free all strings */
-               for (uArgIdx = 0; uArgIdx < DynArray_getLength(oArgs); 
-                    uArgIdx++) {
-                  free(DynArray_get(oArgs, uArgIdx));
-               }
-               DynArray_free(oArgs);
                return NULL;
             }
             /* Ordinary token */
             else
             {
                /* Store as the command name */
-               pcName = Token_getVal(psToken);
+               synAddWord(oCommand, Token_getVal(psToken),
+                          strlen(Token_getVal(psToken)), WORD_ARG);
                eState = STATE_COMMAND;
             }
             break;
@@ -116,163 +178,741 @@ Command_T synArr(DynArray_T tokens)
             /* NULL, or EOF */
             if (Token_getVal(psToken) == NULL)
             {
-               /* Exit, makes Command object */
-               oCommand = newCommand(pcName, oArgs, 
-                                     pcInFile, pcOutFile);
-               if (!oCommand)
-               {perror(getPgmName()); exit(EXIT_FAILURE);}
-               return oCommand;
+               /* Exit, returns Pipeline object */
+               return oPipeline;
             }
             else if (Token_getType(psToken) == SPECIAL_TOKEN && 
-                     strcmp(Token_getVal(psToken), "<") == 0)
+                     strcmp(Token_getVal(psToken), "|") == 0)
             {
-               /* If flag already set, can't have two stdin redirects */
-               if(iInFlag) {
-                  fprintf(stderr, 
-                         "%s: multiple redirection of standard input\n",
-                         getPgmName());
-                  /* Iterate through array and free all strings */
-                  for (uArgIdx = 0; uArgIdx < DynArray_getLength(oArgs);
-                       uArgIdx++) {
-                     free(DynArray_get(oArgs, uArgIdx));
-                  }
-                  DynArray_free(oArgs);
-                  return NULL;
-               }
-               else {
-                  /* Set iInFlag */
-                  iInFlag = 1;
-                  eState = STATE_INREDIR;
-               }
+               /* The next stage reads from the pipe, unless its
+                  redirects say otherwise */
+               oCommand = newCommand(uTextLength, oArena);
+               Pipeline_addCommand(oPipeline, oCommand);
+               eState = STATE_START;
             }
             else if (Token_getType(psToken) == SPECIAL_TOKEN && 
-                     strcmp(Token_getVal(psToken), ">") == 0)
+                     strcmp(Token_getVal(psToken), "&") == 0)
             {
-               /* If flag set, can't have two stdout redirects */
-               if(iOutFlag) {
-                  fprintf(stderr, 
-                        "%s: multiple redirection of standard output\n",
-                        getPgmName());
-                  /* Iterate through array and free all strings */
-                  for (uArgIdx = 0; uArgIdx < DynArray_getLength(oArgs);
-                       uArgIdx++) {
-                     free(DynArray_get(oArgs, uArgIdx));
-                  }
-                  DynArray_free(oArgs);
-                  return NULL;
-               }
-               else {
-                  /* Set iOutFlag */
-                  iOutFlag = 1;
-                  eState = STATE_OUTREDIR;
-               }
+               /* The pipeline runs in the background */
+               Pipeline_setBackground(oPipeline);
+               eState = STATE_BACKGROUND;
+            }
+            /* Any other special token is a redirect operator, and
+               the redirects are applied in order, so a later one
+               of a descriptor overrides an earlier one or a pipe */
+            else if (Token_getType(psToken) == SPECIAL_TOKEN)
+            {
+               synAddRedirect(oCommand, Token_getVal(psToken),
+                              strlen(Token_getVal(psToken)));
+               eState = STATE_REDIR;
             }
             /* Ordinary token is just added to arguments */
             else
             {
-               /* Add the token to the oArgs array */
-               iSuccessful = DynArray_add(oArgs, Token_getVal(psToken));
-               if (!iSuccessful)
-               {perror(getPgmName()); exit(EXIT_FAILURE);}
+               /* Add the token to the Command's arguments */
+               synAddWord(oCommand, Token_getVal(psToken),
+                          strlen(Token_getVal(psToken)), WORD_ARG);
 
                eState = STATE_COMMAND;
             }
             break;
 
-            /* Handle the INREDIR state. */
-         case STATE_INREDIR:
+            /* Handle the REDIR state. */
+         case STATE_REDIR:
             if (Token_getVal(psToken) == NULL || 
                 Token_getType(psToken) == SPECIAL_TOKEN)
             {
                /* Token immediately after must be an ordinary token. */
-               fprintf(stderr, 
-                   "%s: standard input redirection without file name\n",
-                   getPgmName());
-               /* Iterate through array and free all strings */
-               for (uArgIdx = 0; uArgIdx < DynArray_getLength(oArgs); 
-                    uArgIdx++) {
-                  free(DynArray_get(oArgs, uArgIdx));
-               }
-               DynArray_free(oArgs);
+               fprintf(stderr, synMissingWord(oCommand), getPgmName());
                return NULL;
             }
             /* Ordinary token */
             else
             {
-               /* Store the ordinary token as the stdin location. */
-               pcInFile = Token_getVal(psToken);
+               /* Store the ordinary token as the redirect's word. */
+               Command_addChars(oCommand, Token_getVal(psToken),
+                                strlen(Token_getVal(psToken)));
+               if (! Command_endWord(oCommand, WORD_REDIRECT))
+               {
+                  fprintf(stderr, acBadDescriptor, getPgmName());
+                  return NULL;
+               }
                eState = STATE_COMMAND;
             }
             break;
 
-            /* Handle the OUTREDIR state. */
-         case STATE_OUTREDIR:
-            if (Token_getVal(psToken) == NULL || 
-                Token_getType(psToken) == SPECIAL_TOKEN)
+            /* Handle the BACKGROUND state. */
+         case STATE_BACKGROUND:
+            /* Nothing can follow the "&". */
+            fprintf(stderr, "%s: & must end the command line\n",
+                    getPgmName());
+            return NULL;
+
+         default:
+            assert(0);
+      }
+   }
+   if (eState == STATE_COMMAND || eState == STATE_BACKGROUND)
+   {
+      /* Reaches the end of all tokens; exit, returns Pipeline
+         object */
+      return oPipeline;
+   }
+   else if (eState == STATE_START && Pipeline_getLength(oPipeline) > 1)
+   {
+      /* A pipe must be followed by a command. */
+      fprintf(stderr, "%s: missing command name\n", getPgmName());
+      return NULL;
+   }
+   else if (eState == STATE_REDIR)
+   {
+      /* Token immediately after must be an ordinary token. */
+      fprintf(stderr, synMissingWord(oCommand), getPgmName());
+      return NULL;
+   }
+   else 
+   {
+      return NULL;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Syntactically analyze the token stream oStream with the same DFA as
+   synArr().  If oStream contains a syntax error, then write a message
+   to stderr and return NULL.  Otherwise return a Pipeline object
+   whose Commands are built from the tokens.  The Pipeline, its
+   Commands, their argument arrays and null-terminated copies of the
+   token values are allocated from oArena.  The values are copied
+   once, straight into the block of their Command. */
+
+Pipeline_T synStream(TokenStream_T oStream, Arena_T oArena)
+{
+   enum SynState {STATE_START, STATE_COMMAND,
+                  STATE_REDIR, STATE_BACKGROUND};
+
+   /* The current state of the DFA. */
+   enum SynState eState = STATE_START;
+
+   /* The Pipeline being built, and its last stage */
+   Pipeline_T oPipeline;
+   Command_T oCommand;
+
+   /* The working token */
+   const char *pcText;
+   size_t uTextLength;
+   enum TokenType eType;
+
+   /* The number of characters in the tokens not yet read, plus one
+      per token */
+   size_t uTotalLength;
+
+   /* Index variables */
+   size_t u;
+   size_t uLen;
+
+   assert(oStream != NULL);
+   assert(oArena != NULL);
+
+   /* Size the first Command's block for the values of all the
+      tokens. */
+   uLen = TokenStream_getLength(oStream);
+   uTotalLength = 0;
+   for (u = 0; u < uLen; u++)
+   {
+      TokenStream_getText(oStream, u, &uTextLength);
+      uTotalLength += uTextLength + 1;
+   }
+   oPipeline = newPipeline(oArena);
+   oCommand = newCommand(uTotalLength, oArena);
+   Pipeline_addCommand(oPipeline, oCommand);
+
+   for (u = 0; u < uLen; u++)
+   {
+      eType = TokenStream_getType(oStream, u);
+      pcText = TokenStream_getText(oStream, u, &uTextLength);
+      uTotalLength -= uTextLength + 1;
+
+      switch (eState)
+      {
+         /* Handle the START state. */
+         case STATE_START:
+            /* Can't start with a special character */
+            if (eType == SPECIAL_TOKEN)
             {
-               /* Token immediately after must be an ordinary token. */
-               fprintf(stderr, 
-                  "%s: standard output redirection without file name\n",
-                  getPgmName());
-               /* Iterate through array and free all strings */
-               for (uArgIdx = 0; uArgIdx < DynArray_getLength(oArgs); 
-                    uArgIdx++) {
-                  free(DynArray_get(oArgs, uArgIdx));
-               }
-               DynArray_free(oArgs);
+               fprintf(stderr, "%s: missing command name\n",
+                       getPgmName());
                return NULL;
             }
-            /* Ordinary token */
+            synAddWord(oCommand, pcText, uTextLength, WORD_ARG);
+            eState = STATE_COMMAND;
+            break;
+
+            /* Handle the COMMAND state. */
+         case STATE_COMMAND:
+            /* Special tokens are a single '|' or '&', or a
+               redirect operator */
+            if (eType == SPECIAL_TOKEN && *pcText == '|')
+            {
+               /* The next stage reads from the pipe */
+               oCommand = newCommand(uTotalLength, oArena);
+               Pipeline_addCommand(oPipeline, oCommand);
+               eState = STATE_START;
+            }
+            else if (eType == SPECIAL_TOKEN && *pcText == '&')
+            {
+               Pipeline_setBackground(oPipeline);
+               eState = STATE_BACKGROUND;
+            }
+            else if (eType == SPECIAL_TOKEN)
+            {
+               synAddRedirect(oCommand, pcText, uTextLength);
+               eState = STATE_REDIR;
+            }
+            /* Ordinary token is just added to arguments */
             else
+               synAddWord(oCommand, pcText, uTextLength, WORD_ARG);
+            break;
+
+            /* Handle the REDIR state. */
+         case STATE_REDIR:
+            /* Token immediately after must be an ordinary token. */
+            if (eType == SPECIAL_TOKEN)
             {
-               /* Store the ordinary token as the stdin location. */
-               pcOutFile = Token_getVal(psToken);
-               eState = STATE_COMMAND;
+               fprintf(stderr, synMissingWord(oCommand), getPgmName());
+               return NULL;
+            }
+            if (! synAddWord(oCommand, pcText, uTextLength,
+                             WORD_REDIRECT))
+            {
+               fprintf(stderr, acBadDescriptor, getPgmName());
+               return NULL;
             }
+            eState = STATE_COMMAND;
             break;
 
+            /* Handle the BACKGROUND state. */
+         case STATE_BACKGROUND:
+            /* Nothing can follow the "&". */
+            fprintf(stderr, "%s: & must end the command line\n",
+                    getPgmName());
+            return NULL;
+
          default:
             assert(0);
       }
    }
-   if (eState == STATE_COMMAND)
+
+   switch (eState)
    {
-      /* Reaches the end of all tokens; exit, makes Command object */
-      oCommand = newCommand(pcName, oArgs, pcInFile, pcOutFile);
-      if (!oCommand)
-      {perror(getPgmName()); exit(EXIT_FAILURE);}
-      return oCommand;
+      case STATE_COMMAND:
+      case STATE_BACKGROUND:
+         return oPipeline;
+      case STATE_START:
+         /* An empty line is not an error, but a pipe must be
+            followed by a command */
+         if (Pipeline_getLength(oPipeline) > 1)
+            fprintf(stderr, "%s: missing command name\n",
+                    getPgmName());
+         return NULL;
+      case STATE_REDIR:
+         fprintf(stderr, synMissingWord(oCommand), getPgmName());
+         return NULL;
+      default:
+         assert(0);
+         return NULL;
    }
-   else if (eState == STATE_INREDIR)
+}
+
+/*--------------------------------------------------------------------*/
+
+/* A LineParser holds the state of the syntax DFA of synLine(), which
+   is fed one word or special character at a time as the lexical DFA
+   finds them. */
+
+struct LineParser
+{
+   /* The state of the syntax DFA. */
+   enum {PARSE_START, PARSE_COMMAND,
+         PARSE_REDIR, PARSE_BACKGROUND} eState;
+
+   /* The format of the message for the first syntax error, or NULL.
+      The message is written only if the line has no lexical error,
+      just as synStream() never sees a line that lexStream()
+      rejected. */
+   const char *pcError;
+
+   /* The Pipeline being built, and its last stage, whose words are
+      being built */
+   Pipeline_T oPipeline;
+   Command_T oCommand;
+
+   /* 1 iff the word being built has an unquoted "*", "?" or "[" */
+   int iPattern;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 iff any of the uLength characters at pc is "*", "?" or
+   "[".  Otherwise return 0. */
+
+static int synHasPattern(const char *pc, size_t uLength)
+{
+   size_t u;
+
+   for (u = 0; u < uLength; u++)
+      if (pc[u] == '*' || pc[u] == '?' || pc[u] == '[')
+         return 1;
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write to pcPattern the pattern of the word that the uLength
+   characters at pcSource of a line stand for, and return its length.
+   Each character of the word that is quoted or comes from a variable,
+   other than "/", and each "\", is preceded by a "\", so that only
+   the unquoted "*", "?" and "[" that pcSource shows are wildcards.
+   pcPattern must have room for twice the characters of the word. */
+
+static size_t synPattern(const char *pcSource, size_t uLength,
+                         char *pcPattern)
+{
+   size_t uPattern = 0;
+   size_t uRef;
+   const char *pcValue;
+   int iQuoted = 0;
+   size_t u = 0;
+
+   while (u < uLength)
    {
-      /* Token immediately after must be an ordinary token. */
-      fprintf(stderr, 
-              "%s: standard input redirection without file name\n", 
-              getPgmName());
-      /* Iterate through array and free all strings */
-      for (uArgIdx = 0; uArgIdx < DynArray_getLength(oArgs); 
-           uArgIdx++) {
-         free(DynArray_get(oArgs, uArgIdx));
+      if (pcSource[u] == '"')
+      {
+         iQuoted = ! iQuoted;
+         u++;
+         continue;
       }
-      DynArray_free(oArgs);
-      return NULL;
+      if (pcSource[u] == '$')
+      {
+         uRef = lexVariable(pcSource + u, &pcValue);
+         for (; *pcValue != '\0'; pcValue++)
+         {
+            if (*pcValue != '/')
+               pcPattern[uPattern++] = '\\';
+            pcPattern[uPattern++] = *pcValue;
+         }
+         u += uRef;
+         continue;
+      }
+      if ((iQuoted && pcSource[u] != '/') || pcSource[u] == '\\')
+         pcPattern[uPattern++] = '\\';
+      pcPattern[uPattern++] = pcSource[u++];
    }
-   else if (eState == STATE_OUTREDIR)
+   return uPattern;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* End the word being built in oCommand as its next argument.  If
+   iPattern and it matches any paths, replace it with those paths
+   instead, each as an argument of its own.  The word is the one that
+   the uLength characters at pcSource of the line stand for. */
+
+static void synArg(Command_T oCommand, int iPattern,
+                   const char *pcSource, size_t uLength)
+{
+   const char **ppcPaths;
+   char *pcPattern;
+   size_t uPattern;
+   size_t uPaths;
+   size_t u;
+
+   if (iPattern && oSynGlob != NULL)
    {
-      /* Token immediately after must be an ordinary token. */
-      fprintf(stderr, 
-              "%s: standard output redirection without file name\n", 
-              getPgmName());
-      /* Iterate through array and free all strings */
-      for (uArgIdx = 0; uArgIdx < DynArray_getLength(oArgs); 
-           uArgIdx++) {
-         free(DynArray_get(oArgs, uArgIdx));
+      pcPattern = (char*)malloc(2 * Command_getWordLength(oCommand) + 1);
+      if (pcPattern == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+      uPattern = synPattern(pcSource, uLength, pcPattern);
+      uPaths = PathGlob_expand(oSynGlob, pcPattern, uPattern,
+                               &ppcPaths);
+      free(pcPattern);
+      if (uPaths > 0)
+      {
+         Command_discardWord(oCommand);
+         for (u = 0; u < uPaths; u++)
+            synAddWord(oCommand, ppcPaths[u], strlen(ppcPaths[u]),
+                       WORD_ARG);
+         return;
       }
-      DynArray_free(oArgs);
-      return NULL;
    }
-   else 
+   Command_endWord(oCommand, WORD_ARG);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* End the word being built in the Command of psParser, which the
+   uLength characters at pcSource of the line stand for, and feed it
+   to the syntax DFA of psParser.  The DFA is that of synStream(), for
+   an ordinary token, except that an argument is expanded as a
+   pattern if psParser says that it is one, and then marks the
+   Pipeline with Pipeline_setExpands(). */
+
+static void synWord(struct LineParser *psParser, const char *pcSource,
+                    size_t uLength)
+{
+   int iPattern;
+
+   /* After an error, the rest of the line is only lexed. */
+   if (psParser->pcError != NULL)
+      return;
+
+   /* A lone "[" is the test command, not a pattern */
+   iPattern = psParser->iPattern
+      && ! (uLength == 1 && pcSource[0] == '[');
+
+   switch (psParser->eState)
+   {
+      case PARSE_START:
+      case PARSE_COMMAND:
+         if (iPattern)
+            Pipeline_setExpands(psParser->oPipeline);
+         synArg(psParser->oCommand, iPattern, pcSource, uLength);
+         psParser->eState = PARSE_COMMAND;
+         break;
+
+      case PARSE_REDIR:
+         if (! Command_endWord(psParser->oCommand, WORD_REDIRECT))
+            psParser->pcError = acBadDescriptor;
+         psParser->eState = PARSE_COMMAND;
+         break;
+
+      case PARSE_BACKGROUND:
+         psParser->pcError = "%s: & must end the command line\n";
+         break;
+
+      default:
+         assert(0);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Feed the special token that is the uLength characters at pc ("|",
+   "&" or a redirect operator) to the syntax DFA of psParser.  The DFA
+   is that of synStream(), for a special token.  uRest is the number
+   of characters of the line after the token, from which the stage
+   that a pipe starts is built. */
+
+static void synSpecial(struct LineParser *psParser, const char *pc,
+                       size_t uLength, size_t uRest, Arena_T oArena)
+{
+   if (psParser->pcError != NULL)
+      return;
+
+   switch (psParser->eState)
+   {
+      case PARSE_START:
+         psParser->pcError = "%s: missing command name\n";
+         break;
+
+      case PARSE_COMMAND:
+         if (*pc == '|')
+         {
+            /* The next stage reads from the pipe */
+            psParser->oCommand = newCommand(uRest, oArena);
+            Pipeline_addCommand(psParser->oPipeline, psParser->oCommand);
+            psParser->eState = PARSE_START;
+         }
+         else if (*pc == '&')
+         {
+            Pipeline_setBackground(psParser->oPipeline);
+            psParser->eState = PARSE_BACKGROUND;
+         }
+         else
+         {
+            synAddRedirect(psParser->oCommand, pc, uLength);
+            psParser->eState = PARSE_REDIR;
+         }
+         break;
+
+      case PARSE_REDIR:
+         psParser->pcError = synMissingWord(psParser->oCommand);
+         break;
+
+      case PARSE_BACKGROUND:
+         psParser->pcError = "%s: & must end the command line\n";
+         break;
+
+      default:
+         assert(0);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 iff the word being built in the Command of psParser is the
+   delimiter of a here-document.  Otherwise return 0. */
+
+static int synIsHereDocWord(struct LineParser *psParser)
+{
+   const struct Redirect *psRedirects;
+   size_t uRedirects;
+
+   if (psParser->pcError != NULL || psParser->eState != PARSE_REDIR)
+      return 0;
+   psRedirects = Command_getRedirects(psParser->oCommand);
+   uRedirects = Command_getRedirectCount(psParser->oCommand);
+   return psRedirects[uRedirects - 1].eKind == REDIRECT_HEREDOC;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Make synLine() expand the patterns among the arguments with
+   oGlob, or, if oGlob is NULL, leave them as they are. */
+
+void synSetGlob(PathGlob_T oGlob)
+{
+   oSynGlob = oGlob;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Lexically and syntactically analyze string pcLine in one pass.
+   The lexical DFA is that of lexStream(); instead of recording
+   tokens, it writes the characters of each word straight into the
+   block of the current Command, and feeds the finished word to the
+   syntax DFA of synStream(), which decides what part of the Command
+   it is.  Each reference to a variable is replaced as lexLine()
+   replaces it, and so the words are those of lexLine(), not of
+   lexStream(); an argument with an unquoted "*", "?" or "[" is then
+   replaced by the paths that it matches, if synSetGlob() has set a
+   PathGlob and there are any.  Whatever lexSetVars() and
+   synSetGlob() have set, the Pipeline is marked with
+   Pipeline_setExpands() if the line refers to a variable or has
+   such an argument, other than a lone "[".  If pcLine contains an
+   error, write the message that lexStream() or synStream() would
+   have written and return NULL.  The Pipeline and its Commands are
+   allocated from oArena. */
+
+Pipeline_T synLine(const char *pcLine, Arena_T oArena)
+{
+   enum LexState {STATE_START, STATE_SPECIAL,
+                  STATE_ORDINARY, STATE_QUOTE};
+
+   /* The current state of the lexical DFA. */
+   enum LexState eState = STATE_START;
+
+   /* The syntax DFA. */
+   struct LineParser sParser;
+
+   /* An index into pcLine, and the length of pcLine. */
+   size_t uLineIndex = 0;
+   size_t uLineLength;
+
+   /* The length of a run of characters that can be copied at once */
+   size_t uRun;
+
+   /* The number of characters of a '$' and what follows it that
+      stand for pcValue */
+   size_t uRef;
+   const char *pcValue;
+
+   /* The offset in pcLine where the current word began, and 1 iff it
+      contains quotes */
+   size_t uWordStart = 0;
+   int iQuoted = 0;
+
+   /* The offset in pcLine and the length of a special token */
+   size_t uSpecialStart;
+   size_t uSpecial;
+
+   char c;
+
+   assert(pcLine != NULL);
+   assert(oArena != NULL);
+
+   uLineLength = strlen(pcLine);
+   sParser.eState = PARSE_START;
+   sParser.pcError = NULL;
+   sParser.iPattern = 0;
+   sParser.oPipeline = newPipeline(oArena);
+   sParser.oCommand = newCommand(uLineLength, oArena);
+   Pipeline_addCommand(sParser.oPipeline, sParser.oCommand);
+
+   for (;;)
+   {
+      /* Inside a word or a quote, copy the whole run of characters
+         that the DFA would append one at a time. */
+      if (eState == STATE_ORDINARY || eState == STATE_QUOTE)
+      {
+         if (eState == STATE_ORDINARY)
+         {
+            uRun = lexOrdinaryRun(pcLine + uLineIndex);
+            if (! sParser.iPattern)
+               sParser.iPattern =
+                  synHasPattern(pcLine + uLineIndex, uRun);
+         }
+         else
+            uRun = lexQuotedRun(pcLine + uLineIndex);
+         Command_addChars(sParser.oCommand, pcLine + uLineIndex, uRun);
+         uLineIndex += uRun;
+      }
+
+      /* "Read" the next character from pcLine. */
+      c = pcLine[uLineIndex++];
+
+      /* Append what a '$' stands for to the word, starting one
+         outside a word, without looking at it again.  The delimiter
+         of a here-document is not expanded. */
+      if (c == '$')
+      {
+         if (synIsHereDocWord(&sParser))
+         {
+            uRef = 1;
+            pcValue = "$";
+         }
+         else
+         {
+            if (lexIsReference(pcLine + uLineIndex - 1))
+               Pipeline_setExpands(sParser.oPipeline);
+            uRef = lexVariable(pcLine + uLineIndex - 1, &pcValue);
+         }
+         if (uRef == 0)
+         {
+            fprintf(stderr, "%s: bad substitution\n", getPgmName());
+            return NULL;
+         }
+         if (eState == STATE_START || eState == STATE_SPECIAL)
+         {
+            uWordStart = uLineIndex - 1;
+            iQuoted = 0;
+            sParser.iPattern = 0;
+            eState = STATE_ORDINARY;
+         }
+         Command_addChars(sParser.oCommand, pcValue, strlen(pcValue));
+         uLineIndex += uRef - 1;
+         continue;
+      }
+
+      switch (eState)
+      {
+         /* The START and SPECIAL states accept the same input. */
+         case STATE_START:
+         case STATE_SPECIAL:
+            if (c == '\0')
+               break;
+            else if (c == '<' || c == '>' || c == '|' || c == '&')
+            {
+               uSpecial = lexSpecialLength(pcLine + uLineIndex - 1);
+               uLineIndex += uSpecial - 1;
+               synSpecial(&sParser, pcLine + uLineIndex - uSpecial,
+                          uSpecial, uLineLength - uLineIndex, oArena);
+               eState = STATE_SPECIAL;
+            }
+            else if (c == '"')
+            {
+               uWordStart = uLineIndex - 1;
+               iQuoted = 1;
+               sParser.iPattern = 0;
+               eState = STATE_QUOTE;
+            }
+            else if (c != ' ')
+            {
+               uWordStart = uLineIndex - 1;
+               iQuoted = 0;
+               sParser.iPattern = synHasPattern(&c, 1);
+               Command_addChars(sParser.oCommand, &c, 1);
+               eState = STATE_ORDINARY;
+            }
+            break;
+
+            /* Handle the ORDINARY state. */
+         case STATE_ORDINARY:
+            if (c == '"')
+            {
+               iQuoted = 1;
+               eState = STATE_QUOTE;
+            }
+            else if ((c == '<' || c == '>') && ! iQuoted
+                     && lexIsDescriptor(pcLine + uWordStart,
+                                        uLineIndex - 1 - uWordStart))
+            {
+               /* Unquoted digits right before a redirect operator
+                  are not a word, but part of the operator */
+               Command_discardWord(sParser.oCommand);
+               uSpecialStart = uWordStart;
+               uSpecial = lexSpecialLength(pcLine + uLineIndex - 1);
+               uLineIndex += uSpecial - 1;
+               synSpecial(&sParser, pcLine + uSpecialStart,
+                          uLineIndex - uSpecialStart,
+                          uLineLength - uLineIndex, oArena);
+               eState = STATE_SPECIAL;
+            }
+            else
+            {
+               /* The word ends here, at a space, a special character
+                  or the end of the line.  A word that is nothing but
+                  references to unset variables is no word. */
+               if (Command_getWordLength(sParser.oCommand) > 0
+                   || iQuoted)
+                  synWord(&sParser, pcLine + uWordStart,
+                          uLineIndex - 1 - uWordStart);
+               if (c == '<' || c == '>' || c == '|' || c == '&')
+               {
+                  uSpecial = lexSpecialLength(pcLine + uLineIndex - 1);
+                  uLineIndex += uSpecial - 1;
+                  synSpecial(&sParser, pcLine + uLineIndex - uSpecial,
+                             uSpecial, uLineLength - uLineIndex,
+                             oArena);
+                  eState = STATE_SPECIAL;
+               }
+               else
+                  eState = STATE_START;
+            }
+            break;
+
+            /* Handle the QUOTE state. */
+         case STATE_QUOTE:
+            /* Cannot exit with an open quote */
+            if (c == '\0')
+            {
+               fprintf(stderr, "%s: unmatched quote\n", getPgmName());
+               return NULL;
+            }
+            eState = STATE_ORDINARY;
+            break;
+
+         default:
+            assert(0);
+      }
+
+      if (c == '\0')
+         break;
+   }
+
+   if (sParser.pcError != NULL)
    {
+      fprintf(stderr, sParser.pcError, getPgmName());
       return NULL;
    }
+
+   switch (sParser.eState)
+   {
+      case PARSE_COMMAND:
+      case PARSE_BACKGROUND:
+         return sParser.oPipeline;
+      case PARSE_START:
+         /* An empty line is not an error, but a pipe must be
+            followed by a command */
+         if (Pipeline_getLength(sParser.oPipeline) > 1)
+            fprintf(stderr, "%s: missing command name\n",
+                    getPgmName());
+         return NULL;
+      case PARSE_REDIR:
+         fprintf(stderr, synMissingWord(sParser.oCommand),
+                 getPgmName());
+         return NULL;
+      default:
+         assert(0);
+         return NULL;
+   }
 }
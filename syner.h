@@ -8,16 +8,60 @@
 
 #include <stddef.h>
 #include "dynarray.h"
+#include "token.h"
 #include "command.h"
+#include "pipeline.h"
+#include "arena.h"
+#include "pathglob.h"
 
 /*--------------------------------------------------------------------*/
 
-/* synArr lexically analyzes the token array token.  If pcLine 
-   contains a lexical error, then return NULL.  Otherwise return a 
-   Command object using the tokens from tokens.  The caller owns the 
-   Command object. */
+/* synArr syntactically analyzes the token array tokens.  If tokens
+   contains a syntax error, then return NULL.  Otherwise return a
+   Pipeline object with one Command for each command of the line,
+   the commands being separated by "|" tokens.  A final "&" token
+   makes the Pipeline run in the background.  The Pipeline and its
+   Commands, which hold copies of the values of the tokens, are
+   allocated from oArena. */
 
-Command_T synArr(DynArray_T tokens);
+Pipeline_T synArr(DynArray_T tokens, Arena_T oArena);
+
+/*--------------------------------------------------------------------*/
+
+/* synStream syntactically analyzes the token stream oStream in the
+   same way as synArr(), writing the same error messages.  The
+   Pipeline, its Commands and copies of the token values that they
+   use are allocated from oArena. */
+
+Pipeline_T synStream(TokenStream_T oStream, Arena_T oArena);
+
+/*--------------------------------------------------------------------*/
+
+/* synLine lexically and syntactically analyzes the line pcLine in a
+   single pass, without building tokens.  It returns the same
+   Pipeline, or writes the same error message and returns NULL, as
+   lexStream() followed by synStream(), except that it replaces each
+   reference to a variable as lexLine() does, writing the value
+   straight into its word, and that it replaces each argument that
+   is a pattern with the paths that it matches, as synSetGlob()
+   describes.  Whatever lexSetVars() and synSetGlob() have set, the
+   Pipeline is marked with Pipeline_setExpands() if the line refers
+   to a variable or has such an argument, other than a lone "[".
+   The Pipeline, its Commands and their strings are allocated from
+   oArena. */
+
+Pipeline_T synLine(const char *pcLine, Arena_T oArena);
+
+/*--------------------------------------------------------------------*/
+
+/* Make synLine() expand each argument that has an unquoted "*", "?"
+   or "[" as a pattern with oGlob, replacing it with the paths that
+   it matches, in order, or leaving it as it is if it matches none.
+   The name of a redirect is never expanded, and a quoted character
+   or one that came from a variable only matches itself.  If oGlob
+   is NULL, as it is until this is called, nothing is expanded. */
+
+void synSetGlob(PathGlob_T oGlob);
 
 /*--------------------------------------------------------------------*/
 #endif
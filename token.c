@@ -26,28 +26,61 @@ struct Token
 
 /*--------------------------------------------------------------------*/
 
-/* Create and return a token whose type is eTokenType and whose                                   
-   value consists of string pcValue.  The caller owns the token. */
+/* The initial number of tokens a TokenStream has room for. */
+enum {INITIAL_STREAM_LENGTH = 16};
+
+/* The factor by which a TokenStream's arrays grow. */
+enum {GROWTH_FACTOR = 2};
+
+/*--------------------------------------------------------------------*/
+
+/* A TokenStream keeps its tokens in parallel arrays.  Offsets below
+   uLineSpan index pcLine; larger offsets index pcText, after
+   subtracting uLineSpan. */
+
+struct TokenStream
+{
+   /* The line that the tokens were read from, and its length plus
+      one for the null character. */
+   const char *pcLine;
+   size_t uLineSpan;
+
+   /* The text of the tokens that contained quotes, or NULL. */
+   char *pcText;
+
+   /* The type, offset and length of each token. */
+   enum TokenType *aeType;
+   size_t *auOffset;
+   size_t *auLength;
+
+   /* The number of tokens, and the number the arrays can hold. */
+   size_t uLength;
+   size_t uPhysLength;
+
+   /* The arena that holds the stream and its arrays. */
+   Arena_T oArena;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return a token whose type is eTokenType and whose
+   value is a copy of string pcValue.  The token is allocated from
+   oArena, which owns it. */
 
 struct Token *newToken(enum TokenType eTokenType,
-                       char *pcValue)
+                       char *pcValue, Arena_T oArena)
 {
    struct Token *psToken;
 
    assert(pcValue != NULL);
+   assert(oArena != NULL);
 
-   /* Malloc necessary space for Token object */
-   psToken = (struct Token*)malloc(sizeof(struct Token));
-   if (psToken == NULL)
-   {perror(getPgmName()); exit(EXIT_FAILURE);}
-
+   psToken = (struct Token*)Arena_alloc(oArena, sizeof(struct Token));
    psToken->eType = eTokenType;
 
-   /* Malloc necessary space so the Token can own its value */
-   psToken->pcValue = (char*)malloc(strlen(pcValue) + 1);
-   if (psToken->pcValue == NULL)
-   {perror(getPgmName()); exit(EXIT_FAILURE);}
-   strcpy(psToken->pcValue, pcValue);
+   /* Copy the value so the Token does not depend on the caller's
+      buffer */
+   psToken->pcValue = Arena_strndup(oArena, pcValue, strlen(pcValue));
 
    return psToken;
 }
@@ -72,45 +105,211 @@ char *Token_getVal(Token_T psToken){
 
 /*--------------------------------------------------------------------*/
 
-/* Write all tokens in oTokens to stdout.  Writes tokens in order of
-   appearance, followed by whether it is ordinary or special. */
+/* Create and return an empty token stream over string pcLine, whose
+   length is uLineLength.  The stream is allocated from oArena, which
+   owns it, and refers to pcLine, which must remain valid for as long
+   as the stream is used. */
 
-void writeTokens(DynArray_T oTokens)
+TokenStream_T newTokenStream(const char *pcLine, size_t uLineLength,
+                             Arena_T oArena)
+{
+   struct TokenStream *psStream;
+
+   assert(pcLine != NULL);
+   assert(oArena != NULL);
+
+   psStream = (struct TokenStream*)Arena_alloc(oArena,
+                                               sizeof(struct TokenStream));
+   psStream->pcLine = pcLine;
+   psStream->uLineSpan = uLineLength + 1;
+   psStream->pcText = NULL;
+   psStream->uLength = 0;
+   psStream->uPhysLength = INITIAL_STREAM_LENGTH;
+   psStream->aeType = (enum TokenType*)Arena_alloc(oArena,
+      INITIAL_STREAM_LENGTH * sizeof(enum TokenType));
+   psStream->auOffset = (size_t*)Arena_alloc(oArena,
+      INITIAL_STREAM_LENGTH * sizeof(size_t));
+   psStream->auLength = (size_t*)Arena_alloc(oArena,
+      INITIAL_STREAM_LENGTH * sizeof(size_t));
+   psStream->oArena = oArena;
+
+   return psStream;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Append a token of type eTokenType, with offset uOffset and length
+   uLength, to psStream, growing its arrays if they are full. */
+
+static void TokenStream_add(struct TokenStream *psStream,
+                            enum TokenType eTokenType,
+                            size_t uOffset, size_t uLength)
+{
+   size_t uPhysLength;
+   enum TokenType *aeType;
+   size_t *auOffset;
+   size_t *auLength;
+
+   if (psStream->uLength == psStream->uPhysLength)
+   {
+      /* The old arrays stay in the arena until it is reset. */
+      uPhysLength = psStream->uPhysLength * GROWTH_FACTOR;
+      aeType = (enum TokenType*)Arena_alloc(psStream->oArena,
+         uPhysLength * sizeof(enum TokenType));
+      auOffset = (size_t*)Arena_alloc(psStream->oArena,
+         uPhysLength * sizeof(size_t));
+      auLength = (size_t*)Arena_alloc(psStream->oArena,
+         uPhysLength * sizeof(size_t));
+      memcpy(aeType, psStream->aeType,
+             psStream->uLength * sizeof(enum TokenType));
+      memcpy(auOffset, psStream->auOffset,
+             psStream->uLength * sizeof(size_t));
+      memcpy(auLength, psStream->auLength,
+             psStream->uLength * sizeof(size_t));
+      psStream->aeType = aeType;
+      psStream->auOffset = auOffset;
+      psStream->auLength = auLength;
+      psStream->uPhysLength = uPhysLength;
+   }
+
+   psStream->aeType[psStream->uLength] = eTokenType;
+   psStream->auOffset[psStream->uLength] = uOffset;
+   psStream->auLength[psStream->uLength] = uLength;
+   psStream->uLength++;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Append to oStream a token of type eTokenType whose value is the
+   uLength characters of the line that begin at offset uOffset. */
+
+void TokenStream_addSlice(TokenStream_T oStream,
+                          enum TokenType eTokenType,
+                          size_t uOffset, size_t uLength)
+{
+   assert(oStream != NULL);
+   assert(uOffset + uLength < oStream->uLineSpan);
+
+   TokenStream_add(oStream, eTokenType, uOffset, uLength);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the text buffer of oStream, which holds at least as many
+   characters as its line.  Tokens that need their quotes removed are
+   written there and added with TokenStream_addText(). */
+
+char *TokenStream_getTextBuffer(TokenStream_T oStream)
+{
+   assert(oStream != NULL);
+
+   /* Most lines have no quotes, so allocate the buffer on demand. */
+   if (oStream->pcText == NULL)
+      oStream->pcText = (char*)Arena_alloc(oStream->oArena,
+                                           oStream->uLineSpan);
+   return oStream->pcText;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Append to oStream an ordinary token whose value is the uLength
+   characters of its text buffer that begin at offset uOffset. */
+
+void TokenStream_addText(TokenStream_T oStream, size_t uOffset,
+                         size_t uLength)
+{
+   assert(oStream != NULL);
+   assert(oStream->pcText != NULL);
+   assert(uOffset + uLength < oStream->uLineSpan);
+
+   TokenStream_add(oStream, ORDINARY_TOKEN,
+                   oStream->uLineSpan + uOffset, uLength);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the number of tokens in oStream. */
+
+size_t TokenStream_getLength(TokenStream_T oStream)
+{
+   assert(oStream != NULL);
+   return oStream->uLength;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns the type (SPECIAL_TOKEN or ORDINARY_TOKEN) of token uIndex
+   of oStream. */
+
+enum TokenType TokenStream_getType(TokenStream_T oStream, size_t uIndex)
+{
+   assert(oStream != NULL);
+   assert(uIndex < oStream->uLength);
+   return oStream->aeType[uIndex];
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Returns a pointer to the characters of token uIndex of oStream,
+   and stores their number in *puLength.  The characters are not
+   followed by a null character. */
+
+const char *TokenStream_getText(TokenStream_T oStream, size_t uIndex,
+                                size_t *puLength)
+{
+   size_t uOffset;
+
+   assert(oStream != NULL);
+   assert(uIndex < oStream->uLength);
+   assert(puLength != NULL);
+
+   *puLength = oStream->auLength[uIndex];
+   uOffset = oStream->auOffset[uIndex];
+   if (uOffset < oStream->uLineSpan)
+      return oStream->pcLine + uOffset;
+   return oStream->pcText + (uOffset - oStream->uLineSpan);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write all tokens in oStream to stdout in the same format as
+   writeTokens(). */
+
+void writeTokenStream(TokenStream_T oStream)
 {
-   /* Index variables to iterate through Token DynArray */
    size_t u;
+   const char *pcText;
    size_t uLength;
-
    char* sTokenType;
-   
-   struct Token *psToken;
 
-   assert(oTokens != NULL);
+   assert(oStream != NULL);
 
-   uLength = DynArray_getLength(oTokens);
-
-   for (u = 0; u < uLength; u++)
+   for (u = 0; u < oStream->uLength; u++)
    {
-      printf("Token: ");
-      psToken = DynArray_get(oTokens, u);
+      pcText = TokenStream_getText(oStream, u, &uLength);
 
-      if(psToken->eType == SPECIAL_TOKEN)
+      if(oStream->aeType[u] == SPECIAL_TOKEN)
          sTokenType = "special";
       else
          sTokenType = "ordinary";
 
-      printf("%s (%s)\n", psToken->pcValue, sTokenType);
+      printf("Token: %.*s (%s)\n", (int)uLength, pcText, sTokenType);
    }
 }
 
 /*--------------------------------------------------------------------*/
 
-/* Free all of the tokens in oTokens. */
+/* Write all tokens in oTokens to stdout.  Writes tokens in order of
+   appearance, followed by whether it is ordinary or special. */
 
-void freeTokens(DynArray_T oTokens)
+void writeTokens(DynArray_T oTokens)
 {
+   /* Index variables to iterate through Token DynArray */
    size_t u;
    size_t uLength;
+
+   char* sTokenType;
+   
    struct Token *psToken;
 
    assert(oTokens != NULL);
@@ -119,66 +318,16 @@ void freeTokens(DynArray_T oTokens)
 
    for (u = 0; u < uLength; u++)
    {
+      printf("Token: ");
       psToken = DynArray_get(oTokens, u);
-      free(psToken->pcValue);
-      free(psToken);
-   }
-}
-
-/*--------------------------------------------------------------------*/
-
-/* If no lines remain in psFile, then return NULL. Otherwise read a line                          
-   of psFile and return it as a string. The string does not contain a                             
-   terminating newline character. The caller owns the string. */
 
-char *readLine(FILE *psFile)
-{
-   enum {INITIAL_LINE_LENGTH = 2};
-   enum {GROWTH_FACTOR = 2};
-
-   size_t uLineLength = 0;
-   size_t uPhysLineLength = INITIAL_LINE_LENGTH;
-   char *pcLine;
-   int iChar;
-
-   assert(psFile != NULL);
-
-   /* If no lines remain, return NULL. */
-   if (feof(psFile))
-      return NULL;
-   iChar = fgetc(psFile);
-   if (iChar == EOF)
-      return NULL;
-
-   /* Allocate memory for the string. */
-   pcLine = (char*)malloc(uPhysLineLength);
-   if (pcLine == NULL)
-   {perror(getPgmName()); exit(EXIT_FAILURE);}
-
-   /* Read characters into the string. */
-   while ((iChar != '\n') && (iChar != EOF))
-   {
-      if (uLineLength == uPhysLineLength)
-      {
-         uPhysLineLength *= GROWTH_FACTOR;
-         pcLine = (char*)realloc(pcLine, uPhysLineLength);
-         if (pcLine == NULL)
-         {perror(getPgmName()); exit(EXIT_FAILURE);}
-      }
-      pcLine[uLineLength] = (char)iChar;
-      uLineLength++;
-      iChar = fgetc(psFile);
-   }
+      if(psToken->eType == SPECIAL_TOKEN)
+         sTokenType = "special";
+      else
+         sTokenType = "ordinary";
 
-   /* Append a null character to the string. */
-   if (uLineLength == uPhysLineLength)
-   {
-      uPhysLineLength++;
-      pcLine = (char*)realloc(pcLine, uPhysLineLength);
-      if (pcLine == NULL)
-      {perror(getPgmName()); exit(EXIT_FAILURE);}
+      printf("%s (%s)\n", psToken->pcValue, sTokenType);
    }
-   pcLine[uLineLength] = '\0';
-
-   return pcLine;
 }
+
+/*--------------------------------------------------------------------*/
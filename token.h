@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stddef.h>
 #include "dynarray.h"
+#include "arena.h"
 
 /*--------------------------------------------------------------------*/
 
@@ -24,9 +25,11 @@ typedef struct Token *Token_T;
 /*--------------------------------------------------------------------*/
 
 /* Create and return a token whose type is eTokenType and whose
-   value consists of string pcValue.  The caller owns the token. */
+   value is a copy of string pcValue.  The token is allocated from
+   oArena, which owns it. */
 
-Token_T newToken(enum TokenType eTokenType, char *pcValue);
+Token_T newToken(enum TokenType eTokenType, char *pcValue,
+                 Arena_T oArena);
 
 /*--------------------------------------------------------------------*/
 
@@ -42,24 +45,83 @@ char *Token_getVal(Token_T psToken);
 
 /*--------------------------------------------------------------------*/
 
-/* Write all tokens in oTokens to stdout.  Writes tokens in order of
-   appearance, followed by whether it is ordinary or special. */
+/* A TokenStream_T object holds the tokens of one line as parallel
+   arrays of type, offset and length.  Most tokens are slices of the
+   line itself; only tokens that contained quotes are copied, with
+   their quotes removed, into a text buffer owned by the stream. */
 
-void writeTokens(DynArray_T oTokens);
+typedef struct TokenStream *TokenStream_T;
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty token stream over string pcLine, whose
+   length is uLineLength.  The stream is allocated from oArena, which
+   owns it, and refers to pcLine, which must remain valid for as long
+   as the stream is used. */
+
+TokenStream_T newTokenStream(const char *pcLine, size_t uLineLength,
+                             Arena_T oArena);
+
+/*--------------------------------------------------------------------*/
+
+/* Append to oStream a token of type eTokenType whose value is the
+   uLength characters of the line that begin at offset uOffset. */
+
+void TokenStream_addSlice(TokenStream_T oStream,
+                          enum TokenType eTokenType,
+                          size_t uOffset, size_t uLength);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the text buffer of oStream, which holds at least as many
+   characters as its line.  Tokens that need their quotes removed are
+   written there and added with TokenStream_addText(). */
+
+char *TokenStream_getTextBuffer(TokenStream_T oStream);
+
+/*--------------------------------------------------------------------*/
+
+/* Append to oStream an ordinary token whose value is the uLength
+   characters of its text buffer that begin at offset uOffset. */
+
+void TokenStream_addText(TokenStream_T oStream, size_t uOffset,
+                         size_t uLength);
 
 /*--------------------------------------------------------------------*/
 
-/* Free all of the tokens in oTokens. */
+/* Returns the number of tokens in oStream. */
 
-void freeTokens(DynArray_T oTokens);
+size_t TokenStream_getLength(TokenStream_T oStream);
 
 /*--------------------------------------------------------------------*/
 
-/* If no lines remain in psFile, then return NULL. Otherwise read a line
-   of psFile and return it as a string. The string does not contain a
-   terminating newline character. The caller owns the string. */
+/* Returns the type (SPECIAL_TOKEN or ORDINARY_TOKEN) of token uIndex
+   of oStream. */
+
+enum TokenType TokenStream_getType(TokenStream_T oStream, size_t uIndex);
+
+/*--------------------------------------------------------------------*/
+
+/* Returns a pointer to the characters of token uIndex of oStream,
+   and stores their number in *puLength.  The characters are not
+   followed by a null character. */
+
+const char *TokenStream_getText(TokenStream_T oStream, size_t uIndex,
+                                size_t *puLength);
+
+/*--------------------------------------------------------------------*/
 
-char *readLine(FILE *psFile);
+/* Write all tokens in oStream to stdout in the same format as
+   writeTokens(). */
+
+void writeTokenStream(TokenStream_T oStream);
+
+/*--------------------------------------------------------------------*/
+
+/* Write all tokens in oTokens to stdout.  Writes tokens in order of
+   appearance, followed by whether it is ordinary or special. */
+
+void writeTokens(DynArray_T oTokens);
 
 /*--------------------------------------------------------------------*/
 
@@ -0,0 +1,351 @@
+/*--------------------------------------------------------------------*/
+/* usage.c                                                            */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#define _GNU_SOURCE
+
+#include "usage.h"
+#include "pipeline.h"
+#include "command.h"
+#include "ish.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The number of buckets of a histogram.  Bucket i counts the runs
+   that took at least 2^i and less than 2^(i+1) microseconds, except
+   that the first also counts shorter runs and the last longer
+   ones. */
+
+enum {BUCKET_COUNT = 32};
+
+/* The number of chains of the hash table of command names. */
+
+enum {CHAIN_COUNT = 127};
+
+/* The width, in characters, of the longest bar of a histogram. */
+
+enum {BAR_WIDTH = 40};
+
+/*--------------------------------------------------------------------*/
+
+/* A NameStats holds the runs of the commands of one name. */
+
+struct NameStats
+{
+   /* The name, owned by the NameStats. */
+   char *pcName;
+
+   /* The number of runs, their total and longest milliseconds, and
+      their histogram. */
+   unsigned long ulCount;
+   double dTotalMillis;
+   double dMaxMillis;
+   unsigned long aulBuckets[BUCKET_COUNT];
+
+   /* The next NameStats in the same chain, and the next in the order
+      in which the names were first added. */
+   struct NameStats *psNextInChain;
+   struct NameStats *psNextAdded;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A UsageStats is a hash table of NameStats, which are also linked
+   in the order in which they were added. */
+
+struct UsageStats
+{
+   struct NameStats *apsChains[CHAIN_COUNT];
+   struct NameStats *psFirst;
+   struct NameStats *psLast;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Return the milliseconds of the timeval *psTime. */
+
+static double Usage_millis(const struct timeval *psTime)
+{
+   return (double)psTime->tv_sec * 1e3 + (double)psTime->tv_usec / 1e3;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *psDiff the time *psAfter minus the time *psBefore. */
+
+static void Usage_subtract(struct timeval *psDiff,
+                           const struct timeval *psAfter,
+                           const struct timeval *psBefore)
+{
+   psDiff->tv_sec = psAfter->tv_sec - psBefore->tv_sec;
+   psDiff->tv_usec = psAfter->tv_usec - psBefore->tv_usec;
+   if (psDiff->tv_usec < 0)
+   {
+      psDiff->tv_sec--;
+      psDiff->tv_usec += 1000000;
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *psUsage what a builtin command that the shell has just
+   run cost: the milliseconds since *psStart, and the resources that
+   getrusage() reports the shell used since it reported *psBefore. */
+
+void Usage_sinceSelf(struct Usage *psUsage,
+                     const struct timespec *psStart,
+                     const struct rusage *psBefore)
+{
+   struct timespec sNow;
+   struct rusage sAfter;
+
+   assert(psUsage != NULL);
+   assert(psStart != NULL);
+   assert(psBefore != NULL);
+
+   if (clock_gettime(CLOCK_MONOTONIC, &sNow) == -1
+       || getrusage(RUSAGE_SELF, &sAfter) == -1)
+   {perror(getPgmName()); exit(EXIT_FAILURE); }
+
+   psUsage->dMillis =
+      (double)(sNow.tv_sec - psStart->tv_sec) * 1e3
+      + (double)(sNow.tv_nsec - psStart->tv_nsec) / 1e6;
+
+   /* The maximum resident set size of the shell is not a difference:
+      it is the shell's own, which is the most the builtin used */
+   memset(&psUsage->sRusage, 0, sizeof(struct rusage));
+   Usage_subtract(&psUsage->sRusage.ru_utime, &sAfter.ru_utime,
+                  &psBefore->ru_utime);
+   Usage_subtract(&psUsage->sRusage.ru_stime, &sAfter.ru_stime,
+                  &psBefore->ru_stime);
+   psUsage->sRusage.ru_maxrss = sAfter.ru_maxrss;
+   psUsage->sRusage.ru_nvcsw = sAfter.ru_nvcsw - psBefore->ru_nvcsw;
+   psUsage->sRusage.ru_nivcsw = sAfter.ru_nivcsw - psBefore->ru_nivcsw;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write *psUsage, the cost of the command named pcName, to psFile in
+   one line. */
+
+void Usage_write(const char *pcName, const struct Usage *psUsage,
+                 FILE *psFile)
+{
+   const struct rusage *psRusage;
+
+   assert(pcName != NULL);
+   assert(psUsage != NULL);
+   assert(psFile != NULL);
+
+   psRusage = &psUsage->sRusage;
+   fprintf(psFile,
+           "%s: %.3f ms real, %.3f ms user, %.3f ms sys, "
+           "%ld KB max RSS, %ld voluntary and %ld involuntary "
+           "context switches\n",
+           pcName, psUsage->dMillis, Usage_millis(&psRusage->ru_utime),
+           Usage_millis(&psRusage->ru_stime), psRusage->ru_maxrss,
+           psRusage->ru_nvcsw, psRusage->ru_nivcsw);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty UsageStats.  The caller owns it. */
+
+UsageStats_T UsageStats_new(void)
+{
+   UsageStats_T oStats;
+
+   oStats = (UsageStats_T)calloc(1, sizeof(struct UsageStats));
+   if (oStats == NULL) {perror(getPgmName()); exit(EXIT_FAILURE); }
+   return oStats;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Free oStats. */
+
+void UsageStats_free(UsageStats_T oStats)
+{
+   struct NameStats *psName;
+   struct NameStats *psNext;
+
+   if (oStats == NULL)
+      return;
+
+   for (psName = oStats->psFirst; psName != NULL; psName = psNext)
+   {
+      psNext = psName->psNextAdded;
+      free(psName->pcName);
+      free(psName);
+   }
+   free(oStats);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return a hash code for pcName that is between 0 and
+   CHAIN_COUNT-1, inclusive. */
+
+static size_t UsageStats_hash(const char *pcName)
+{
+   const size_t HASH_MULTIPLIER = 65599;
+   size_t u;
+   size_t uHash = 0;
+
+   for (u = 0; pcName[u] != '\0'; u++)
+      uHash = uHash * HASH_MULTIPLIER + (size_t)pcName[u];
+
+   return uHash % CHAIN_COUNT;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the bucket of a histogram that counts a run that took
+   dMillis milliseconds. */
+
+static int UsageStats_getBucket(double dMillis)
+{
+   double dMicros = dMillis * 1e3;
+   int iBucket = 0;
+
+   while (iBucket < BUCKET_COUNT - 1 && dMicros >= 2.0)
+   {
+      dMicros /= 2.0;
+      iBucket++;
+   }
+   return iBucket;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Add to oStats a run of the command named pcName that cost
+   *psUsage. */
+
+void UsageStats_add(UsageStats_T oStats, const char *pcName,
+                    const struct Usage *psUsage)
+{
+   struct NameStats *psName;
+   size_t uChain;
+   size_t uLength;
+
+   assert(oStats != NULL);
+   assert(pcName != NULL);
+   assert(psUsage != NULL);
+
+   uChain = UsageStats_hash(pcName);
+   for (psName = oStats->apsChains[uChain]; psName != NULL;
+        psName = psName->psNextInChain)
+      if (strcmp(psName->pcName, pcName) == 0)
+         break;
+
+   if (psName == NULL)
+   {
+      psName = (struct NameStats*)calloc(1, sizeof(struct NameStats));
+      uLength = strlen(pcName);
+      if (psName != NULL)
+         psName->pcName = (char*)malloc(uLength + 1);
+      if (psName == NULL || psName->pcName == NULL)
+      {perror(getPgmName()); exit(EXIT_FAILURE); }
+      memcpy(psName->pcName, pcName, uLength + 1);
+
+      psName->psNextInChain = oStats->apsChains[uChain];
+      oStats->apsChains[uChain] = psName;
+      if (oStats->psLast == NULL)
+         oStats->psFirst = psName;
+      else
+         oStats->psLast->psNextAdded = psName;
+      oStats->psLast = psName;
+   }
+
+   psName->ulCount++;
+   psName->dTotalMillis += psUsage->dMillis;
+   if (psUsage->dMillis > psName->dMaxMillis)
+      psName->dMaxMillis = psUsage->dMillis;
+   psName->aulBuckets[UsageStats_getBucket(psUsage->dMillis)]++;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Add to oStats each stage u of oPipeline that was started, as
+   aiPids[u] shows, and that cost asUsage[u].  If iTimed, also write
+   the cost of each such stage to stderr with Usage_write(). */
+
+void UsageStats_addPipeline(UsageStats_T oStats, Pipeline_T oPipeline,
+                            const pid_t aiPids[],
+                            const struct Usage asUsage[], int iTimed)
+{
+   const char *pcName;
+   size_t u;
+
+   assert(oStats != NULL);
+   assert(oPipeline != NULL);
+   assert(aiPids != NULL);
+   assert(asUsage != NULL);
+
+   for (u = 0; u < Pipeline_getLength(oPipeline); u++)
+   {
+      if (aiPids[u] == -1)
+         continue;
+      pcName = Command_getName(Pipeline_getCommand(oPipeline, u));
+      UsageStats_add(oStats, pcName, &asUsage[u]);
+      if (iTimed)
+         Usage_write(pcName, &asUsage[u], stderr);
+   }
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Write the histogram of each command name of oStats to psFile, in
+   the order in which the names were first added. */
+
+void UsageStats_write(UsageStats_T oStats, FILE *psFile)
+{
+   struct NameStats *psName;
+   unsigned long ulMost;
+   double dLow;
+   int iBucket;
+   int iBar;
+
+   assert(oStats != NULL);
+   assert(psFile != NULL);
+
+   for (psName = oStats->psFirst; psName != NULL;
+        psName = psName->psNextAdded)
+   {
+      fprintf(psFile, "%s: %lu run%s, %.3f ms mean, %.3f ms max\n",
+              psName->pcName, psName->ulCount,
+              (psName->ulCount == 1) ? "" : "s",
+              psName->dTotalMillis / (double)psName->ulCount,
+              psName->dMaxMillis);
+
+      ulMost = 0;
+      for (iBucket = 0; iBucket < BUCKET_COUNT; iBucket++)
+         if (psName->aulBuckets[iBucket] > ulMost)
+            ulMost = psName->aulBuckets[iBucket];
+
+      /* One line per bucket that is not empty, labeled with its
+         lower bound, with a bar as long as its share of the most */
+      for (iBucket = 0; iBucket < BUCKET_COUNT; iBucket++)
+      {
+         if (psName->aulBuckets[iBucket] == 0)
+            continue;
+         dLow = (iBucket == 0) ? 0.0 : (double)(1UL << iBucket) / 1e3;
+         fprintf(psFile, "  >= %12.3f ms %8lu ", dLow,
+                 psName->aulBuckets[iBucket]);
+         iBar = (int)((psName->aulBuckets[iBucket] * BAR_WIDTH
+                       + ulMost - 1) / ulMost);
+         for (; iBar > 0; iBar--)
+            putc('#', psFile);
+         putc('\n', psFile);
+      }
+   }
+}
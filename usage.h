@@ -0,0 +1,94 @@
+/*--------------------------------------------------------------------*/
+/* usage.h                                                            */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef USAGE_INCLUDED
+#define USAGE_INCLUDED
+
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include "pipeline.h"
+
+/*--------------------------------------------------------------------*/
+
+/* A Usage is what one command cost: the milliseconds from the start
+   of its pipeline until it was reaped, and the resources that
+   wait4() reported for it, of which the CPU times, the maximum
+   resident set size, and the context switches are used. */
+
+struct Usage
+{
+   double dMillis;
+   struct rusage sRusage;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Store in *psUsage what a builtin command that the shell has just
+   run cost: the milliseconds since *psStart, and the resources that
+   getrusage() reports the shell used since it reported *psBefore. */
+
+void Usage_sinceSelf(struct Usage *psUsage,
+                     const struct timespec *psStart,
+                     const struct rusage *psBefore);
+
+/*--------------------------------------------------------------------*/
+
+/* Write *psUsage, the cost of the command named pcName, to psFile in
+   one line. */
+
+void Usage_write(const char *pcName, const struct Usage *psUsage,
+                 FILE *psFile);
+
+/*--------------------------------------------------------------------*/
+
+/* A UsageStats_T object gathers, for each command name, how many
+   times commands of that name ran, and a histogram of how long they
+   took, in buckets whose bounds are powers of two microseconds. */
+
+typedef struct UsageStats *UsageStats_T;
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return an empty UsageStats.  The caller owns it. */
+
+UsageStats_T UsageStats_new(void);
+
+/*--------------------------------------------------------------------*/
+
+/* Free oStats. */
+
+void UsageStats_free(UsageStats_T oStats);
+
+/*--------------------------------------------------------------------*/
+
+/* Add to oStats a run of the command named pcName that cost
+   *psUsage. */
+
+void UsageStats_add(UsageStats_T oStats, const char *pcName,
+                    const struct Usage *psUsage);
+
+/*--------------------------------------------------------------------*/
+
+/* Add to oStats each stage u of oPipeline that was started, as
+   aiPids[u] shows, and that cost asUsage[u].  If iTimed, also write
+   the cost of each such stage to stderr with Usage_write(). */
+
+void UsageStats_addPipeline(UsageStats_T oStats, Pipeline_T oPipeline,
+                            const pid_t aiPids[],
+                            const struct Usage asUsage[], int iTimed);
+
+/*--------------------------------------------------------------------*/
+
+/* Write the histogram of each command name of oStats to psFile, in
+   the order in which the names were first added. */
+
+void UsageStats_write(UsageStats_T oStats, FILE *psFile);
+
+/*--------------------------------------------------------------------*/
+
+#endif
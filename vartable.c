@@ -0,0 +1,455 @@
+/*--------------------------------------------------------------------*/
+/* vartable.c                                                         */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#include "vartable.h"
+#include "ish.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+
+/*--------------------------------------------------------------------*/
+
+/* The bucket counts that the table grows through.  The table stops
+   growing once it has the last of them. */
+static const size_t auBucketCounts[] =
+   {61, 127, 251, 509, 1021, 2039, 4093, 8191, 16381, 32749, 65521};
+enum {BUCKET_COUNT_COUNT =
+   sizeof(auBucketCounts) / sizeof(auBucketCounts[0])};
+
+/* The initial physical length of the envp array. */
+enum {INITIAL_PHYS_ENVP = 64};
+
+/*--------------------------------------------------------------------*/
+
+/* A Var is one variable of a VarTable. */
+
+struct Var
+{
+   /* The variable as "name=value", and the length of its name, so
+      that the string can be an element of the envp array as is. */
+   char *pcText;
+   size_t uNameLength;
+
+   /* 1 iff the variable is exported. */
+   int iExported;
+
+   /* The next variable in the same bucket. */
+   struct Var *psNextInBucket;
+
+   /* The variables that were set before and after this one. */
+   struct Var *psPrevAdded;
+   struct Var *psNextAdded;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* A VarTable is a hash table of Var structures, chained in their
+   buckets, that also keeps its variables in the order in which they
+   were first set, and the envp array that was last built from
+   them. */
+
+struct VarTable
+{
+   /* The buckets, and the index in auBucketCounts of their count. */
+   struct Var **ppsBuckets;
+   size_t uBucketIndex;
+
+   /* The number of variables, and of exported variables. */
+   size_t uLength;
+   size_t uExported;
+
+   /* The first and last variables added. */
+   struct Var *psFirstAdded;
+   struct Var *psLastAdded;
+
+   /* The generation of the environment, which changes whenever an
+      exported variable does. */
+   unsigned long ulGeneration;
+
+   /* The envp array, its physical length, and the generation that it
+      was built for, or 0 if it has not been built. */
+   char **ppcEnvp;
+   size_t uPhysEnvp;
+   unsigned long ulEnvpGeneration;
+};
+
+/*--------------------------------------------------------------------*/
+
+/* Return a hash code for the uNameLength characters at pcName that is
+   between 0 and uBucketCount-1, inclusive. */
+
+static size_t VarTable_hash(const char *pcName, size_t uNameLength,
+                            size_t uBucketCount)
+{
+   const size_t HASH_MULTIPLIER = 65599;
+   size_t u;
+   size_t uHash = 0;
+
+   assert(pcName != NULL);
+
+   for (u = 0; u < uNameLength; u++)
+      uHash = uHash * HASH_MULTIPLIER + (size_t)pcName[u];
+
+   return uHash % uBucketCount;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return a new array of uBucketCount empty buckets. */
+
+static struct Var **VarTable_newBuckets(size_t uBucketCount)
+{
+   struct Var **ppsBuckets;
+
+   ppsBuckets = (struct Var**)calloc(uBucketCount, sizeof(struct Var*));
+   if (ppsBuckets == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+   return ppsBuckets;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Move the variables of oVars to the next larger array of
+   buckets. */
+
+static void VarTable_grow(VarTable_T oVars)
+{
+   struct Var **ppsBuckets;
+   struct Var *psVar;
+   size_t uBucketCount;
+   size_t uHash;
+
+   oVars->uBucketIndex++;
+   uBucketCount = auBucketCounts[oVars->uBucketIndex];
+   ppsBuckets = VarTable_newBuckets(uBucketCount);
+
+   for (psVar = oVars->psFirstAdded; psVar != NULL;
+        psVar = psVar->psNextAdded)
+   {
+      uHash = VarTable_hash(psVar->pcText, psVar->uNameLength,
+                            uBucketCount);
+      psVar->psNextInBucket = ppsBuckets[uHash];
+      ppsBuckets[uHash] = psVar;
+   }
+
+   free(oVars->ppsBuckets);
+   oVars->ppsBuckets = ppsBuckets;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the link that points to the variable of oVars whose name is
+   the uNameLength characters at pcName, or to NULL at the end of its
+   bucket if there is none. */
+
+static struct Var **VarTable_find(VarTable_T oVars, const char *pcName,
+                                  size_t uNameLength)
+{
+   struct Var **ppsLink;
+   size_t uHash;
+
+   uHash = VarTable_hash(pcName, uNameLength,
+                         auBucketCounts[oVars->uBucketIndex]);
+   for (ppsLink = &oVars->ppsBuckets[uHash]; *ppsLink != NULL;
+        ppsLink = &(*ppsLink)->psNextInBucket)
+      if ((*ppsLink)->uNameLength == uNameLength
+          && memcmp((*ppsLink)->pcText, pcName, uNameLength) == 0)
+         break;
+   return ppsLink;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return 1 iff pcName can be the name of a variable: it is not empty
+   and has no "=".  Otherwise set errno to EINVAL and return 0. */
+
+static int VarTable_isName(const char *pcName)
+{
+   if (*pcName == '\0' || strchr(pcName, '=') != NULL)
+   {
+      errno = EINVAL;
+      return 0;
+   }
+   return 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Set the variable of oVars whose name is the uNameLength characters
+   at pcName to pcValue, and export it iff iExported. */
+
+static void VarTable_setRange(VarTable_T oVars, const char *pcName,
+                              size_t uNameLength, const char *pcValue,
+                              int iExported)
+{
+   struct Var **ppsLink;
+   struct Var *psVar;
+   size_t uValueLength;
+   char *pcText;
+
+   uValueLength = strlen(pcValue);
+   pcText = (char*)malloc(uNameLength + uValueLength + 2);
+   if (pcText == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+   memcpy(pcText, pcName, uNameLength);
+   pcText[uNameLength] = '=';
+   memcpy(pcText + uNameLength + 1, pcValue, uValueLength + 1);
+
+   ppsLink = VarTable_find(oVars, pcName, uNameLength);
+   psVar = *ppsLink;
+   if (psVar != NULL)
+   {
+      /* A variable keeps its place in the environment */
+      if (psVar->iExported || iExported)
+         oVars->ulGeneration++;
+      if (psVar->iExported)
+         oVars->uExported--;
+      free(psVar->pcText);
+   }
+   else
+   {
+      psVar = (struct Var*)malloc(sizeof(struct Var));
+      if (psVar == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+      psVar->uNameLength = uNameLength;
+      psVar->psNextInBucket = NULL;
+      *ppsLink = psVar;
+
+      psVar->psPrevAdded = oVars->psLastAdded;
+      psVar->psNextAdded = NULL;
+      if (oVars->psLastAdded == NULL)
+         oVars->psFirstAdded = psVar;
+      else
+         oVars->psLastAdded->psNextAdded = psVar;
+      oVars->psLastAdded = psVar;
+
+      if (iExported)
+         oVars->ulGeneration++;
+      oVars->uLength++;
+   }
+
+   psVar->pcText = pcText;
+   psVar->iExported = iExported;
+   if (iExported)
+      oVars->uExported++;
+
+   if (oVars->uLength > auBucketCounts[oVars->uBucketIndex]
+       && oVars->uBucketIndex < BUCKET_COUNT_COUNT - 1)
+      VarTable_grow(oVars);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return a VarTable that holds, exported, the variables of
+   the NULL-terminated array of "name=value" strings ppcEnv, such as
+   environ.  A string without "=" is skipped, and of several with the
+   same name, the first is kept.  The caller owns the VarTable. */
+
+VarTable_T VarTable_new(char **ppcEnv)
+{
+   VarTable_T oVars;
+   const char *pcEquals;
+   size_t uNameLength;
+   char **ppc;
+
+   assert(ppcEnv != NULL);
+
+   oVars = (VarTable_T)malloc(sizeof(struct VarTable));
+   if (oVars == NULL) {perror(getPgmName()); exit(EXIT_FAILURE);}
+
+   oVars->uBucketIndex = 0;
+   oVars->ppsBuckets = VarTable_newBuckets(auBucketCounts[0]);
+   oVars->uLength = 0;
+   oVars->uExported = 0;
+   oVars->psFirstAdded = NULL;
+   oVars->psLastAdded = NULL;
+   oVars->ulGeneration = 1;
+   oVars->ppcEnvp = NULL;
+   oVars->uPhysEnvp = 0;
+   oVars->ulEnvpGeneration = 0;
+
+   for (ppc = ppcEnv; *ppc != NULL; ppc++)
+   {
+      pcEquals = strchr(*ppc, '=');
+      if (pcEquals == NULL || pcEquals == *ppc)
+         continue;
+      uNameLength = (size_t)(pcEquals - *ppc);
+      if (*VarTable_find(oVars, *ppc, uNameLength) == NULL)
+         VarTable_setRange(oVars, *ppc, uNameLength, pcEquals + 1, 1);
+   }
+   return oVars;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Free oVars and all of its variables. */
+
+void VarTable_free(VarTable_T oVars)
+{
+   struct Var *psVar;
+   struct Var *psNext;
+
+   if (oVars == NULL)
+      return;
+
+   for (psVar = oVars->psFirstAdded; psVar != NULL; psVar = psNext)
+   {
+      psNext = psVar->psNextAdded;
+      free(psVar->pcText);
+      free(psVar);
+   }
+   free(oVars->ppsBuckets);
+   free(oVars->ppcEnvp);
+   free(oVars);
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the value of variable pcName of oVars, or NULL if it is not
+   set.  The value is valid until the variable changes. */
+
+const char *VarTable_get(VarTable_T oVars, const char *pcName)
+{
+   assert(oVars != NULL);
+   assert(pcName != NULL);
+
+   return VarTable_getRange(oVars, pcName, strlen(pcName));
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the value of the variable of oVars whose name is the
+   uNameLength characters at pcName, which need not be
+   null-terminated, or NULL if it is not set.  The value is valid
+   until the variable changes. */
+
+const char *VarTable_getRange(VarTable_T oVars, const char *pcName,
+                              size_t uNameLength)
+{
+   struct Var *psVar;
+
+   assert(oVars != NULL);
+   assert(pcName != NULL);
+
+   psVar = *VarTable_find(oVars, pcName, uNameLength);
+   if (psVar == NULL)
+      return NULL;
+   return psVar->pcText + uNameLength + 1;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Set variable pcName of oVars to pcValue, and export it iff
+   iExported.  Return 0, or -1 with errno set to EINVAL if pcName is
+   empty or contains "=". */
+
+int VarTable_set(VarTable_T oVars, const char *pcName,
+                 const char *pcValue, int iExported)
+{
+   assert(oVars != NULL);
+   assert(pcName != NULL);
+   assert(pcValue != NULL);
+
+   if (! VarTable_isName(pcName))
+      return -1;
+   VarTable_setRange(oVars, pcName, strlen(pcName), pcValue,
+                     iExported != 0);
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Remove variable pcName from oVars, if it is set.  Return 0, or -1
+   with errno set to EINVAL if pcName is empty or contains "=". */
+
+int VarTable_unset(VarTable_T oVars, const char *pcName)
+{
+   struct Var **ppsLink;
+   struct Var *psVar;
+
+   assert(oVars != NULL);
+   assert(pcName != NULL);
+
+   if (! VarTable_isName(pcName))
+      return -1;
+
+   ppsLink = VarTable_find(oVars, pcName, strlen(pcName));
+   psVar = *ppsLink;
+   if (psVar == NULL)
+      return 0;
+
+   *ppsLink = psVar->psNextInBucket;
+   if (psVar->psPrevAdded == NULL)
+      oVars->psFirstAdded = psVar->psNextAdded;
+   else
+      psVar->psPrevAdded->psNextAdded = psVar->psNextAdded;
+   if (psVar->psNextAdded == NULL)
+      oVars->psLastAdded = psVar->psPrevAdded;
+   else
+      psVar->psNextAdded->psPrevAdded = psVar->psPrevAdded;
+
+   if (psVar->iExported)
+   {
+      oVars->uExported--;
+      oVars->ulGeneration++;
+   }
+   oVars->uLength--;
+   free(psVar->pcText);
+   free(psVar);
+   return 0;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the environment of the commands of oVars: a NULL-terminated
+   array of the "name=value" strings of its exported variables, in
+   the order in which they were first set.  oVars owns the array,
+   which is valid until an exported variable changes. */
+
+char **VarTable_getEnvp(VarTable_T oVars)
+{
+   struct Var *psVar;
+   size_t uPhysEnvp;
+   size_t u = 0;
+
+   assert(oVars != NULL);
+
+   /* Nothing exported has changed since the array was built */
+   if (oVars->ulEnvpGeneration == oVars->ulGeneration)
+      return oVars->ppcEnvp;
+
+   if (oVars->uExported + 1 > oVars->uPhysEnvp)
+   {
+      uPhysEnvp = (oVars->uPhysEnvp == 0)
+         ? INITIAL_PHYS_ENVP : oVars->uPhysEnvp;
+      while (oVars->uExported + 1 > uPhysEnvp)
+         uPhysEnvp *= 2;
+      free(oVars->ppcEnvp);
+      oVars->ppcEnvp = (char**)malloc(uPhysEnvp * sizeof(char*));
+      if (oVars->ppcEnvp == NULL)
+      {perror(getPgmName()); exit(EXIT_FAILURE);}
+      oVars->uPhysEnvp = uPhysEnvp;
+   }
+
+   for (psVar = oVars->psFirstAdded; psVar != NULL;
+        psVar = psVar->psNextAdded)
+      if (psVar->iExported)
+         oVars->ppcEnvp[u++] = psVar->pcText;
+   oVars->ppcEnvp[u] = NULL;
+
+   oVars->ulEnvpGeneration = oVars->ulGeneration;
+   return oVars->ppcEnvp;
+}
+
+/*--------------------------------------------------------------------*/
+
+/* Return the generation of the environment of oVars, a number that
+   is never 0 and that changes exactly when the array that
+   VarTable_getEnvp() returns would. */
+
+unsigned long VarTable_getGeneration(VarTable_T oVars)
+{
+   assert(oVars != NULL);
+   return oVars->ulGeneration;
+}
@@ -0,0 +1,91 @@
+/*--------------------------------------------------------------------*/
+/* vartable.h                                                         */
+/* Author: Greg Umali                                                 */
+/*--------------------------------------------------------------------*/
+
+#ifndef VARTABLE_INCLUDED
+#define VARTABLE_INCLUDED
+
+#include <stddef.h>
+
+/*--------------------------------------------------------------------*/
+
+/* A VarTable_T object holds the variables of the shell: a hash table
+   of names and values, each of which is either exported to the
+   commands that the shell runs or not.  The shell reads and changes
+   its variables only here, never through the C library's environ.
+   The environment of the commands, an envp array of "name=value"
+   strings, is built only when it is asked for after an exported
+   variable has changed, and the same array is handed out until the
+   next such change. */
+
+typedef struct VarTable *VarTable_T;
+
+/*--------------------------------------------------------------------*/
+
+/* Create and return a VarTable that holds, exported, the variables of
+   the NULL-terminated array of "name=value" strings ppcEnv, such as
+   environ.  A string without "=" is skipped, and of several with the
+   same name, the first is kept.  The caller owns the VarTable. */
+
+VarTable_T VarTable_new(char **ppcEnv);
+
+/*--------------------------------------------------------------------*/
+
+/* Free oVars and all of its variables. */
+
+void VarTable_free(VarTable_T oVars);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the value of variable pcName of oVars, or NULL if it is not
+   set.  The value is valid until the variable changes. */
+
+const char *VarTable_get(VarTable_T oVars, const char *pcName);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the value of the variable of oVars whose name is the
+   uNameLength characters at pcName, which need not be
+   null-terminated, or NULL if it is not set.  The value is valid
+   until the variable changes. */
+
+const char *VarTable_getRange(VarTable_T oVars, const char *pcName,
+                              size_t uNameLength);
+
+/*--------------------------------------------------------------------*/
+
+/* Set variable pcName of oVars to pcValue, and export it iff
+   iExported.  Return 0, or -1 with errno set to EINVAL if pcName is
+   empty or contains "=". */
+
+int VarTable_set(VarTable_T oVars, const char *pcName,
+                 const char *pcValue, int iExported);
+
+/*--------------------------------------------------------------------*/
+
+/* Remove variable pcName from oVars, if it is set.  Return 0, or -1
+   with errno set to EINVAL if pcName is empty or contains "=". */
+
+int VarTable_unset(VarTable_T oVars, const char *pcName);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the environment of the commands of oVars: a NULL-terminated
+   array of the "name=value" strings of its exported variables, in
+   the order in which they were first set.  oVars owns the array,
+   which is valid until an exported variable changes. */
+
+char **VarTable_getEnvp(VarTable_T oVars);
+
+/*--------------------------------------------------------------------*/
+
+/* Return the generation of the environment of oVars, a number that
+   is never 0 and that changes exactly when the array that
+   VarTable_getEnvp() returns would. */
+
+unsigned long VarTable_getGeneration(VarTable_T oVars);
+
+/*--------------------------------------------------------------------*/
+
+#endif